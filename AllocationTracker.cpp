@@ -0,0 +1,350 @@
+#include "AllocationTracker.h"
+
+#if MEMORY_DEBUGGING == 1
+
+#include <atomic>
+#include <new>
+#include <cstddef>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_timer.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG = "_2log::AllocationTracker";
+
+    const char*     SUBSYSTEM_NAMES[] =
+    {
+        "other",
+        "connection",
+        "device_node",
+        "device_properties",
+        "device_settings",
+        "base_device"
+    };
+
+    static_assert(sizeof(SUBSYSTEM_NAMES) / sizeof(SUBSYSTEM_NAMES[0]) == static_cast<size_t>(_2log::AllocationSubsystem::Count), "a name is required for every subsystem");
+
+    /**
+     * @brief The BlockHeader struct precedes every tracked allocation
+     */
+    struct BlockHeader
+    {
+        uint32_t    size;
+        uint32_t    time;           // allocation time in milliseconds since boot
+        uint8_t     subsystem;
+    };
+
+    // keeps the returned memory aligned like the one of malloc()
+    const size_t    HEADER_SIZE = ( sizeof(BlockHeader) + alignof(std::max_align_t) - 1 ) & ~( alignof(std::max_align_t) - 1 );
+
+    struct SubsystemCounter
+    {
+        std::atomic<uint32_t>   allocations;
+        std::atomic<uint32_t>   releases;
+        std::atomic<uint64_t>   allocatedBytes;
+        std::atomic<size_t>     liveBytes;
+        std::atomic<size_t>     peakBytes;
+        std::atomic<uint32_t>   lifetimes[_2log::AllocationTracker::LifetimeBucketCount];
+    };
+
+    SubsystemCounter            counters[static_cast<size_t>(_2log::AllocationSubsystem::Count)];
+    std::atomic<uint32_t>       sizeHistogram[_2log::AllocationTracker::SIZE_BUCKET_COUNT];
+    std::atomic<uint32_t>       violations = { 0 };
+
+    // only trivially initialized thread locals, they are used by operator new before anything else runs
+    thread_local _2log::AllocationSubsystem     currentSubsystem    = _2log::AllocationSubsystem::Other;
+    thread_local uint32_t                       taskAllocations     = 0;
+
+    uint32_t getMilliseconds()
+    {
+        return static_cast<uint32_t>( esp_timer_get_time() / 1000 );
+    }
+
+    _2log::AllocationTracker::LifetimeBucket getLifetimeBucket(uint32_t lifetime)
+    {
+        uint32_t limit = 1;
+
+        for ( int bucket = _2log::AllocationTracker::LifetimeBelow1ms; bucket < _2log::AllocationTracker::LifetimeLonger; bucket++ )
+        {
+            if ( lifetime < limit )
+            {
+                return static_cast<_2log::AllocationTracker::LifetimeBucket>(bucket);
+            }
+
+            limit *= 10;
+        }
+
+        return _2log::AllocationTracker::LifetimeLonger;
+    }
+
+    int getSizeBucket(size_t size)
+    {
+        int bucket = 0;
+
+        while ( bucket < _2log::AllocationTracker::SIZE_BUCKET_COUNT - 1 && size > ( static_cast<size_t>(16) << bucket ) )
+        {
+            bucket++;
+        }
+
+        return bucket;
+    }
+
+    void *allocateOrFail(size_t size)
+    {
+        void *pointer = _2log::AllocationTracker::allocate(size);
+
+        if ( pointer == nullptr )
+        {
+            #if __cpp_exceptions
+                throw std::bad_alloc();
+            #else
+                abort();
+            #endif
+        }
+
+        return pointer;
+    }
+}
+
+namespace _2log
+{
+    AllocationTracker::Tag::Tag(AllocationSubsystem subsystem)
+    {
+        _previous           = currentSubsystem;
+        currentSubsystem    = subsystem;
+    }
+
+    AllocationTracker::Tag::~Tag()
+    {
+        currentSubsystem = _previous;
+    }
+
+    AllocationTracker::NoAllocationGuard::NoAllocationGuard(const char *name) : _name(name)
+    {
+        _startAllocations = taskAllocations;
+    }
+
+    AllocationTracker::NoAllocationGuard::~NoAllocationGuard()
+    {
+        uint32_t allocations = taskAllocations - _startAllocations;
+
+        if ( allocations > 0 )
+        {
+            violations++;
+            ESP_LOGE(LOG_TAG, "%s made %u allocations", _name, allocations);
+        }
+    }
+
+    void *AllocationTracker::allocate(size_t size)
+    {
+        // no logging in here, it may allocate itself
+        uint8_t *block = static_cast<uint8_t*>( malloc(HEADER_SIZE + size) );
+
+        if ( block == nullptr )
+        {
+            return nullptr;
+        }
+
+        BlockHeader *header = reinterpret_cast<BlockHeader*>(block);
+        header->size        = static_cast<uint32_t>(size);
+        header->time        = getMilliseconds();
+        header->subsystem   = static_cast<uint8_t>(currentSubsystem);
+
+        SubsystemCounter &counter = counters[header->subsystem];
+
+        counter.allocations.fetch_add(1, std::memory_order_relaxed);
+        counter.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+        size_t liveBytes = counter.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+        size_t peakBytes = counter.peakBytes.load(std::memory_order_relaxed);
+
+        while ( liveBytes > peakBytes && ! counter.peakBytes.compare_exchange_weak(peakBytes, liveBytes, std::memory_order_relaxed) )
+        {
+
+        }
+
+        sizeHistogram[getSizeBucket(size)].fetch_add(1, std::memory_order_relaxed);
+        taskAllocations++;
+
+        return block + HEADER_SIZE;
+    }
+
+    char *AllocationTracker::duplicate(const char *string)
+    {
+        size_t length = strlen(string) + 1;
+        char *copy = static_cast<char*>( allocate(length) );
+
+        if ( copy != nullptr )
+        {
+            memcpy(copy, string, length);
+        }
+
+        return copy;
+    }
+
+    void AllocationTracker::release(void *pointer)
+    {
+        if ( pointer == nullptr )
+        {
+            return;
+        }
+
+        uint8_t     *block  = static_cast<uint8_t*>(pointer) - HEADER_SIZE;
+        BlockHeader *header = reinterpret_cast<BlockHeader*>(block);
+
+        // released blocks are attributed to the subsystem that allocated them
+        SubsystemCounter &counter = counters[header->subsystem];
+
+        counter.releases.fetch_add(1, std::memory_order_relaxed);
+        counter.liveBytes.fetch_sub(header->size, std::memory_order_relaxed);
+        counter.lifetimes[getLifetimeBucket( getMilliseconds() - header->time )].fetch_add(1, std::memory_order_relaxed);
+
+        free(block);
+    }
+
+    uint32_t AllocationTracker::getTaskAllocations()
+    {
+        return taskAllocations;
+    }
+
+    AllocationTracker::Statistics AllocationTracker::getStatistics(AllocationSubsystem subsystem)
+    {
+        SubsystemCounter &counter = counters[static_cast<size_t>(subsystem)];
+
+        Statistics statistics;
+        statistics.allocations      = counter.allocations.load(std::memory_order_relaxed);
+        statistics.releases         = counter.releases.load(std::memory_order_relaxed);
+        statistics.allocatedBytes   = counter.allocatedBytes.load(std::memory_order_relaxed);
+        statistics.liveBytes        = counter.liveBytes.load(std::memory_order_relaxed);
+        statistics.peakBytes        = counter.peakBytes.load(std::memory_order_relaxed);
+
+        for ( int bucket = 0; bucket < LifetimeBucketCount; bucket++ )
+        {
+            statistics.lifetimes[bucket] = counter.lifetimes[bucket].load(std::memory_order_relaxed);
+        }
+
+        return statistics;
+    }
+
+    const char *AllocationTracker::getSubsystemName(AllocationSubsystem subsystem)
+    {
+        return subsystem < AllocationSubsystem::Count ? SUBSYSTEM_NAMES[static_cast<size_t>(subsystem)] : "unknown";
+    }
+
+    void AllocationTracker::getSizeHistogram(uint32_t histogram[SIZE_BUCKET_COUNT])
+    {
+        for ( int bucket = 0; bucket < SIZE_BUCKET_COUNT; bucket++ )
+        {
+            histogram[bucket] = sizeHistogram[bucket].load(std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t AllocationTracker::getViolations()
+    {
+        return violations.load(std::memory_order_relaxed);
+    }
+
+    void AllocationTracker::reset()
+    {
+        for ( SubsystemCounter &counter : counters )
+        {
+            counter.allocations     = 0;
+            counter.releases        = 0;
+            counter.allocatedBytes  = 0;
+            counter.peakBytes       = counter.liveBytes.load();
+
+            for ( std::atomic<uint32_t> &lifetime : counter.lifetimes )
+            {
+                lifetime = 0;
+            }
+        }
+
+        for ( std::atomic<uint32_t> &bucket : sizeHistogram )
+        {
+            bucket = 0;
+        }
+
+        violations = 0;
+    }
+
+    void AllocationTracker::logReport()
+    {
+        ESP_LOGI(LOG_TAG, "%-18s %8s %8s %10s %8s %8s | lifetime <1ms <10ms <100ms <1s <10s <100s longer", "subsystem", "allocs", "frees",
+                 "bytes", "live", "peak");
+
+        for ( size_t index = 0; index < static_cast<size_t>(AllocationSubsystem::Count); index++ )
+        {
+            AllocationSubsystem subsystem   = static_cast<AllocationSubsystem>(index);
+            Statistics          statistics  = getStatistics(subsystem);
+
+            ESP_LOGI(LOG_TAG, "%-18s %8u %8u %10llu %8u %8u | %u %u %u %u %u %u %u", getSubsystemName(subsystem), statistics.allocations,
+                     statistics.releases, static_cast<unsigned long long>(statistics.allocatedBytes), static_cast<unsigned>(statistics.liveBytes),
+                     static_cast<unsigned>(statistics.peakBytes), statistics.lifetimes[LifetimeBelow1ms], statistics.lifetimes[LifetimeBelow10ms],
+                     statistics.lifetimes[LifetimeBelow100ms], statistics.lifetimes[LifetimeBelow1s], statistics.lifetimes[LifetimeBelow10s],
+                     statistics.lifetimes[LifetimeBelow100s], statistics.lifetimes[LifetimeLonger]);
+        }
+
+        ESP_LOGI(LOG_TAG, "no allocation violations: %u", getViolations() );
+    }
+}
+
+/*
+ * All C++ allocations of the firmware go through the tracker, so std::string, std::map and new[] buffers
+ * are attributed as well.
+ */
+
+void *operator new(size_t size)
+{
+    return allocateOrFail(size);
+}
+
+void *operator new[](size_t size)
+{
+    return allocateOrFail(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return _2log::AllocationTracker::allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return _2log::AllocationTracker::allocate(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    _2log::AllocationTracker::release(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    _2log::AllocationTracker::release(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    _2log::AllocationTracker::release(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+    _2log::AllocationTracker::release(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t&) noexcept
+{
+    _2log::AllocationTracker::release(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t&) noexcept
+{
+    _2log::AllocationTracker::release(pointer);
+}
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef ALLOCATIONTRACKER_H
+#define ALLOCATIONTRACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BuildConfig.h"
+
+#ifndef MEMORY_DEBUGGING
+    #define MEMORY_DEBUGGING    0
+#endif
+
+#if MEMORY_DEBUGGING == 1
+    #define ALLOCATION_SUBSYSTEM(subsystem)     _2log::AllocationTracker::Tag allocationTag(subsystem)
+    #define EXPECT_NO_ALLOCATIONS(name)         _2log::AllocationTracker::NoAllocationGuard noAllocationGuard(name)
+#else
+    #define ALLOCATION_SUBSYSTEM(subsystem)
+    #define EXPECT_NO_ALLOCATIONS(name)
+#endif
+
+namespace _2log
+{
+    /**
+     * @brief The AllocationSubsystem enum enumerates the owners allocations are attributed to
+     */
+    enum class AllocationSubsystem : uint8_t
+    {
+        Other = 0,          ///< allocations outside of a tagged scope, e.g. IDFix, WiFi or the main project
+        Connection,
+        DeviceNode,
+        DeviceProperties,
+        DeviceSettings,
+        BaseDevice,
+        Count
+    };
+
+    /**
+     * @brief The AllocationTracker class attributes heap allocations to the subsystems of the component.
+     *
+     * With MEMORY_DEBUGGING == 1 in the BuildConfig the global operator new / delete are replaced, and the cJSON
+     * hooks, the node events and the outbound frames allocate through allocate() / duplicate() / release(). Each
+     * tracked block carries a small header with its size, subsystem and allocation time, so the count, the live and
+     * peak bytes and the lifetime histogram of every subsystem are known at any time. The subsystem is the innermost
+     * ALLOCATION_SUBSYSTEM() scope of the allocating task.
+     *
+     * Without MEMORY_DEBUGGING allocate(), duplicate() and release() are plain malloc(), strdup() and free(), the
+     * macros expand to nothing and the statistics are not available.
+     */
+    class AllocationTracker
+    {
+        public:
+
+            /**
+             * @brief The lifetime buckets of the histogram, each one ten times the previous one
+             */
+            enum LifetimeBucket
+            {
+                LifetimeBelow1ms = 0,
+                LifetimeBelow10ms,
+                LifetimeBelow100ms,
+                LifetimeBelow1s,
+                LifetimeBelow10s,
+                LifetimeBelow100s,
+                LifetimeLonger,
+                LifetimeBucketCount
+            };
+
+            /**
+             * @brief Number of buckets of the size histogram, bucket i counts the sizes up to 16 << i bytes and the
+             * last one all larger allocations
+             */
+            static const int    SIZE_BUCKET_COUNT = 10;
+
+            /**
+             * @brief The Statistics struct summarizes the allocations of a subsystem since boot or the last reset
+             */
+            struct Statistics
+            {
+                uint32_t    allocations;                        ///< number of allocations
+                uint32_t    releases;                           ///< number of releases
+                uint64_t    allocatedBytes;                     ///< sum of all allocation sizes
+                size_t      liveBytes;                          ///< bytes currently allocated
+                size_t      peakBytes;                          ///< maximum of liveBytes
+                uint32_t    lifetimes[LifetimeBucketCount];     ///< released allocations per lifetime bucket
+            };
+
+            /**
+             * @brief The Tag class attributes the allocations of the current task to a subsystem while it exists
+             */
+            class Tag
+            {
+                public:
+
+                                        Tag(AllocationSubsystem subsystem);
+                                        ~Tag(void);
+
+                                        Tag(Tag const&)                 = delete;
+                    void                operator=(Tag const&)           = delete;
+
+                private:
+
+                    AllocationSubsystem _previous;
+            };
+
+            /**
+             * @brief The NoAllocationGuard class reports allocations of the current task during its lifetime.
+             *
+             * Meant for steady state paths that must not touch the heap, e.g. a property update of a known property
+             * or the ping handling. Violations are logged and counted, see getViolations().
+             */
+            class NoAllocationGuard
+            {
+                public:
+
+                                        NoAllocationGuard(const char *name);
+                                        ~NoAllocationGuard(void);
+
+                                        NoAllocationGuard(NoAllocationGuard const&)     = delete;
+                    void                operator=(NoAllocationGuard const&)             = delete;
+
+                private:
+
+                    const char*         _name;
+                    uint32_t            _startAllocations;
+            };
+
+            /**
+             * @brief Allocate tracked memory, attributed to the current subsystem
+             * @return  the memory or \c nullptr, to be released with release()
+             */
+            static void*        allocate(size_t size);
+
+            /**
+             * @brief Duplicate a string into tracked memory
+             * @return  the copy or \c nullptr, to be released with release()
+             */
+            static char*        duplicate(const char *string);
+
+            /**
+             * @brief Release memory of allocate() or duplicate(), \c nullptr is ignored
+             */
+            static void         release(void *pointer);
+
+            /**
+             * @brief Get the number of allocations made by the calling task since it started
+             */
+            static uint32_t     getTaskAllocations(void);
+
+            static Statistics   getStatistics(AllocationSubsystem subsystem);
+            static const char*  getSubsystemName(AllocationSubsystem subsystem);
+
+            /**
+             * @brief Get the size histogram of all tracked allocations since boot or the last reset
+             * @param histogram receives SIZE_BUCKET_COUNT counts
+             */
+            static void         getSizeHistogram(uint32_t histogram[SIZE_BUCKET_COUNT]);
+
+            /**
+             * @brief Get the number of NoAllocationGuard scopes that saw allocations
+             */
+            static uint32_t     getViolations(void);
+
+            /**
+             * @brief Reset the counters, peaks and histograms, live bytes are kept
+             */
+            static void         reset(void);
+
+            /**
+             * @brief Log the statistics of all subsystems
+             */
+            static void         logReport(void);
+    };
+
+#if MEMORY_DEBUGGING != 1
+    inline void *AllocationTracker::allocate(size_t size)
+    {
+        return malloc(size);
+    }
+
+    inline char *AllocationTracker::duplicate(const char *string)
+    {
+        return strdup(string);
+    }
+
+    inline void AllocationTracker::release(void *pointer)
+    {
+        free(pointer);
+    }
+#endif
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include "ECDSASignatureVerifier.h"
 #include "HTTPFirmwareDownloader.h"
 #include "DeviceProperties.h"
+#include "AllocationTracker.h"
 #include <esp_wifi.h>
 #include "MutexLocker.h"
 
@@ -141,6 +142,14 @@ namespace
     #warning "Memory debugging enabled!"
 #endif
 
+#if PERFORMANCE_COUNTERS == 1
+    #warning "Performance counters enabled!"
+#endif
+
+#if HEAP_MONITORING == 1
+    #warning "Heap monitoring enabled!"
+#endif
+
 
 namespace _2log
 {
@@ -150,11 +159,17 @@ namespace _2log
             _systemMonitor.start();
         #endif
 
+        #if HEAP_MONITORING == 1
+            _heapMonitor.start(HEAP_MONITOR_INTERVAL);
+        #endif
+
         esp_log_level_set("*", DEVICE_LOG_LEVEL );
     }
 
     void BaseDevice::startDevice()
     {
+        ALLOCATION_SUBSYSTEM(AllocationSubsystem::BaseDevice);
+
         esp_err_t result = nvs_flash_init();
 
         #ifdef CONFIG_IDF_TARGET_ESP32
@@ -228,6 +243,8 @@ namespace _2log
 
     void BaseDevice::run()
     {
+        ALLOCATION_SUBSYSTEM(AllocationSubsystem::BaseDevice);
+
         performUpdate();
     }
 
@@ -339,9 +356,8 @@ namespace _2log
         _deviceMutex.unlock();
 
         ESP_LOGW(LOG_TAG, "WiFi disconnected! (running in task %s)", Task::getRunningTaskName().c_str() );
-        bool success;
 
-        if( DeviceProperties::instance().getProperty(".configReset", false).asBool(&success) && success)
+        if( DeviceProperties::instance().getProperty<bool>(".configReset", false) )
         {
             // this was the first start after a configuration and wifi connection was not successful
             // we asume the configuration was incorrect, clear the configuration and restart in configuration mode again
@@ -460,6 +476,8 @@ namespace _2log
     {
         ESP_LOGI(LOG_TAG, "Device configured and starts running");
 
+        ALLOCATION_SUBSYSTEM(AllocationSubsystem::BaseDevice);
+
         std::string connectionURL;
 
         #if OVERRIDE_CONFIG == 1
@@ -473,6 +491,14 @@ namespace _2log
         _deviceNode->registerInitPropertiesCallback(std::bind(&BaseDevice::initProperties, this, std::placeholders::_1) );
         _deviceNode->registerRPC(".fwupdate",       std::bind(&BaseDevice::updateFirmwareRPC, this, std::placeholders::_1) );
 
+        #if MEMORY_DEBUGGING == 1
+            _deviceNode->registerRPC(".memreport",  std::bind(&BaseDevice::memoryReportRPC, this, std::placeholders::_1) );
+        #endif
+
+        #if HEAP_MONITORING == 1
+            _deviceNode->registerRPC(".heapreport", std::bind(&BaseDevice::heapReportRPC, this, std::placeholders::_1) );
+        #endif
+
         connectWiFi();
 
         #if DUMP_TASK_STATS == 1
@@ -515,6 +541,20 @@ namespace _2log
         }
     }
 
+#if MEMORY_DEBUGGING == 1
+    void BaseDevice::memoryReportRPC(cJSON *argument)
+    {
+        AllocationTracker::logReport();
+    }
+#endif
+
+#if HEAP_MONITORING == 1
+    void BaseDevice::heapReportRPC(cJSON *argument)
+    {
+        _heapMonitor.logReport();
+    }
+#endif
+
     void BaseDevice::performUpdate()
     {
         ESP_LOGI(LOG_TAG, "Performing firmware update from URL %s", _updateURL.c_str() );
@@ -16,6 +16,10 @@
     #include "SystemMonitor.h"
 #endif
 
+#if HEAP_MONITORING == 1
+    #include "HeapMonitor.h"
+#endif
+
 namespace _2log
 {
     /**
@@ -157,6 +161,14 @@ namespace _2log
             void                updateFirmwareRPC(cJSON* argument);
             void                performUpdate(void);
 
+            #if MEMORY_DEBUGGING == 1
+                void            memoryReportRPC(cJSON* argument);
+            #endif
+
+            #if HEAP_MONITORING == 1
+                void            heapReportRPC(cJSON* argument);
+            #endif
+
             // new event and state handlers for subclassed device implementations
             virtual void        baseDeviceEventHandler(BaseDeviceEvent event);
             virtual void        baseDeviceStateChanged(BaseDeviceState state);
@@ -181,6 +193,10 @@ namespace _2log
             #if SYSTEM_MONITORING == 1
                 IDFix::SystemMonitor        _systemMonitor;
             #endif
+
+            #if HEAP_MONITORING == 1
+                HeapMonitor                 _heapMonitor;
+            #endif
     };
 }
 
@@ -1,6 +1,9 @@
 #include "Connection.h"
+#include "MessageArena.h"
+#include "PerfCounters.h"
+#include "AllocationTracker.h"
 #include "auxiliary.h"
-#include "IDFixTask.h"
+#include <string.h>
 
 extern "C"
 {
@@ -19,6 +22,21 @@ namespace _2log
 
 	Connection::Connection(const std::string &url, const char *caCertificate) : _serverURL(url), _connectionID(0), _connected(false), _webSocket(this), _eventHandler(nullptr)
 	{
+        MessageArena::install();
+
+        for ( size_t lane = 0; lane < LANE_COUNT; lane++ )
+        {
+            _laneBacklogs[lane].store(0);
+        }
+
+        _senderSignal   = xSemaphoreCreateBinary();
+        _senderTask     = new WorkerTask("ws_sender", _senderSignal, [this]() { senderStep(); });
+
+        if ( ! _senderTask->start() )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to start sender task");
+        }
+
         _webSocket.start();
         _webSocket.setURL(url);
 
@@ -28,6 +46,39 @@ namespace _2log
         }
 	}
 
+	Connection::~Connection()
+	{
+        // frames queued from here on would never be written
+        _closing = true;
+
+        if ( _pingTimeoutTimer != nullptr )
+        {
+            xTimerDelete(_pingTimeoutTimer, portMAX_DELAY);
+        }
+
+        // stops the sender task, it finishes the frames it is writing
+        delete _senderTask;
+
+        OutboundFrame *frame;
+
+        while ( ( frame = nextFrame() ) != nullptr )
+        {
+            _laneBacklogs[static_cast<size_t>(frame->priority)] -= frame->length;
+
+            if ( frame->completion )
+            {
+                frame->completion(SendStatus::Dropped);
+            }
+
+            OutboundFrame::destroy(frame);
+        }
+
+        if ( _senderSignal != nullptr )
+        {
+            vSemaphoreDelete(_senderSignal);
+        }
+	}
+
 	bool Connection::connect(uint32_t delayTime)
 	{
 		if ( ! _webSocket.connect(delayTime) )
@@ -45,43 +96,102 @@ namespace _2log
 	}
 
 	bool Connection::sendPayload(const cJSON *payload)
+	{
+		return sendPayloadAsync(payload) == SendStatus::Queued;
+	}
+
+	SendStatus Connection::sendPayloadAsync(const cJSON *payload, sendCompletionFunction completion, SendPriority priority)
 	{
 		if ( ! _connected )
 		{
             ESP_LOGE(LOG_TAG, "Connection::sendPayload: not connected");
-			return false;
+			return SendStatus::Dropped;
 		}
 
 		if ( payload == nullptr || cJSON_IsInvalid(payload) )
 		{
             ESP_LOGE(LOG_TAG, "Connection::sendPayload: payload invalid");
-            return false;
+            return SendStatus::Dropped;
+		}
+
+		size_t lane = static_cast<size_t>(priority);
+
+		// reject a full lane before serializing, so a congested link costs the producer as little as possible;
+		// sendJSON() reserves the bytes of the frame
+		if ( _laneBacklogs[lane].load() >= _laneLimits[lane] )
+		{
+            ESP_LOGW(LOG_TAG, "Connection::sendPayload: lane %u full (%u bytes)", static_cast<unsigned>(lane), static_cast<unsigned>(_laneBacklogs[lane].load()) );
+			return SendStatus::RejectedFull;
 		}
 
+		MessageArena::Scope arenaScope;
+
 		cJSON *envelope = cJSON_CreateObject();
 
 		if (cJSON_AddStringToObject(envelope, "command", "send") == nullptr)
 		{
             ESP_LOGE(LOG_TAG, "cJSON_AddStringToObject failed");
 			cJSON_Delete(envelope);
-			return false;
+			return SendStatus::Dropped;
 		}
 
 		if (cJSON_AddNumberToObject(envelope, "uuid", _connectionID) == nullptr)
 		{
             ESP_LOGE(LOG_TAG, "cJSON_AddNumberToObject failed");
 			cJSON_Delete(envelope);
-			return false;
+			return SendStatus::Dropped;
 		}
 
 		// add payload as reference(!) so it won't be deleted by cJSON_Delete
 		// payload is owned by caller and should be deleted there
 		cJSON_AddItemReferenceToObject(envelope, "payload", const_cast<cJSON*>(payload) );
 
-		sendJSON(envelope);
+		SendStatus status = sendJSON(envelope, priority, completion);
 		cJSON_Delete(envelope);
 
-		return true;
+		return status;
+	}
+
+	size_t Connection::getBacklogSize() const
+	{
+		size_t backlogSize = 0;
+
+		for ( size_t lane = 0; lane < LANE_COUNT; lane++ )
+		{
+			backlogSize += _laneBacklogs[lane].load();
+		}
+
+		return backlogSize;
+	}
+
+	size_t Connection::getBacklogSize(SendPriority priority) const
+	{
+		return _laneBacklogs[static_cast<size_t>(priority)].load();
+	}
+
+	void Connection::setSchedulingMode(SchedulingMode mode)
+	{
+		_schedulingMode = mode;
+	}
+
+	void Connection::setLaneWeight(SendPriority priority, uint8_t weight)
+	{
+		_laneWeights[static_cast<size_t>(priority)] = weight > 0 ? weight : 1;
+	}
+
+	void Connection::setLaneLimit(SendPriority priority, size_t limit)
+	{
+		_laneLimits[static_cast<size_t>(priority)] = limit;
+	}
+
+	bool Connection::startCapture(const char *fileName, size_t maxSize)
+	{
+		return _trafficRecorder.start(fileName, maxSize);
+	}
+
+	void Connection::stopCapture()
+	{
+		_trafficRecorder.stop();
 	}
 
 	bool Connection::setConnectionEventHandler(ConnectionEventHandler *newEventHandler)
@@ -90,39 +200,164 @@ namespace _2log
 		return true;
 	}
 
-	bool Connection::sendJSON(const cJSON *json)
+	SendStatus Connection::sendJSON(const cJSON *json, SendPriority priority, sendCompletionFunction completion)
 	{
-		if ( json == nullptr || cJSON_IsInvalid(json) )
+		PERF_SCOPE(PerfProbe::ConnectionSend);
+		ALLOCATION_SUBSYSTEM(AllocationSubsystem::Connection);
+
+		if ( json == nullptr || cJSON_IsInvalid(json) || _closing )
 		{
-			return false;
+			return SendStatus::Dropped;
 		}
 
 		char* jsonString = cJSON_Print(json);
 
 		if ( jsonString == nullptr)
 		{
-			return false;
+			return SendStatus::Dropped;
 		}
 
-		if ( strlen(jsonString) == 0 )
+		size_t length = strlen(jsonString);
+
+		if ( length == 0 )
 		{
-			free(jsonString);
-			return false;
+			cJSON_free(jsonString);
+			return SendStatus::Dropped;
 		}
 
+		size_t lane = static_cast<size_t>(priority);
 
-        int bytesSend = _webSocket.sendBinaryMessage(jsonString, strlen(jsonString) );
+		if ( ! reserveBacklog(lane, length) )
+		{
+			cJSON_free(jsonString);
+
+            ESP_LOGW(LOG_TAG, "Connection::sendJSON: lane %u full (%u bytes)", static_cast<unsigned>(lane), static_cast<unsigned>(_laneBacklogs[lane].load()) );
+			return SendStatus::RejectedFull;
+		}
 
-		free(jsonString);
+		// the frame outlives a possible arena scope, so it is copied to its own heap block
+		OutboundFrame *frame = OutboundFrame::create(jsonString, length, _connectionGeneration.load() );
 
-		if ( bytesSend == 0 )
+		cJSON_free(jsonString);
+
+		if ( frame == nullptr )
 		{
-			return false;
+			_laneBacklogs[lane] -= length;
+
+            ESP_LOGE(LOG_TAG, "Failed to allocate outbound frame");
+			return SendStatus::Dropped;
 		}
 
+		frame->priority		= priority;
+		frame->completion	= std::move(completion);
+
+		_lanes[lane].push(frame);
+
+		// a binary semaphore: multiple gives before the sender wakes up result in a single drain of the queue
+		xSemaphoreGive(_senderSignal);
+
+        return SendStatus::Queued;
+    }
+
+    bool Connection::reserveBacklog(size_t lane, size_t length)
+    {
+        // concurrent producers each see the backlog including all earlier reservations, so the lane can not
+        // go above its limit; an empty lane takes any frame
+        size_t backlog = _laneBacklogs[lane].fetch_add(length);
+
+        if ( backlog > 0 && backlog + length > _laneLimits[lane] )
+        {
+            _laneBacklogs[lane] -= length;
+            return false;
+        }
+
         return true;
     }
 
+    void Connection::senderStep()
+    {
+        if ( xSemaphoreTake(_senderSignal, portMAX_DELAY) == pdTRUE )
+        {
+            writeQueuedFrames();
+        }
+    }
+
+    void Connection::writeQueuedFrames()
+    {
+        ALLOCATION_SUBSYSTEM(AllocationSubsystem::Connection);
+
+        OutboundFrame *frame;
+
+        while ( ( frame = nextFrame() ) != nullptr )
+        {
+            SendStatus status = SendStatus::Dropped;
+
+            if ( frame->generation == _connectionGeneration.load() )
+            {
+                if ( _webSocket.sendBinaryMessage(frame->data, frame->length) == 0 )
+                {
+                    ESP_LOGE(LOG_TAG, "Failed to write frame (%u bytes)", static_cast<unsigned>(frame->length) );
+                }
+                else
+                {
+                    status = SendStatus::Sent;
+                    _trafficRecorder.record(TrafficRecordType::Outbound, frame->data, frame->length);
+                }
+            }
+            else
+            {
+                ESP_LOGD(LOG_TAG, "Dropping frame of a previous connection");
+            }
+
+            _laneBacklogs[static_cast<size_t>(frame->priority)] -= frame->length;
+
+            if ( frame->completion )
+            {
+                frame->completion(status);
+            }
+
+            OutboundFrame::destroy(frame);
+        }
+    }
+
+    OutboundFrame *Connection::nextFrame()
+    {
+        if ( _schedulingMode == SchedulingMode::Strict )
+        {
+            for ( size_t lane = 0; lane < LANE_COUNT; lane++ )
+            {
+                OutboundFrame *frame = _lanes[lane].pop();
+
+                if ( frame != nullptr )
+                {
+                    return frame;
+                }
+            }
+
+            return nullptr;
+        }
+
+        // weighted round robin: visit every lane once with fresh credits before giving up
+        for ( size_t attempt = 0; attempt <= LANE_COUNT; attempt++ )
+        {
+            if ( _laneCredits[_currentLane] > 0 )
+            {
+                OutboundFrame *frame = _lanes[_currentLane].pop();
+
+                if ( frame != nullptr )
+                {
+                    _laneCredits[_currentLane]--;
+                    return frame;
+                }
+            }
+
+            _currentLane = (_currentLane + 1) % LANE_COUNT;
+            _laneCredits[_currentLane] = _laneWeights[_currentLane];
+        }
+
+        return nullptr;
+    }
+
     void Connection::checkPingTimeoutWrapper(TimerHandle_t xTimer)
     {
         Connection *objectInstance = static_cast<Connection*>( pvTimerGetTimerID(xTimer) );
@@ -143,6 +378,8 @@ namespace _2log
 
 	void Connection::webSocketConnected()
 	{
+        ALLOCATION_SUBSYSTEM(AllocationSubsystem::Connection);
+
         ESP_LOGD(LOG_TAG, "webSocketConnected() running in %s", IDFix::Task::getRunningTaskName().c_str() );
 
         if ( _pingTimeoutTimer == nullptr )
@@ -161,13 +398,26 @@ namespace _2log
 
          _lastPingTimestamp = getTickMs();   // Reset ping timeout
 
+        _trafficRecorder.record(TrafficRecordType::Connected);
+
+        // frames queued for a previous connection must not be written to the new one
+        _connectionGeneration++;
+
         registerHandle();
 	}
 
 	void Connection::webSocketDisconnected()
 	{
+        ALLOCATION_SUBSYSTEM(AllocationSubsystem::Connection);
+
         ESP_LOGW(LOG_TAG, "webSocketDisconnected()");
 
+        _trafficRecorder.record(TrafficRecordType::Disconnected);
+
+        // invalidate all queued frames and let the sender task drop them
+        _connectionGeneration++;
+        xSemaphoreGive(_senderSignal);
+
         if ( _pingTimeoutTimer != nullptr )
         {
             if ( xTimerStop(_pingTimeoutTimer, 0) != pdPASS )
@@ -184,15 +434,34 @@ namespace _2log
 
     void Connection::webSocketBinaryMessageReceived(const char *data, int length)
 	{
-        std::string message = std::string(data, static_cast<unsigned long>(length) );
+        PERF_SCOPE(PerfProbe::ConnectionReceive);
+        ALLOCATION_SUBSYSTEM(AllocationSubsystem::Connection);
+
+        _trafficRecorder.record(TrafficRecordType::Inbound, data, static_cast<size_t>(length) );
+
+        ESP_LOGV(LOG_TAG, " Running in Task: %s - Connection::webSocketBinaryMessageReceived(%.*s)", pcTaskGetTaskName(NULL), length, data);
+
+        MessageArena::Scope arenaScope;
+
+        // the data is not null-terminated, the terminated copy lives in the arena like the parsed message
+        char *message = static_cast<char*>( cJSON_malloc(static_cast<size_t>(length) + 1) );
+
+        if ( message == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to copy received message (%d bytes)", length);
+            return;
+        }
 
-        ESP_LOGV(LOG_TAG, " Running in Task: %s - Connection::webSocketBinaryMessageReceived(%s)", pcTaskGetTaskName(NULL), message.c_str() );
+        memcpy(message, data, static_cast<size_t>(length) );
+        message[length] = '\0';
 
-        cJSON *jsonMessage = cJSON_Parse( message.c_str() );
+        cJSON *jsonMessage = cJSON_Parse(message);
 
 		if ( jsonMessage == nullptr || ! cJSON_IsObject(jsonMessage) )
 		{
             ESP_LOGE(LOG_TAG, "Invalid json message received");
+			cJSON_Delete(jsonMessage);
+			cJSON_free(message);
 			return;
 		}
 
@@ -201,6 +470,7 @@ namespace _2log
 
 		// ... so we have to do cleanup only once
 		cJSON_Delete(jsonMessage);
+		cJSON_free(message);
 	}
 
 	bool Connection::registerHandle()
@@ -223,7 +493,7 @@ namespace _2log
 			return false;
 		}
 
-		bool sendOK = sendJSON(registerCommand);
+		bool sendOK = sendJSON(registerCommand) == SendStatus::Queued;
 		cJSON_Delete(registerCommand);
 
 		return sendOK;
@@ -239,9 +509,9 @@ namespace _2log
 			return;
 		}
 
-		std::string command = commandObject->valuestring;
+		const char *command = commandObject->valuestring;
 
-		if ( command == "ping" )
+		if ( strcmp(command, "ping") == 0 )
 		{
             _lastPingTimestamp = getTickMs();
 
@@ -260,7 +530,7 @@ namespace _2log
 			return;
 		}
 
-		if ( command == "pong" || command == "ACK" )
+		if ( strcmp(command, "pong") == 0 || strcmp(command, "ACK") == 0 )
 		{
             ESP_LOGD(LOG_TAG, "pong/ACK received");
             _lastPingTimestamp = getTickMs();
@@ -270,31 +540,33 @@ namespace _2log
 
 		// TODO: check uuid ( if(__map.count(uuid) > 0) )
 
-		if ( command == "connection:registered" )
+		if ( strcmp(command, "connection:registered") == 0 )
 		{
 			_connected = true;
 
 			if ( _eventHandler )
 			{
+				MessageArena::Suspend arenaSuspend;
 				_eventHandler->connected();
 			}
 
 			return;
 		}
 
-		if ( command == "connection:closed" )
+		if ( strcmp(command, "connection:closed") == 0 )
 		{
 			_connected = false;
 
 			if ( _eventHandler )
 			{
+				MessageArena::Suspend arenaSuspend;
 				_eventHandler->disconnected();
 			}
 
 			return;
 		}
 
-		if ( command == "send" )
+		if ( strcmp(command, "send") == 0 )
 		{
 			cJSON *jsonPayload = cJSON_GetObjectItemCaseSensitive(jsonMessage, "payload");
 
@@ -306,6 +578,8 @@ namespace _2log
 
 			if ( _eventHandler )
 			{
+				// the payload stays in the arena, everything the handler allocates may outlive the message
+				MessageArena::Suspend arenaSuspend;
 				_eventHandler->jsonReceived(jsonPayload);
 			}
 
@@ -4,16 +4,37 @@
 #include "WebSocketEventHandler.h"
 #include "WebSocket.h"
 #include "ConnectionEventHandler.h"
+#include "OutboundQueue.h"
+#include "TrafficRecorder.h"
+#include "WorkerTask.h"
 
 #include "IConnection.h"
 #include <cJSON.h>
 #include <string>
+#include <atomic>
 
 extern "C"
 {
     #include <freertos/timers.h>
+    #include <freertos/semphr.h>
 }
 
+#ifndef CONNECTION_CONTROL_BACKLOG_LIMIT
+    #define CONNECTION_CONTROL_BACKLOG_LIMIT    2048
+#endif
+
+#ifndef CONNECTION_RPC_BACKLOG_LIMIT
+    #define CONNECTION_RPC_BACKLOG_LIMIT        2048
+#endif
+
+#ifndef CONNECTION_STATE_BACKLOG_LIMIT
+    #define CONNECTION_STATE_BACKLOG_LIMIT      4096
+#endif
+
+#ifndef CONNECTION_BULK_BACKLOG_LIMIT
+    #define CONNECTION_BULK_BACKLOG_LIMIT       4096
+#endif
+
 namespace _2log
 {
     /**
@@ -23,11 +44,29 @@ namespace _2log
      * connection and draws up the first layer of the QuickHub JSON protocol. Unlike the server equivalent this class
      * currently does not support multiple sub-connections and implicitly establishes a VirtualConnection to the
      * QuickHub instance. So this class currently combines the server side Connection and VirtualConnection class.
+     *
+     * Outbound messages are serialized by the calling task and put into one lock-free queue per SendPriority lane.
+     * A dedicated sender task writes the queued frames to the WebSocket, so callers never block on the socket.
+     * Frames of the same lane are written in order. Lanes are served either strictly by priority (default), or
+     * weighted round robin, where each lane may write up to its weight in frames before the next lane is served.
+     * Each lane has a backlog limit; a frame reserves its bytes in the lane before it is queued, control frames
+     * of the connection itself included.
      */
     class Connection : public IDFix::Protocols::WebSocketEventHandler, public IConnection
 	{
 		public:
 
+            /**
+             * @brief The SchedulingMode enum enumerates how the sender task chooses between lanes
+             */
+            enum class SchedulingMode
+            {
+                Strict,     ///< always write the frame of the highest priority lane first
+                Weighted    ///< weighted round robin over all lanes
+            };
+
+            static const size_t LANE_COUNT = 4;
+
             /**
              * @brief Constructs a new Connection
              *
@@ -36,6 +75,12 @@ namespace _2log
              */
 										Connection(const std::string &url, const char *caCertificate = nullptr);
 
+            /**
+             * @brief Stops the sender task and drops the frames it did not write, their completions are called
+             * with \c Dropped. The WebSocket should be disconnected before, so that no message arrives meanwhile.
+             */
+										~Connection(void);
+
             /**
              * @brief Attempts to connect to the server
              * @param delayTime     an optional time to delay the connection attempt in milliseconds
@@ -53,11 +98,79 @@ namespace _2log
 			virtual bool				disconnect(void) override;
 
             /**
-             * @brief Send a JSON payload to the server
-             * @return  \c true on success, \c false otherwise
+             * @brief Queue a JSON payload to be sent to the server
+             * @return  \c true if the payload was queued, \c false otherwise
              */
 			virtual bool				sendPayload(const cJSON*) override;
 
+            /**
+             * @brief Queue a JSON payload to be sent to the server
+             *
+             * The completion callback is only called for queued payloads, once they were either sent or dropped.
+             * It is called from the sender task.
+             *
+             * @param payload       the payload, owned by the caller
+             * @param completion    optional callback that receives the final status (\c Sent or \c Dropped)
+             * @param priority      the outbound lane to use
+             *
+             * @return  \c Queued if the payload was accepted, otherwise the reason why it was not
+             */
+			virtual SendStatus			sendPayloadAsync(const cJSON *payload, sendCompletionFunction completion = nullptr,
+														 SendPriority priority = SendPriority::State) override;
+
+            /**
+             * @brief Get the number of bytes waiting to be sent
+             * @return  the send backlog in bytes
+             */
+			virtual size_t				getBacklogSize(void) const override;
+
+            /**
+             * @brief Get the number of bytes waiting to be sent in a single lane
+             * @param priority  the lane
+             * @return  the lane backlog in bytes
+             */
+			size_t						getBacklogSize(SendPriority priority) const;
+
+            /**
+             * @brief Set how the sender task chooses between lanes. Should be configured before connecting.
+             * @param mode  the scheduling mode
+             */
+			void						setSchedulingMode(SchedulingMode mode);
+
+            /**
+             * @brief Set the number of frames a lane may write per round in \c SchedulingMode::Weighted
+             * @param priority  the lane
+             * @param weight    the lane weight, at least 1
+             */
+			void						setLaneWeight(SendPriority priority, uint8_t weight);
+
+            /**
+             * @brief Set the backlog limit of a lane, a payload is rejected if it would take the lane backlog above
+             * the limit. An empty lane accepts a payload of any size, so a payload larger than the limit is not
+             * rejected forever.
+             * @param priority  the lane
+             * @param limit     the limit in bytes
+             */
+			void						setLaneLimit(SendPriority priority, size_t limit);
+
+            /**
+             * @brief Record all frames and connection events with timestamps to a binary traffic log
+             *
+             * Inbound frames are recorded before they are parsed, outbound frames once they were written to the
+             * WebSocket. The log can be replayed on the host with quickhub_traffic_replay.
+             *
+             * @param fileName  the log file, e.g. below the DataStorage mount point
+             * @param maxSize   the size limit of the log in bytes
+             *
+             * @return  \c true if the capture was started, \c false otherwise
+             */
+			bool						startCapture(const char *fileName, size_t maxSize = TRAFFIC_RECORDER_MAX_SIZE);
+
+            /**
+             * @brief Stop the traffic capture and close the log
+             */
+			void						stopCapture(void);
+
             /**
              * @brief Sets the event handler for this connection
              * @param handler   pointer to the event handler
@@ -97,10 +210,36 @@ namespace _2log
 			void						handleJSONMessage(const cJSON *jsonMessage);
 
             /**
-             * @brief Convert the JSON onbject to a string and send it to the server.
-             * @return  \c true if messages was successfully sent, \c false otherwise
+             * @brief Convert the JSON onbject to a string and queue it for the sender task.
+             * @param json          the JSON object to send
+             * @param priority      the outbound lane to use
+             * @param completion    optional callback that receives the final status
+             *
+             * @return  \c Queued if messages was successfully queued
+             */
+			SendStatus					sendJSON(const cJSON *json, SendPriority priority = SendPriority::Control, sendCompletionFunction completion = nullptr);
+
+            /**
+             * @brief One iteration of the sender task: waits for queued frames and writes them to the WebSocket
+             */
+			void						senderStep(void);
+
+            /**
+             * @brief Reserve the bytes of a frame in the backlog of its lane
+             * @return  \c true if the frame fits below the lane limit, \c false otherwise, then nothing was reserved
+             */
+			bool						reserveBacklog(size_t lane, size_t length);
+
+            /**
+             * @brief Write all queued frames to the WebSocket, frames of a previous connection are dropped
+             */
+			void						writeQueuedFrames(void);
+
+            /**
+             * @brief Take the next frame to write according to the scheduling mode
+             * @return  the next frame or \c nullptr if all lanes are empty
              */
-			bool						sendJSON(const cJSON*);
+			OutboundFrame*				nextFrame(void);
 
             /**
              * @brief Static timer wrapper function
@@ -122,6 +261,19 @@ namespace _2log
 			ConnectionEventHandler*		_eventHandler;
             uint64_t                    _lastPingTimestamp = { 0 };
             TimerHandle_t               _pingTimeoutTimer = { nullptr };
+            OutboundQueue               _lanes[LANE_COUNT];
+            std::atomic<size_t>         _laneBacklogs[LANE_COUNT];
+            size_t                      _laneLimits[LANE_COUNT] =  { CONNECTION_CONTROL_BACKLOG_LIMIT, CONNECTION_RPC_BACKLOG_LIMIT,
+                                                                     CONNECTION_STATE_BACKLOG_LIMIT, CONNECTION_BULK_BACKLOG_LIMIT };
+            uint8_t                     _laneWeights[LANE_COUNT] = { 8, 4, 2, 1 };
+            uint8_t                     _laneCredits[LANE_COUNT] = { 8, 0, 0, 0 };
+            size_t                      _currentLane = { 0 };
+            SchedulingMode              _schedulingMode = { SchedulingMode::Strict };
+            SemaphoreHandle_t           _senderSignal = { nullptr };
+            WorkerTask*                 _senderTask = { nullptr };
+            std::atomic<bool>           _closing = { false };
+            std::atomic<uint32_t>       _connectionGeneration = { 0 };
+            TrafficRecorder             _trafficRecorder;
 	};
 }
 
@@ -26,6 +26,9 @@ namespace _2log
 
             /**
              * @brief This event is triggered when a JSON payload was received from the QuickHub server
+             *
+             * The payload belongs to the received message and must not be used after the handler returned.
+             * cJSON data the handler allocates is not part of the message arena and may be kept.
              */
 			virtual void	jsonReceived(const cJSON*) = 0;
 	};
@@ -0,0 +1,401 @@
+#include "CounterStore.h"
+#include "Crc32.h"
+
+#include <string.h>
+
+extern "C"
+{
+    #include "esp_log.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG         = "_2log::CounterStore";
+    const uint8_t   SLOT_MAGIC[2]   = { 'Q', 'C' };
+    const size_t    CRC_OFFSET      = 12;
+
+    void writeUint32(uint8_t *buffer, uint32_t value)
+    {
+        for ( int index = 0; index < 4; index++ )
+        {
+            buffer[index] = static_cast<uint8_t>( value >> ( 8 * index ) );
+        }
+    }
+
+    uint32_t readUint32(const uint8_t *buffer)
+    {
+        return static_cast<uint32_t>(buffer[0]) | static_cast<uint32_t>(buffer[1]) << 8 | static_cast<uint32_t>(buffer[2]) << 16 |
+               static_cast<uint32_t>(buffer[3]) << 24;
+    }
+
+    void writeUint64(uint8_t *buffer, uint64_t value)
+    {
+        writeUint32(buffer, static_cast<uint32_t>(value) );
+        writeUint32(buffer + 4, static_cast<uint32_t>( value >> 32 ) );
+    }
+
+    uint64_t readUint64(const uint8_t *buffer)
+    {
+        return static_cast<uint64_t>( readUint32(buffer) ) | static_cast<uint64_t>( readUint32(buffer + 4) ) << 32;
+    }
+
+    uint32_t getSlotCrc(const uint8_t *slot)
+    {
+        uint32_t crc = _2log::updateCrc32(0, slot, CRC_OFFSET);
+        return _2log::updateCrc32(crc, slot + _2log::CounterStore::SLOT_HEADER_SIZE, _2log::CounterStore::SLOT_SIZE - _2log::CounterStore::SLOT_HEADER_SIZE);
+    }
+}
+
+namespace _2log
+{
+    CounterStore::CounterStore()
+    {
+        _mutex          = xSemaphoreCreateMutex();
+        _persistSignal  = xSemaphoreCreateBinary();
+        _persistTask    = new WorkerTask("counter_store", _persistSignal, [this]() { persistStep(); });
+    }
+
+    CounterStore::~CounterStore()
+    {
+        close();
+
+        delete _persistTask;
+
+        if ( _persistSignal != nullptr )
+        {
+            vSemaphoreDelete(_persistSignal);
+        }
+
+        if ( _mutex != nullptr )
+        {
+            vSemaphoreDelete(_mutex);
+        }
+    }
+
+    bool CounterStore::open(const char *label)
+    {
+        close();
+
+        if ( _mutex == nullptr || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        _partition      = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        _slotsPerSector = SPI_FLASH_SEC_SIZE / SLOT_SIZE;
+        _slotCount      = _partition != nullptr ? _partition->size / SPI_FLASH_SEC_SIZE * _slotsPerSector : 0;
+        _slot           = SIZE_MAX;
+        _sequence       = 0;
+        _dirty          = false;
+        _statistics     = {};
+
+        memset(_counters, 0, sizeof(_counters) );
+
+        if ( _slotCount < 2 * _slotsPerSector )
+        {
+            ESP_LOGE(LOG_TAG, "No data partition %s with at least two sectors", label);
+            _partition = nullptr;
+
+            xSemaphoreGive(_mutex);
+            return false;
+        }
+
+        // newest wins, the sequence number only grows
+        uint64_t counters[COUNTER_STORE_MAX_COUNTERS];
+
+        for ( size_t slot = 0; slot < _slotCount; slot++ )
+        {
+            uint32_t    sequence;
+            bool        torn;
+
+            if ( readSlot(slot, counters, &sequence, &torn) )
+            {
+                if ( _slot == SIZE_MAX || sequence > _sequence )
+                {
+                    _slot       = slot;
+                    _sequence   = sequence;
+                    memcpy(_counters, counters, sizeof(_counters) );
+                }
+            }
+            else if ( torn )
+            {
+                _statistics.invalidSlots++;
+            }
+        }
+
+        ESP_LOGI(LOG_TAG, "Opened %s: %u slots, sequence %u, %u invalid slots", label, static_cast<unsigned>(_slotCount), _sequence,
+                 _statistics.invalidSlots);
+
+        xSemaphoreGive(_mutex);
+
+        if ( ! _persistTask->start() )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to start persist task");
+        }
+
+        return true;
+    }
+
+    void CounterStore::close()
+    {
+        // before locking, a running persist is finished first
+        _persistTask->stop();
+
+        if ( _mutex == nullptr || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return;
+        }
+
+        if ( _partition != nullptr )
+        {
+            persistLocked();
+            _partition = nullptr;
+        }
+
+        xSemaphoreGive(_mutex);
+    }
+
+    bool CounterStore::isOpen() const
+    {
+        return _partition != nullptr;
+    }
+
+    uint64_t CounterStore::get(uint8_t counter)
+    {
+        if ( counter >= COUNTER_STORE_MAX_COUNTERS || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return 0;
+        }
+
+        uint64_t value = _counters[counter];
+
+        xSemaphoreGive(_mutex);
+
+        return value;
+    }
+
+    bool CounterStore::add(uint8_t counter, uint64_t increment)
+    {
+        if ( counter >= COUNTER_STORE_MAX_COUNTERS || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        _counters[counter] += increment;
+        _dirty = _dirty || increment != 0;
+
+        xSemaphoreGive(_mutex);
+
+        return true;
+    }
+
+    bool CounterStore::set(uint8_t counter, uint64_t value)
+    {
+        if ( counter >= COUNTER_STORE_MAX_COUNTERS || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        _dirty = _dirty || _counters[counter] != value;
+        _counters[counter] = value;
+
+        xSemaphoreGive(_mutex);
+
+        return true;
+    }
+
+    bool CounterStore::persist()
+    {
+        if ( xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        bool success = persistLocked();
+
+        xSemaphoreGive(_mutex);
+
+        return success;
+    }
+
+    void CounterStore::setPersistInterval(uint32_t interval)
+    {
+        _persistInterval = interval;
+
+        // apply the new interval right away
+        if ( _persistSignal != nullptr )
+        {
+            xSemaphoreGive(_persistSignal);
+        }
+    }
+
+    CounterStore::Statistics CounterStore::getStatistics()
+    {
+        Statistics statistics = {};
+
+        if ( xSemaphoreTake(_mutex, portMAX_DELAY) == pdTRUE )
+        {
+            statistics          = _statistics;
+            statistics.slots    = static_cast<uint32_t>(_slotCount);
+            statistics.sequence = _sequence;
+
+            xSemaphoreGive(_mutex);
+        }
+
+        return statistics;
+    }
+
+    void CounterStore::persistStep()
+    {
+        // woken early by a new interval and by stop(), close() persists after it
+        xSemaphoreTake(_persistSignal, pdMS_TO_TICKS(_persistInterval.load() ) );
+
+        persist();
+    }
+
+    bool CounterStore::persistLocked()
+    {
+        if ( ! _dirty )
+        {
+            return true;
+        }
+
+        if ( _partition == nullptr )
+        {
+            return false;
+        }
+
+        uint8_t slotData[SLOT_SIZE];
+
+        memcpy(slotData, SLOT_MAGIC, sizeof(SLOT_MAGIC) );
+        slotData[2] = FORMAT_VERSION;
+        slotData[3] = COUNTER_STORE_MAX_COUNTERS;
+        writeUint32(slotData + 4, _sequence + 1);
+        writeUint32(slotData + 8, 0xFFFFFFFF);
+
+        for ( size_t counter = 0; counter < COUNTER_STORE_MAX_COUNTERS; counter++ )
+        {
+            writeUint64(slotData + SLOT_HEADER_SIZE + counter * sizeof(uint64_t), _counters[counter]);
+        }
+
+        writeUint32(slotData + CRC_OFFSET, getSlotCrc(slotData) );
+
+        size_t slot = nextSlot();
+
+        if ( slot == SIZE_MAX )
+        {
+            _statistics.failedWrites++;
+            return false;
+        }
+
+        size_t offset = slot / _slotsPerSector * SPI_FLASH_SEC_SIZE + slot % _slotsPerSector * SLOT_SIZE;
+
+        if ( esp_partition_write(_partition, offset, slotData, SLOT_SIZE) != ESP_OK )
+        {
+            // the slot is not blank anymore, the next write skips it
+            ESP_LOGE(LOG_TAG, "Failed to write slot %u", static_cast<unsigned>(slot) );
+            _statistics.failedWrites++;
+            return false;
+        }
+
+        _slot = slot;
+        _sequence++;
+        _dirty = false;
+        _statistics.writes++;
+
+        // erase the sector with the oldest slots ahead of time, the next write does not wait for it
+        if ( slot % _slotsPerSector == _slotsPerSector - 1 )
+        {
+            eraseSector( ( slot / _slotsPerSector + 1 ) % ( _slotCount / _slotsPerSector ) );
+        }
+
+        return true;
+    }
+
+    bool CounterStore::readSlot(size_t slot, uint64_t *counters, uint32_t *sequence, bool *torn)
+    {
+        uint8_t slotData[SLOT_SIZE];
+        size_t  offset = slot / _slotsPerSector * SPI_FLASH_SEC_SIZE + slot % _slotsPerSector * SLOT_SIZE;
+
+        *torn = false;
+
+        if ( esp_partition_read(_partition, offset, slotData, SLOT_SIZE) != ESP_OK || memcmp(slotData, SLOT_MAGIC, sizeof(SLOT_MAGIC) ) != 0 ||
+             slotData[2] != FORMAT_VERSION || slotData[3] != COUNTER_STORE_MAX_COUNTERS )
+        {
+            return false;
+        }
+
+        if ( readUint32(slotData + CRC_OFFSET) != getSlotCrc(slotData) )
+        {
+            *torn = true;
+            return false;
+        }
+
+        *sequence = readUint32(slotData + 4);
+
+        for ( size_t counter = 0; counter < COUNTER_STORE_MAX_COUNTERS; counter++ )
+        {
+            counters[counter] = readUint64(slotData + SLOT_HEADER_SIZE + counter * sizeof(uint64_t) );
+        }
+
+        return true;
+    }
+
+    bool CounterStore::isBlank(size_t slot)
+    {
+        uint8_t slotData[SLOT_SIZE];
+        size_t  offset = slot / _slotsPerSector * SPI_FLASH_SEC_SIZE + slot % _slotsPerSector * SLOT_SIZE;
+
+        if ( esp_partition_read(_partition, offset, slotData, SLOT_SIZE) != ESP_OK )
+        {
+            return false;
+        }
+
+        for ( size_t index = 0; index < SLOT_SIZE; index++ )
+        {
+            if ( slotData[index] != 0xFF )
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool CounterStore::eraseSector(size_t sector)
+    {
+        if ( esp_partition_erase_range(_partition, sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE) != ESP_OK )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to erase sector %u", static_cast<unsigned>(sector) );
+            return false;
+        }
+
+        _statistics.erases++;
+
+        return true;
+    }
+
+    size_t CounterStore::nextSlot()
+    {
+        size_t slot = _slot == SIZE_MAX ? 0 : ( _slot + 1 ) % _slotCount;
+
+        // slots that are not blank, e.g. torn ones or those of a sector whose erase was interrupted, are skipped
+        for ( size_t attempt = 0; attempt < _slotCount; attempt++ )
+        {
+            if ( isBlank(slot) )
+            {
+                return slot;
+            }
+
+            // the first slot of a sector is only used if the sector was erased, it holds the oldest slots
+            if ( slot % _slotsPerSector == 0 && slot / _slotsPerSector != _slot / _slotsPerSector )
+            {
+                return eraseSector(slot / _slotsPerSector) ? slot : SIZE_MAX;
+            }
+
+            slot = ( slot + 1 ) % _slotCount;
+        }
+
+        return SIZE_MAX;
+    }
+}
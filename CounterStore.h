@@ -0,0 +1,155 @@
+#ifndef COUNTERSTORE_H
+#define COUNTERSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "WorkerTask.h"
+
+extern "C"
+{
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/semphr.h>
+    #include "esp_partition.h"
+}
+
+#ifndef COUNTER_STORE_PARTITION
+    #define COUNTER_STORE_PARTITION         "counters"
+#endif
+
+#ifndef COUNTER_STORE_MAX_COUNTERS
+    #define COUNTER_STORE_MAX_COUNTERS      8
+#endif
+
+// changed counters are written at most this often, in milliseconds
+#ifndef COUNTER_STORE_PERSIST_INTERVAL
+    #define COUNTER_STORE_PERSIST_INTERVAL  5000
+#endif
+
+namespace _2log
+{
+    /**
+     * @brief The CounterStore class keeps cumulative counters, e.g. energy, operating hours or relay cycles, in
+     * a raw flash partition without wearing it out.
+     *
+     * All counters are written together as one slot: the magic "QC", version, number of counters, a sequence
+     * number, 4 reserved bytes and the CRC-32 of the slot, followed by the counters as little endian uint64.
+     * The slots fill the partition as a ring, a write never goes to a used slot. When the last slot of a sector
+     * is written the next sector, which holds the oldest slots, is erased, so every sector is erased once per
+     * round of the ring and the erases are spread evenly over the partition.
+     *
+     * open() reads all slots and continues with the valid one with the highest sequence number; a slot that
+     * was torn by a power loss fails its CRC and is skipped. While the store is open, a background task writes
+     * changed counters every COUNTER_STORE_PERSIST_INTERVAL ms, persist() writes them right away.
+     *
+     * With the default 8 counters a slot has 80 bytes. A 64 KB partition holds 816 slots, so persisting every
+     * 5 seconds erases each sector about 7700 times a year and the 100000 erase cycles of the flash last 13
+     * years; the lifetime grows with the partition size and the interval.
+     * Changing COUNTER_STORE_MAX_COUNTERS changes the slot size, the counters start from zero then.
+     *
+     * All functions may be called from any task.
+     */
+    class CounterStore
+    {
+        public:
+
+            static const uint8_t    FORMAT_VERSION = 1;
+            static const size_t     SLOT_HEADER_SIZE = 16;
+            static const size_t     SLOT_SIZE = SLOT_HEADER_SIZE + COUNTER_STORE_MAX_COUNTERS * sizeof(uint64_t);
+
+            /**
+             * @brief The Statistics struct summarizes the ring and the writes since open()
+             */
+            struct Statistics
+            {
+                uint32_t    slots;              ///< slots of the ring
+                uint32_t    sequence;           ///< sequence number of the newest slot
+                uint32_t    writes;             ///< slots written
+                uint32_t    erases;             ///< sectors erased
+                uint32_t    failedWrites;
+                uint32_t    invalidSlots;       ///< slots with a bad CRC found by open()
+            };
+
+                                CounterStore(void);
+                                ~CounterStore(void);
+
+                                CounterStore(CounterStore const&)       = delete;
+            void                operator=(CounterStore const&)          = delete;
+
+            /**
+             * @brief Open the partition and load the newest counters
+             * @param label     the label of a data partition with at least two sectors
+             *
+             * @return  \c true if the store is ready, \c false otherwise
+             */
+            bool                open(const char *label = COUNTER_STORE_PARTITION);
+
+            /**
+             * @brief Write changed counters and close the partition
+             */
+            void                close(void);
+
+            bool                isOpen(void) const;
+
+            /**
+             * @brief Get a counter
+             * @param counter   the index of the counter, below COUNTER_STORE_MAX_COUNTERS
+             * @return  the value, \c 0 for an unknown counter
+             */
+            uint64_t            get(uint8_t counter);
+
+            /**
+             * @brief Add to a counter, it is written by the next persist
+             * @return  \c true on success, \c false for an unknown counter
+             */
+            bool                add(uint8_t counter, uint64_t increment);
+
+            /**
+             * @brief Set a counter, it is written by the next persist
+             * @return  \c true on success, \c false for an unknown counter
+             */
+            bool                set(uint8_t counter, uint64_t value);
+
+            /**
+             * @brief Write changed counters now, on the calling task
+             * @return  \c true if nothing changed or the slot was written, \c false otherwise
+             */
+            bool                persist(void);
+
+            /**
+             * @brief Change how often changed counters are written
+             * @param interval  the interval in milliseconds
+             */
+            void                setPersistInterval(uint32_t interval);
+
+            Statistics          getStatistics(void);
+
+        private:
+
+            void                persistStep(void);
+
+            bool                persistLocked(void);
+            bool                readSlot(size_t slot, uint64_t *counters, uint32_t *sequence, bool *torn);
+            bool                isBlank(size_t slot);
+            bool                eraseSector(size_t sector);
+            size_t              nextSlot(void);
+
+        private:
+
+            SemaphoreHandle_t       _mutex = { nullptr };
+            SemaphoreHandle_t       _persistSignal = { nullptr };
+            WorkerTask*             _persistTask = { nullptr };
+            const esp_partition_t*  _partition = { nullptr };
+            size_t                  _slotCount = { 0 };
+            size_t                  _slotsPerSector = { 0 };
+            size_t                  _slot = { SIZE_MAX };       ///< the newest slot, SIZE_MAX before the first write
+            uint32_t                _sequence = { 0 };
+            uint64_t                _counters[COUNTER_STORE_MAX_COUNTERS] = {};
+            bool                    _dirty = { false };
+            std::atomic<uint32_t>   _persistInterval = { COUNTER_STORE_PERSIST_INTERVAL };
+            Statistics              _statistics = {};
+    };
+}
+
+#endif
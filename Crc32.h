@@ -0,0 +1,36 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace _2log
+{
+    /**
+     * @brief Continue a CRC-32 (IEEE 802.3), start with \c 0 and feed the data in any number of pieces
+     *
+     * The nibble table keeps the code small, the records it checks are short.
+     */
+    inline uint32_t updateCrc32(uint32_t crc, const void *data, size_t length)
+    {
+        static const uint32_t CRC_TABLE[16] =
+        {
+            0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+            0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+        };
+
+        const uint8_t *bytes = static_cast<const uint8_t*>(data);
+
+        crc = ~crc;
+
+        for ( size_t index = 0; index < length; index++ )
+        {
+            crc = CRC_TABLE[( crc ^ bytes[index] ) & 0x0F] ^ ( crc >> 4 );
+            crc = CRC_TABLE[( crc ^ ( bytes[index] >> 4 ) ) & 0x0F] ^ ( crc >> 4 );
+        }
+
+        return ~crc;
+    }
+}
+
+#endif
@@ -2,13 +2,9 @@
 
 extern "C"
 {
-	#include "esp_spiffs.h"
 	#include "esp_log.h"
-	#include "esp_task_wdt.h"
+	#include "esp_timer.h"
 	#include "string.h"
-	#include <sys/stat.h>
-	#include <stdio.h>
-	#include <sys/unistd.h>
 
     #ifndef CONFIG_IDF_TARGET_ESP32
     #include "FreeRTOS.h"
@@ -19,13 +15,111 @@ extern "C"
 namespace
 {
 	const char* LOG_TAG = "_2log::DataStorage";
+
+	void recordLatency(std::atomic<uint32_t> *histogram, int64_t start)
+	{
+		uint64_t	latency	= static_cast<uint64_t>( esp_timer_get_time() - start );
+		int			bucket	= 0;
+
+		// bucket n holds the latencies below 2^(n+1) microseconds
+		while ( latency > 1 && bucket < _2log::DataStorage::LATENCY_BUCKET_COUNT - 1 )
+		{
+			latency >>= 1;
+			bucket++;
+		}
+
+		histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	_2log::DataStorage::LatencyStatistics getLatencyStatistics(const std::atomic<uint32_t> *histogram)
+	{
+		uint32_t counts[_2log::DataStorage::LATENCY_BUCKET_COUNT];
+		_2log::DataStorage::LatencyStatistics statistics = {};
+
+		for ( int bucket = 0; bucket < _2log::DataStorage::LATENCY_BUCKET_COUNT; bucket++ )
+		{
+			counts[bucket]		= histogram[bucket].load(std::memory_order_relaxed);
+			statistics.count   += counts[bucket];
+		}
+
+		uint32_t	*percentiles[]	= { &statistics.p50, &statistics.p90, &statistics.p99, &statistics.max };
+		uint64_t	limits[]		= { statistics.count * 50ULL, statistics.count * 90ULL, statistics.count * 99ULL, statistics.count * 100ULL };
+		uint64_t	cumulative		= 0;
+		size_t		next			= 0;
+
+		for ( int bucket = 0; bucket < _2log::DataStorage::LATENCY_BUCKET_COUNT && next < 4; bucket++ )
+		{
+			cumulative += counts[bucket] * 100ULL;
+
+			while ( next < 4 && counts[bucket] > 0 && cumulative >= limits[next] )
+			{
+				*percentiles[next++] = bucket < 31 ? ( 1U << ( bucket + 1 ) ) : UINT32_MAX;
+			}
+		}
+
+		return statistics;
+	}
 }
 
 namespace _2log
 {
 	DataStorage::DataStorage() : _isMounted(false)
 	{
+		resetLatencyStatistics();
+
+		_backend = StorageBackend::create(StorageBackendType::DATA_STORAGE_BACKEND);
 
+		if ( _backend == nullptr )
+		{
+			_backend = StorageBackend::create(StorageBackendType::Spiffs);
+		}
+
+		_queueMutex		= xSemaphoreCreateMutex();
+		_requestSignal	= xSemaphoreCreateBinary();
+
+		_ioTask			= new WorkerTask("storage_io", _requestSignal, [this]() { storageStep(); });
+
+		_taskStarted = _queueMutex != nullptr && _requestSignal != nullptr && _ioTask->start();
+
+		if ( ! _taskStarted )
+		{
+			// the file functions still work, but on the calling task
+			ESP_LOGE(LOG_TAG, "Failed to start storage task");
+		}
+	}
+
+	DataStorage::~DataStorage()
+	{
+		// the last step of the storage task serves the queued requests, later ones run on the calling task
+		_taskStarted = false;
+		_ioTask->stop();
+		_storageTask = nullptr;
+
+		StorageRequest *request;
+
+		while ( _queueMutex != nullptr && ( request = nextRequest() ) != nullptr )
+		{
+			execute(request);
+		}
+
+		delete _ioTask;
+
+		if ( _isMounted )
+		{
+			_backend->unmount();
+		}
+
+		delete _backend;
+
+		if ( _requestSignal != nullptr )
+		{
+			vSemaphoreDelete(_requestSignal);
+		}
+
+		if ( _queueMutex != nullptr )
+		{
+			vSemaphoreDelete(_queueMutex);
+		}
 	}
 
     DataStorage &DataStorage::getInstance()
@@ -34,33 +128,49 @@ namespace _2log
         return instance;
     }
 
-    bool DataStorage::mount(const char* mountPoint)
+	bool DataStorage::setBackend(StorageBackendType type)
 	{
-		if ( _isMounted || esp_spiffs_mounted(nullptr) )
+		if ( _isMounted )
 		{
-			ESP_LOGW(LOG_TAG, "SPIFFS Already Mounted!");
-			return true;
+			ESP_LOGE(LOG_TAG, "Failed to select %s, the storage is mounted", StorageBackend::getTypeName(type) );
+			return false;
 		}
 
-		esp_vfs_spiffs_conf_t conf = {};
+		StorageBackend *backend = StorageBackend::create(type);
 
-		conf.base_path				= mountPoint;
-		conf.partition_label		= nullptr;
-		conf.max_files				= 10;
-		conf.format_if_mount_failed	= false;
+		if ( backend == nullptr )
+		{
+			return false;
+		}
+
+		delete _backend;
+		_backend = backend;
+
+		return true;
+	}
+
+	StorageBackendType DataStorage::getBackendType() const
+	{
+		return _backend->getType();
+	}
 
-		esp_err_t err = esp_vfs_spiffs_register(&conf);
-        if(err == ESP_FAIL)
+	bool DataStorage::hasFileAccess() const
+	{
+		return _backend->hasFileAccess();
+	}
+
+    bool DataStorage::mount(const char* mountPoint)
+	{
+		const char *backendName = StorageBackend::getTypeName( _backend->getType() );
+
+		if ( _isMounted )
 		{
-			// automatically format on failure (first use)
-			if( format() )
-			{
-				err = esp_vfs_spiffs_register(&conf);
-			}
+			ESP_LOGW(LOG_TAG, "%s Already Mounted!", backendName);
+			return true;
 		}
-		if(err != ESP_OK)
+
+		if ( ! _backend->mount(mountPoint) )
 		{
-			ESP_LOGE(LOG_TAG, "Mounting SPIFFS failed! Error: %d", err);
 			return false;
 		}
 
@@ -68,14 +178,9 @@ namespace _2log
 
 		size_t total = 0, used = 0;
 
-		err = esp_spiffs_info(nullptr, &total, &used);
-		if (err != ESP_OK)
-		{
-			ESP_LOGE(LOG_TAG, "Failed to get SPIFFS partition information (%s)", esp_err_to_name(err) );
-		}
-		else
+		if ( _backend->getInfo(&total, &used) )
 		{
-			ESP_LOGI(LOG_TAG, "Partition size: total: %zu, used: %zu", total, used);
+			ESP_LOGI(LOG_TAG, "%s size: total: %zu, used: %zu", backendName, total, used);
 		}
 
 		return true;
@@ -83,169 +188,464 @@ namespace _2log
 
 	bool DataStorage::unmount()
 	{
-		if( esp_spiffs_mounted(nullptr) )
+		if ( ! _isMounted )
+		{
+			return _backend->unmount();
+		}
+
+		bool success = false;
+
+		// without a file name after all requests queued before, which still find the storage mounted
+		executeCall("", [&]()
 		{
-			esp_err_t err = esp_vfs_spiffs_unregister(nullptr);
-			if(err)
+			success = _backend->unmount();
+
+			if ( success )
 			{
-				ESP_LOGE(LOG_TAG, "Unmounting SPIFFS failed! Error: %d", err);
-				return false;
+				_isMounted = false;
 			}
-		}
-		_isMounted = false;
-		return true;
+		});
+
+		return success;
 	}
 
-	const char *DataStorage::readTextFile(const char *fileName)
+	const char *DataStorage::readTextFileNow(const char *fileName, size_t *length)
 	{
-		ESP_LOGD(LOG_TAG, "Reading file %s", fileName);
-		struct stat fileStat;
-		long		fileSize;
-		char*		fileBuffer = nullptr;
-
 		if ( ! _isMounted )
 		{
-			ESP_LOGE(LOG_TAG, "Failed to read file: SPIFFS not mounted");
+			ESP_LOGE(LOG_TAG, "Failed to read file: storage not mounted");
 			return nullptr;
 		}
 
-		if ( stat(fileName, &fileStat) != 0)
-		{
-			// file does not exists
-			ESP_LOGE(LOG_TAG, "File %s does not exist", fileName);
-			return nullptr;
-		}
+		return _backend->readFile(fileName, length);
+	}
 
-		FILE* file = fopen(fileName, "r");
-		if (file == nullptr)
+	int DataStorage::writeTextFileNow(const char *fileName, const char *content)
+	{
+		if ( ! _isMounted )
 		{
-			ESP_LOGE(LOG_TAG, "Failed to open file for reading");
-			return nullptr;
+			ESP_LOGE(LOG_TAG, "Failed to write file: storage not mounted");
+			return -1;
 		}
 
-		fseek (file , 0 , SEEK_END);
-		fileSize = ftell(file);
-		rewind(file);
+		return _backend->writeFile(fileName, content);
+	}
 
-		if ( fileSize == 0 )
+	bool DataStorage::deleteFileNow(const char *fileName)
+	{
+		if ( ! _isMounted )
 		{
-			ESP_LOGE(LOG_TAG, "File %s is empty", fileName);
-			fclose(file);
-			return nullptr;
+			ESP_LOGE(LOG_TAG, "Failed to delete file: storage not mounted");
+			return false;
 		}
 
-		fileBuffer = new char [fileSize + 1];
+		return _backend->deleteFile(fileName);
+	}
+
+	const char *DataStorage::readTextFile(const char *fileName)
+	{
+		return readTextFile(fileName, nullptr);
+	}
+
+	const char *DataStorage::readTextFile(const char *fileName, size_t *length)
+	{
+		int64_t			start	= esp_timer_get_time();
+		StorageRequest	request;
+
+		request.type		= StorageRequestType::Read;
+		request.fileName	= fileName;
+
+		const char *content = executeAndWait(&request) ? request.readResult : nullptr;
 
-		if ( fileBuffer == nullptr )
+		if ( content != nullptr && length != nullptr )
 		{
-			ESP_LOGE(LOG_TAG, "Memory error");
-			fclose(file);
-			return nullptr;
+			*length = request.readLength;
 		}
 
-		size_t result = fread (fileBuffer, 1, static_cast<size_t>(fileSize), file);
+		recordLatency(_callerLatency, start);
+		return content;
+	}
+
+	int DataStorage::writeTextFile(const char *fileName, const char *content)
+	{
+		int64_t			start	= esp_timer_get_time();
+		StorageRequest	request;
+
+		request.type		= StorageRequestType::Write;
+		request.fileName	= fileName;
+		request.content		= content;
 
-		if ( result != static_cast<size_t>(fileSize) )
+		int charsWritten = executeAndWait(&request) ? request.writeResult : -1;
+
+		recordLatency(_callerLatency, start);
+		return charsWritten;
+	}
+
+	int DataStorage::getFileSize(const char *fileName)
+	{
+		int size = -1;
+
+		executeCall(fileName, [&]()
 		{
-			ESP_LOGE(LOG_TAG, "reading error");
-			delete fileBuffer;
-			fileBuffer = nullptr;
-		}
-		else
+			size = _backend->getFileSize(fileName);
+		});
+
+		return size;
+	}
+
+	int DataStorage::readFile(const char *fileName, void *buffer, size_t size, size_t offset)
+	{
+		int bytesRead = -1;
+
+		executeCall(fileName, [&]()
 		{
-			fileBuffer[fileSize] = '\0';
-		}
+			bytesRead = _backend->readData(fileName, offset, buffer, size);
+		});
 
-		fclose(file);
+		return bytesRead;
+	}
+
+	int DataStorage::writeFile(const char *fileName, const void *data, size_t length, bool append)
+	{
+		int bytesWritten = -1;
 
-		return fileBuffer;
+		executeCall(fileName, [&]()
+		{
+			bytesWritten = _backend->writeData(fileName, data, length, append);
+		});
+
+		return bytesWritten;
 	}
 
-	int DataStorage::writeTextFile(const char *fileName, const char *content)
+	int DataStorage::readFileChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, ChunkReadFunction consumer)
 	{
-		ESP_LOGD(LOG_TAG, "Writing file %s", fileName);
+		int bytesRead = -1;
 
-		if ( ! _isMounted )
+		if ( buffer == nullptr || bufferSize == 0 || ! consumer )
 		{
-			ESP_LOGE(LOG_TAG, "Failed to write file: SPIFFS not mounted");
 			return -1;
 		}
 
-		FILE* file = fopen(fileName, "w");
+		executeCall(fileName, [&]()
+		{
+			bytesRead = _backend->readChunked(fileName, buffer, bufferSize, consumer);
+		});
+
+		return bytesRead;
+	}
+
+	int DataStorage::writeFileChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, ChunkWriteFunction producer)
+	{
+		int bytesWritten = -1;
 
-		if (file == nullptr)
+		if ( buffer == nullptr || bufferSize == 0 || ! producer )
 		{
-			ESP_LOGE(LOG_TAG, "Failed to open file for writing");
 			return -1;
 		}
 
-		int charsWritten = fprintf(file, "%s", content);
-		fclose(file);
+		executeCall(fileName, [&]()
+		{
+			bytesWritten = _backend->writeChunked(fileName, buffer, bufferSize, producer);
+		});
 
-		ESP_LOGD(LOG_TAG, "File %s written", fileName);
-		return charsWritten;
+		return bytesWritten;
 	}
 
 	bool DataStorage::deleteFile(const char *fileName)
 	{
-		struct stat fileStats;
-		bool fileWasOverwritten = false;
-		if ( stat(fileName, &fileStats) == 0 )
+		int64_t			start	= esp_timer_get_time();
+		StorageRequest	request;
+
+		request.type		= StorageRequestType::Delete;
+		request.fileName	= fileName;
+
+		bool success = executeAndWait(&request) && request.deleteResult;
+
+		recordLatency(_callerLatency, start);
+		return success;
+	}
+
+	bool DataStorage::readTextFileAsync(const char *fileName, readCompletionFunction completion, StoragePriority priority)
+	{
+		int64_t			start	= esp_timer_get_time();
+		StorageRequest*	request	= new StorageRequest();
+
+		request->type			= StorageRequestType::Read;
+		request->fileName		= fileName;
+		request->readCompletion	= std::move(completion);
+
+		bool queued = enqueue(request, priority);
+
+		recordLatency(_callerLatency, start);
+		return queued;
+	}
+
+	bool DataStorage::writeTextFileAsync(const char *fileName, const char *content, writeCompletionFunction completion, StoragePriority priority)
+	{
+		int64_t			start	= esp_timer_get_time();
+		StorageRequest*	request	= new StorageRequest();
+
+		request->type				= StorageRequestType::Write;
+		request->fileName			= fileName;
+		request->content			= content;
+		request->writeCompletion	= std::move(completion);
+
+		bool queued = enqueue(request, priority);
+
+		recordLatency(_callerLatency, start);
+		return queued;
+	}
+
+	bool DataStorage::deleteFileAsync(const char *fileName, deleteCompletionFunction completion, StoragePriority priority)
+	{
+		int64_t			start	= esp_timer_get_time();
+		StorageRequest*	request	= new StorageRequest();
+
+		request->type				= StorageRequestType::Delete;
+		request->fileName			= fileName;
+		request->deleteCompletion	= std::move(completion);
+
+		bool queued = enqueue(request, priority);
+
+		recordLatency(_callerLatency, start);
+		return queued;
+	}
+
+	DataStorage::LatencyStatistics DataStorage::getCallerLatency()
+	{
+		return getLatencyStatistics(_callerLatency);
+	}
+
+	DataStorage::LatencyStatistics DataStorage::getServiceLatency()
+	{
+		return getLatencyStatistics(_serviceLatency);
+	}
+
+	void DataStorage::resetLatencyStatistics()
+	{
+		for ( int bucket = 0; bucket < LATENCY_BUCKET_COUNT; bucket++ )
+		{
+			_callerLatency[bucket]	= 0;
+			_serviceLatency[bucket]	= 0;
+		}
+	}
+
+	void DataStorage::storageStep()
+	{
+		_storageTask = xTaskGetCurrentTaskHandle();
+
+		// woken by a request or by stop()
+		if ( xSemaphoreTake(_requestSignal, portMAX_DELAY) != pdTRUE )
+		{
+			return;
+		}
+
+		StorageRequest *request;
+
+		while ( ( request = nextRequest() ) != nullptr )
+		{
+			execute(request);
+		}
+	}
+
+	bool DataStorage::enqueue(StorageRequest *request, StoragePriority priority)
+	{
+		// without a storage task, or called from a completion, the request is executed right away
+		if ( ! _taskStarted || isStorageTask() )
+		{
+			execute(request);
+			return true;
+		}
+
+		xSemaphoreTake(_queueMutex, portMAX_DELAY);
+
+		// waiting callers are not limited, they can not flood the queue
+		if ( request->done == nullptr && _pendingRequests >= DATA_STORAGE_QUEUE_LENGTH )
 		{
-			// complete erase file contents
-			FILE* file = fopen(fileName, "w");
+			xSemaphoreGive(_queueMutex);
+
+			ESP_LOGE(LOG_TAG, "Storage queue full, dropping request for %s", request->fileName.c_str() );
+			delete request;
+			return false;
+		}
+
+		request->sequence = _sequence++;
+		_queues[static_cast<size_t>(priority)].push_back(request);
+		_pendingRequests++;
+
+		xSemaphoreGive(_queueMutex);
+
+		// a binary semaphore: multiple gives before the task wakes up result in a single drain of the queues
+		xSemaphoreGive(_requestSignal);
+
+		return true;
+	}
+
+	DataStorage::StorageRequest *DataStorage::nextRequest()
+	{
+		xSemaphoreTake(_queueMutex, portMAX_DELAY);
 
-			for (int i = 0; i < fileStats.st_size; i++)
+		std::deque<StorageRequest*>				*selectedQueue = nullptr;
+		std::deque<StorageRequest*>::iterator	selected;
+
+		for ( std::deque<StorageRequest*> &queue : _queues )
+		{
+			if ( ! queue.empty() )
 			{
-				fwrite(" ", 1, 1, file);
+				selectedQueue	= &queue;
+				selected		= queue.begin();
+				break;
 			}
+		}
 
-			fclose(file);
-			fileWasOverwritten = true;
+		if ( selectedQueue == nullptr )
+		{
+			xSemaphoreGive(_queueMutex);
+			return nullptr;
 		}
 
-		// finally delete file
-		return unlink(fileName) == 0 || fileWasOverwritten;
+		// an earlier request for the same file goes first, whatever its priority, and every earlier one before a
+		// request without a file name, which is for the whole storage, e.g. unmount()
+		for ( std::deque<StorageRequest*> &queue : _queues )
+		{
+			for ( auto request = queue.begin(); request != queue.end(); ++request )
+			{
+				if ( (*request)->sequence < (*selected)->sequence && ( (*request)->fileName == (*selected)->fileName || (*selected)->fileName.empty() ) )
+				{
+					selectedQueue	= &queue;
+					selected		= request;
+					break;
+				}
+			}
+		}
+
+		StorageRequest *request = *selected;
+		selectedQueue->erase(selected);
+		_pendingRequests--;
+
+		xSemaphoreGive(_queueMutex);
+
+		return request;
 	}
 
-	bool DataStorage::format()
+	void DataStorage::execute(StorageRequest *request)
 	{
+		int64_t start = esp_timer_get_time();
 
-        ESP_LOGI(LOG_TAG, "Format file system start..");
+		switch ( request->type )
+		{
+			case StorageRequestType::Read:
+				request->readResult = readTextFileNow( request->fileName.c_str(), &request->readLength );
+				break;
 
-        #ifdef CONFIG_IDF_TARGET_ESP32
+			case StorageRequestType::Write:
+				request->writeResult = writeTextFileNow( request->fileName.c_str(), request->content.c_str() );
+				break;
 
-            UBaseType_t coreID = xPortGetCoreID();
-            TaskHandle_t idleTask = xTaskGetIdleTaskHandleForCPU( coreID );
+			case StorageRequestType::Delete:
+				request->deleteResult = deleteFileNow( request->fileName.c_str() );
+				break;
 
-            // disable watchdog for current core, as esp_spiffs_format can take some time
-            if( idleTask == nullptr || esp_task_wdt_delete(idleTask) != ESP_OK )
-            {
-                ESP_LOGE(LOG_TAG, "Failed to remove Core %d IDLE task from WDT", coreID);
-            }
+			case StorageRequestType::Call:
+				request->call();
+				break;
+		}
 
-        #endif
+		recordLatency(_serviceLatency, start);
 
-            esp_err_t err = esp_spiffs_format(nullptr);
+		if ( request->done != nullptr )
+		{
+			// the waiting caller owns the request and the read buffer
+			xSemaphoreGive(request->done);
+			return;
+		}
 
-		// re-enable watchdog
-        #ifdef CONFIG_IDF_TARGET_ESP32
+		switch ( request->type )
+		{
+			case StorageRequestType::Read:
+				if ( request->readCompletion )
+				{
+					request->readCompletion(request->readResult);
+				}
+
+				delete [] request->readResult;
+				break;
+
+			case StorageRequestType::Write:
+				if ( request->writeCompletion )
+				{
+					request->writeCompletion(request->writeResult);
+				}
+				break;
+
+			case StorageRequestType::Delete:
+				if ( request->deleteCompletion )
+				{
+					request->deleteCompletion(request->deleteResult);
+				}
+				break;
+
+			case StorageRequestType::Call:
+				break;
+		}
 
-            if( idleTask == nullptr || esp_task_wdt_add(idleTask) != ESP_OK )
-            {
-                ESP_LOGE(LOG_TAG, "Failed to add Core %d IDLE task to WDT", coreID);
-            }
+		delete request;
+	}
 
-        #endif
+	bool DataStorage::executeAndWait(StorageRequest *request)
+	{
+		request->done = xSemaphoreCreateBinary();
 
-		if(err)
+		if ( request->done == nullptr )
 		{
-			ESP_LOGE(LOG_TAG, "Formatting SPIFFS failed! Error: %d", err);
+			ESP_LOGE(LOG_TAG, "Failed to wait for request for %s", request->fileName.c_str() );
 			return false;
 		}
 
-        ESP_LOGI(LOG_TAG, "Format file system finished..");
+		enqueue(request, StoragePriority::High);
+		xSemaphoreTake(request->done, portMAX_DELAY);
+
+		vSemaphoreDelete(request->done);
+		request->done = nullptr;
 
 		return true;
 	}
+
+	bool DataStorage::isStorageTask() const
+	{
+		return xTaskGetCurrentTaskHandle() == _storageTask.load();
+	}
+
+	bool DataStorage::executeCall(const char *fileName, std::function<void(void)> call)
+	{
+		int64_t			start	= esp_timer_get_time();
+		StorageRequest	request;
+
+		if ( ! _isMounted )
+		{
+			ESP_LOGE(LOG_TAG, "Failed to access %s: storage not mounted", fileName);
+			return false;
+		}
+
+		request.type		= StorageRequestType::Call;
+		request.fileName	= fileName;
+		request.call		= std::move(call);
+
+		bool success = executeAndWait(&request);
+
+		recordLatency(_callerLatency, start);
+		return success;
+	}
+
+	bool DataStorage::listFiles(const char *directory, std::vector<std::string> &fileNames)
+	{
+		bool success = false;
+
+		executeCall(directory, [&]()
+		{
+			success = _backend->listFiles(directory, fileNames);
+		});
+
+		return success;
+	}
 }
@@ -2,23 +2,98 @@
 #define DATASTORAGE_H
 
 #include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+#include "WorkerTask.h"
+#include "StorageBackend.h"
+
+extern "C"
+{
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/semphr.h>
+}
+
+#ifndef DATA_STORAGE_QUEUE_LENGTH
+    #define DATA_STORAGE_QUEUE_LENGTH   16
+#endif
 
 
 namespace _2log
 {
     /**
-     * @brief The DataStorage class provides a basic access to the SPIFFS device storage.
+     * @brief The StoragePriority enum enumerates the priorities of storage requests, in the order they are served
+     */
+    enum class StoragePriority : uint8_t
+    {
+        High    = 0,    ///< used by the synchronous functions, whose caller waits
+        Normal  = 1,
+        Low     = 2     ///< e.g. statistics or logs that may be written late
+    };
+
+    /**
+     * @brief The DataStorage class provides a basic access to the device storage.
+     *
+     * The files are stored by a StorageBackend, SPIFFS unless DATA_STORAGE_BACKEND or setBackend() selects
+     * LittleFS, NVS or a POSIX directory.
+     *
+     * All file operations are executed by a storage task, so a stall of the file system, e.g. a SPIFFS garbage
+     * collection, only blocks the callers that wait for the result. The ...Async() functions queue a request and
+     * return immediately, the completion is called on the storage task. The synchronous functions queue a request
+     * with StoragePriority::High and wait for it. Requests are served by priority and in call order within a
+     * priority, but never before an earlier request for the same file, so a read always sees the preceding writes.
+     * The storage task is stopped when the DataStorage is destroyed, after it has served the queued requests.
      */
 	class DataStorage
 	{
 		public:
 
+            typedef std::function<void(const char* content)>    readCompletionFunction;     ///< content is \c nullptr on failure, valid during the call
+            typedef std::function<void(int bytesWritten)>       writeCompletionFunction;
+            typedef std::function<void(bool success)>           deleteCompletionFunction;
+
+            /**
+             * @brief The LatencyStatistics struct describes a latency distribution in microseconds.
+             *
+             * The percentiles are the upper bounds of power of two buckets, i.e. accurate within a factor of two.
+             */
+            struct LatencyStatistics
+            {
+                uint32_t    count;
+                uint32_t    p50;
+                uint32_t    p90;
+                uint32_t    p99;
+                uint32_t    max;
+            };
+
+            static const int LATENCY_BUCKET_COUNT = 32;
+
             /**
              * @brief Access to the single instance of the DataStore
              * @return the single instance of \c DataStorage
              */
             static DataStorage& getInstance();
 
+            /**
+             * @brief Select the backend, before the first mount()
+             *
+             * @param type  the type of the backend
+             *
+             * @return  true on success
+             * @return  false if the storage is mounted or the backend is not compiled in
+             */
+			bool			setBackend(StorageBackendType type);
+
+			StorageBackendType	getBackendType(void) const;
+
+            /**
+             * @brief Whether the files can also be opened with fopen(), e.g. by the LogStore
+             */
+			bool			hasFileAccess(void) const;
+
             /**
              * @brief Mount the DataStorage on the specified path
              *
@@ -30,7 +105,7 @@ namespace _2log
 			bool			mount(const char* mountPoint);
 
             /**
-             * @brief Unmount the DataStorage
+             * @brief Unmount the DataStorage, after the requests queued before
              *
              * @return  true on success
              * @return  false on failure
@@ -46,6 +121,16 @@ namespace _2log
              */
 			const char*		readTextFile(const char* fileName);
 
+            /**
+             * @brief Read a text file from the DataStorage
+             *
+             * @param fileName  the file to read
+             * @param length    receives the length of the content, which may contain null characters
+             *
+             * @return null-terminated string of the file contents allocated with new[], \c nullptr on failure
+             */
+			const char*		readTextFile(const char* fileName, size_t* length);
+
             /**
              * @brief Write a text file to the DataStorage
              *
@@ -57,6 +142,65 @@ namespace _2log
              */
 			int				writeTextFile(const char* fileName, const char* content);
 
+            /**
+             * @brief Get the size of a file
+             *
+             * @return  the size in bytes, \c -1 if the file does not exist
+             */
+			int				getFileSize(const char* fileName);
+
+            /**
+             * @brief Read a part of a file into a buffer of the caller, binary and without a terminator
+             *
+             * @param fileName  the file to read
+             * @param buffer    receives the data
+             * @param size      the size of the buffer
+             * @param offset    the offset in the file
+             *
+             * @return  the number of bytes read, \c 0 at the end of the file, \c -1 on failure
+             */
+			int				readFile(const char* fileName, void* buffer, size_t size, size_t offset = 0);
+
+            /**
+             * @brief Write binary data to a file
+             *
+             * @param fileName  the file to write
+             * @param data      the data
+             * @param length    the length of the data
+             * @param append    \c true to append to the file instead of replacing it
+             *
+             * @return  the number of bytes written, \c -1 on failure
+             */
+			int				writeFile(const char* fileName, const void* data, size_t length, bool append = false);
+
+            /**
+             * @brief Read a file in chunks, the memory used is bounded by the buffer
+             *
+             * The consumer is called on the storage task while the caller waits, other requests wait as well.
+             *
+             * @param fileName      the file to read
+             * @param buffer        the buffer for a chunk
+             * @param bufferSize    the size of the buffer, the maximum chunk length
+             * @param consumer      called with every chunk, until it returns \c false
+             *
+             * @return  the number of bytes passed to the consumer, \c -1 on failure
+             */
+			int				readFileChunked(const char* fileName, uint8_t* buffer, size_t bufferSize, ChunkReadFunction consumer);
+
+            /**
+             * @brief Write a file in chunks, the memory used is bounded by the buffer
+             *
+             * The producer is called on the storage task while the caller waits, other requests wait as well.
+             *
+             * @param fileName      the file to write
+             * @param buffer        the buffer for a chunk
+             * @param bufferSize    the size of the buffer, the maximum chunk length
+             * @param producer      fills the buffer with the next chunk and returns its length, \c 0 at the end
+             *
+             * @return  the number of bytes written, \c -1 on failure
+             */
+			int				writeFileChunked(const char* fileName, uint8_t* buffer, size_t bufferSize, ChunkWriteFunction producer);
+
             /**
              * @brief Delete a file from the DataStorage
              *
@@ -67,14 +211,132 @@ namespace _2log
              */
 			bool			deleteFile(const char* fileName);
 
+            /**
+             * @brief List the files of a directory of the DataStorage
+             *
+             * @param directory the directory, e.g. "/2log/prop"
+             * @param fileNames receives the names of the files, without the directory
+             *
+             * @return  true if the directory could be read, also if it is empty
+             * @return  false on failure
+             */
+			bool			listFiles(const char* directory, std::vector<std::string>& fileNames);
+
+            /**
+             * @brief Read a text file on the storage task
+             *
+             * @param fileName      the file to read
+             * @param completion    called with the file contents
+             * @param priority      the request priority
+             *
+             * @return  true if the request was queued
+             * @return  false if the queue is full
+             */
+			bool			readTextFileAsync(const char* fileName, readCompletionFunction completion, StoragePriority priority = StoragePriority::Normal);
+
+            /**
+             * @brief Write a text file on the storage task, the content is copied
+             *
+             * @param fileName      the file to write
+             * @param content       null-terminated string
+             * @param completion    called with the result of writeTextFile(), may be empty
+             * @param priority      the request priority
+             *
+             * @return  true if the request was queued
+             * @return  false if the queue is full
+             */
+			bool			writeTextFileAsync(const char* fileName, const char* content, writeCompletionFunction completion = nullptr,
+											   StoragePriority priority = StoragePriority::Normal);
+
+            /**
+             * @brief Delete a file on the storage task
+             *
+             * @param fileName      the file to delete
+             * @param completion    called with the result of deleteFile(), may be empty
+             * @param priority      the request priority
+             *
+             * @return  true if the request was queued
+             * @return  false if the queue is full
+             */
+			bool			deleteFileAsync(const char* fileName, deleteCompletionFunction completion = nullptr,
+											StoragePriority priority = StoragePriority::Normal);
+
+            /**
+             * @brief Get the time the callers of the file functions were blocked, from the call until the return
+             */
+			LatencyStatistics	getCallerLatency(void);
+
+            /**
+             * @brief Get the time the storage task needed per request
+             */
+			LatencyStatistics	getServiceLatency(void);
+
+			void			resetLatencyStatistics(void);
+
 		private:
 
+            /**
+             * @brief The StorageRequestType enum enumerates the operations of the storage task
+             */
+            enum class StorageRequestType : uint8_t
+            {
+                Read,
+                Write,
+                Delete,
+                Call        ///< any other backend function, for a waiting caller
+            };
+
+            /**
+             * @brief The StorageRequest struct is a queued file operation
+             */
+            struct StorageRequest
+            {
+                StorageRequestType          type;
+                uint32_t                    sequence;               ///< call order over all priorities
+                std::string                 fileName;
+                std::string                 content;
+                readCompletionFunction      readCompletion;
+                writeCompletionFunction     writeCompletion;
+                deleteCompletionFunction    deleteCompletion;
+                std::function<void(void)>   call;
+                SemaphoreHandle_t           done = { nullptr };     ///< given instead of calling a completion, for a waiting caller
+                const char*                 readResult = { nullptr };
+                size_t                      readLength = { 0 };
+                int                         writeResult = { 0 };
+                bool                        deleteResult = { false };
+            };
+
             DataStorage();
+            ~DataStorage();
             DataStorage(DataStorage const&)     = delete;
             void operator=(DataStorage const&)  = delete;
 
-            bool	format();
-			bool	_isMounted;
+            void			storageStep(void);
+
+            bool			enqueue(StorageRequest* request, StoragePriority priority);
+            StorageRequest*	nextRequest(void);
+            void			execute(StorageRequest* request);
+            bool			executeAndWait(StorageRequest* request);
+            bool			isStorageTask(void) const;
+            bool			executeCall(const char* fileName, std::function<void(void)> call);
+
+            const char*		readTextFileNow(const char* fileName, size_t* length);
+            int				writeTextFileNow(const char* fileName, const char* content);
+            bool			deleteFileNow(const char* fileName);
+
+			StorageBackend*	_backend = { nullptr };
+			std::atomic<bool>	_isMounted;     ///< cleared by unmount() on the storage task
+			std::atomic<bool>	_taskStarted = { false };
+			WorkerTask*		_ioTask = { nullptr };
+
+            SemaphoreHandle_t                   _queueMutex = { nullptr };
+            SemaphoreHandle_t                   _requestSignal = { nullptr };
+            std::deque<StorageRequest*>         _queues[3];                 ///< one per StoragePriority
+            size_t                              _pendingRequests = { 0 };
+            uint32_t                            _sequence = { 0 };
+            std::atomic<TaskHandle_t>           _storageTask = { nullptr };
+            std::atomic<uint32_t>               _callerLatency[LATENCY_BUCKET_COUNT];
+            std::atomic<uint32_t>               _serviceLatency[LATENCY_BUCKET_COUNT];
 	};
 }
 
@@ -1,9 +1,17 @@
 #include "DeviceNode.h"
 #include "DeviceNodeEventHandler.h"
+#include "MessageArena.h"
+#include "NumberFormatter.h"
+#include "PerfCounters.h"
+#include "AllocationTracker.h"
+
+#include <stdlib.h>
+#include <string.h>
 
 extern "C"
 {
 	#include "esp_log.h"
+	#include "esp_timer.h"
 	#include <freertos/FreeRTOS.h>
 	#include <freertos/task.h>
 }
@@ -14,22 +22,345 @@ namespace _2log
 {
 
 	DeviceNode::DeviceNode(IConnection *connection, DeviceNodeEventHandler *eventHandler, const std::string &nodeType, const std::string &id, const std::string &shortID, const uint32_t authKey)
-		: _connection(connection), _nodeType(nodeType), _id(id), _shortID(shortID), _authKey(authKey), _eventHandler(eventHandler)
+		: IDFix::Task("node_loop"), _connection(connection), _nodeType(nodeType), _id(id), _shortID(shortID), _authKey(authKey), _eventHandler(eventHandler)
 	{
+		_eventQueue		= xQueueCreate(DEVICE_NODE_EVENT_QUEUE_LENGTH, sizeof(NodeEvent) );
+		_loopStopped	= xSemaphoreCreateBinary();
+		_loopStarted	= _eventQueue != nullptr && _loopStopped != nullptr && startTask();
+
+		if ( ! _loopStarted )
+		{
+			ESP_LOGE(DeviceNodeLogTAG, "Failed to start event loop task");
+		}
+
 		_connection->setConnectionEventHandler(this);
 	}
 
 	DeviceNode::~DeviceNode()
 	{
+		// the connection must not post events anymore
+		_connection->setConnectionEventHandler(nullptr);
+
+		if ( _loopStarted )
+		{
+			// queued behind the pending events, which are handled before the loop task exits
+			NodeEvent stopEvent = makeEvent(NodeEventType::Stop);
+
+			xQueueSend(_eventQueue, &stopEvent, portMAX_DELAY);
+			xSemaphoreTake(_loopStopped, portMAX_DELAY);
+		}
+
+		if ( _eventQueue != nullptr )
+		{
+			NodeEvent event;
+
+			// events posted by other tasks after the stop event
+			while ( xQueueReceive(_eventQueue, &event, 0) == pdTRUE )
+			{
+				releaseEvent(event);
+			}
+
+			vQueueDelete(_eventQueue);
+		}
+
+		if ( _loopStopped != nullptr )
+		{
+			vSemaphoreDelete(_loopStopped);
+		}
+
 		delete _connection;
 	}
 
-	bool DeviceNode::setDeviceNodeEventHandler(DeviceNodeEventHandler *newEventHandler)
+	void DeviceNode::run()
 	{
-		_eventHandler = newEventHandler;
+		_loopTask = xTaskGetCurrentTaskHandle();
+
+		NodeEvent event;
+
+		while ( true )
+		{
+			if ( xQueueReceive(_eventQueue, &event, portMAX_DELAY) != pdTRUE )
+			{
+				continue;
+			}
+
+			if ( event.type == NodeEventType::Stop )
+			{
+				break;
+			}
+
+			int64_t startTime	= esp_timer_get_time();
+			uint32_t latency	= static_cast<uint32_t>(startTime - event.timestamp);
+
+			handleEvent(event);
+
+			uint32_t handlingTime = static_cast<uint32_t>(esp_timer_get_time() - startTime);
+
+			_statistics.processedEvents++;
+			_statistics.totalLatency += latency;
+
+			if ( latency > _statistics.maxLatency )
+			{
+				_statistics.maxLatency = latency;
+			}
+
+			if ( handlingTime > _statistics.maxHandlingTime )
+			{
+				_statistics.maxHandlingTime = handlingTime;
+			}
+		}
+
+		_loopTask = nullptr;
+
+		// the node may be gone as soon as it is signalled, delete the task without returning into it
+		xSemaphoreGive(_loopStopped);
+		vTaskDelete(nullptr);
+	}
+
+	bool DeviceNode::isLoopTask() const
+	{
+		return _loopTask.load() == xTaskGetCurrentTaskHandle();
+	}
+
+	DeviceNode::NodeEvent DeviceNode::makeEvent(NodeEventType type)
+	{
+		NodeEvent event;
+		memset(&event, 0, sizeof(event) );
+
+		event.type = type;
+
+		return event;
+	}
+
+	bool DeviceNode::postEvent(NodeEvent &event, TickType_t wait)
+	{
+		event.timestamp = esp_timer_get_time();
+
+		// the loop task must not wait for itself
+		if ( isLoopTask() )
+		{
+			handleEvent(event);
+			return true;
+		}
+
+		if ( _eventQueue == nullptr || xQueueSend(_eventQueue, &event, wait) != pdTRUE )
+		{
+			_rejectedEvents++;
+			releaseEvent(event);
+			return false;
+		}
+
+		return true;
+	}
+
+	void DeviceNode::releaseEvent(NodeEvent &event)
+	{
+		AllocationTracker::release(event.property);
+
+		switch ( event.type )
+		{
+			case NodeEventType::SetProperty:
+				if ( event.propertyType == PropertyType::String && event.textValue == 0 )
+				{
+					AllocationTracker::release(event.value.string);
+				}
+				break;
+
+			case NodeEventType::SendData:
+				AllocationTracker::release(event.value.string);
+				break;
+
+			case NodeEventType::JsonReceived:
+			case NodeEventType::SetProperties:
+				cJSON_Delete(event.value.json);
+				break;
+
+			default:
+				break;
+		}
+
+		delete event.callback;
+		releaseCompletion(event.completion);
+
+		event.property		= nullptr;
+		event.callback		= nullptr;
+		event.completion	= nullptr;
+	}
+
+	bool DeviceNode::copyText(NodeEvent &event, const char *property)
+	{
+		const char	*string		= event.propertyType == PropertyType::String ? event.value.string : nullptr;
+		size_t		keySize		= strlen(property) + 1;
+
+		// from here on a string value is owned by the event
+		if ( string != nullptr )
+		{
+			event.value.string = nullptr;
+		}
+
+		if ( keySize <= sizeof(event.text) )
+		{
+			memcpy(event.text, property, keySize);
+			event.textKey = true;
+		}
+		else if ( ( event.property = AllocationTracker::duplicate(property) ) == nullptr )
+		{
+			return false;
+		}
+
+		if ( string != nullptr )
+		{
+			size_t valueSize = strlen(string) + 1;
+
+			if ( event.textKey && keySize + valueSize <= sizeof(event.text) )
+			{
+				memcpy(event.text + keySize, string, valueSize);
+				event.textValue = static_cast<uint8_t>(keySize);
+			}
+			else if ( ( event.value.string = AllocationTracker::duplicate(string) ) == nullptr )
+			{
+				return false;
+			}
+		}
+
+		event.key = event.property;
+		bindText(event);
+
 		return true;
 	}
 
+	void DeviceNode::bindText(NodeEvent &event)
+	{
+		if ( event.textKey )
+		{
+			event.key = event.text;
+		}
+
+		if ( event.textValue > 0 )
+		{
+			event.value.string = event.text + event.textValue;
+		}
+	}
+
+	sendCompletionFunction *DeviceNode::acquireCompletion(sendCompletionFunction &&completion)
+	{
+		uint32_t used = _usedCompletions.load();
+
+		for ( size_t slot = 0; slot < COMPLETION_POOL_SIZE; slot++ )
+		{
+			uint32_t bit = static_cast<uint32_t>(1) << slot;
+
+			// a failed exchange updates used, the slot is tried again with the current value
+			while ( ( used & bit ) == 0 )
+			{
+				if ( _usedCompletions.compare_exchange_weak(used, used | bit) )
+				{
+					_completions[slot] = std::move(completion);
+					return &_completions[slot];
+				}
+			}
+		}
+
+		return new sendCompletionFunction(std::move(completion) );
+	}
+
+	void DeviceNode::releaseCompletion(sendCompletionFunction *completion)
+	{
+		if ( completion >= &_completions[0] && completion < &_completions[COMPLETION_POOL_SIZE] )
+		{
+			*completion = nullptr;
+			_usedCompletions &= ~( static_cast<uint32_t>(1) << ( completion - &_completions[0] ) );
+
+			return;
+		}
+
+		delete completion;
+	}
+
+	void DeviceNode::handleEvent(NodeEvent &event)
+	{
+		ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceNode);
+
+		// everything cJSON allocates while handling a single event is temporary
+		MessageArena::Scope arenaScope;
+
+		// the event was copied out of the queue
+		bindText(event);
+
+		switch ( event.type )
+		{
+			case NodeEventType::Connected:
+				handleConnected();
+				break;
+
+			case NodeEventType::Disconnected:
+				handleDisconnected();
+				break;
+
+			case NodeEventType::JsonReceived:
+				handleJsonMessage(event.value.json);
+				break;
+
+			case NodeEventType::SetProperty:
+				publishProperty(event);
+				break;
+
+			case NodeEventType::SetProperties:
+				publishProperties(event.value.json, event.completion ? *event.completion : nullptr, event.priority);
+				break;
+
+			case NodeEventType::SendData:
+				publishData(event.value.string);
+				break;
+
+			case NodeEventType::RegisterRPC:
+				_rpcCallbacks[event.key] = *event.callback;
+				break;
+
+			case NodeEventType::RegisterInitProperties:
+				_initPropertiesCallback = *event.callback;
+				break;
+
+			case NodeEventType::SetEventHandler:
+				_eventHandler = event.value.handler;
+				break;
+
+			case NodeEventType::SetPrecision:
+				_propertyPrecisions[event.key] = event.value.decimals;
+				break;
+
+			case NodeEventType::SetPriority:
+				_propertyPriorities[event.key] = event.priority;
+				break;
+
+			case NodeEventType::DeclareScale:
+				_propertyScales[event.key] = event.value.decimals;
+				break;
+
+			case NodeEventType::Stop:
+				// handled by run()
+				break;
+		}
+
+		releaseEvent(event);
+	}
+
+	DeviceNode::EventLoopStatistics DeviceNode::getEventLoopStatistics() const
+	{
+		EventLoopStatistics statistics = _statistics;
+		statistics.rejectedEvents = _rejectedEvents.load();
+
+		return statistics;
+	}
+
+	bool DeviceNode::setDeviceNodeEventHandler(DeviceNodeEventHandler *newEventHandler)
+	{
+		NodeEvent event = makeEvent(NodeEventType::SetEventHandler);
+		event.value.handler = newEventHandler;
+
+		return postEvent(event, portMAX_DELAY);
+	}
+
 	bool DeviceNode::connect(uint32_t delayTime)
 	{
 		return _connection->connect(delayTime);
@@ -42,19 +373,48 @@ namespace _2log
 
 	void DeviceNode::registerInitPropertiesCallback(DeviceNode::jsonCallbackFunction callbackFunction)
 	{
-		_initPropertiesCallback = callbackFunction;
+		NodeEvent event = makeEvent(NodeEventType::RegisterInitProperties);
+		event.callback = new jsonCallbackFunction(callbackFunction);
+
+		postEvent(event, portMAX_DELAY);
 	}
 
 	void DeviceNode::registerRPC(const char *name, jsonCallbackFunction callback)
 	{
 		ESP_LOGD(DeviceNodeLogTAG, "DeviceNode::registerRPC");
-		_rpcCallbacks[name] = callback;
+
+		NodeEvent event = makeEvent(NodeEventType::RegisterRPC);
+		event.key		= name;
+		event.callback	= new jsonCallbackFunction(callback);
+
+		postEvent(event, portMAX_DELAY);
 	}
 
 	bool DeviceNode::sendData(const char *subject)
 	{
 		ESP_LOGV(DeviceNodeLogTAG, "DeviceNode::sendData: %s running in Task %s", subject, pcTaskGetTaskName(NULL) );
 
+		ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceNode);
+
+		if ( isLoopTask() )
+		{
+			return publishData(subject);
+		}
+
+		NodeEvent event = makeEvent(NodeEventType::SendData);
+		event.value.string = AllocationTracker::duplicate(subject);
+
+		if ( event.value.string == nullptr )
+		{
+			ESP_LOGE(DeviceNodeLogTAG, "duplicate failed - subject");
+			return false;
+		}
+
+		return postEvent(event, 0);
+	}
+
+	bool DeviceNode::publishData(const char *subject)
+	{
 		cJSON *payload = cJSON_CreateObject();
 
 		if (cJSON_AddStringToObject(payload, "cmd", "msg") == nullptr)
@@ -87,9 +447,61 @@ namespace _2log
 		return success;
 	}
 
+	size_t DeviceNode::getSendBacklog() const
+	{
+		return _connection->getBacklogSize();
+	}
+
 	void DeviceNode::connected()
+	{
+		NodeEvent event = makeEvent(NodeEventType::Connected);
+
+		if ( ! postEvent(event, pdMS_TO_TICKS(DEVICE_NODE_EVENT_POST_TIMEOUT_MS) ) )
+		{
+			ESP_LOGE(DeviceNodeLogTAG, "Failed to post connected event");
+		}
+	}
+
+	void DeviceNode::disconnected()
+	{
+		NodeEvent event = makeEvent(NodeEventType::Disconnected);
+
+		if ( ! postEvent(event, pdMS_TO_TICKS(DEVICE_NODE_EVENT_POST_TIMEOUT_MS) ) )
+		{
+			ESP_LOGE(DeviceNodeLogTAG, "Failed to post disconnected event");
+		}
+	}
+
+	void DeviceNode::jsonReceived(const cJSON* jsonMessage)
+	{
+		ESP_LOGV(DeviceNodeLogTAG, "jsonReceived() running in Task %s", pcTaskGetTaskName(NULL) );
+
+		ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceNode);
+
+		NodeEvent event = makeEvent(NodeEventType::JsonReceived);
+
+		{
+			// the message lives in the arena scope of the connection, the copy has to outlive it
+			MessageArena::Suspend arenaSuspend;
+			event.value.json = cJSON_Duplicate(jsonMessage, true);
+		}
+
+		if ( event.value.json == nullptr )
+		{
+			ESP_LOGE(DeviceNodeLogTAG, "cJSON_Duplicate failed");
+			return;
+		}
+
+		if ( ! postEvent(event, pdMS_TO_TICKS(DEVICE_NODE_EVENT_POST_TIMEOUT_MS) ) )
+		{
+			ESP_LOGE(DeviceNodeLogTAG, "Failed to post received message");
+		}
+	}
+
+	void DeviceNode::handleConnected()
 	{
         _isConnected = true;
+
 		cJSON *registerObject = cJSON_CreateObject();
 
 		registerNode(registerObject);
@@ -98,22 +510,24 @@ namespace _2log
 
 		if ( _eventHandler )
 		{
+			MessageArena::Suspend arenaSuspend;
 			_eventHandler->deviceNodeConnected();
 		}
 	}
 
-	void DeviceNode::disconnected()
+	void DeviceNode::handleDisconnected()
 	{
         _isConnected = false;
 		if ( _eventHandler )
 		{
+			MessageArena::Suspend arenaSuspend;
 			_eventHandler->deviceNodeDisconnected();
 		}
 	}
 
-	void DeviceNode::jsonReceived(const cJSON* jsonMessage)
+	void DeviceNode::handleJsonMessage(const cJSON* jsonMessage)
 	{
-		ESP_LOGV(DeviceNodeLogTAG, "jsonReceived() running in Task %s", pcTaskGetTaskName(NULL) );
+		ESP_LOGV(DeviceNodeLogTAG, "handleJsonMessage() running in Task %s", pcTaskGetTaskName(NULL) );
 
 		cJSON *cmdItem = cJSON_GetObjectItemCaseSensitive(jsonMessage, "cmd");
 
@@ -172,6 +586,7 @@ namespace _2log
 
 				if ( _eventHandler )
 				{
+					MessageArena::Suspend arenaSuspend;
 					_eventHandler->deviceNodeAuthKeyChanged(authKey);
 				}
 			}
@@ -188,11 +603,19 @@ namespace _2log
 	{
 		ESP_LOGD(DeviceNodeLogTAG, "DeviceNode::callRPC(%s)", name);
 
-		jsonCallbackFunction callback = _rpcCallbacks[name];
+		// find() instead of operator[], which would insert an empty callback for unknown names
+		auto callback = _rpcCallbacks.end();
+
+		{
+			PERF_SCOPE(PerfProbe::NodeCallRPC);
+			callback = _rpcCallbacks.find(name);
+		}
 
-		if ( callback )
+		if ( callback != _rpcCallbacks.end() && callback->second )
 		{
-			callback(argument);
+			// the argument stays in the arena, everything the callback allocates may outlive the message
+			MessageArena::Suspend arenaSuspend;
+			callback->second(argument);
 		}
 		else
 		{
@@ -204,6 +627,8 @@ namespace _2log
 	{
 		ESP_LOGD(DeviceNodeLogTAG, "DeviceNode::registerNode()");
 
+		PERF_SCOPE(PerfProbe::NodeRegister);
+
 		if (cJSON_AddStringToObject(registerObject, "command", "node:register") == nullptr)
 		{
 			ESP_LOGE(DeviceNodeLogTAG, "cJSON_AddStringToObject failed - command: \"node:register\"");
@@ -267,6 +692,25 @@ namespace _2log
 		}
 
 
+		if ( ! _propertyScales.empty() )
+		{
+			cJSON *scalesObject = cJSON_AddObjectToObject(parametersObject, "scales");
+
+			if ( scalesObject == nullptr || ! cJSON_IsObject(scalesObject) )
+			{
+				ESP_LOGE(DeviceNodeLogTAG, "cJSON_AddObjectToObject failed - creating scales object");
+				return;
+			}
+
+			for ( auto scale : _propertyScales )
+			{
+				if ( cJSON_AddNumberToObject(scalesObject, scale.first, scale.second) == nullptr )
+				{
+					ESP_LOGE(DeviceNodeLogTAG, "cJSON_AddNumberToObject failed - scale: %s", scale.first);
+				}
+			}
+		}
+
 		if ( _initPropertiesCallback )
 		{
 			cJSON *propertiesObject = cJSON_AddObjectToObject(parametersObject, "properties");
@@ -277,121 +721,295 @@ namespace _2log
 			}
 			else
 			{
+				MessageArena::Suspend arenaSuspend;
 				_initPropertiesCallback(propertiesObject);
 			}
 		}
 
-		_connection->sendPayload(registerObject);
+		_connection->sendPayloadAsync(registerObject, nullptr, SendPriority::Control);
 	}
 
-	void DeviceNode::setProperty(const char *property, int value)
+	SendStatus DeviceNode::postProperty(NodeEvent &event, const char *property, sendCompletionFunction completion)
 	{
+		ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceNode);
+
         if ( !_isConnected )
         {
-            return;
+            return SendStatus::Dropped;
         }
 
-		ESP_LOGD(DeviceNodeLogTAG, "DeviceNode::setProperty()");
-		cJSON *parametersObject = cJSON_CreateObject();
+		if ( isLoopTask() )
+		{
+			// called from a RPC or init callback: publish right away and report the real status, the caller's
+			// strings are valid until then
+			event.key			= property;
+			event.completion	= completion ? &completion : nullptr;
+
+			return publishProperty(event);
+		}
 
-		if ( cJSON_AddNumberToObject(parametersObject, property, value) == nullptr )
+		if ( ! copyText(event, property) )
 		{
-			ESP_LOGE(DeviceNodeLogTAG, "cJSON_AddNumberToObject failed - property: %s", property);
-			cJSON_Delete(parametersObject);
-			return;
+			ESP_LOGE(DeviceNodeLogTAG, "duplicate failed - property: %s", property);
+			releaseEvent(event);
+			return SendStatus::Dropped;
 		}
 
-		setProperties(parametersObject);
+		if ( completion )
+		{
+			event.completion = acquireCompletion(std::move(completion) );
+		}
 
-		cJSON_Delete(parametersObject);
+		if ( ! postEvent(event, 0) )
+		{
+			ESP_LOGW(DeviceNodeLogTAG, "event queue full - property: %s", property);
+			return SendStatus::RejectedFull;
+		}
+
+		return SendStatus::Queued;
 	}
 
+	SendStatus DeviceNode::setProperty(const char *property, int value, sendCompletionFunction completion)
+	{
+		ESP_LOGD(DeviceNodeLogTAG, "DeviceNode::setProperty()");
+
+		NodeEvent event = makeEvent(NodeEventType::SetProperty);
+		event.propertyType	= PropertyType::Integer;
+		event.value.integer	= value;
 
-    void DeviceNode::setProperty(const char *property, const char* value)
+		return postProperty(event, property, completion);
+	}
+
+    SendStatus DeviceNode::setProperty(const char *property, const char* value, sendCompletionFunction completion)
     {
-        if ( !_isConnected )
-        {
-            return;
-        }
+        ESP_LOGD(DeviceNodeLogTAG, "DeviceNode::setProperty()");
+
+        NodeEvent event = makeEvent(NodeEventType::SetProperty);
+        event.propertyType  = PropertyType::String;
+        event.value.string  = const_cast<char*>(value != nullptr ? value : "");
+
+        return postProperty(event, property, completion);
+    }
+
+    SendStatus DeviceNode::setProperty(const char *property, bool value, sendCompletionFunction completion)
+    {
+        ESP_LOGD(DeviceNodeLogTAG, "DeviceNode::setProperty()");
+
+        NodeEvent event = makeEvent(NodeEventType::SetProperty);
+        event.propertyType  = PropertyType::Bool;
+        event.value.boolean = value;
+
+        return postProperty(event, property, completion);
+    }
 
+    SendStatus DeviceNode::setProperty(const char *property, float value, sendCompletionFunction completion)
+    {
         ESP_LOGD(DeviceNodeLogTAG, "DeviceNode::setProperty()");
+
+        NodeEvent event = makeEvent(NodeEventType::SetProperty);
+        event.propertyType  = PropertyType::Float;
+        event.value.real    = value;
+
+        return postProperty(event, property, completion);
+    }
+
+    SendStatus DeviceNode::setScaledProperty(const char *property, int32_t value, sendCompletionFunction completion)
+    {
+        ESP_LOGD(DeviceNodeLogTAG, "DeviceNode::setScaledProperty()");
+
+        NodeEvent event = makeEvent(NodeEventType::SetProperty);
+        event.propertyType  = PropertyType::Scaled;
+        event.value.scaled  = value;
+
+        return postProperty(event, property, completion);
+    }
+
+    SendStatus DeviceNode::publishProperty(const NodeEvent &event)
+    {
+        PERF_SCOPE(PerfProbe::NodeSetProperty);
+
+        const char *property = event.key;
+
+        // format numbers ourselves, cJSON would print "%1.15g" and verify the result with sscanf
+        char valueString[NumberFormatter::BUFFER_SIZE];
+
         cJSON *parametersObject = cJSON_CreateObject();
+        cJSON *valueItem        = nullptr;
 
-        if ( cJSON_AddStringToObject(parametersObject, property, value) == nullptr )
+        switch ( event.propertyType )
         {
-            ESP_LOGE(DeviceNodeLogTAG, "cJSON_AddNumberToObject failed - property: %s", property);
-            cJSON_Delete(parametersObject);
-            return;
+            case PropertyType::Integer:
+                valueItem = cJSON_AddNumberToObject(parametersObject, property, event.value.integer);
+                break;
+
+            case PropertyType::String:
+                valueItem = cJSON_AddStringToObject(parametersObject, property, event.value.string);
+                break;
+
+            case PropertyType::Bool:
+                valueItem = cJSON_AddBoolToObject(parametersObject, property, event.value.boolean);
+                break;
+
+            case PropertyType::Float:
+            {
+                auto precision = _propertyPrecisions.find(property);
+
+                if ( precision != _propertyPrecisions.end() )
+                {
+                    NumberFormatter::formatFixed(event.value.real, precision->second, valueString);
+                }
+                else
+                {
+                    NumberFormatter::formatFloat(event.value.real, valueString);
+                }
+
+                valueItem = cJSON_AddRawToObject(parametersObject, property, valueString);
+                break;
+            }
+
+            case PropertyType::Scaled:
+                if ( _propertyScales.count(property) == 0 )
+                {
+                    ESP_LOGW(DeviceNodeLogTAG, "scaled property %s was not declared", property);
+                }
+
+                // the scale is known to the server, so only the raw integer goes on the wire
+                NumberFormatter::formatInteger(event.value.scaled, valueString);
+                valueItem = cJSON_AddRawToObject(parametersObject, property, valueString);
+                break;
         }
 
-        setProperties(parametersObject);
+        SendStatus status = SendStatus::Dropped;
+
+        if ( valueItem == nullptr )
+        {
+            ESP_LOGE(DeviceNodeLogTAG, "failed to add property value - property: %s", property);
+        }
+        else
+        {
+            status = publishProperties(parametersObject, event.completion ? *event.completion : nullptr, getPropertyPriority(property) );
+        }
 
         cJSON_Delete(parametersObject);
+
+        return status;
     }
 
-    void DeviceNode::setProperty(const char *property, bool value)
+    void DeviceNode::setPropertyPrecision(const char *property, uint8_t decimals)
     {
-        if ( !_isConnected )
+        if ( decimals > NumberFormatter::MAX_DECIMALS )
         {
-            return;
+            ESP_LOGW(DeviceNodeLogTAG, "precision of %s limited to %u decimals", property, NumberFormatter::MAX_DECIMALS);
+            decimals = NumberFormatter::MAX_DECIMALS;
         }
 
-        ESP_LOGI(DeviceNodeLogTAG, "DeviceNode::setProperty()");
-        cJSON *parametersObject = cJSON_CreateObject();
+        NodeEvent event = makeEvent(NodeEventType::SetPrecision);
+        event.key               = property;
+        event.value.decimals    = decimals;
 
-        if ( cJSON_AddBoolToObject(parametersObject, property, value) == nullptr )
-        {
-            ESP_LOGI(DeviceNodeLogTAG, "cJSON_AddBoolToObject failed - property: %s", property);
-            cJSON_Delete(parametersObject);
-            return;
-        }
+        postEvent(event, portMAX_DELAY);
+    }
 
-        setProperties(parametersObject);
+    void DeviceNode::setPropertyPriority(const char *property, SendPriority priority)
+    {
+        NodeEvent event = makeEvent(NodeEventType::SetPriority);
+        event.key       = property;
+        event.priority  = priority;
 
-        cJSON_Delete(parametersObject);
+        postEvent(event, portMAX_DELAY);
     }
 
-    void DeviceNode::setProperty(const char *property, float value)
+    SendPriority DeviceNode::getPropertyPriority(const char *property) const
     {
-        if ( !_isConnected )
+        auto priority = _propertyPriorities.find(property);
+
+        if ( priority != _propertyPriorities.end() )
         {
-            return;
+            return priority->second;
         }
 
-        ESP_LOGD(DeviceNodeLogTAG, "DeviceNode::setProperty()");
-        cJSON *parametersObject = cJSON_CreateObject();
+        return SendPriority::State;
+    }
+
+    void DeviceNode::declareScaledProperty(const char *property, uint8_t decimals)
+    {
+        NodeEvent event = makeEvent(NodeEventType::DeclareScale);
+        event.key               = property;
+        event.value.decimals    = decimals;
 
-        if ( cJSON_AddNumberToObject(parametersObject, property, value) == nullptr )
+        postEvent(event, portMAX_DELAY);
+    }
+
+	SendStatus DeviceNode::setProperties(cJSON *parameters, sendCompletionFunction completion, SendPriority priority)
+	{
+		ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceNode);
+
+		if ( isLoopTask() )
+		{
+			return publishProperties(parameters, completion, priority);
+		}
+
+        if ( !_isConnected )
         {
-            ESP_LOGE(DeviceNodeLogTAG, "cJSON_AddNumberToObject failed - property: %s", property);
-            cJSON_Delete(parametersObject);
-            return;
+            return SendStatus::Dropped;
         }
 
-        setProperties(parametersObject);
+		NodeEvent event = makeEvent(NodeEventType::SetProperties);
 
-        cJSON_Delete(parametersObject);
-    }
+		{
+			// the parameters are owned by the caller, the loop task works on its own copy
+			MessageArena::Suspend arenaSuspend;
+			event.value.json = cJSON_Duplicate(parameters, true);
+		}
+
+		if ( event.value.json == nullptr )
+		{
+			ESP_LOGE(DeviceNodeLogTAG, "cJSON_Duplicate failed");
+			return SendStatus::Dropped;
+		}
 
-	void DeviceNode::setProperties(cJSON *parameters)
+		event.priority = priority;
+
+		if ( completion )
+		{
+			event.completion = acquireCompletion(std::move(completion) );
+		}
+
+		if ( ! postEvent(event, 0) )
+		{
+			return SendStatus::RejectedFull;
+		}
+
+		return SendStatus::Queued;
+	}
+
+	SendStatus DeviceNode::publishProperties(cJSON *parameters, sendCompletionFunction completion, SendPriority priority)
 	{
-        ESP_LOGI(DeviceNodeLogTAG, "DeviceNode::setProperties()");
+        ESP_LOGD(DeviceNodeLogTAG, "DeviceNode::publishProperties()");
 		cJSON *payload = cJSON_CreateObject();
 
 		if ( cJSON_AddStringToObject(payload, "cmd", "set") == nullptr )
 		{
 			ESP_LOGE(DeviceNodeLogTAG, "cJSON_AddStringToObject(payload, \"cmd\", \"set\") failed");
 			cJSON_Delete(payload);
-			return;
+			return SendStatus::Dropped;
 		}
 
 		// add payload as reference(!) so it won't be deleted by cJSON_Delete
 		// payload is owned by caller and should be deleted there
 		cJSON_AddItemReferenceToObject(payload, "params", parameters);
 
-		_connection->sendPayload(payload);
+		SendStatus status = _connection->sendPayloadAsync(payload, completion, priority);
 
 		cJSON_Delete(payload);
+
+		// the connection only reports the status of queued frames to the completion callback
+		if ( status != SendStatus::Queued && completion )
+		{
+			completion(status);
+		}
+
+		return status;
 	}
 
 }
@@ -3,11 +3,32 @@
 
 #include <functional>
 #include <map>
+#include <atomic>
 #include "StringComparison.h"
 #include "ConnectionEventHandler.h"
 #include "IConnection.h"
 #include "IDeviceNode.h"
 #include "DeviceSettings.h"
+#include "IDFixTask.h"
+
+extern "C"
+{
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/queue.h>
+    #include <freertos/semphr.h>
+}
+
+#ifndef DEVICE_NODE_EVENT_QUEUE_LENGTH
+    #define DEVICE_NODE_EVENT_QUEUE_LENGTH      16
+#endif
+
+#ifndef DEVICE_NODE_EVENT_POST_TIMEOUT_MS
+    #define DEVICE_NODE_EVENT_POST_TIMEOUT_MS   1000
+#endif
+
+#ifndef DEVICE_NODE_EVENT_TEXT_SIZE
+    #define DEVICE_NODE_EVENT_TEXT_SIZE         48
+#endif
 
 struct cJSON;
 
@@ -17,11 +38,34 @@ namespace _2log
 
     /**
      * @brief The DeviceNode class represents a device on the QuickHub instance
+     *
+     * All node state is owned by a single event loop task. The public functions and the connection callbacks
+     * only post events into a bounded queue, which the loop task handles one after another. RPC callbacks, the
+     * init properties callback and the DeviceNodeEventHandler are called on the loop task. Calls made from the
+     * loop task itself, e.g. setProperty() inside a RPC callback, are handled immediately.
+     *
+     * setProperty() never blocks: if the queue is full the value is rejected with \c SendStatus::RejectedFull.
+     * Configuration calls wait for free queue space, connection events wait up to DEVICE_NODE_EVENT_POST_TIMEOUT_MS.
+     *
+     * The destructor stops the loop task and releases the events that are still queued, it must not be called on
+     * the loop task, e.g. from a RPC callback.
      */
-	class DeviceNode : public IDeviceNode, public ConnectionEventHandler
+	class DeviceNode : public IDeviceNode, public ConnectionEventHandler, private IDFix::Task
 	{
 		public:
 
+            /**
+             * @brief The EventLoopStatistics struct summarizes the event loop activity since the node was created
+             */
+            struct EventLoopStatistics
+            {
+                uint32_t    processedEvents;        ///< number of events handled by the loop task
+                uint32_t    rejectedEvents;         ///< number of events that did not fit into the queue
+                uint32_t    maxLatency;             ///< maximum time between posting and handling an event in microseconds
+                uint64_t    totalLatency;           ///< sum of all event latencies in microseconds
+                uint32_t    maxHandlingTime;        ///< maximum time spent handling a single event in microseconds
+            };
+
             /**
              * @brief Constructs a new DeviceNode
              * @param connection    the connection to the QuickHub instance
@@ -60,12 +104,24 @@ namespace _2log
 
             /**
              * @brief Register a callback function to initially set the properties of the device
+             *
+             * The callback runs on the loop task of the node. The properties object belongs to the registration
+             * message and must not be used after the callback returned. cJSON data the callback allocates is not
+             * part of the message arena and may be kept, strings of cJSON_Print() have to be released with
+             * cJSON_free().
+             *
              * @param callbackFunction  the callback to call upon the initialization
              */
 			virtual void	registerInitPropertiesCallback(jsonCallbackFunction callbackFunction) override;
 
             /**
              * @brief Register a RPC callback for this device
+             *
+             * The callback runs on the loop task of the node. Its argument belongs to the received message and must
+             * not be used after the callback returned, keep a cJSON_Duplicate() of it instead. cJSON data the
+             * callback allocates is not part of the message arena and may be kept, strings of cJSON_Print() have
+             * to be released with cJSON_free().
+             *
              * @param name      the RPC name
              * @param callback  the RPC callback function
              */
@@ -78,39 +134,106 @@ namespace _2log
              */
 			virtual bool	sendData(const char *subject) override;
 
+            /**
+             * @brief Get the number of bytes waiting to be sent to the QuickHub server
+             *
+             * Producers can use the backlog to adapt their sampling rate to the available bandwidth.
+             *
+             * @return  the send backlog in bytes
+             */
+			virtual size_t	getSendBacklog(void) const override;
+
             /**
              * @brief Send a changed property value to the QuickHub server
              * @param property  the property name
              * @param value     the property value
+             * @param completion  optional callback that receives the final send status
+             * @return  \c Queued if the value was queued for sending, otherwise the reason why it was not
              */
-			virtual void	setProperty(const char* property, int value) override;
+			virtual SendStatus  setProperty(const char* property, int value, sendCompletionFunction completion = nullptr) override;
 
             /**
              * @brief Send a changed property value to the QuickHub server
              * @param property  the property name
              * @param value     the property value
+             * @param completion  optional callback that receives the final send status
+             * @return  \c Queued if the value was queued for sending, otherwise the reason why it was not
              */
-            virtual void	setProperty(const char* property, float value) override;
+            virtual SendStatus  setProperty(const char* property, float value, sendCompletionFunction completion = nullptr) override;
 
             /**
              * @brief Send a changed property value to the QuickHub server
              * @param property  the property name
              * @param value     the property value
+             * @param completion  optional callback that receives the final send status
+             * @return  \c Queued if the value was queued for sending, otherwise the reason why it was not
              */
-            virtual void    setProperty(const char *property, const char* value) override;
+            virtual SendStatus  setProperty(const char *property, const char* value, sendCompletionFunction completion = nullptr) override;
 
             /**
              * @brief Send a changed property value to the QuickHub server
              * @param property  the property name
              * @param value     the property value
+             * @param completion  optional callback that receives the final send status
+             * @return  \c Queued if the value was queued for sending, otherwise the reason why it was not
+             */
+            virtual SendStatus  setProperty(const char *property, bool value, sendCompletionFunction completion = nullptr) override;
+
+            /**
+             * @brief Send float values of a property rounded to a fixed number of decimals
+             * @param property  the property name, must stay valid for the lifetime of the node (e.g. a string literal)
+             * @param decimals  the number of decimals to send
+             */
+            virtual void    setPropertyPrecision(const char *property, uint8_t decimals) override;
+
+            /**
+             * @brief Send updates of a property on another outbound lane than \c SendPriority::State
+             *
+             * Use \c SendPriority::Bulk for high rate or sampled data, so it can not delay protocol messages and
+             * regular state updates, or \c SendPriority::RPCResult for properties that answer an RPC call.
+             *
+             * @param property  the property name, must stay valid for the lifetime of the node (e.g. a string literal)
+             * @param priority  the outbound lane for this property
              */
-            virtual void    setProperty(const char *property, bool value) override;
+            virtual void    setPropertyPriority(const char *property, SendPriority priority) override;
+
+            /**
+             * @brief Declare a property as scaled integer with the resolution 10^-decimals
+             *
+             * The scale is sent to the server during registration, afterwards only the raw integer is sent.
+             *
+             * @param property  the property name, must stay valid for the lifetime of the node (e.g. a string literal)
+             * @param decimals  the number of implied decimals, e.g. 2 for a value in 0.01 units
+             */
+            virtual void    declareScaledProperty(const char *property, uint8_t decimals) override;
+
+            /**
+             * @brief Send a changed scaled integer property value to the QuickHub server
+             * @param property  the property name, previously declared with declareScaledProperty()
+             * @param value     the raw property value in units of 10^-decimals
+             * @param completion  optional callback that receives the final send status
+             * @return  \c Queued if the value was queued for sending, otherwise the reason why it was not
+             */
+            virtual SendStatus  setScaledProperty(const char *property, int32_t value, sendCompletionFunction completion = nullptr) override;
 
             /**
              * @brief Send changed propertie values to the QuickHub server
              * @param parameters    the changed properties as cJSON object
+             * @param completion    optional callback that receives the final send status
+             * @param priority      the outbound lane to use
+             * @return  \c Queued if the values were queued for sending, otherwise the reason why they were not
              */
-			void			setProperties(cJSON *parameters);
+			SendStatus		setProperties(cJSON *parameters, sendCompletionFunction completion = nullptr,
+										  SendPriority priority = SendPriority::State);
+
+            /**
+             * @brief Get the event loop statistics
+             *
+             * The values are updated by the loop task without locking, so they are only a snapshot.
+             *
+             * @return  a copy of the current statistics
+             */
+			EventLoopStatistics	getEventLoopStatistics(void) const;
 
             /**
              * @brief Handles the connection connected event
@@ -129,6 +252,193 @@ namespace _2log
 
 		private:
 
+            /**
+             * @brief The NodeEventType enum enumerates the events handled by the loop task
+             */
+			enum class NodeEventType : uint8_t
+			{
+				Connected,
+				Disconnected,
+				JsonReceived,
+				SetProperty,
+				SetProperties,
+				SendData,
+				RegisterRPC,
+				RegisterInitProperties,
+				SetEventHandler,
+				SetPrecision,
+				SetPriority,
+				DeclareScale,
+				Stop
+			};
+
+            /**
+             * @brief The PropertyType enum enumerates the value types of a SetProperty event
+             */
+			enum class PropertyType : uint8_t
+			{
+				Integer,
+				Float,
+				String,
+				Bool,
+				Scaled
+			};
+
+            /**
+             * @brief The NodeEvent struct is a message to the loop task.
+             *
+             * Events are copied into the FreeRTOS queue, so they only hold plain data. Strings, cJSON items and
+             * callbacks are copies owned by the event and released by releaseEvent(). The name and a short string
+             * value of a SetProperty event are copied into the text of the event, longer ones to the heap. The
+             * completion callback is a slot of the completion pool of the node, or a heap copy if all are in use.
+             */
+			struct NodeEvent
+			{
+				NodeEventType				type;
+				PropertyType				propertyType;
+				int64_t						timestamp;			///< esp_timer time when the event was posted
+				const char*					key;				///< caller owned name (RPC, precision, priority, scale) or the property name
+				char*						property;			///< heap copy of a property name that does not fit into the text
+				SendPriority				priority;			///< the outbound lane (SetProperties, SetPriority)
+				bool						textKey;			///< the property name is stored in the text
+				uint8_t						textValue;			///< offset of the string value in the text, 0 if it is a heap copy
+				union
+				{
+					int						integer;
+					float					real;
+					bool					boolean;
+					int32_t					scaled;
+					uint8_t					decimals;
+					char*					string;
+					cJSON*					json;
+					DeviceNodeEventHandler*	handler;
+				}							value;
+				jsonCallbackFunction*		callback;
+				sendCompletionFunction*		completion;
+				char						text[DEVICE_NODE_EVENT_TEXT_SIZE];
+			};
+
+			static_assert(DEVICE_NODE_EVENT_TEXT_SIZE <= UINT8_MAX, "the text offsets of a NodeEvent are 8 bit");
+
+            /**
+             * @brief Number of completion callbacks the node keeps without heap allocations, one per queued event
+             * and one for the event being handled
+             */
+			static const size_t COMPLETION_POOL_SIZE = DEVICE_NODE_EVENT_QUEUE_LENGTH < 32 ? DEVICE_NODE_EVENT_QUEUE_LENGTH + 1 : 32;
+
+            /**
+             * @brief The event loop
+             */
+			virtual void	run(void) override;
+
+            /**
+             * @brief Check if the calling task is the loop task
+             * @return  \c true if called on the loop task, \c false otherwise
+             */
+			bool			isLoopTask(void) const;
+
+            /**
+             * @brief Post an event to the loop task, or handle it immediately if called on the loop task
+             * @param event     the event, its resources are released if it could not be posted
+             * @param wait      the maximum number of ticks to wait for free queue space
+             * @return  \c true if the event was posted or handled, \c false otherwise
+             */
+			bool			postEvent(NodeEvent &event, TickType_t wait);
+
+            /**
+             * @brief Post a SetProperty event without waiting
+             * @param event         the prepared SetProperty event, a string value is still the caller's
+             * @param property      the property name, copied into the event
+             * @param completion    optional callback that receives the final send status
+             * @return  the send status for the caller
+             */
+			SendStatus		postProperty(NodeEvent &event, const char *property, sendCompletionFunction completion);
+
+            /**
+             * @brief Copy the property name and a string value of a SetProperty event, the caller's may be temporary
+             * @param event     the SetProperty event, a string value is replaced by its copy
+             * @param property  the property name
+             * @return  \c true if the copies were made, \c false otherwise
+             */
+			bool			copyText(NodeEvent &event, const char *property);
+
+            /**
+             * @brief Point the key and a string value of an event to its text, which moves with every copy of the event
+             * @param event     the event
+             */
+			static void		bindText(NodeEvent &event);
+
+            /**
+             * @brief Take a slot of the completion pool, or a heap copy if all are in use
+             * @param completion    the completion callback, moved into the slot
+             * @return  the stored callback, to be released with releaseCompletion()
+             */
+			sendCompletionFunction*	acquireCompletion(sendCompletionFunction &&completion);
+
+            /**
+             * @brief Return a callback of acquireCompletion() to the pool or the heap, \c nullptr is ignored
+             * @param completion    the callback
+             */
+			void			releaseCompletion(sendCompletionFunction *completion);
+
+            /**
+             * @brief Handle a single event on the loop task and release its resources
+             * @param event     the event to handle
+             */
+			void			handleEvent(NodeEvent &event);
+
+            /**
+             * @brief Release the copies owned by an event
+             * @param event     the event to release
+             */
+			void			releaseEvent(NodeEvent &event);
+
+            /**
+             * @brief Create an empty event of the given type
+             * @param type  the event type
+             * @return  the event
+             */
+			static NodeEvent	makeEvent(NodeEventType type);
+
+            /**
+             * @brief Serialize and send the value of a SetProperty event
+             * @param event     the SetProperty event
+             * @return  the status returned by the connection
+             */
+			SendStatus		publishProperty(const NodeEvent &event);
+
+            /**
+             * @brief Send changed property values on the loop task
+             * @param parameters    the changed properties as cJSON object
+             * @param completion    optional callback that receives the final send status
+             * @param priority      the outbound lane to use
+             * @return  the status returned by the connection
+             */
+			SendStatus		publishProperties(cJSON *parameters, sendCompletionFunction completion, SendPriority priority);
+
+            /**
+             * @brief Send a generic data message on the loop task
+             * @param subject   the data message to send
+             * @return  \c true if the message was queued, \c false otherwise
+             */
+			bool			publishData(const char *subject);
+
+            /**
+             * @brief Handles the connected event on the loop task
+             */
+			void			handleConnected(void);
+
+            /**
+             * @brief Handles the disconnected event on the loop task
+             */
+			void			handleDisconnected(void);
+
+            /**
+             * @brief Handles a received JSON message on the loop task
+             * @param jsonMessage   the message
+             */
+			void			handleJsonMessage(const cJSON *jsonMessage);
+
             /**
              * @brief Call a RPC with the specified argument
              * @param name      the RPC name
@@ -142,10 +452,25 @@ namespace _2log
              */
 			void			registerNode(cJSON *registerObject);
 
+            /**
+             * @brief Get the outbound lane of a property
+             * @param property  the property name
+             * @return  the lane set with setPropertyPriority(), \c SendPriority::State otherwise
+             */
+			SendPriority	getPropertyPriority(const char *property) const;
+
 		private:
 
 			IConnection*													_connection;
-            bool                                                            _isConnected = { false };
+            std::atomic<bool>                                               _isConnected = { false };
+			QueueHandle_t													_eventQueue = { nullptr };
+			SemaphoreHandle_t												_loopStopped = { nullptr };
+			bool															_loopStarted = { false };
+			std::atomic<TaskHandle_t>										_loopTask = { nullptr };
+			EventLoopStatistics												_statistics = {};
+			std::atomic<uint32_t>											_rejectedEvents = { 0 };
+			sendCompletionFunction											_completions[COMPLETION_POOL_SIZE];
+			std::atomic<uint32_t>											_usedCompletions = { 0 };
 
 			const std::string												_nodeType;
 			const std::string												_id;
@@ -155,6 +480,9 @@ namespace _2log
 
 			jsonCallbackFunction											_initPropertiesCallback = {};
 			std::map<const char*, jsonCallbackFunction, StringComparison>	_rpcCallbacks = {};
+			std::map<const char*, uint8_t, StringComparison>				_propertyPrecisions = {};
+			std::map<const char*, uint8_t, StringComparison>				_propertyScales = {};
+			std::map<const char*, SendPriority, StringComparison>			_propertyPriorities = {};
 	};
 }
 
@@ -1,177 +1,1058 @@
 
 #include "DeviceProperties.h"
+#include "PerfCounters.h"
+#include "AllocationTracker.h"
 
 #include <string.h>
+#include <vector>
 #include <stdlib.h>
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 
 
 
 namespace
 {
-        const char* LOG_TAG = "_2log::DeviceProperties";
-        const char* PREFIX  = "/2log/prop/"; // 11+1 chars
-        const int MAX_PROPERTY_LENGTH = 45;
-}
+        const char* LOG_TAG         = "_2log::DeviceProperties";
+        const char* STORE_FILE      = "/2log/properties.kv";
+        const char* LEGACY_DIRECTORY = "/2log/prop"; // layout before the LogStore, one file per property
+        const char* LEGACY_PREFIX   = "/2log/prop/";
+        const int   MAX_LEGACY_FILENAME_LENGTH = 45;
 
-namespace _2log
-{
-        DeviceProperties::DeviceProperties()
+        using PropertyValue = _2log::DeviceProperties::PropertyValue;
+
+        /*
+         * Binary value record, the value of a LogStore record:
+         *
+         *   header byte    RECORD_FORMAT_MAGIC | RECORD_FORMAT_VERSION
+         *   type tag       PropertyValue::PropertyDataType
+         *   payload        INT, FLOAT: 4 bytes, BOOL: 1 byte, SCALED: 4 bytes value + 1 byte decimals,
+         *                  INT64, DOUBLE: 8 bytes, CSTRING: the characters without the terminating null,
+         *                  BYTES: the bytes
+         *
+         * Numbers are little endian. The length is the one of the LogStore record, which also covers the
+         * record with its CRC. Values written before the binary format are JSON objects, they start with '{'.
+         */
+        const uint8_t RECORD_FORMAT_MAGIC   = 0xB0;
+        const uint8_t RECORD_FORMAT_VERSION = 1;
+        const size_t  RECORD_HEADER_SIZE    = 2;
+
+        void writeUint32(std::string& record, uint32_t value)
         {
-            init();
+            for(int shift = 0; shift < 32; shift += 8)
+                record.push_back(static_cast<char>(value >> shift));
         }
 
-        bool DeviceProperties::init()
+        void writeUint64(std::string& record, uint64_t value)
         {
-            _initialized = DataStorage::getInstance().mount("/2log");
-            return _initialized;
+            writeUint32(record, static_cast<uint32_t>(value));
+            writeUint32(record, static_cast<uint32_t>(value >> 32));
         }
 
-        bool DeviceProperties::saveProperty(const char *key, const DeviceProperties::PropertyValue& value)
+        uint32_t readUint32(const uint8_t* data)
         {
-            if(!_initialized)
+            return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 | static_cast<uint32_t>(data[2]) << 16 |
+                   static_cast<uint32_t>(data[3]) << 24;
+        }
+
+        uint64_t readUint64(const uint8_t* data)
+        {
+            return static_cast<uint64_t>(readUint32(data)) | static_cast<uint64_t>(readUint32(data + 4)) << 32;
+        }
+
+        /**
+         * @brief Encode a value as binary record
+         * @param value     the value
+         * @param record    receives the record, its capacity is reused
+         * @return  \c true on success, \c false for an invalid value
+         */
+        bool encodeValue(const PropertyValue& value, std::string& record)
+        {
+            record.clear();
+            record.push_back(static_cast<char>(RECORD_FORMAT_MAGIC | RECORD_FORMAT_VERSION));
+            record.push_back(static_cast<char>(value.getType()));
+
+            switch(value.getType())
             {
-                ESP_LOGD(LOG_TAG, "Not initialized.");
-                return false;
+                case PropertyValue::INT:
+                    writeUint32(record, static_cast<uint32_t>(value.asInt(nullptr)));
+                    return true;
+
+                case PropertyValue::FLOAT:
+                {
+                    float number = value.asFloat(nullptr);
+                    uint32_t bits;
+                    memcpy(&bits, &number, sizeof(bits));
+                    writeUint32(record, bits);
+                    return true;
+                }
+
+                case PropertyValue::BOOL:
+                    record.push_back(value.asBool(nullptr) ? 1 : 0);
+                    return true;
+
+                case PropertyValue::INT64:
+                    writeUint64(record, static_cast<uint64_t>(value.asInt64(nullptr)));
+                    return true;
+
+                case PropertyValue::DOUBLE:
+                {
+                    double number = value.asDouble(nullptr);
+                    uint64_t bits;
+                    memcpy(&bits, &number, sizeof(bits));
+                    writeUint64(record, bits);
+                    return true;
+                }
+
+                case PropertyValue::CSTRING:
+                case PropertyValue::BYTES:
+                {
+                    size_t length;
+                    const uint8_t* bytes = value.asBytes(&length);
+                    record.append(reinterpret_cast<const char*>(bytes), length);
+                    return true;
+                }
+
+                case PropertyValue::SCALED:
+                {
+                    uint8_t decimals;
+                    writeUint32(record, static_cast<uint32_t>(value.asScaled(nullptr, &decimals)));
+                    record.push_back(static_cast<char>(decimals));
+                    return true;
+                }
+
+                default:
+                    return false;
             }
+        }
 
-            if(strlen(PREFIX) + strlen(key) + 1 > MAX_PROPERTY_LENGTH)
+        /**
+         * @brief Decode a binary record written by encodeValue()
+         * @return  \c true if the record is valid, \c false otherwise
+         */
+        bool decodeBinaryValue(const uint8_t* record, size_t length, PropertyValue& property)
+        {
+            if(length < RECORD_HEADER_SIZE || record[0] != (RECORD_FORMAT_MAGIC | RECORD_FORMAT_VERSION))
+                return false;
+
+            const uint8_t* payload = record + RECORD_HEADER_SIZE;
+            size_t payloadLength = length - RECORD_HEADER_SIZE;
+
+            switch(static_cast<PropertyValue::PropertyDataType>(record[1]))
             {
-                  ESP_LOGD(LOG_TAG, "Property name has too much characters");
-                  return false;
+                case PropertyValue::INT:
+                    if(payloadLength != 4)
+                        return false;
+                    property.setInt(static_cast<int32_t>(readUint32(payload)));
+                    return true;
+
+                case PropertyValue::FLOAT:
+                {
+                    if(payloadLength != 4)
+                        return false;
+                    uint32_t bits = readUint32(payload);
+                    float number;
+                    memcpy(&number, &bits, sizeof(number));
+                    property.setFloat(number);
+                    return true;
+                }
+
+                case PropertyValue::BOOL:
+                    if(payloadLength != 1)
+                        return false;
+                    property.setBool(payload[0] != 0);
+                    return true;
+
+                case PropertyValue::INT64:
+                    if(payloadLength != 8)
+                        return false;
+                    property.setInt64(static_cast<int64_t>(readUint64(payload)));
+                    return true;
+
+                case PropertyValue::DOUBLE:
+                {
+                    if(payloadLength != 8)
+                        return false;
+                    uint64_t bits = readUint64(payload);
+                    double number;
+                    memcpy(&number, &bits, sizeof(number));
+                    property.setDouble(number);
+                    return true;
+                }
+
+                case PropertyValue::CSTRING:
+                    property.setString(reinterpret_cast<const char*>(payload), payloadLength);
+                    return true;
+
+                case PropertyValue::BYTES:
+                    property.setBytes(payload, payloadLength);
+                    return true;
+
+                case PropertyValue::SCALED:
+                    if(payloadLength != 5)
+                        return false;
+                    property.setScaled(static_cast<int32_t>(readUint32(payload)), payload[4]);
+                    return true;
+
+                default:
+                    return false;
             }
+        }
 
-            char filename[MAX_PROPERTY_LENGTH];
-            strcpy(filename, PREFIX);
-            strcat(filename, key);
+        /**
+         * @brief Decode the JSON object of a legacy property file or of a record written before the binary format
+         * @param json      the JSON object
+         * @param property  receives the value
+         * @return  \c true if the object describes a property, \c false otherwise
+         */
+        bool decodeJsonValue(const char* json, PropertyValue& property)
+        {
+            cJSON* propertyJson = cJSON_Parse(json);
 
-            cJSON *object = cJSON_CreateObject();
-            cJSON_AddNumberToObject(object, "type", (int) value.getType());
+            cJSON* typeJSON = cJSON_GetObjectItem(propertyJson, "type");
+            cJSON* valueJSON = cJSON_GetObjectItem(propertyJson, "val");
+            if(!(typeJSON && cJSON_IsNumber(typeJSON) && valueJSON))
+            {
+                cJSON_Delete(propertyJson);
+                return false;
+            }
 
-            switch(value.getType())
+            PropertyValue::PropertyDataType type = static_cast<PropertyValue::PropertyDataType> (typeJSON->valueint);
+
+            switch(type)
             {
                 case PropertyValue::INT:
+                    property.setInt(valueJSON->valueint);
+                break;
+
                 case PropertyValue::FLOAT:
-                    cJSON_AddNumberToObject(object, "val", value.asNumber(nullptr));
+                    property.setFloat(valueJSON->valuedouble);
                     break;
 
                 case PropertyValue::BOOL:
-                    cJSON_AddBoolToObject(object, "val", value.asBool(nullptr));
+                    property.setBool(cJSON_IsTrue(valueJSON));
                     break;
 
                 case PropertyValue::CSTRING:
-                    cJSON_AddStringToObject(object, "val", value.asCstring(nullptr));
+                    property.setString(cJSON_IsString(valueJSON) ? valueJSON->valuestring : "");
                     break;
 
-                default: return false;
+                case PropertyValue::SCALED:
+                {
+                    cJSON* decimalsJSON = cJSON_GetObjectItem(propertyJson, "dec");
+                    property.setScaled(valueJSON->valueint, cJSON_IsNumber(decimalsJSON) ? static_cast<uint8_t>(decimalsJSON->valueint) : 0);
+                    break;
+                }
+
+                default:
+                    cJSON_Delete(propertyJson);
+                    return false;
             }
 
-            char *jsonString = cJSON_Print(object);
+            cJSON_Delete(propertyJson);
+            return true;
+        }
+
+        /**
+         * @brief Decode the value of a LogStore record, binary or JSON
+         * @param record    the record, null-terminated for the JSON parser
+         * @param property  receives the value
+         * @return  \c true if the record describes a property, \c false otherwise
+         */
+        bool decodeValue(const std::string& record, PropertyValue& property)
+        {
+            if(!record.empty() && record[0] == '{')
+                return decodeJsonValue(record.c_str(), property);
 
+            return decodeBinaryValue(reinterpret_cast<const uint8_t*>(record.data()), record.size(), property);
+        }
 
-            bool success = DataStorage::getInstance().writeTextFile(filename, jsonString) > 0;
-            if(success)
+        bool isValidProperty(const char* key, const PropertyValue& value)
+        {
+            if(value.getType() < PropertyValue::INT || value.getType() > PropertyValue::BYTES)
+            {
+                ESP_LOGD(LOG_TAG, "Invalid value for property %s", key);
+                return false;
+            }
+
+            if(strlen(key) == 0 || strlen(key) > LOG_STORE_MAX_KEY_LENGTH)
+            {
+                ESP_LOGD(LOG_TAG, "Property name has too much characters");
+                return false;
+            }
+
+            return true;
+        }
+
+        bool isEqual(const PropertyValue& a, const PropertyValue& b)
+        {
+            if(a.getType() != b.getType())
+                return false;
+
+            switch(a.getType())
+            {
+                case PropertyValue::INT:
+                    return a.asInt(nullptr) == b.asInt(nullptr);
+
+                case PropertyValue::FLOAT:
+                    return a.asFloat(nullptr) == b.asFloat(nullptr);
+
+                case PropertyValue::BOOL:
+                    return a.asBool(nullptr) == b.asBool(nullptr);
+
+                case PropertyValue::INT64:
+                    return a.asInt64(nullptr) == b.asInt64(nullptr);
+
+                case PropertyValue::DOUBLE:
+                    return a.asDouble(nullptr) == b.asDouble(nullptr);
+
+                case PropertyValue::CSTRING:
+                case PropertyValue::BYTES:
+                {
+                    size_t lengthA, lengthB;
+                    const uint8_t* bytesA = a.asBytes(&lengthA);
+                    const uint8_t* bytesB = b.asBytes(&lengthB);
+                    return lengthA == lengthB && memcmp(bytesA, bytesB, lengthA) == 0;
+                }
+
+                case PropertyValue::SCALED:
+                {
+                    uint8_t decimalsA, decimalsB;
+                    return a.asScaled(nullptr, &decimalsA) == b.asScaled(nullptr, &decimalsB) && decimalsA == decimalsB;
+                }
+
+                default:
+                    return false;
+            }
+        }
+}
+
+namespace _2log
+{
+        DeviceProperties::PropertyValue::PropertyValue(const PropertyValue& other)
+        {
+            *this = other;
+        }
+
+        DeviceProperties::PropertyValue::PropertyValue(PropertyValue&& other) noexcept
+        {
+            *this = std::move(other);
+        }
+
+        DeviceProperties::PropertyValue& DeviceProperties::PropertyValue::operator=(const PropertyValue& other)
+        {
+            if(this == &other)
+                return *this;
+
+            if(other.type == CSTRING || other.type == BYTES)
+            {
+                assign(other.type, other.storage(), other.length);
+            }
+            else
+            {
+                clear();
+                data = other.data;
+                type = other.type;
+            }
+
+            return *this;
+        }
+
+        DeviceProperties::PropertyValue& DeviceProperties::PropertyValue::operator=(PropertyValue&& other) noexcept
+        {
+            if(this == &other)
+                return *this;
+
+            // takes over the heap storage of a long string, the other value becomes INVALID
+            clear();
+            data = other.data;
+            length = other.length;
+            type = other.type;
+
+            other.length = 0;
+            other.type = INVALID;
+
+            return *this;
+        }
+
+        DeviceProperties::PropertyValue::~PropertyValue()
+        {
+            clear();
+        }
+
+        void DeviceProperties::PropertyValue::clear()
+        {
+            if(isHeapAllocated())
+                AllocationTracker::release(data.val_heap);
+
+            length = 0;
+            type = INVALID;
+        }
+
+        void DeviceProperties::PropertyValue::assign(PropertyDataType newType, const void* bytes, size_t newLength)
+        {
+            if(newLength > PROPERTY_VALUE_INLINE_SIZE)
             {
-                ESP_LOGD(LOG_TAG, "property written: %s", filename);
-                ESP_LOGD(LOG_TAG, "payload: %s", jsonString);
+                char* heap = static_cast<char*>(AllocationTracker::allocate(newLength + 1));
+                if(heap == nullptr)
+                {
+                    ESP_LOGE(LOG_TAG, "Failed to allocate %u bytes for a property value", static_cast<unsigned>(newLength));
+                    clear();
+                    return;
+                }
+
+                memcpy(heap, bytes, newLength);
+                heap[newLength] = '\0';
+
+                clear();
+                data.val_heap = heap;
             }
             else
             {
-                ESP_LOGD(LOG_TAG, "failed to write file: %s", filename);
+                // the bytes may be the own storage of this value
+                char inlineStorage[PROPERTY_VALUE_INLINE_SIZE + 1];
+                memcpy(inlineStorage, bytes, newLength);
+                inlineStorage[newLength] = '\0';
+
+                clear();
+                memcpy(data.val_inline, inlineStorage, newLength + 1);
             }
 
-            // cJSON uses malloc(), don't mix malloc/new + free/delete
-            free(jsonString);
-            cJSON_Delete(object);
+            length = static_cast<uint32_t>(newLength);
+            type = newType;
+        }
+
+        bool DeviceProperties::PropertyValue::get(int& val) const
+        {
+            if(type == INT)
+                val = data.val_int;
+            else if(type == INT64 && data.val_int64 >= INT32_MIN && data.val_int64 <= INT32_MAX)
+                val = static_cast<int>(data.val_int64);
+            else
+                return false;
+
+            return true;
+        }
+
+        bool DeviceProperties::PropertyValue::get(int64_t& val) const
+        {
+            bool success;
+            int64_t number = asInt64(&success);
+
+            if(success)
+                val = number;
+
+            return success;
+        }
+
+        bool DeviceProperties::PropertyValue::get(float& val) const
+        {
+            bool success;
+            float number = asNumber(&success);
+
+            if(success)
+                val = number;
+
             return success;
         }
+
+        bool DeviceProperties::PropertyValue::get(double& val) const
+        {
+            if(type == DOUBLE || type == FLOAT)
+                val = asDouble(nullptr);
+            else if(type == INT || type == INT64)
+                val = static_cast<double>(asInt64(nullptr));
+            else if(type == SCALED)
+                val = data.val_scaled.value / pow(10.0, data.val_scaled.decimals);
+            else
+                return false;
+
+            return true;
+        }
+
+        bool DeviceProperties::PropertyValue::get(bool& val) const
+        {
+            if(type != BOOL)
+                return false;
+
+            val = data.val_bool;
+            return true;
+        }
+
+        bool DeviceProperties::PropertyValue::get(std::string& val) const
+        {
+            if(type != CSTRING && type != BYTES)
+                return false;
+
+            val.assign(storage(), length);
+            return true;
+        }
+
+        DeviceProperties::DeviceProperties()
+        {
+            _mutex = xSemaphoreCreateMutex();
+            _writeMutex = xSemaphoreCreateMutex();
+            _flushSignal = xSemaphoreCreateBinary();
+            _flushTask = new WorkerTask("prop_flush", _flushSignal, [this]() { flushStep(); });
+
+            init();
+        }
+
+        DeviceProperties::~DeviceProperties()
+        {
+            esp_unregister_shutdown_handler(&DeviceProperties::shutdownHandler);
+
+            // the last step writes the dirty properties
+            delete _flushTask;
+
+            _store.close();
+
+            if(_segmentBackend != nullptr)
+            {
+                _segmentBackend->unmount();
+                delete _segmentBackend;
+            }
+
+            if(_flushSignal != nullptr)
+                vSemaphoreDelete(_flushSignal);
+
+            if(_writeMutex != nullptr)
+                vSemaphoreDelete(_writeMutex);
+
+            if(_mutex != nullptr)
+                vSemaphoreDelete(_mutex);
+        }
+
+        bool DeviceProperties::init()
+        {
+            _initialized = _mutex != nullptr && _flushSignal != nullptr && mountSegment() && _store.open(STORE_FILE);
+
+            if(_initialized)
+            {
+                migrateLegacyProperties();
+                preloadProperties();
+
+                if(!_flushTask->start())
+                    ESP_LOGE(LOG_TAG, "Failed to start flush task");
+
+                // properties saved right before a restart are written by sync()
+                esp_register_shutdown_handler(&DeviceProperties::shutdownHandler);
+            }
+
+            return _initialized;
+        }
+
+        bool DeviceProperties::mountSegment()
+        {
+            DataStorage& storage = DataStorage::getInstance();
+
+            // legacy property files are migrated from DataStorage in any case
+            if(!storage.mount("/2log"))
+                return false;
+
+            if(storage.hasFileAccess())
+                return true;
+
+            // the LogStore opens its segment with fopen()
+            _segmentBackend = StorageBackend::create(StorageBackendType::DEVICE_PROPERTIES_BACKEND);
+
+            if(_segmentBackend == nullptr || !_segmentBackend->hasFileAccess() || !_segmentBackend->mount("/2log"))
+            {
+                ESP_LOGE(LOG_TAG, "The %s backend can not hold %s and no file system could be mounted for it", StorageBackend::getTypeName(storage.getBackendType()), STORE_FILE);
+                delete _segmentBackend;
+                _segmentBackend = nullptr;
+                return false;
+            }
+
+            ESP_LOGI(LOG_TAG, "%s is kept on %s, the files of DataStorage on %s", STORE_FILE, StorageBackend::getTypeName(_segmentBackend->getType()), StorageBackend::getTypeName(storage.getBackendType()));
+
+            return true;
+        }
+
+        void DeviceProperties::migrateLegacyProperties()
+        {
+            ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceProperties);
+
+            std::vector<std::string> keys;
+
+            if(!DataStorage::getInstance().listFiles(LEGACY_DIRECTORY, keys) || keys.empty())
+                return;
+
+            ESP_LOGI(LOG_TAG, "Migrating %u properties to %s", static_cast<unsigned>(keys.size()), STORE_FILE);
+
+            for(const std::string& key : keys)
+            {
+                if(strlen(LEGACY_PREFIX) + key.size() + 1 > MAX_LEGACY_FILENAME_LENGTH)
+                    continue;
+
+                char filename[MAX_LEGACY_FILENAME_LENGTH];
+                strcpy(filename, LEGACY_PREFIX);
+                strcat(filename, key.c_str());
+
+                // a key that is already in the store was migrated before a reset interrupted the migration
+                if(!_store.contains(key.c_str()))
+                {
+                    const char* propertyFile = DataStorage::getInstance().readTextFile(filename);
+                    PropertyValue property;
+                    std::string record;
+
+                    if(propertyFile == nullptr || !decodeJsonValue(propertyFile, property) || !encodeValue(property, record))
+                    {
+                        ESP_LOGE(LOG_TAG, "Dropping unreadable property file %s", filename);
+                    }
+                    else if(!_store.put(key.c_str(), record.data(), record.size()))
+                    {
+                        // keep the file, the migration is repeated on the next start
+                        ESP_LOGE(LOG_TAG, "Failed to migrate property %s", key.c_str());
+                        delete [] propertyFile;
+                        continue;
+                    }
+
+                    delete [] propertyFile;
+                }
+
+                DataStorage::getInstance().deleteFile(filename);
+            }
+        }
+
+        void DeviceProperties::preloadProperties()
+        {
+            ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceProperties);
+
+            int64_t start = esp_timer_get_time();
+            uint32_t keys = _store.getStatistics().keys;
+
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+
+            bool success = _store.forEach([this](const char* key, const std::string& record)
+            {
+                if(_cacheStatistics.preloaded >= PROPERTY_CACHE_PRELOAD_LIMIT)
+                    return false;
+
+                // an undecodable record stays in the store, getProperty() returns the default as before
+                PropertyValue property;
+                if(decodeValue(record, property))
+                {
+                    _cache.emplace(key, CacheEntry()).first->second.value = std::move(property);
+                    _cacheStatistics.preloaded++;
+                }
+
+                return true;
+            });
+
+            _complete = success && keys <= PROPERTY_CACHE_PRELOAD_LIMIT;
+
+            xSemaphoreGive(_mutex);
+
+            ESP_LOGI(LOG_TAG, "Loaded %u of %u properties in %u us", _cacheStatistics.preloaded, keys,
+                     static_cast<unsigned>(esp_timer_get_time() - start));
+        }
+
+        bool DeviceProperties::saveProperty(const char *key, const DeviceProperties::PropertyValue& value)
+        {
+            PERF_SCOPE(PerfProbe::PropertySave);
+            ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceProperties);
+
+            if(!_initialized)
+            {
+                ESP_LOGD(LOG_TAG, "Not initialized.");
+                return false;
+            }
+
+            if(!isValidProperty(key, value))
+                return false;
+
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+
+            auto entry = _cache.find(key);
+            if(entry != _cache.end() && !entry->second.deleted && isEqual(entry->second.value, value))
+            {
+                _cacheStatistics.unchangedSaves++;
+                xSemaphoreGive(_mutex);
+                return true;
+            }
+
+            if(entry == _cache.end())
+                entry = _cache.emplace(key, CacheEntry()).first;
+
+            CacheEntry& cached = entry->second;
+            cached.value = value;
+            cached.deleted = false;
+            markDirty(cached);
+            _cacheStatistics.saves++;
+
+            ESP_LOGD(LOG_TAG, "property saved: %s", key);
+
+            bool flushDue = _cacheStatistics.dirtyProperties >= _flushThreshold;
+            xSemaphoreGive(_mutex);
+
+            if(flushDue)
+                xSemaphoreGive(_flushSignal);
+
+            return true;
+        }
         
         bool DeviceProperties::deleteProperty(const char *key)
         {
-            char filename[MAX_PROPERTY_LENGTH];
+            ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceProperties);
 
-            if(strlen(PREFIX) + strlen(key) + 1 > MAX_PROPERTY_LENGTH)
+            if(!_initialized)
+                return false;
+
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+
+            auto entry = _cache.find(key);
+            if(entry == _cache.end())
             {
-                  ESP_LOGD(LOG_TAG, "property name has too much characters");
-                  return false;
+                if(!_store.contains(key))
+                {
+                    xSemaphoreGive(_mutex);
+                    return false;
+                }
+
+                entry = _cache.emplace(key, CacheEntry()).first;
             }
-            strcpy(filename, PREFIX);
-            strcat(filename, key);
+            else if(entry->second.deleted)
+            {
+                xSemaphoreGive(_mutex);
+                return false;
+            }
+
+            entry->second.value.clear();
+            entry->second.deleted = true;
+            markDirty(entry->second);
 
-            return DataStorage::getInstance().deleteFile(filename);
+            bool flushDue = _cacheStatistics.dirtyProperties >= _flushThreshold;
+            xSemaphoreGive(_mutex);
+
+            if(flushDue)
+                xSemaphoreGive(_flushSignal);
+
+            return true;
         }
 
 
         DeviceProperties::PropertyValue DeviceProperties::getProperty(const char *key, const PropertyValue &defaultValue)
         {
+            PERF_SCOPE(PerfProbe::PropertyGet);
+            ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceProperties);
+
             if(!_initialized)
                 return defaultValue;
 
-            if(strlen(PREFIX) + strlen(key) + 1 > MAX_PROPERTY_LENGTH)
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+
+            auto entry = _cache.find(key);
+            if(entry != _cache.end())
+            {
+                _cacheStatistics.hits++;
+            }
+            else if(_complete)
+            {
+                _cacheStatistics.absent++;
+                xSemaphoreGive(_mutex);
+                return defaultValue;
+            }
+            else
             {
-                  ESP_LOGD(LOG_TAG, "property name has too much characters");
-                  return {};
+                _cacheStatistics.misses++;
+
+                std::string record;
+                if(!_store.get(key, record))
+                {
+                    ESP_LOGD(LOG_TAG, "Property not available -> return default value");
+                    xSemaphoreGive(_mutex);
+                    return defaultValue;
+                }
+
+                entry = _cache.emplace(key, CacheEntry()).first;
+                if(!decodeValue(record, entry->second.value))
+                {
+                    _cache.erase(entry);
+                    xSemaphoreGive(_mutex);
+                    return defaultValue;
+                }
             }
 
-            const char* propertyFile;
+            PropertyValue property = entry->second.deleted ? defaultValue : entry->second.value;
+            xSemaphoreGive(_mutex);
+            return property;
+        }
+
+        bool DeviceProperties::sync()
+        {
+            if(!_initialized)
+                return false;
+
+            return flush();
+        }
+
+        void DeviceProperties::setFlushPolicy(uint32_t interval, uint32_t threshold)
+        {
+            _flushInterval = interval;
+            _flushThreshold = threshold;
+
+            // apply the new interval right away
+            xSemaphoreGive(_flushSignal);
+        }
+
+        DeviceProperties::CacheStatistics DeviceProperties::getCacheStatistics()
+        {
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+            CacheStatistics statistics = _cacheStatistics;
+            xSemaphoreGive(_mutex);
+
+            return statistics;
+        }
+
+        void DeviceProperties::flushStep()
+        {
+            ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceProperties);
+
+            // woken by a full cache, by stop() or when the interval elapsed
+            xSemaphoreTake(_flushSignal, pdMS_TO_TICKS(_flushInterval.load()));
+
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+            bool dirty = _cacheStatistics.dirtyProperties > 0;
+            xSemaphoreGive(_mutex);
+
+            if(dirty)
+                flush();
+        }
+
+        bool DeviceProperties::flush()
+        {
+            LogStore::Batch batch;
+            std::vector<std::pair<std::string, uint32_t>> written;
+            std::string record;
+
+            // no other flush or transaction writes between the snapshot and its write
+            xSemaphoreTake(_writeMutex, portMAX_DELAY);
+            xSemaphoreTake(_mutex, portMAX_DELAY);
 
+            // one batch, a reset during the flush stores all or none of the dirty properties
+            for(auto& entry : _cache)
             {
-                char filename[MAX_PROPERTY_LENGTH];
-                strcpy(filename, PREFIX);
-                strcat(filename, key);
-                propertyFile = DataStorage::getInstance().readTextFile(filename);
+                CacheEntry& cached = entry.second;
+                if(!cached.dirty)
+                    continue;
+
+                if(cached.deleted)
+                    batch.remove(entry.first.c_str());
+                else if(encodeValue(cached.value, record))
+                    batch.put(entry.first.c_str(), record.data(), record.size());
+                else
+                {
+                    // a retry would fail the same way
+                    ESP_LOGE(LOG_TAG, "dropped property %s, its value can not be encoded", entry.first.c_str());
+                    cached.dirty = false;
+                    _cacheStatistics.dirtyProperties--;
+                    continue;
+                }
+
+                written.emplace_back(entry.first, cached.generation);
             }
 
-            cJSON* propertyJson = cJSON_Parse(propertyFile);
+            xSemaphoreGive(_mutex);
 
-            PropertyValue property;
-            if (propertyFile != nullptr)
+            // the store has its own lock, the cache stays available during the write
+            bool success = batch.empty() || _store.write(batch);
+
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+
+            if(success)
             {
+                uint32_t cleaned = 0;
 
-                cJSON* typeJSON = cJSON_GetObjectItem(propertyJson, "type");
-                if(!(typeJSON && cJSON_IsNumber(typeJSON)))
+                for(const auto& key : written)
                 {
-                    delete [] propertyFile;
-                    cJSON_Delete(propertyJson);
+                    auto entry = _cache.find(key.first);
 
-                    return defaultValue;
+                    // changed during the write, the next flush writes the new value
+                    if(entry == _cache.end() || !entry->second.dirty || entry->second.generation != key.second)
+                        continue;
+
+                    entry->second.dirty = false;
+                    cleaned++;
+
+                    if(entry->second.deleted)
+                        _cache.erase(entry);
                 }
 
-                PropertyValue::PropertyDataType type = static_cast<PropertyValue::PropertyDataType> (typeJSON->valueint);
-                cJSON* valueJSON = cJSON_GetObjectItem(propertyJson, "val");
+                _cacheStatistics.dirtyProperties -= cleaned;
+                _cacheStatistics.flushes++;
+                _cacheStatistics.flushedProperties += written.size();
+            }
+
+            xSemaphoreGive(_mutex);
+            xSemaphoreGive(_writeMutex);
 
-                switch(type)
-                {
-                    case PropertyValue::INT:
-                        property.setInt(valueJSON->valueint);
-                    break;
+            if(!success)
+            {
+                // stay dirty, the next flush tries again
+                ESP_LOGE(LOG_TAG, "failed to write %u properties", static_cast<unsigned>(batch.size()));
+                return false;
+            }
+
+            ESP_LOGD(LOG_TAG, "flushed %u properties", static_cast<unsigned>(written.size()));
+            return true;
+        }
+
+        bool DeviceProperties::commitTransaction(const std::vector<Transaction::Change>& changes)
+        {
+            ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceProperties);
+
+            if(!_initialized)
+                return false;
+
+            LogStore::Batch batch;
+            std::string record;
 
-                    case PropertyValue::FLOAT:
-                        property.setFloat(valueJSON->valuedouble);
-                        break;
+            for(const Transaction::Change& change : changes)
+            {
+                if(change.value.getType() == PropertyValue::INVALID)
+                    batch.remove(change.key.c_str());
+                else if(encodeValue(change.value, record))
+                    batch.put(change.key.c_str(), record.data(), record.size());
+            }
+
+            std::vector<uint32_t> generations;
+            generations.reserve(changes.size());
+
+            // no flush writes an older value of these keys after the transaction
+            xSemaphoreTake(_writeMutex, portMAX_DELAY);
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+
+            for(const Transaction::Change& change : changes)
+                generations.push_back(generationOf(change.key));
+
+            xSemaphoreGive(_mutex);
+
+            if(!_store.write(batch))
+            {
+                xSemaphoreGive(_writeMutex);
+                ESP_LOGE(LOG_TAG, "failed to commit a transaction of %u properties", static_cast<unsigned>(changes.size()));
+                return false;
+            }
+
+            xSemaphoreTake(_mutex, portMAX_DELAY);
+
+            // the store has the values of the transaction, an older dirty value of these keys must not overwrite them
+            for(size_t index = 0; index < changes.size(); index++)
+            {
+                const Transaction::Change& change = changes[index];
 
-                    case PropertyValue::BOOL:
-                        property.setBool(cJSON_IsTrue(valueJSON));
-                        break;
+                // saved or deleted again during the write, the newer change wins
+                if(generationOf(change.key) != generations[index])
+                    continue;
 
-                    case PropertyValue::CSTRING:
-                        property.setString(valueJSON->string);
-                        break;
+                auto entry = _cache.find(change.key);
 
-                    default:;
+                if(entry != _cache.end() && entry->second.dirty)
+                {
+                    entry->second.dirty = false;
+                    _cacheStatistics.dirtyProperties--;
                 }
+
+                if(change.value.getType() == PropertyValue::INVALID)
+                {
+                    if(entry != _cache.end())
+                        _cache.erase(entry);
+
+                    continue;
+                }
+
+                if(entry == _cache.end())
+                    entry = _cache.emplace(change.key, CacheEntry()).first;
+
+                entry->second.value = change.value;
+                entry->second.deleted = false;
+                entry->second.generation = ++_generation;
             }
-            else
+
+            _cacheStatistics.transactions++;
+            xSemaphoreGive(_mutex);
+            xSemaphoreGive(_writeMutex);
+
+            return true;
+        }
+
+        void DeviceProperties::markDirty(CacheEntry& entry)
+        {
+            entry.generation = ++_generation;
+
+            if(!entry.dirty)
             {
-                ESP_LOGD(LOG_TAG, "Property not available -> return default value");
-                cJSON_Delete(propertyJson);
-                return defaultValue;
+                entry.dirty = true;
+                _cacheStatistics.dirtyProperties++;
             }
+        }
 
-            cJSON_Delete(propertyJson);
-            delete [] propertyFile;
-            return property;
+        uint32_t DeviceProperties::generationOf(const std::string& key) const
+        {
+            auto entry = _cache.find(key);
+            return entry != _cache.end() ? entry->second.generation : 0;
+        }
+
+        DeviceProperties::Transaction DeviceProperties::beginTransaction()
+        {
+            return Transaction(*this);
+        }
+
+        bool DeviceProperties::Transaction::saveProperty(const char* key, const PropertyValue& value)
+        {
+            return isValidProperty(key, value) && setChange(key, value);
+        }
+
+        bool DeviceProperties::Transaction::deleteProperty(const char* key)
+        {
+            return isValidProperty(key, PropertyValue(0)) && setChange(key, PropertyValue());
+        }
+
+        bool DeviceProperties::Transaction::commit()
+        {
+            if(_changes.empty())
+                return true;
+
+            if(!_properties.commitTransaction(_changes))
+                return false;
+
+            _changes.clear();
+            return true;
+        }
+
+        void DeviceProperties::Transaction::rollback()
+        {
+            _changes.clear();
+        }
+
+        bool DeviceProperties::Transaction::setChange(const char* key, const PropertyValue& value)
+        {
+            ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceProperties);
+
+            // the last change of a key wins
+            for(Change& change : _changes)
+            {
+                if(change.key == key)
+                {
+                    change.value = value;
+                    return true;
+                }
+            }
+
+            _changes.push_back({ key, value });
+            return true;
+        }
+
+        void DeviceProperties::shutdownHandler()
+        {
+            instance().sync();
+        }
+
+        LogStore::Statistics DeviceProperties::getStorageStatistics()
+        {
+            return _store.getStatistics();
         }
 
         DeviceProperties& DeviceProperties::instance()
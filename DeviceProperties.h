@@ -2,14 +2,63 @@
 #define DEVICEPROPERTIES_H
 
 #include <string>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <vector>
+#include <atomic>
 #include "DataStorage.h"
+#include "LogStore.h"
+#include "WorkerTask.h"
 #include <cJSON.h>
 
+// strings and bytes up to this length are stored inside the PropertyValue, without a heap allocation
+#ifndef PROPERTY_VALUE_INLINE_SIZE
+    #define PROPERTY_VALUE_INLINE_SIZE      15
+#endif
+
+// properties read into the cache at init, with at most this many keys in the store a missing key is known
+// without a store lookup
+#ifndef PROPERTY_CACHE_PRELOAD_LIMIT
+    #define PROPERTY_CACHE_PRELOAD_LIMIT    256
+#endif
+
+#ifndef PROPERTY_CACHE_FLUSH_INTERVAL
+    #define PROPERTY_CACHE_FLUSH_INTERVAL   30000
+#endif
+
+#ifndef PROPERTY_CACHE_FLUSH_THRESHOLD
+    #define PROPERTY_CACHE_FLUSH_THRESHOLD  16
+#endif
+
+// the file system of the segment when the backend of DataStorage can not be opened with fopen(), e.g. Nvs
+#ifndef DEVICE_PROPERTIES_BACKEND
+    #define DEVICE_PROPERTIES_BACKEND       Spiffs
+#endif
 
 namespace _2log
 {
     /**
      * @brief The DeviceProperties class provides a way to store properties as key/value pairs.
+     *
+     * The properties are compact binary records of a LogStore in "/2log/properties.kv", so an update appends a
+     * single record instead of rewriting a file. Properties of the former layout, one JSON file per key in
+     * "/2log/prop/", are moved into the store on the first start; JSON records are still read. The LogStore needs
+     * fopen() access, so with the Nvs backend of DataStorage the segment is kept on a DEVICE_PROPERTIES_BACKEND
+     * file system mounted at "/2log", while the files of DataStorage stay in NVS.
+     *
+     * Properties are cached in RAM. At init up to PROPERTY_CACHE_PRELOAD_LIMIT properties are read into the cache
+     * in one pass over the store; if that were all of them, getProperty() never reads the store and answers a
+     * missing key from RAM. Otherwise getProperty() reads a key from the store only once, saveProperty() and
+     * deleteProperty() just change the cache and mark the key dirty; saving the value a key already has is
+     * free. Dirty keys are written by a flush task every PROPERTY_CACHE_FLUSH_INTERVAL ms, as soon as
+     * PROPERTY_CACHE_FLUSH_THRESHOLD keys are dirty, on sync() and before esp_restart(). Repeated saves of a
+     * key between two flushes therefore result in a single record. A flush writes all dirty keys as one batch
+     * with a single sync; a Transaction is written the same way, right away on commit(). The cache is not locked
+     * while a batch is written, so getProperty() and saveProperty() never wait for the flash; a key changed
+     * during the write stays dirty for the next flush. When DeviceProperties is destroyed, the flush task writes
+     * the dirty keys a last time and stops.
      */
     class DeviceProperties
     {
@@ -17,11 +66,15 @@ namespace _2log
 
             /**
              * @brief The PropertyValue struct represents a variant property value
+             *
+             * String and byte values are owned by the value. Up to PROPERTY_VALUE_INLINE_SIZE bytes are stored in
+             * the value itself, so copying a short string does not allocate; longer ones are copied to the heap.
+             * A moved-from value is INVALID.
              */
             struct PropertyValue
             {
                 /**
-                 * @brief The PropertyDataType enum enumerates the possible data types
+                 * @brief The PropertyDataType enum enumerates the possible data types, the numbers are stored
                  */
                 enum PropertyDataType
                 {
@@ -29,7 +82,11 @@ namespace _2log
                     INT = 0,
                     CSTRING,
                     FLOAT,
-                    BOOL
+                    BOOL,
+                    SCALED,
+                    INT64,
+                    DOUBLE,
+                    BYTES
                 };
 
                 /**
@@ -37,6 +94,12 @@ namespace _2log
                  */
                 PropertyValue(void){}
 
+                PropertyValue(const PropertyValue& other);
+                PropertyValue(PropertyValue&& other) noexcept;
+                PropertyValue& operator=(const PropertyValue& other);
+                PropertyValue& operator=(PropertyValue&& other) noexcept;
+                ~PropertyValue();
+
                 /**
                  * @brief Initialize an INT PropertyValue
                  * @param val   the int value
@@ -47,6 +110,16 @@ namespace _2log
                     type = INT;
                 }
 
+                /**
+                 * @brief Initialize an INT64 PropertyValue
+                 * @param val   the 64 bit integer value
+                 */
+                PropertyValue(int64_t val)
+                {
+                    data.val_int64 = val;
+                    type = INT64;
+                }
+
                 /**
                  * @brief Initialize a FLOAT PropertyValue
                  * @param val   the float value
@@ -57,14 +130,44 @@ namespace _2log
                     type = FLOAT;
                 }
 
+                /**
+                 * @brief Initialize a DOUBLE PropertyValue
+                 * @param val   the double value
+                 */
+                PropertyValue(double val)
+                {
+                    data.val_double = val;
+                    type = DOUBLE;
+                }
+
+                /**
+                 * @brief Initialize a CSTRING PropertyValue
+                 * @param val   the NULL-terminated c-string value, it is copied
+                 */
+                PropertyValue(const char* val)
+                {
+                    setString(val);
+                }
+
                 /**
                  * @brief Initialize a CSTRING PropertyValue
-                 * @param val   the NULL-terminated c-string value
+                 * @param val   the string value, it is copied
                  */
-                PropertyValue(char* val)
+                PropertyValue(const std::string& val)
                 {
-                    data.val_cstring = val;
-                    type = CSTRING;
+                    assign(CSTRING, val.data(), val.size());
+                }
+
+                /**
+                 * @brief Initialize a SCALED PropertyValue, a fixed-point value of val * 10^-decimals
+                 * @param val       the raw integer value
+                 * @param decimals  the number of implied decimals
+                 */
+                PropertyValue(int32_t val, uint8_t decimals)
+                {
+                    data.val_scaled.value = val;
+                    data.val_scaled.decimals = decimals;
+                    type = SCALED;
                 }
 
                 /**
@@ -77,6 +180,18 @@ namespace _2log
                     type = BOOL;
                 }
 
+                /**
+                 * @brief Create a BYTES PropertyValue
+                 * @param bytes     the data, it is copied
+                 * @param length    the number of bytes
+                 */
+                static PropertyValue fromBytes(const void* bytes, size_t length)
+                {
+                    PropertyValue value;
+                    value.setBytes(bytes, length);
+                    return value;
+                }
+
                 /**
                  * @brief Returns the value as int
                  * @param success   is set to true if value could be converted to int
@@ -90,6 +205,19 @@ namespace _2log
                     return data.val_int;
                 }
 
+                /**
+                 * @brief Returns the value as 64 bit integer
+                 * @param success   is set to true if value is an INT or INT64
+                 * @return  the value as 64 bit integer
+                 */
+                int64_t asInt64(bool* success) const
+                {
+                    if(success)
+                        *success = (type == INT64 || type == INT);
+
+                    return (type == INT) ? data.val_int : data.val_int64;
+                }
+
                 /**
                  * @brief Returns the value as float
                  * @param success   is set to true if value could be converted to float
@@ -103,6 +231,19 @@ namespace _2log
                     return data.val_float;
                 }
 
+                /**
+                 * @brief Returns the value as double
+                 * @param success   is set to true if value is a FLOAT or DOUBLE
+                 * @return  the value as double
+                 */
+                double asDouble(bool* success) const
+                {
+                    if(success)
+                        *success = (type == DOUBLE || type == FLOAT);
+
+                    return (type == FLOAT) ? data.val_float : data.val_double;
+                }
+
                 /**
                  * @brief Returns the value as number
                  * @param success   is set to true if value could be converted to number
@@ -111,25 +252,63 @@ namespace _2log
                 float asNumber(bool* success) const
                 {
                     if(success)
-                        *success = (type == FLOAT || type == INT);
+                        *success = (type == FLOAT || type == INT || type == SCALED || type == INT64 || type == DOUBLE);
 
                     if (type == FLOAT)
                         return data.val_float;
+                    else if (type == SCALED)
+                        return data.val_scaled.value / powf(10.0F, data.val_scaled.decimals);
+                    else if (type == INT64)
+                        return static_cast<float>(data.val_int64);
+                    else if (type == DOUBLE)
+                        return static_cast<float>(data.val_double);
                     else
                         return data.val_int;
                 }
 
+                /**
+                 * @brief Returns the raw value of a scaled integer
+                 * @param success   is set to true if value is a scaled integer
+                 * @param decimals  is set to the number of implied decimals
+                 * @return  the raw integer value
+                 */
+                int32_t asScaled(bool* success, uint8_t* decimals) const
+                {
+                    if(success)
+                        *success = (type == SCALED);
+
+                    if(decimals)
+                        *decimals = (type == SCALED) ? data.val_scaled.decimals : 0;
+
+                    return (type == SCALED) ? data.val_scaled.value : data.val_int;
+                }
+
                 /**
                  * @brief Returns the value as c-string
                  * @param success   is set to true if value could be converted to c-string
-                 * @return  the value as c-string
+                 * @return  the value as c-string, owned by the value, or \c nullptr if it is no CSTRING
                  */
-                char* asCstring(bool* success) const
+                const char* asCstring(bool* success) const
                 {
                     if(success)
                         *success = (type == CSTRING);
 
-                    return data.val_cstring;
+                    return (type == CSTRING) ? storage() : nullptr;
+                }
+
+                /**
+                 * @brief Returns the value as bytes
+                 * @param length    is set to the number of bytes
+                 * @return  the bytes of a BYTES or CSTRING value, owned by the value, \c nullptr otherwise
+                 */
+                const uint8_t* asBytes(size_t* length) const
+                {
+                    bool isBytes = (type == BYTES || type == CSTRING);
+
+                    if(length)
+                        *length = isBytes ? this->length : 0;
+
+                    return isBytes ? reinterpret_cast<const uint8_t*>(storage()) : nullptr;
                 }
 
                 /**
@@ -145,14 +324,52 @@ namespace _2log
                     return data.val_bool;
                 }
 
+                /**
+                 * @brief Read the value into a variable of the matching type
+                 *
+                 * Integers are widened to int64_t, all numbers convert to float and double, an int receives an
+                 * INT64 that fits, a std::string receives a CSTRING or BYTES value.
+                 *
+                 * @param val   receives the value
+                 * @return  \c true if the value was converted, \c false otherwise, val is unchanged then
+                 */
+                bool get(int& val) const;
+                bool get(int64_t& val) const;
+                bool get(float& val) const;
+                bool get(double& val) const;
+                bool get(bool& val) const;
+                bool get(std::string& val) const;
+
                 /**
                  * @brief Set the value to a c-string
-                 * @param val   the c-string value
+                 * @param val   the c-string value, it is copied; \c nullptr makes the value INVALID
+                 */
+                void setString(const char* val)
+                {
+                    if(val)
+                        assign(CSTRING, val, strlen(val));
+                    else
+                        clear();
+                }
+
+                /**
+                 * @brief Set the value to a string of the given length
+                 * @param val       the characters, they are copied
+                 * @param length    the number of characters
                  */
-                void setString(char* val)
+                void setString(const char* val, size_t length)
                 {
-                    type = CSTRING;
-                    data.val_cstring = val;
+                    assign(CSTRING, val, length);
+                }
+
+                /**
+                 * @brief Set the value to bytes
+                 * @param bytes     the data, it is copied
+                 * @param length    the number of bytes
+                 */
+                void setBytes(const void* bytes, size_t length)
+                {
+                    assign(BYTES, bytes, length);
                 }
 
                 /**
@@ -161,6 +378,7 @@ namespace _2log
                  */
                 void setBool(bool val)
                 {
+                    clear();
                     type = BOOL;
                     data.val_bool = val;
                 }
@@ -171,20 +389,62 @@ namespace _2log
                  */
                 void setFloat(float val)
                 {
+                    clear();
                     type = FLOAT;
                     data.val_float = val;
                 }
 
+                /**
+                 * @brief Set the value to a double
+                 * @param val   the double value
+                 */
+                void setDouble(double val)
+                {
+                    clear();
+                    type = DOUBLE;
+                    data.val_double = val;
+                }
+
                 /**
                  * @brief Set the value to an int
                  * @param val   the int value
                  */
                 void setInt(int val)
                 {
+                    clear();
                     type = INT;
                     data.val_int = val;
                 }
 
+                /**
+                 * @brief Set the value to a 64 bit integer
+                 * @param val   the 64 bit integer value
+                 */
+                void setInt64(int64_t val)
+                {
+                    clear();
+                    type = INT64;
+                    data.val_int64 = val;
+                }
+
+                /**
+                 * @brief Set the value to a scaled integer
+                 * @param val       the raw integer value
+                 * @param decimals  the number of implied decimals
+                 */
+                void setScaled(int32_t val, uint8_t decimals)
+                {
+                    clear();
+                    type = SCALED;
+                    data.val_scaled.value = val;
+                    data.val_scaled.decimals = decimals;
+                }
+
+                /**
+                 * @brief Release the string or bytes and make the value INVALID
+                 */
+                void clear();
+
                 /**
                  * @brief Get the value data type
                  * @return
@@ -194,20 +454,122 @@ namespace _2log
                     return type;
                 }
 
+                /**
+                 * @brief Check if a CSTRING or BYTES value is stored on the heap
+                 */
+                bool isHeapAllocated() const
+                {
+                    return (type == CSTRING || type == BYTES) && length > PROPERTY_VALUE_INLINE_SIZE;
+                }
+
             private:
+                void assign(PropertyDataType type, const void* bytes, size_t length);
+
+                const char* storage() const
+                {
+                    return isHeapAllocated() ? data.val_heap : data.val_inline;
+                }
+
                 union PropertyData
                 {
                     int val_int;
                     float val_float;
-                    char* val_cstring;
                     bool  val_bool;
+                    struct
+                    {
+                        int32_t value;
+                        uint8_t decimals;
+                    } val_scaled;
+                    int64_t val_int64;
+                    double val_double;
+                    char* val_heap;                                 ///< CSTRING or BYTES longer than the inline storage
+                    char val_inline[PROPERTY_VALUE_INLINE_SIZE + 1];  ///< short CSTRING or BYTES, null-terminated
                 } data;
 
+                uint32_t length = 0;                                ///< bytes of a CSTRING or BYTES value
                 PropertyDataType type = INVALID;
             };
 
             /**
-             * @brief Saves a property to the storage
+             * @brief The CacheStatistics struct counts the work of the property cache
+             */
+            struct CacheStatistics
+            {
+                uint32_t    saves;                  ///< saveProperty() calls that changed a value
+                uint32_t    unchangedSaves;         ///< saveProperty() calls with the value the key already had
+                uint32_t    hits;                   ///< getProperty() calls answered from the cache
+                uint32_t    misses;                 ///< getProperty() calls that read the store
+                uint32_t    absent;                 ///< getProperty() calls for a missing key answered without the store
+                uint32_t    preloaded;              ///< properties read into the cache at init
+                uint32_t    flushes;
+                uint32_t    flushedProperties;      ///< records written by the flushes
+                uint32_t    dirtyProperties;        ///< keys currently waiting for a flush
+                uint32_t    transactions;           ///< committed transactions
+            };
+
+            /**
+             * @brief The Transaction class groups changes of several properties that must be stored together
+             *
+             * The changes are collected in the transaction and are not visible before commit(), which writes them
+             * right away as one journaled LogStore batch: after a reset either all or none of them are stored. A
+             * transaction that is not committed is discarded.
+             */
+            class Transaction
+            {
+                public:
+
+                    /**
+                     * @brief Save a property as part of the transaction
+                     * @return  \c true if the key and value are valid, \c false otherwise
+                     */
+                    bool saveProperty(const char* key, const PropertyValue &value);
+
+                    template<typename T>
+                    bool saveProperty(const char* key, const T &value)
+                    {
+                        return saveProperty(key, PropertyValue(value));
+                    }
+
+                    /**
+                     * @brief Delete a property as part of the transaction, a key that does not exist is ignored
+                     * @return  \c true if the key is valid, \c false otherwise
+                     */
+                    bool deleteProperty(const char* key);
+
+                    /**
+                     * @brief Store all changes
+                     * @return  \c true if they were stored, \c false otherwise, then none of them was and the
+                     * transaction can be committed again
+                     */
+                    bool commit();
+
+                    /**
+                     * @brief Discard all changes
+                     */
+                    void rollback();
+
+                private:
+                    friend class DeviceProperties;
+
+                    /**
+                     * @brief The Change struct is a saved value or, with an INVALID value, a deletion
+                     */
+                    struct Change
+                    {
+                        std::string     key;
+                        PropertyValue   value;
+                    };
+
+                    explicit Transaction(DeviceProperties& properties) : _properties(properties) {}
+
+                    bool setChange(const char* key, const PropertyValue& value);
+
+                    DeviceProperties& _properties;
+                    std::vector<Change> _changes;
+            };
+
+            /**
+             * @brief Saves a property, it is written to the storage by the next flush
              * @param key   the property key as NULL-terminated c-string
              * @param value the value for this property
              *
@@ -216,7 +578,26 @@ namespace _2log
             bool saveProperty(const char* key, const PropertyValue &value);
 
             /**
-             * @brief Delete a property from the storage
+             * @brief Saves a property of a plain type, e.g. saveProperty(".interval", 60) or saveProperty("name", std::string("hub"))
+             * @param key   the property key as NULL-terminated c-string
+             * @param value a value any PropertyValue constructor accepts
+             *
+             * @return  \c true if property was successfully stored, \c false otherwise
+             */
+            template<typename T>
+            bool saveProperty(const char* key, const T &value)
+            {
+                return saveProperty(key, PropertyValue(value));
+            }
+
+            /**
+             * @brief Start a transaction, e.g. to store a set of calibration values or a counter with its timestamp
+             * @return  the empty transaction
+             */
+            Transaction beginTransaction();
+
+            /**
+             * @brief Delete a property, it is removed from the storage by the next flush
              * @param key   the property key as NULL-terminated c-string
              * @return  \c true if property was successfully deleted, \c false otherwise
              */
@@ -226,20 +607,88 @@ namespace _2log
              * @brief Loads a property from the storage
              * @param key           the property key as NULL-terminated c-string
              * @param defaultValue  a default value that is used, if the property did not yet exist
-             * @return  the loaded property
+             * @return  a copy of the loaded property
              */
             PropertyValue getProperty(const char* key, const DeviceProperties::PropertyValue& defaultValue = {});
 
+            /**
+             * @brief Loads a property as int, int64_t, float, double, bool or std::string, e.g. getProperty<bool>(".configReset", false)
+             * @param key           the property key as NULL-terminated c-string
+             * @param defaultValue  the value that is returned if the property does not exist or has an incompatible type
+             * @return  the loaded value, see PropertyValue::get() for the conversions
+             */
+            template<typename T>
+            T getProperty(const char* key, const T& defaultValue)
+            {
+                T value;
+                return getProperty(key).get(value) ? value : defaultValue;
+            }
+
             /**
              * @brief Access to the single instance of the DeviceProperties
              * @return the single instance of \c DeviceProperties
              */
             static DeviceProperties& instance();
 
+            /**
+             * @brief Get the statistics of the underlying LogStore, e.g. the bytes written per update
+             * @return  the store statistics
+             */
+            LogStore::Statistics getStorageStatistics();
+
+            /**
+             * @brief Write all dirty properties to the storage now, on the calling task
+             * @return  \c true if all properties were written, \c false otherwise
+             */
+            bool sync();
+
+            /**
+             * @brief Change when dirty properties are written
+             * @param interval  the flush interval in milliseconds
+             * @param threshold number of dirty keys that start a flush right away
+             */
+            void setFlushPolicy(uint32_t interval, uint32_t threshold);
+
+            CacheStatistics getCacheStatistics();
+
         private:
+            /**
+             * @brief The CacheEntry struct is the cached value of a key
+             */
+            struct CacheEntry
+            {
+                PropertyValue   value;
+                bool            dirty = false;
+                bool            deleted = false;    ///< deleted, but not yet removed from the store
+                uint32_t        generation = 0;     ///< changes with every change of the key
+            };
+
             bool init();
+            bool mountSegment();
+            void migrateLegacyProperties();
+            void preloadProperties();
+            void flushStep();
+            bool flush();
+            bool commitTransaction(const std::vector<Transaction::Change>& changes);
+            void markDirty(CacheEntry& entry);
+            uint32_t generationOf(const std::string& key) const;
+            static void shutdownHandler();
+
             bool _initialized = false;
+            bool _complete = false;     ///< the cache holds every property of the store
+            LogStore _store;
+            StorageBackend* _segmentBackend = nullptr;  ///< file system of the segment if DataStorage has no fopen() access
+            SemaphoreHandle_t _mutex = nullptr;
+            SemaphoreHandle_t _writeMutex = nullptr;    ///< one write to the store at a time, taken before _mutex
+            SemaphoreHandle_t _flushSignal = nullptr;
+            WorkerTask* _flushTask = nullptr;
+            uint32_t _generation = 0;
+            std::map<std::string, CacheEntry, std::less<>> _cache;
+            CacheStatistics _cacheStatistics = {};
+            std::atomic<uint32_t> _flushInterval = { PROPERTY_CACHE_FLUSH_INTERVAL };
+            std::atomic<uint32_t> _flushThreshold = { PROPERTY_CACHE_FLUSH_THRESHOLD };
             DeviceProperties();
+            ~DeviceProperties();
     };
 }
 
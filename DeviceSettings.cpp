@@ -1,4 +1,6 @@
 #include "DeviceSettings.h"
+#include "PerfCounters.h"
+#include "AllocationTracker.h"
 
 #include <string.h>
 #include "esp_log.h"
@@ -37,6 +39,8 @@ namespace _2log
 
 	bool DeviceSettings::init()
 	{
+        ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceSettings);
+
         DataStorage::getInstance().mount("/2log");
 
 		loadDeviceShortID();
@@ -110,7 +114,7 @@ namespace _2log
 		}
 
 		cJSON_free(authJson);
-        delete authJsonString;
+        delete [] authJsonString;
     }
 
     void DeviceSettings::getEncryptionPass(unsigned char encryptionPass[])
@@ -245,6 +249,8 @@ namespace _2log
 
 	void DeviceSettings::writeAuthKey(uint32_t authKey)
 	{
+		ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceSettings);
+
 		_authKey = authKey;
 
 		cJSON *jsonConfig = cJSON_CreateObject();
@@ -258,13 +264,26 @@ namespace _2log
 
 		char *jsonString = cJSON_Print(jsonConfig);
 
-        if ( DataStorage::getInstance().writeTextFile(AUTHKEY_FILE, jsonString) > 0)
+		// called on the DeviceNode loop task, which must not wait for the flash
+		bool queued = DataStorage::getInstance().writeTextFileAsync(AUTHKEY_FILE, jsonString, [authKey](int bytesWritten)
 		{
-			ESP_LOGD(LOG_TAG, "_authKey written: %u", _authKey);
+			if ( bytesWritten > 0 )
+			{
+				ESP_LOGD(LOG_TAG, "_authKey written: %u", authKey);
+			}
+			else
+			{
+				ESP_LOGE(LOG_TAG, "Failed to write _authKey");
+			}
+		});
+
+		if ( ! queued )
+		{
+			ESP_LOGE(LOG_TAG, "Failed to queue _authKey");
 		}
 
-		// cJSON uses malloc(), don't mix malloc/new + free/delete
-        free(jsonString);
+		// cJSON allocates through its hooks, so release the string with cJSON_free()
+        cJSON_free(jsonString);
 		cJSON_Delete(jsonConfig);
 	}
 
@@ -333,7 +352,7 @@ namespace _2log
 			}
 
 			// deleting possible nullptr is safe
-			delete deviceID;
+			delete [] deviceID;
 
 		#endif
 
@@ -386,6 +405,9 @@ namespace _2log
 
 	void DeviceSettings::loadDeviceSettings()
 	{
+		PERF_SCOPE(PerfProbe::SettingsLoad);
+		ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceSettings);
+
         unsigned char decryptionPass[ENCRYPTION_PASS_LEN + 1];
         getEncryptionPass(decryptionPass);
 
@@ -447,11 +469,13 @@ namespace _2log
 		}
 
 		cJSON_free(networkJson);
-		delete settingsJsonString;
+		delete [] settingsJsonString;
 	}
 
 	void DeviceSettings::saveConfiguration()
 	{
+		ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceSettings);
+
 		unsigned char encryptionPass[ENCRYPTION_PASS_LEN + 1];
         getEncryptionPass(encryptionPass);
 
@@ -511,8 +535,8 @@ namespace _2log
             ESP_LOGE(LOG_TAG, "Saving config FAILED!");
         }
 
-		// cJSON uses malloc(), don't mix malloc/new + free/delete
-		free(jsonString);
+		// cJSON allocates through its hooks, so release the string with cJSON_free()
+		cJSON_free(jsonString);
 		cJSON_Delete(networkJson);
 	}
 
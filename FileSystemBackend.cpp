@@ -0,0 +1,317 @@
+#include "FileSystemBackend.h"
+
+#include <string.h>
+
+extern "C"
+{
+    #include "esp_vfs.h"
+    #include "esp_log.h"
+    #include <sys/stat.h>
+    #include <stdio.h>
+    #include <sys/unistd.h>
+    #include <dirent.h>
+}
+
+namespace
+{
+    const char* LOG_TAG = "_2log::FileSystemBackend";
+
+    bool removeFiles(const std::string &directoryPath)
+    {
+        DIR *directory = opendir(directoryPath.c_str() );
+
+        if ( directory == nullptr )
+        {
+            return false;
+        }
+
+        std::vector<std::string>    entries;
+        struct dirent               *entry;
+
+        while ( ( entry = readdir(directory) ) != nullptr )
+        {
+            if ( strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0 )
+            {
+                entries.push_back(directoryPath + "/" + entry->d_name);
+            }
+        }
+
+        closedir(directory);
+
+        bool success = true;
+
+        for ( const std::string &entryPath : entries )
+        {
+            struct stat entryStat;
+
+            if ( stat(entryPath.c_str(), &entryStat) == 0 && S_ISDIR(entryStat.st_mode) )
+            {
+                success = removeFiles(entryPath) && rmdir(entryPath.c_str() ) == 0 && success;
+            }
+            else
+            {
+                success = unlink(entryPath.c_str() ) == 0 && success;
+            }
+        }
+
+        return success;
+    }
+}
+
+namespace _2log
+{
+    bool FileSystemBackend::isMounted() const
+    {
+        return _isMounted;
+    }
+
+    bool FileSystemBackend::hasFileAccess() const
+    {
+        return true;
+    }
+
+    char *FileSystemBackend::readFile(const char *fileName, size_t *length)
+    {
+        ESP_LOGD(LOG_TAG, "Reading file %s", fileName);
+
+        int fileSize = getFileSize(fileName);
+
+        if ( fileSize < 0 )
+        {
+            // file does not exists
+            ESP_LOGE(LOG_TAG, "File %s does not exist", fileName);
+            return nullptr;
+        }
+
+        if ( fileSize == 0 )
+        {
+            ESP_LOGE(LOG_TAG, "File %s is empty", fileName);
+            return nullptr;
+        }
+
+        char *fileBuffer = new char [fileSize + 1];
+
+        if ( readData(fileName, 0, fileBuffer, static_cast<size_t>(fileSize) ) != fileSize )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to read file %s", fileName);
+            delete [] fileBuffer;
+            return nullptr;
+        }
+
+        fileBuffer[fileSize] = '\0';
+
+        if ( length != nullptr )
+        {
+            *length = static_cast<size_t>(fileSize);
+        }
+
+        return fileBuffer;
+    }
+
+    int FileSystemBackend::getFileSize(const char *fileName)
+    {
+        struct stat fileStat;
+
+        return stat(fileName, &fileStat) == 0 ? static_cast<int>(fileStat.st_size) : -1;
+    }
+
+    int FileSystemBackend::readData(const char *fileName, size_t offset, void *buffer, size_t size)
+    {
+        FILE* file = fopen(fileName, "rb");
+
+        if ( file == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to open %s for reading", fileName);
+            return -1;
+        }
+
+        int bytesRead = -1;
+
+        if ( fseek(file, static_cast<long>(offset), SEEK_SET) == 0 )
+        {
+            size_t result = fread(buffer, 1, size, file);
+            bytesRead = ferror(file) ? -1 : static_cast<int>(result);
+        }
+
+        fclose(file);
+
+        return bytesRead;
+    }
+
+    int FileSystemBackend::writeData(const char *fileName, const void *data, size_t length, bool append)
+    {
+        ESP_LOGD(LOG_TAG, "Writing file %s", fileName);
+
+        FILE* file = fopen(fileName, append ? "ab" : "wb");
+
+        if ( file == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to open %s for writing", fileName);
+            return -1;
+        }
+
+        size_t written = length > 0 ? fwrite(data, 1, length, file) : 0;
+
+        // fclose() writes the buffered rest, e.g. when the file system is full
+        if ( fclose(file) != 0 || written != length )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to write %s", fileName);
+            return -1;
+        }
+
+        return static_cast<int>(written);
+    }
+
+    int FileSystemBackend::readChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, const ChunkReadFunction &consumer)
+    {
+        FILE* file = fopen(fileName, "rb");
+
+        if ( file == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to open %s for reading", fileName);
+            return -1;
+        }
+
+        size_t  total = 0;
+        size_t  length;
+
+        while ( ( length = fread(buffer, 1, bufferSize, file) ) > 0 )
+        {
+            total += length;
+
+            if ( ! consumer(buffer, length) )
+            {
+                break;
+            }
+        }
+
+        bool success = ! ferror(file);
+        fclose(file);
+
+        return success ? static_cast<int>(total) : -1;
+    }
+
+    int FileSystemBackend::writeChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, const ChunkWriteFunction &producer)
+    {
+        FILE* file = fopen(fileName, "wb");
+
+        if ( file == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to open %s for writing", fileName);
+            return -1;
+        }
+
+        size_t  total   = 0;
+        bool    success = true;
+        size_t  length;
+
+        while ( success && ( length = producer(buffer, bufferSize) ) > 0 )
+        {
+            length   = length < bufferSize ? length : bufferSize;
+            success  = fwrite(buffer, 1, length, file) == length;
+            total   += length;
+        }
+
+        if ( fclose(file) != 0 || ! success )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to write %s", fileName);
+            return -1;
+        }
+
+        return static_cast<int>(total);
+    }
+
+    bool FileSystemBackend::deleteFile(const char *fileName)
+    {
+        struct stat fileStats;
+        bool fileWasOverwritten = false;
+        if ( stat(fileName, &fileStats) == 0 )
+        {
+            // complete erase file contents
+            FILE* file = fopen(fileName, "w");
+
+            for (int i = 0; i < fileStats.st_size; i++)
+            {
+                fwrite(" ", 1, 1, file);
+            }
+
+            fclose(file);
+            fileWasOverwritten = true;
+        }
+
+        // finally delete file
+        return unlink(fileName) == 0 || fileWasOverwritten;
+    }
+
+    bool FileSystemBackend::listFiles(const char *directory, std::vector<std::string> &fileNames)
+    {
+        DIR* dir = opendir(directory);
+
+        if ( dir == nullptr )
+        {
+            ESP_LOGD(LOG_TAG, "Directory %s not available", directory);
+            return false;
+        }
+
+        struct dirent* entry;
+
+        while ( ( entry = readdir(dir) ) != nullptr )
+        {
+            if ( entry->d_type != DT_DIR )
+            {
+                fileNames.push_back(entry->d_name);
+            }
+        }
+
+        closedir(dir);
+
+        return true;
+    }
+
+    StorageBackendType PosixBackend::getType() const
+    {
+        return StorageBackendType::Posix;
+    }
+
+    bool PosixBackend::mount(const char *mountPoint)
+    {
+        if ( _isMounted )
+        {
+            return true;
+        }
+
+        struct stat directoryStat;
+
+        if ( stat(mountPoint, &directoryStat) != 0 && mkdir(mountPoint, 0755) != 0 )
+        {
+            ESP_LOGE(LOG_TAG, "Directory %s not available", mountPoint);
+            return false;
+        }
+
+        _mountPoint = mountPoint;
+        _isMounted  = true;
+
+        return true;
+    }
+
+    bool PosixBackend::unmount()
+    {
+        // the file system stays registered, it belongs to the application
+        _isMounted = false;
+        return true;
+    }
+
+    bool PosixBackend::format()
+    {
+        return _isMounted && removeFiles(_mountPoint);
+    }
+
+    bool PosixBackend::getInfo(size_t *totalBytes, size_t *usedBytes)
+    {
+        // the size of a generic file system is not known
+        (void) totalBytes;
+        (void) usedBytes;
+
+        return false;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef FILESYSTEMBACKEND_H
+#define FILESYSTEMBACKEND_H
+
+#include "StorageBackend.h"
+
+namespace _2log
+{
+    /**
+     * @brief The FileSystemBackend class implements the file functions of a StorageBackend with stdio on a file
+     * system registered with the VFS; the derived classes mount it.
+     */
+    class FileSystemBackend : public StorageBackend
+    {
+        public:
+
+            bool                    isMounted(void) const override;
+            bool                    hasFileAccess(void) const override;
+
+            char*                   readFile(const char *fileName, size_t *length) override;
+            int                     getFileSize(const char *fileName) override;
+            int                     readData(const char *fileName, size_t offset, void *buffer, size_t size) override;
+            int                     writeData(const char *fileName, const void *data, size_t length, bool append) override;
+            int                     readChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, const ChunkReadFunction &consumer) override;
+            int                     writeChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, const ChunkWriteFunction &producer) override;
+            bool                    deleteFile(const char *fileName) override;
+            bool                    listFiles(const char *directory, std::vector<std::string> &fileNames) override;
+
+        protected:
+
+            bool                    _isMounted = { false };
+            std::string             _mountPoint;
+    };
+
+    /**
+     * @brief The PosixBackend class uses a directory of a file system that is already registered, e.g. FAT on an
+     * SD card mounted by the application. On the host, the application registers it with host_vfs_mount().
+     */
+    class PosixBackend : public FileSystemBackend
+    {
+        public:
+
+            StorageBackendType      getType(void) const override;
+
+            bool                    mount(const char *mountPoint) override;
+            bool                    unmount(void) override;
+            bool                    format(void) override;
+            bool                    getInfo(size_t *totalBytes, size_t *usedBytes) override;
+    };
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include "HeapMonitor.h"
+#include "AllocationTracker.h"
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_timer.h"
+    #include "esp_heap_caps.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG = "_2log::HeapMonitor";
+
+    void logSample(const char *name, const _2log::HeapMonitor::Sample &sample)
+    {
+        ESP_LOGI(LOG_TAG, "%-6s %8us free %7u largest block %7u minimum free %7u fragmentation %3u%%", name, sample.time, sample.freeBytes,
+                 sample.largestFreeBlock, sample.minimumFreeBytes, sample.fragmentation);
+    }
+}
+
+namespace _2log
+{
+    HeapMonitor::HeapMonitor()
+    {
+        _mutex = xSemaphoreCreateMutex();
+    }
+
+    HeapMonitor::~HeapMonitor()
+    {
+        stop();
+
+        if ( _timer != nullptr )
+        {
+            xTimerDelete(_timer, portMAX_DELAY);
+        }
+
+        if ( _mutex != nullptr )
+        {
+            vSemaphoreDelete(_mutex);
+        }
+    }
+
+    HeapMonitor::Sample HeapMonitor::takeSample()
+    {
+        Sample sample;
+
+        sample.time             = static_cast<uint32_t>( esp_timer_get_time() / 1000000 );
+        sample.freeBytes        = static_cast<uint32_t>( heap_caps_get_free_size(MALLOC_CAP_8BIT) );
+        sample.largestFreeBlock = static_cast<uint32_t>( heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) );
+        sample.minimumFreeBytes = static_cast<uint32_t>( heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT) );
+        sample.fragmentation    = 0;
+
+        if ( sample.freeBytes > 0 && sample.largestFreeBlock < sample.freeBytes )
+        {
+            sample.fragmentation = static_cast<uint8_t>( 100 - static_cast<uint64_t>(sample.largestFreeBlock) * 100 / sample.freeBytes );
+        }
+
+        return sample;
+    }
+
+    bool HeapMonitor::start(uint32_t interval)
+    {
+        if ( _timer == nullptr )
+        {
+            _timer = xTimerCreate("heap_monitor", pdMS_TO_TICKS(interval), pdTRUE, this, &HeapMonitor::sampleTimer);
+
+            if ( _timer == nullptr )
+            {
+                ESP_LOGE(LOG_TAG, "Failed to create the sample timer");
+                return false;
+            }
+        }
+        else
+        {
+            xTimerChangePeriod(_timer, pdMS_TO_TICKS(interval), portMAX_DELAY);
+        }
+
+        addSample();
+
+        return xTimerStart(_timer, portMAX_DELAY) == pdPASS;
+    }
+
+    void HeapMonitor::stop()
+    {
+        if ( _timer != nullptr )
+        {
+            xTimerStop(_timer, portMAX_DELAY);
+        }
+    }
+
+    void HeapMonitor::addSample()
+    {
+        Sample sample = takeSample();
+
+        if ( _mutex == nullptr || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return;
+        }
+
+        if ( _worst.freeBytes == 0 || sample.largestFreeBlock < _worst.largestFreeBlock )
+        {
+            _worst = sample;
+        }
+
+        _latest = sample;
+
+        _pending++;
+
+        if ( _pending >= _stride )
+        {
+            _pending = 0;
+
+            if ( _sampleCount == HEAP_MONITOR_HISTORY )
+            {
+                // keep every second sample, the history now covers twice the time
+                for ( size_t index = 0; index < HEAP_MONITOR_HISTORY / 2; index++ )
+                {
+                    _samples[index] = _samples[index * 2];
+                }
+
+                _sampleCount = HEAP_MONITOR_HISTORY / 2;
+                _stride *= 2;
+            }
+
+            _samples[_sampleCount++] = sample;
+        }
+
+        xSemaphoreGive(_mutex);
+    }
+
+    size_t HeapMonitor::getSamples(Sample *samples, size_t maxSamples)
+    {
+        size_t count = 0;
+
+        if ( _mutex != nullptr && xSemaphoreTake(_mutex, portMAX_DELAY) == pdTRUE )
+        {
+            for ( ; count < _sampleCount && count < maxSamples; count++ )
+            {
+                samples[count] = _samples[count];
+            }
+
+            xSemaphoreGive(_mutex);
+        }
+
+        return count;
+    }
+
+    int32_t HeapMonitor::getLargestFreeBlockTrend()
+    {
+        if ( _mutex == nullptr || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return 0;
+        }
+
+        double meanTime     = 0.0;
+        double meanBlock    = 0.0;
+
+        for ( size_t index = 0; index < _sampleCount; index++ )
+        {
+            meanTime    += _samples[index].time;
+            meanBlock   += _samples[index].largestFreeBlock;
+        }
+
+        double covariance   = 0.0;
+        double variance     = 0.0;
+
+        if ( _sampleCount > 1 )
+        {
+            meanTime    /= _sampleCount;
+            meanBlock   /= _sampleCount;
+
+            for ( size_t index = 0; index < _sampleCount; index++ )
+            {
+                double time = _samples[index].time - meanTime;
+
+                covariance  += time * ( _samples[index].largestFreeBlock - meanBlock );
+                variance    += time * time;
+            }
+        }
+
+        xSemaphoreGive(_mutex);
+
+        return variance > 0.0 ? static_cast<int32_t>( covariance / variance * 3600.0 ) : 0;
+    }
+
+    void HeapMonitor::logReport()
+    {
+        Sample first;
+        Sample last;
+        Sample worst;
+        size_t count;
+
+        if ( _mutex == nullptr || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return;
+        }
+
+        count = _sampleCount;
+
+        if ( count > 0 )
+        {
+            first   = _samples[0];
+            last    = _latest;
+            worst   = _worst;
+        }
+
+        xSemaphoreGive(_mutex);
+
+        if ( count == 0 )
+        {
+            ESP_LOGI(LOG_TAG, "No samples");
+            return;
+        }
+
+        logSample("first", first);
+        logSample("worst", worst);
+        logSample("last", last);
+
+        ESP_LOGI(LOG_TAG, "largest free block trend %d bytes/h over %u samples", getLargestFreeBlockTrend(), static_cast<unsigned>(count) );
+
+        #if MEMORY_DEBUGGING == 1
+            uint32_t histogram[AllocationTracker::SIZE_BUCKET_COUNT];
+            AllocationTracker::getSizeHistogram(histogram);
+
+            for ( int bucket = 0; bucket < AllocationTracker::SIZE_BUCKET_COUNT; bucket++ )
+            {
+                if ( bucket < AllocationTracker::SIZE_BUCKET_COUNT - 1 )
+                {
+                    ESP_LOGI(LOG_TAG, "allocations <= %5u bytes: %u", 16u << bucket, histogram[bucket]);
+                }
+                else
+                {
+                    ESP_LOGI(LOG_TAG, "allocations  > %5u bytes: %u", 16u << ( bucket - 1 ), histogram[bucket]);
+                }
+            }
+        #endif
+    }
+
+    void HeapMonitor::sampleTimer(TimerHandle_t timer)
+    {
+        static_cast<HeapMonitor*>( pvTimerGetTimerID(timer) )->addSample();
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef HEAPMONITOR_H
+#define HEAPMONITOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C"
+{
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/semphr.h>
+    #include <freertos/timers.h>
+}
+
+#ifndef HEAP_MONITOR_HISTORY
+    #define HEAP_MONITOR_HISTORY    64
+#endif
+
+#ifndef HEAP_MONITOR_INTERVAL
+    #define HEAP_MONITOR_INTERVAL   60000
+#endif
+
+namespace _2log
+{
+    /**
+     * @brief The HeapMonitor class follows the fragmentation of the heap over the lifetime of a device.
+     *
+     * Each sample holds the free heap, the largest free block and the minimum free heap since boot. The
+     * fragmentation is the part of the free heap that is not available as one block, 1 - largest / free.
+     * The history has a fixed size: when it is full every second sample is dropped and the sample interval
+     * doubles, so the history always covers the whole uptime, from minutes to months.
+     *
+     * The monitor samples on its own with start(), or whenever addSample() is called.
+     */
+    class HeapMonitor
+    {
+        public:
+
+            /**
+             * @brief The Sample struct is a single measurement of the heap
+             */
+            struct Sample
+            {
+                uint32_t    time;               ///< seconds since boot
+                uint32_t    freeBytes;          ///< free heap
+                uint32_t    largestFreeBlock;   ///< largest free block of the heap
+                uint32_t    minimumFreeBytes;   ///< lowest free heap since boot
+                uint8_t     fragmentation;      ///< 0 - 100 percent
+            };
+
+                                HeapMonitor(void);
+                                ~HeapMonitor(void);
+
+                                HeapMonitor(HeapMonitor const&)     = delete;
+            void                operator=(HeapMonitor const&)       = delete;
+
+            /**
+             * @brief Measure the heap without storing the sample
+             */
+            static Sample       takeSample(void);
+
+            /**
+             * @brief Sample the heap periodically
+             * @param interval  the sample interval in milliseconds
+             * @return  \c true if the timer was started, \c false otherwise
+             */
+            bool                start(uint32_t interval);
+
+            void                stop(void);
+
+            /**
+             * @brief Measure the heap and add the sample to the history
+             */
+            void                addSample(void);
+
+            /**
+             * @brief Copy the history, oldest sample first
+             * @param samples       receives the samples
+             * @param maxSamples    the capacity of samples
+             * @return  the number of copied samples
+             */
+            size_t              getSamples(Sample *samples, size_t maxSamples);
+
+            /**
+             * @brief Get the change of the largest free block by a least squares fit over the history
+             * @return  bytes per hour, negative while the heap fragments
+             */
+            int32_t             getLargestFreeBlockTrend(void);
+
+            /**
+             * @brief Log the first, the worst and the last sample and the trend, with MEMORY_DEBUGGING also
+             * the allocation size histogram of the AllocationTracker
+             */
+            void                logReport(void);
+
+        private:
+
+            static void         sampleTimer(TimerHandle_t timer);
+
+        private:
+
+            SemaphoreHandle_t   _mutex = { nullptr };
+            TimerHandle_t       _timer = { nullptr };
+            Sample              _samples[HEAP_MONITOR_HISTORY];
+            size_t              _sampleCount = { 0 };
+            uint32_t            _stride = { 1 };        ///< addSample() calls per stored sample
+            uint32_t            _pending = { 0 };       ///< addSample() calls since the last stored sample
+            Sample              _worst = {};            ///< sample with the smallest largest free block
+            Sample              _latest = {};
+    };
+}
+
+#endif
@@ -2,6 +2,8 @@
 #define ICONNECTION_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <functional>
 
 // Forward declaration
 class cJSON;
@@ -10,6 +12,30 @@ namespace _2log
 {
 	class ConnectionEventHandler;
 
+    /**
+     * @brief The SendStatus enum describes the state of an outbound message
+     */
+    enum class SendStatus
+    {
+        Queued,         ///< the message was queued and will be sent by the connection
+        Sent,           ///< the message was written to the server
+        Dropped,        ///< the message was discarded, e.g. because the connection was lost or is not established
+        RejectedFull    ///< the message was not queued because the send backlog is full
+    };
+
+    /**
+     * @brief The SendPriority enum enumerates the outbound lanes, from highest to lowest priority
+     */
+    enum class SendPriority : uint8_t
+    {
+        Control = 0,    ///< protocol messages like pong and registration
+        RPCResult,      ///< responses to RPC calls of the server
+        State,          ///< regular property and state updates
+        Bulk            ///< bulk or sampled data that may be delayed
+    };
+
+    typedef std::function<void(SendStatus)>    sendCompletionFunction;
+
     /**
      * @brief The IConnection class provides an interface to a QuickHub connection
      */
@@ -41,6 +67,27 @@ namespace _2log
              */
 			virtual bool	sendPayload(const cJSON*) = 0;
 
+            /**
+             * @brief Queue a JSON payload to be sent to the server
+             *
+             * The completion callback is only called for queued payloads, once they were either sent or dropped.
+             * It may be called from a different task than the caller.
+             *
+             * @param payload       the payload, owned by the caller
+             * @param completion    optional callback that receives the final status (\c Sent or \c Dropped)
+             * @param priority      the outbound lane to use
+             *
+             * @return  \c Queued if the payload was accepted, otherwise the reason why it was not
+             */
+			virtual SendStatus	sendPayloadAsync(const cJSON *payload, sendCompletionFunction completion = nullptr,
+												 SendPriority priority = SendPriority::State) = 0;
+
+            /**
+             * @brief Get the number of bytes waiting to be sent
+             * @return  the send backlog in bytes
+             */
+			virtual size_t	getBacklogSize(void) const = 0;
+
             /**
              * @brief Sets the event handler for this connection
              * @param handler   pointer to the event handler
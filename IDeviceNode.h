@@ -2,6 +2,9 @@
 #define IDEVICENODE_H
 
 #include <functional>
+#include <stdint.h>
+#include <stddef.h>
+#include "IConnection.h"
 
 // Forward declaration
 class cJSON;
@@ -45,12 +48,24 @@ namespace _2log
 
             /**
              * @brief Register a callback function to initially set the properties of the device
+             *
+             * The callback runs on the loop task of the node. The properties object belongs to the registration
+             * message and must not be used after the callback returned. cJSON data the callback allocates is not
+             * part of the message arena and may be kept, strings of cJSON_Print() have to be released with
+             * cJSON_free().
+             *
              * @param callbackFunction  the callback to call upon the initialization
              */
 			virtual void	registerInitPropertiesCallback(jsonCallbackFunction callbackFunction) = 0;
 
             /**
              * @brief Register a RPC callback for this device
+             *
+             * The callback runs on the loop task of the node. Its argument belongs to the received message and must
+             * not be used after the callback returned, keep a cJSON_Duplicate() of it instead. cJSON data the
+             * callback allocates is not part of the message arena and may be kept, strings of cJSON_Print() have
+             * to be released with cJSON_free().
+             *
              * @param name      the RPC name
              * @param callback  the RPC callback function
              */
@@ -63,33 +78,87 @@ namespace _2log
              */
 			virtual bool	sendData(const char *subject) = 0;
 
+            /**
+             * @brief Get the number of bytes waiting to be sent to the QuickHub server
+             *
+             * Producers can use the backlog to adapt their sampling rate to the available bandwidth.
+             *
+             * @return  the send backlog in bytes
+             */
+			virtual size_t	getSendBacklog(void) const = 0;
+
             /**
              * @brief Send a changed property value to the QuickHub server
              * @param property  the property name
              * @param value     the property value
+             * @param completion  optional callback that receives the final send status
+             * @return  \c Queued if the value was queued for sending, otherwise the reason why it was not
              */
-			virtual void	setProperty(const char* property, int value) = 0;
+			virtual SendStatus  setProperty(const char* property, int value, sendCompletionFunction completion = nullptr) = 0;
 
             /**
              * @brief Send a changed property value to the QuickHub server
              * @param property  the property name
              * @param value     the property value
+             * @param completion  optional callback that receives the final send status
+             * @return  \c Queued if the value was queued for sending, otherwise the reason why it was not
              */
-            virtual void	setProperty(const char* property, float value) = 0;
+            virtual SendStatus  setProperty(const char* property, float value, sendCompletionFunction completion = nullptr) = 0;
 
             /**
              * @brief Send a changed property value to the QuickHub server
              * @param property  the property name
              * @param value     the property value
+             * @param completion  optional callback that receives the final send status
+             * @return  \c Queued if the value was queued for sending, otherwise the reason why it was not
              */
-            virtual void	setProperty(const char* property, const char* value) = 0;
+            virtual SendStatus  setProperty(const char* property, const char* value, sendCompletionFunction completion = nullptr) = 0;
 
             /**
              * @brief Send a changed property value to the QuickHub server
              * @param property  the property name
              * @param value     the property value
+             * @param completion  optional callback that receives the final send status
+             * @return  \c Queued if the value was queued for sending, otherwise the reason why it was not
+             */
+            virtual SendStatus  setProperty(const char *property, bool value, sendCompletionFunction completion = nullptr) = 0;
+
+            /**
+             * @brief Send float values of a property rounded to a fixed number of decimals
+             * @param property  the property name, must stay valid for the lifetime of the node (e.g. a string literal)
+             * @param decimals  the number of decimals to send
+             */
+            virtual void    setPropertyPrecision(const char *property, uint8_t decimals) = 0;
+
+            /**
+             * @brief Send updates of a property on another outbound lane than \c SendPriority::State
+             *
+             * Use \c SendPriority::Bulk for high rate or sampled data, so it can not delay protocol messages and
+             * regular state updates, or \c SendPriority::RPCResult for properties that answer an RPC call.
+             *
+             * @param property  the property name, must stay valid for the lifetime of the node (e.g. a string literal)
+             * @param priority  the outbound lane for this property
+             */
+            virtual void    setPropertyPriority(const char *property, SendPriority priority) = 0;
+
+            /**
+             * @brief Declare a property as scaled integer with the resolution 10^-decimals
+             *
+             * The scale is sent to the server during registration, afterwards only the raw integer is sent.
+             *
+             * @param property  the property name, must stay valid for the lifetime of the node (e.g. a string literal)
+             * @param decimals  the number of implied decimals, e.g. 2 for a value in 0.01 units
+             */
+            virtual void    declareScaledProperty(const char *property, uint8_t decimals) = 0;
+
+            /**
+             * @brief Send a changed scaled integer property value to the QuickHub server
+             * @param property  the property name, previously declared with declareScaledProperty()
+             * @param value     the raw property value in units of 10^-decimals
+             * @param completion  optional callback that receives the final send status
+             * @return  \c Queued if the value was queued for sending, otherwise the reason why it was not
              */
-            virtual void    setProperty(const char *property, bool value) = 0;
+            virtual SendStatus  setScaledProperty(const char *property, int32_t value, sendCompletionFunction completion = nullptr) = 0;
 	};
 }
 
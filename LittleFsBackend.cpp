@@ -0,0 +1,94 @@
+#include "LittleFsBackend.h"
+
+#ifdef DATA_STORAGE_HAS_LITTLEFS
+
+extern "C"
+{
+    #include "esp_littlefs.h"
+    #include "esp_log.h"
+}
+
+namespace
+{
+    const char* LOG_TAG = "_2log::LittleFsBackend";
+}
+
+namespace _2log
+{
+    StorageBackendType LittleFsBackend::getType() const
+    {
+        return StorageBackendType::LittleFs;
+    }
+
+    bool LittleFsBackend::mount(const char *mountPoint)
+    {
+        if ( _isMounted )
+        {
+            return true;
+        }
+
+        esp_vfs_littlefs_conf_t conf = {};
+
+        conf.base_path              = mountPoint;
+        conf.partition_label        = DATA_STORAGE_LITTLEFS_PARTITION;
+        conf.format_if_mount_failed = true;
+
+        esp_err_t err = esp_vfs_littlefs_register(&conf);
+
+        if ( err != ESP_OK )
+        {
+            ESP_LOGE(LOG_TAG, "Mounting LittleFS partition %s failed (%s)", DATA_STORAGE_LITTLEFS_PARTITION, esp_err_to_name(err) );
+            return false;
+        }
+
+        _mountPoint = mountPoint;
+        _isMounted  = true;
+
+        return true;
+    }
+
+    bool LittleFsBackend::unmount()
+    {
+        if ( _isMounted )
+        {
+            esp_err_t err = esp_vfs_littlefs_unregister(DATA_STORAGE_LITTLEFS_PARTITION);
+
+            if ( err != ESP_OK )
+            {
+                ESP_LOGE(LOG_TAG, "Unmounting LittleFS failed (%s)", esp_err_to_name(err) );
+                return false;
+            }
+        }
+
+        _isMounted = false;
+        return true;
+    }
+
+    bool LittleFsBackend::format()
+    {
+        esp_err_t err = esp_littlefs_format(DATA_STORAGE_LITTLEFS_PARTITION);
+
+        if ( err != ESP_OK )
+        {
+            ESP_LOGE(LOG_TAG, "Formatting LittleFS failed (%s)", esp_err_to_name(err) );
+            return false;
+        }
+
+        return true;
+    }
+
+    bool LittleFsBackend::getInfo(size_t *totalBytes, size_t *usedBytes)
+    {
+        esp_err_t err = esp_littlefs_info(DATA_STORAGE_LITTLEFS_PARTITION, totalBytes, usedBytes);
+
+        if ( err != ESP_OK )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to get LittleFS partition information (%s)", esp_err_to_name(err) );
+            return false;
+        }
+
+        return true;
+    }
+}
+
+#endif
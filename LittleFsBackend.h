@@ -0,0 +1,34 @@
+#ifndef LITTLEFSBACKEND_H
+#define LITTLEFSBACKEND_H
+
+#include "FileSystemBackend.h"
+
+#if __has_include("esp_littlefs.h")
+    #define DATA_STORAGE_HAS_LITTLEFS   1
+#endif
+
+#ifndef DATA_STORAGE_LITTLEFS_PARTITION
+    #define DATA_STORAGE_LITTLEFS_PARTITION     "littlefs"
+#endif
+
+namespace _2log
+{
+    /**
+     * @brief The LittleFsBackend class mounts the LittleFS partition DATA_STORAGE_LITTLEFS_PARTITION, it is
+     * formatted on first use. LittleFS is power loss safe and does not stall for a garbage collection like
+     * SPIFFS does; it is only compiled in if the project has the esp_littlefs component.
+     */
+    class LittleFsBackend : public FileSystemBackend
+    {
+        public:
+
+            StorageBackendType      getType(void) const override;
+
+            bool                    mount(const char *mountPoint) override;
+            bool                    unmount(void) override;
+            bool                    format(void) override;
+            bool                    getInfo(size_t *totalBytes, size_t *usedBytes) override;
+    };
+}
+
+#endif
@@ -0,0 +1,912 @@
+#include "LogStore.h"
+#include "AllocationTracker.h"
+#include "Crc32.h"
+
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_spiffs.h"
+    #include <sys/stat.h>
+    #include <sys/unistd.h>
+}
+
+namespace
+{
+    const char*     LOG_TAG         = "_2log::LogStore";
+    const char      STORE_MAGIC[4]  = { 'Q', 'H', 'K', 'V' };
+    const uint8_t   RECORD_MAGIC    = 0xA5;
+    const uint8_t   RECORD_PUT      = 1;
+    const uint8_t   RECORD_REMOVE   = 2;
+    const uint8_t   RECORD_BEGIN    = 3;    // start of a batch, the value is the number of its operations
+    const uint8_t   RECORD_COMMIT   = 4;    // end of a batch, with the same value
+    const size_t    MARKER_LENGTH   = 4;
+
+    // bytes of the segment that are copied or checked at once
+    const size_t    CHUNK_SIZE      = 128;
+
+    void writeUint32(uint8_t *buffer, uint32_t value)
+    {
+        buffer[0] = static_cast<uint8_t>(value);
+        buffer[1] = static_cast<uint8_t>( value >> 8 );
+        buffer[2] = static_cast<uint8_t>( value >> 16 );
+        buffer[3] = static_cast<uint8_t>( value >> 24 );
+    }
+
+    uint32_t readUint32(const uint8_t *buffer)
+    {
+        return static_cast<uint32_t>(buffer[0]) | static_cast<uint32_t>(buffer[1]) << 8 | static_cast<uint32_t>(buffer[2]) << 16 |
+               static_cast<uint32_t>(buffer[3]) << 24;
+    }
+
+    size_t getRecordSize(size_t keyLength, size_t valueLength)
+    {
+        return _2log::LogStore::RECORD_HEADER_SIZE + keyLength + valueLength;
+    }
+
+    bool syncFile(FILE *file)
+    {
+        return fflush(file) == 0 && fsync(fileno(file) ) == 0;
+    }
+}
+
+namespace _2log
+{
+    LogStore::LogStore()
+    {
+        _mutex              = xSemaphoreCreateMutex();
+        _compactionSignal   = xSemaphoreCreateBinary();
+        _compactionTask     = new WorkerTask("kv_compaction", _compactionSignal, [this]() { compactionStep(); });
+    }
+
+    LogStore::~LogStore()
+    {
+        close();
+
+        delete _compactionTask;
+
+        if ( _compactionSignal != nullptr )
+        {
+            vSemaphoreDelete(_compactionSignal);
+        }
+
+        if ( _mutex != nullptr )
+        {
+            vSemaphoreDelete(_mutex);
+        }
+    }
+
+    bool LogStore::open(const char *fileName)
+    {
+        close();
+
+        if ( _mutex == nullptr || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        _fileName   = fileName;
+        _statistics = {};
+
+        bool success = openSegment() && scanSegment();
+
+        if ( success && _statistics.discardedBytes > 0 )
+        {
+            ESP_LOGW(LOG_TAG, "Discarding %u bytes after the last valid record of %s", _statistics.discardedBytes, fileName);
+            success = compactLocked();
+        }
+
+        if ( ! success && _file != nullptr )
+        {
+            fclose(_file);
+            _file = nullptr;
+        }
+
+        if ( success )
+        {
+            ESP_LOGI(LOG_TAG, "Opened %s: %u keys, %u bytes, %u dead", fileName, static_cast<unsigned>( _index.size() ),
+                     static_cast<unsigned>(_end), static_cast<unsigned>(_statistics.deadBytes) );
+        }
+        else
+        {
+            ESP_LOGE(LOG_TAG, "Failed to open %s", fileName);
+        }
+
+        bool compactionDue = needsCompaction();
+
+        xSemaphoreGive(_mutex);
+
+        if ( success )
+        {
+            if ( ! _compactionTask->start() )
+            {
+                ESP_LOGE(LOG_TAG, "Failed to start compaction task");
+            }
+            else if ( compactionDue )
+            {
+                requestCompaction();
+            }
+        }
+
+        return success;
+    }
+
+    void LogStore::close()
+    {
+        // before locking, a running compaction is finished first
+        _compactionTask->stop();
+
+        if ( _mutex == nullptr || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return;
+        }
+
+        if ( _file != nullptr )
+        {
+            fclose(_file);
+            _file = nullptr;
+        }
+
+        _index.clear();
+        _end = 0;
+
+        xSemaphoreGive(_mutex);
+    }
+
+    bool LogStore::isOpen() const
+    {
+        return _file != nullptr;
+    }
+
+    bool LogStore::put(const char *key, const void *value, size_t length)
+    {
+        size_t keyLength = strlen(key);
+
+        if ( keyLength == 0 || keyLength > LOG_STORE_MAX_KEY_LENGTH || length > LOG_STORE_MAX_VALUE_LENGTH )
+        {
+            ESP_LOGE(LOG_TAG, "Key or value of %s too long", key);
+            return false;
+        }
+
+        if ( xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        size_t  offset  = _end;
+        bool    success = appendRecord(RECORD_PUT, key, keyLength, value, length);
+
+        if ( success )
+        {
+            auto entry = _index.find(key);
+
+            if ( entry != _index.end() )
+            {
+                _statistics.deadBytes += getRecordSize(keyLength, entry->second.valueLength);
+                entry->second = { static_cast<uint32_t>(offset), static_cast<uint32_t>(length) };
+            }
+            else
+            {
+                _index.emplace(key, IndexEntry{ static_cast<uint32_t>(offset), static_cast<uint32_t>(length) });
+            }
+
+            _statistics.puts++;
+        }
+
+        bool compactionDue = needsCompaction();
+
+        xSemaphoreGive(_mutex);
+
+        if ( compactionDue )
+        {
+            requestCompaction();
+        }
+
+        return success;
+    }
+
+    bool LogStore::write(const Batch &batch)
+    {
+        for ( const Batch::Operation &operation : batch._operations )
+        {
+            if ( operation.key.empty() || operation.key.size() > LOG_STORE_MAX_KEY_LENGTH || operation.value.size() > LOG_STORE_MAX_VALUE_LENGTH )
+            {
+                ESP_LOGE(LOG_TAG, "Key or value of %s too long", operation.key.c_str() );
+                return false;
+            }
+        }
+
+        if ( xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        std::vector<const Batch::Operation*> operations;
+        operations.reserve( batch._operations.size() );
+
+        for ( const Batch::Operation &operation : batch._operations )
+        {
+            bool exists = operation.type == RECORD_PUT || _index.find(operation.key) != _index.end();
+
+            // a remove of a key that is only put by this batch is kept
+            for ( size_t index = 0; ! exists && index < operations.size(); index++ )
+            {
+                exists = operations[index]->key == operation.key;
+            }
+
+            if ( exists )
+            {
+                operations.push_back(&operation);
+            }
+        }
+
+        if ( operations.empty() )
+        {
+            xSemaphoreGive(_mutex);
+            return true;
+        }
+
+        uint8_t             count[MARKER_LENGTH];
+        size_t              end = _end + getRecordSize(0, MARKER_LENGTH);
+        std::vector<size_t> offsets;
+
+        writeUint32(count, static_cast<uint32_t>( operations.size() ) );
+        offsets.reserve( operations.size() );
+
+        bool success = _file != nullptr && fseek(_file, static_cast<long>(_end), SEEK_SET) == 0 && writeRecord(RECORD_BEGIN, nullptr, 0, count, sizeof(count) );
+
+        for ( size_t index = 0; success && index < operations.size(); index++ )
+        {
+            const Batch::Operation &operation = *operations[index];
+
+            offsets.push_back(end);
+            end += getRecordSize( operation.key.size(), operation.value.size() );
+
+            success = writeRecord(operation.type, operation.key.data(), operation.key.size(), operation.value.data(), operation.value.size() );
+        }
+
+        success = success && writeRecord(RECORD_COMMIT, nullptr, 0, count, sizeof(count) ) && syncFile(_file);
+        end += getRecordSize(0, MARKER_LENGTH);
+
+        if ( success )
+        {
+            for ( size_t index = 0; index < operations.size(); index++ )
+            {
+                const Batch::Operation &operation = *operations[index];
+
+                indexRecord(operation.type, operation.key.c_str(), operation.key.size(), offsets[index], static_cast<uint32_t>( operation.value.size() ) );
+
+                if ( operation.type == RECORD_PUT )
+                {
+                    _statistics.puts++;
+                }
+                else
+                {
+                    _statistics.removes++;
+                }
+            }
+
+            _statistics.deadBytes      += 2 * getRecordSize(0, MARKER_LENGTH);
+            _statistics.bytesWritten   += end - _end;
+            _statistics.batches++;
+            _end                        = end;
+        }
+        else
+        {
+            ESP_LOGE(LOG_TAG, "Failed to write a batch of %u operations", static_cast<unsigned>( operations.size() ) );
+
+            if ( _file != nullptr )
+            {
+                invalidateTail(end - _end);
+            }
+        }
+
+        bool compactionDue = needsCompaction();
+
+        xSemaphoreGive(_mutex);
+
+        if ( compactionDue )
+        {
+            requestCompaction();
+        }
+
+        return success;
+    }
+
+    bool LogStore::get(const char *key, std::string &value)
+    {
+        if ( xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        bool success    = false;
+        auto entry      = _index.find(key);
+
+        _statistics.gets++;
+
+        if ( entry != _index.end() && _file != nullptr )
+        {
+            value.resize(entry->second.valueLength);
+
+            success = fseek(_file, static_cast<long>( entry->second.offset + RECORD_HEADER_SIZE + entry->first.size() ), SEEK_SET) == 0 &&
+                      fread(&value[0], 1, value.size(), _file) == value.size();
+
+            if ( ! success )
+            {
+                ESP_LOGE(LOG_TAG, "Failed to read the value of %s", key);
+            }
+        }
+
+        xSemaphoreGive(_mutex);
+
+        return success;
+    }
+
+    bool LogStore::forEach(const RecordFunction &function)
+    {
+        if ( xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        // visit the records in the order of the segment, after a compaction they are adjacent
+        std::vector<const std::pair<const std::string, IndexEntry>*> entries;
+        entries.reserve( _index.size() );
+
+        for ( const auto &entry : _index )
+        {
+            entries.push_back(&entry);
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const std::pair<const std::string, IndexEntry> *a, const std::pair<const std::string, IndexEntry> *b)
+        {
+            return a->second.offset < b->second.offset;
+        });
+
+        bool        success     = _file != nullptr;
+        long        position    = -1;
+        std::string value;
+
+        for ( size_t index = 0; success && index < entries.size(); index++ )
+        {
+            const std::string   &key    = entries[index]->first;
+            const IndexEntry    &entry  = entries[index]->second;
+            long                offset  = static_cast<long>( entry.offset + RECORD_HEADER_SIZE + key.size() );
+
+            value.resize(entry.valueLength);
+
+            // skip the header and key with a read while the next record follows closely, a seek refills the buffer
+            if ( position < 0 || offset < position || offset - position > static_cast<long>(CHUNK_SIZE) )
+            {
+                success = fseek(_file, offset, SEEK_SET) == 0;
+            }
+            else
+            {
+                uint8_t skipped[CHUNK_SIZE];
+                size_t  length = static_cast<size_t>( offset - position );
+
+                success = fread(skipped, 1, length, _file) == length;
+            }
+
+            success = success && fread(&value[0], 1, value.size(), _file) == value.size();
+
+            if ( ! success )
+            {
+                ESP_LOGE(LOG_TAG, "Failed to read the value of %s", key.c_str() );
+                break;
+            }
+
+            position = offset + static_cast<long>( value.size() );
+
+            if ( ! function(key.c_str(), value) )
+            {
+                break;
+            }
+        }
+
+        xSemaphoreGive(_mutex);
+
+        return success;
+    }
+
+    bool LogStore::contains(const char *key)
+    {
+        if ( xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        bool found = _index.find(key) != _index.end();
+
+        xSemaphoreGive(_mutex);
+
+        return found;
+    }
+
+    bool LogStore::remove(const char *key)
+    {
+        if ( xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        bool success    = false;
+        auto entry      = _index.find(key);
+
+        if ( entry != _index.end() && appendRecord(RECORD_REMOVE, key, entry->first.size(), nullptr, 0) )
+        {
+            // the removal record itself is dead right away, compaction drops both
+            _statistics.deadBytes += getRecordSize(entry->first.size(), entry->second.valueLength) + getRecordSize(entry->first.size(), 0);
+            _statistics.removes++;
+            _index.erase(entry);
+
+            success = true;
+        }
+
+        bool compactionDue = needsCompaction();
+
+        xSemaphoreGive(_mutex);
+
+        if ( compactionDue )
+        {
+            requestCompaction();
+        }
+
+        return success;
+    }
+
+    bool LogStore::compact()
+    {
+        if ( xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        bool success = compactLocked();
+
+        xSemaphoreGive(_mutex);
+
+        return success;
+    }
+
+    LogStore::Statistics LogStore::getStatistics()
+    {
+        Statistics statistics = {};
+
+        if ( xSemaphoreTake(_mutex, portMAX_DELAY) == pdTRUE )
+        {
+            statistics      = _statistics;
+            statistics.keys = static_cast<uint32_t>( _index.size() );
+            statistics.size = _end;
+
+            xSemaphoreGive(_mutex);
+        }
+
+        return statistics;
+    }
+
+    void LogStore::Batch::put(const char *key, const void *value, size_t length)
+    {
+        _operations.push_back({ RECORD_PUT, key, length > 0 ? std::string(static_cast<const char*>(value), length) : std::string() });
+    }
+
+    void LogStore::Batch::remove(const char *key)
+    {
+        _operations.push_back({ RECORD_REMOVE, key, std::string() });
+    }
+
+    void LogStore::Batch::clear()
+    {
+        _operations.clear();
+    }
+
+    bool LogStore::Batch::empty() const
+    {
+        return _operations.empty();
+    }
+
+    size_t LogStore::Batch::size() const
+    {
+        return _operations.size();
+    }
+
+    void LogStore::compactionStep()
+    {
+        ALLOCATION_SUBSYSTEM(AllocationSubsystem::DeviceProperties);
+
+        if ( xSemaphoreTake(_compactionSignal, portMAX_DELAY) != pdTRUE )
+        {
+            return;
+        }
+
+        if ( xSemaphoreTake(_mutex, portMAX_DELAY) == pdTRUE )
+        {
+            if ( needsCompaction() )
+            {
+                compactLocked();
+            }
+
+            xSemaphoreGive(_mutex);
+        }
+    }
+
+    bool LogStore::openSegment()
+    {
+        std::string temporaryName = _fileName + ".tmp";
+        struct stat fileStat;
+
+        if ( stat(temporaryName.c_str(), &fileStat) == 0 )
+        {
+            if ( stat(_fileName.c_str(), &fileStat) == 0 )
+            {
+                // the compaction did not finish, the segment is still complete
+                unlink(temporaryName.c_str() );
+            }
+            else if ( rename(temporaryName.c_str(), _fileName.c_str() ) != 0 )
+            {
+                ESP_LOGE(LOG_TAG, "Failed to complete the compaction of %s", _fileName.c_str() );
+                return false;
+            }
+        }
+
+        _file = fopen(_fileName.c_str(), "r+b");
+
+        if ( _file == nullptr )
+        {
+            _file = fopen(_fileName.c_str(), "w+b");
+        }
+
+        return _file != nullptr;
+    }
+
+    bool LogStore::scanSegment()
+    {
+        _index.clear();
+
+        if ( fseek(_file, 0, SEEK_END) != 0 )
+        {
+            return false;
+        }
+
+        long    size = ftell(_file);
+        uint8_t header[HEADER_SIZE] = { 0 };
+
+        if ( size == 0 )
+        {
+            memcpy(header, STORE_MAGIC, sizeof(STORE_MAGIC) );
+            header[4] = FORMAT_VERSION;
+
+            if ( fwrite(header, 1, sizeof(header), _file) != sizeof(header) || ! syncFile(_file) )
+            {
+                return false;
+            }
+
+            _end = HEADER_SIZE;
+            _statistics.bytesWritten += HEADER_SIZE;
+
+            return true;
+        }
+
+        if ( size < static_cast<long>(HEADER_SIZE) || fseek(_file, 0, SEEK_SET) != 0 || fread(header, 1, sizeof(header), _file) != sizeof(header) ||
+             memcmp(header, STORE_MAGIC, sizeof(STORE_MAGIC) ) != 0 || header[4] != FORMAT_VERSION )
+        {
+            ESP_LOGE(LOG_TAG, "%s is not a segment of a supported version", _fileName.c_str() );
+            return false;
+        }
+
+        size_t  offset = HEADER_SIZE;
+        uint8_t recordHeader[RECORD_HEADER_SIZE];
+        char    key[LOG_STORE_MAX_KEY_LENGTH + 1];
+        uint8_t chunk[CHUNK_SIZE];
+
+        struct PendingRecord
+        {
+            uint8_t     type;
+            std::string key;
+            size_t      offset;
+            uint32_t    valueLength;
+        };
+
+        // records of a batch are indexed when its COMMIT is found
+        std::vector<PendingRecord>  pending;
+        size_t                      batchStart = 0;
+
+        // the records are read in one sequential pass, a seek would drop the read buffer of the file
+        while ( offset + RECORD_HEADER_SIZE <= static_cast<size_t>(size) )
+        {
+            if ( fread(recordHeader, 1, RECORD_HEADER_SIZE, _file) != RECORD_HEADER_SIZE )
+            {
+                break;
+            }
+
+            uint8_t     type        = recordHeader[1];
+            size_t      keyLength   = recordHeader[2];
+            uint32_t    valueLength = readUint32(recordHeader + 4);
+            size_t      recordSize  = getRecordSize(keyLength, valueLength);
+
+            bool        isMarker    = type == RECORD_BEGIN || type == RECORD_COMMIT;
+
+            if ( recordHeader[0] != RECORD_MAGIC || type < RECORD_PUT || type > RECORD_COMMIT || ( keyLength == 0 ) != isMarker ||
+                 keyLength > LOG_STORE_MAX_KEY_LENGTH || valueLength > LOG_STORE_MAX_VALUE_LENGTH || ( type == RECORD_REMOVE && valueLength > 0 ) ||
+                 ( isMarker && valueLength != MARKER_LENGTH ) || offset + recordSize > static_cast<size_t>(size) )
+            {
+                break;
+            }
+
+            if ( fread(key, 1, keyLength, _file) != keyLength )
+            {
+                break;
+            }
+
+            key[keyLength] = '\0';
+
+            uint32_t crc = updateCrc32(0, recordHeader, 8);
+            crc = updateCrc32(crc, key, keyLength);
+
+            size_t remaining = valueLength;
+
+            while ( remaining > 0 )
+            {
+                size_t length = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
+
+                if ( fread(chunk, 1, length, _file) != length )
+                {
+                    break;
+                }
+
+                crc = updateCrc32(crc, chunk, length);
+                remaining -= length;
+            }
+
+            if ( remaining > 0 || crc != readUint32(recordHeader + 8) )
+            {
+                break;
+            }
+
+            if ( type == RECORD_BEGIN )
+            {
+                if ( batchStart != 0 )
+                {
+                    break;
+                }
+
+                batchStart = offset;
+                pending.clear();
+            }
+            else if ( type == RECORD_COMMIT )
+            {
+                if ( batchStart == 0 || readUint32(chunk) != pending.size() )
+                {
+                    break;
+                }
+
+                for ( const PendingRecord &record : pending )
+                {
+                    indexRecord(record.type, record.key.c_str(), record.key.size(), record.offset, record.valueLength);
+                }
+
+                // the markers are dead right away
+                _statistics.deadBytes += 2 * getRecordSize(0, MARKER_LENGTH);
+                batchStart = 0;
+                pending.clear();
+            }
+            else if ( batchStart != 0 )
+            {
+                pending.push_back({ type, key, offset, valueLength });
+            }
+            else
+            {
+                indexRecord(type, key, keyLength, offset, valueLength);
+            }
+
+            offset += recordSize;
+        }
+
+        if ( batchStart != 0 )
+        {
+            // a batch without COMMIT was torn, it is dropped with the tail
+            offset = batchStart;
+        }
+
+        _end                        = offset;
+        _statistics.discardedBytes  = static_cast<uint32_t>( static_cast<size_t>(size) - offset );
+
+        return true;
+    }
+
+    bool LogStore::appendRecord(uint8_t type, const char *key, size_t keyLength, const void *value, size_t length)
+    {
+        if ( _file == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "Store not open");
+            return false;
+        }
+
+        size_t  recordSize  = getRecordSize(keyLength, length);
+        bool    success     = fseek(_file, static_cast<long>(_end), SEEK_SET) == 0 && writeRecord(type, key, keyLength, value, length) && syncFile(_file);
+
+        if ( ! success )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to append the record of %s", key);
+            invalidateTail(recordSize);
+            return false;
+        }
+
+        _end                        += recordSize;
+        _statistics.bytesWritten    += recordSize;
+
+        return true;
+    }
+
+    bool LogStore::writeRecord(uint8_t type, const char *key, size_t keyLength, const void *value, size_t length)
+    {
+        uint8_t header[RECORD_HEADER_SIZE] = { RECORD_MAGIC, type, static_cast<uint8_t>(keyLength), 0 };
+        writeUint32(header + 4, static_cast<uint32_t>(length) );
+
+        uint32_t crc = updateCrc32(0, header, 8);
+        crc = updateCrc32(crc, key, keyLength);
+        crc = updateCrc32(crc, value, length);
+        writeUint32(header + 8, crc);
+
+        return fwrite(header, 1, sizeof(header), _file) == sizeof(header) && ( keyLength == 0 || fwrite(key, 1, keyLength, _file) == keyLength ) &&
+               ( length == 0 || fwrite(value, 1, length, _file) == length );
+    }
+
+    void LogStore::invalidateTail(size_t length)
+    {
+        // a record may be complete on the flash although writing or syncing it failed, zeroing it keeps
+        // open() from finding it, and from finding records of a batch behind a shorter next record
+        static const uint8_t zeros[CHUNK_SIZE] = {};
+
+        clearerr(_file);
+
+        bool success = fseek(_file, static_cast<long>(_end), SEEK_SET) == 0;
+
+        for ( size_t offset = 0; success && offset < length; offset += CHUNK_SIZE )
+        {
+            size_t chunkLength = std::min(CHUNK_SIZE, length - offset);
+            success = fwrite(zeros, 1, chunkLength, _file) == chunkLength;
+        }
+
+        if ( ! success || ! syncFile(_file) )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to invalidate %u bytes after the last record", static_cast<unsigned>(length) );
+            clearerr(_file);
+        }
+    }
+
+    void LogStore::indexRecord(uint8_t type, const char *key, size_t keyLength, size_t offset, uint32_t valueLength)
+    {
+        auto entry = _index.find(key);
+
+        if ( entry != _index.end() )
+        {
+            _statistics.deadBytes += getRecordSize(keyLength, entry->second.valueLength);
+        }
+
+        if ( type == RECORD_PUT )
+        {
+            if ( entry != _index.end() )
+            {
+                entry->second = { static_cast<uint32_t>(offset), valueLength };
+            }
+            else
+            {
+                _index.emplace(key, IndexEntry{ static_cast<uint32_t>(offset), valueLength });
+            }
+        }
+        else
+        {
+            // the removal record itself is dead right away
+            _statistics.deadBytes += getRecordSize(keyLength, 0);
+
+            if ( entry != _index.end() )
+            {
+                _index.erase(entry);
+            }
+        }
+    }
+
+    bool LogStore::compactLocked()
+    {
+        if ( _file == nullptr )
+        {
+            return false;
+        }
+
+        std::string temporaryName   = _fileName + ".tmp";
+        FILE*       temporary       = fopen(temporaryName.c_str(), "wb");
+
+        if ( temporary == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to create %s", temporaryName.c_str() );
+            return false;
+        }
+
+        uint8_t header[HEADER_SIZE] = { 0 };
+        memcpy(header, STORE_MAGIC, sizeof(STORE_MAGIC) );
+        header[4] = FORMAT_VERSION;
+
+        bool                    success = fwrite(header, 1, sizeof(header), temporary) == sizeof(header);
+        size_t                  end     = HEADER_SIZE;
+        std::vector<uint32_t>   offsets;
+        uint8_t                 chunk[CHUNK_SIZE];
+
+        offsets.reserve( _index.size() );
+
+        // records do not depend on their position, so the live ones are copied unchanged
+        for ( auto entry = _index.begin(); success && entry != _index.end(); ++entry )
+        {
+            size_t remaining = getRecordSize(entry->first.size(), entry->second.valueLength);
+
+            offsets.push_back( static_cast<uint32_t>(end) );
+            end += remaining;
+
+            success = fseek(_file, static_cast<long>(entry->second.offset), SEEK_SET) == 0;
+
+            while ( success && remaining > 0 )
+            {
+                size_t length = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
+
+                success     = fread(chunk, 1, length, _file) == length && fwrite(chunk, 1, length, temporary) == length;
+                remaining  -= length;
+            }
+        }
+
+        success = syncFile(temporary) && success;
+        fclose(temporary);
+
+        if ( ! success )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to compact %s", _fileName.c_str() );
+            unlink(temporaryName.c_str() );
+            return false;
+        }
+
+        // SPIFFS can not rename onto an existing file, openSegment() completes the compaction if we reset in between
+        fclose(_file);
+        _file = nullptr;
+        unlink(_fileName.c_str() );
+
+        if ( ! openSegment() )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to reopen %s after compaction", _fileName.c_str() );
+            _index.clear();
+            return false;
+        }
+
+        size_t index = 0;
+
+        for ( auto &entry : _index )
+        {
+            entry.second.offset = offsets[index++];
+        }
+
+        ESP_LOGI(LOG_TAG, "Compacted %s from %u to %u bytes", _fileName.c_str(), static_cast<unsigned>(_end), static_cast<unsigned>(end) );
+
+        _end                        = end;
+        _statistics.deadBytes       = 0;
+        _statistics.bytesWritten   += end;
+        _statistics.compactions++;
+
+        return true;
+    }
+
+    bool LogStore::needsCompaction() const
+    {
+        return _file != nullptr && _statistics.deadBytes >= LOG_STORE_COMPACTION_MIN_DEAD_BYTES &&
+               _statistics.deadBytes * 100 >= _end * LOG_STORE_COMPACTION_DEAD_PERCENT;
+    }
+
+    void LogStore::requestCompaction()
+    {
+        if ( _compactionSignal != nullptr )
+        {
+            xSemaphoreGive(_compactionSignal);
+        }
+    }
+}
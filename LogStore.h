@@ -0,0 +1,235 @@
+#ifndef LOGSTORE_H
+#define LOGSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <functional>
+
+#include "WorkerTask.h"
+
+extern "C"
+{
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/semphr.h>
+}
+
+#ifndef LOG_STORE_MAX_KEY_LENGTH
+    #define LOG_STORE_MAX_KEY_LENGTH            64
+#endif
+
+#ifndef LOG_STORE_MAX_VALUE_LENGTH
+    #define LOG_STORE_MAX_VALUE_LENGTH          4096
+#endif
+
+// compaction starts when at least this many bytes of the segment are dead ...
+#ifndef LOG_STORE_COMPACTION_MIN_DEAD_BYTES
+    #define LOG_STORE_COMPACTION_MIN_DEAD_BYTES 4096
+#endif
+
+// ... and they make up at least this percentage of the segment
+#ifndef LOG_STORE_COMPACTION_DEAD_PERCENT
+    #define LOG_STORE_COMPACTION_DEAD_PERCENT   50
+#endif
+
+namespace _2log
+{
+    /**
+     * @brief The LogStore class is an append-only key/value store in a single segment file.
+     *
+     * The segment starts with the 8 byte header "QHKV", version, 3 reserved bytes. Every put() and remove()
+     * appends one record: magic byte, record type, key length, reserved byte, the value length and the CRC-32
+     * of the record as little endian uint32, followed by the key and the value. A removal is a record without
+     * a value. An update therefore writes only the record itself instead of rewriting a file.
+     *
+     * write() appends a Batch of puts and removes between a BEGIN and a COMMIT record, both without a key and
+     * with the number of operations as value, and syncs the file once. open() applies the records of a batch
+     * only when it finds its COMMIT, so after a reset either all or none of them are in the store.
+     *
+     * The index of all live keys with the offset of their value is kept in RAM. It is rebuilt by reading the
+     * segment sequentially in open(), which stops at the first record with a bad header or CRC, e.g. one that
+     * was torn by a power loss; such a segment is compacted right away, which drops the broken tail. A record
+     * or batch whose write or sync fails is overwritten with zeros, so it does not come back with the next
+     * open() even if it reached the flash.
+     *
+     * Records that were overwritten or removed are dead. Once enough of the segment is dead it is compacted
+     * by a background task that runs while the store is open: the live records are copied to "<segment>.tmp",
+     * which then replaces the segment.
+     * If the device resets in between, open() completes or discards the compaction.
+     *
+     * All functions may be called from any task.
+     */
+    class LogStore
+    {
+        public:
+
+            static const uint8_t    FORMAT_VERSION = 1;
+            static const size_t     HEADER_SIZE = 8;
+            static const size_t     RECORD_HEADER_SIZE = 12;
+
+            /**
+             * @brief The Batch class collects puts and removes that write() applies atomically
+             */
+            class Batch
+            {
+                public:
+
+                    /**
+                     * @brief Add a put, the value is copied
+                     */
+                    void        put(const char *key, const void *value, size_t length);
+
+                    void        remove(const char *key);
+
+                    void        clear(void);
+
+                    bool        empty(void) const;
+
+                    size_t      size(void) const;
+
+                private:
+
+                    friend class LogStore;
+
+                    struct Operation
+                    {
+                        uint8_t     type;
+                        std::string key;
+                        std::string value;
+                    };
+
+                    std::vector<Operation>  _operations;
+            };
+
+            /**
+             * @brief Called by forEach() with every key and its value, returns \c false to stop
+             */
+            typedef std::function<bool(const char *key, const std::string &value)>  RecordFunction;
+
+            /**
+             * @brief The Statistics struct summarizes the segment and the operations since open()
+             */
+            struct Statistics
+            {
+                uint32_t    keys;               ///< number of live keys
+                size_t      size;               ///< segment size in bytes
+                size_t      deadBytes;          ///< bytes of overwritten or removed records
+                uint32_t    puts;
+                uint32_t    gets;
+                uint32_t    removes;
+                uint32_t    compactions;
+                uint32_t    batches;            ///< batches committed by write()
+                uint64_t    bytesWritten;       ///< bytes appended to the segment or written by compactions
+                uint32_t    discardedBytes;     ///< bytes after the last valid record found by open()
+            };
+
+                                LogStore(void);
+                                ~LogStore(void);
+
+                                LogStore(LogStore const&)       = delete;
+            void                operator=(LogStore const&)      = delete;
+
+            /**
+             * @brief Open or create the segment and build the index
+             * @param fileName  the segment file, on a mounted file system
+             *
+             * @return  \c true if the store is ready, \c false otherwise
+             */
+            bool                open(const char *fileName);
+
+            void                close(void);
+
+            bool                isOpen(void) const;
+
+            /**
+             * @brief Store a value, an existing value of the key is replaced
+             * @param key       NULL-terminated key of at most LOG_STORE_MAX_KEY_LENGTH characters
+             * @param value     the value data
+             * @param length    the value length of at most LOG_STORE_MAX_VALUE_LENGTH bytes
+             *
+             * @return  \c true if the record was written, \c false otherwise
+             */
+            bool                put(const char *key, const void *value, size_t length);
+
+            /**
+             * @brief Write the operations of a batch as one journaled transaction with a single sync
+             * @param batch     the puts and removes, a remove of a key that does not exist is skipped
+             *
+             * @return  \c true if the batch was committed, \c false otherwise, then none of it was applied
+             */
+            bool                write(const Batch &batch);
+
+            /**
+             * @brief Read a value
+             * @param key       NULL-terminated key
+             * @param value     receives the value
+             *
+             * @return  \c true if the key exists and the value was read, \c false otherwise
+             */
+            bool                get(const char *key, std::string &value);
+
+            /**
+             * @brief Read all values in one pass over the segment, e.g. to load them at boot
+             * @param function  called with every key and value in the order of the segment, while the store is
+             *                  locked, so it must not call the store
+             *
+             * @return  \c true if all values were read, \c false on a read error
+             */
+            bool                forEach(const RecordFunction &function);
+
+            /**
+             * @brief Check if a key exists, answered from the index
+             */
+            bool                contains(const char *key);
+
+            /**
+             * @brief Remove a key
+             * @return  \c true if the key existed and was removed, \c false otherwise
+             */
+            bool                remove(const char *key);
+
+            /**
+             * @brief Compact the segment now, on the calling task
+             * @return  \c true on success, \c false otherwise
+             */
+            bool                compact(void);
+
+            Statistics          getStatistics(void);
+
+        private:
+
+            struct IndexEntry
+            {
+                uint32_t    offset;         ///< offset of the record in the segment
+                uint32_t    valueLength;
+            };
+
+            void                compactionStep(void);
+
+            bool                openSegment(void);
+            bool                scanSegment(void);
+            bool                appendRecord(uint8_t type, const char *key, size_t keyLength, const void *value, size_t length);
+            bool                writeRecord(uint8_t type, const char *key, size_t keyLength, const void *value, size_t length);
+            void                invalidateTail(size_t length);
+            void                indexRecord(uint8_t type, const char *key, size_t keyLength, size_t offset, uint32_t valueLength);
+            bool                compactLocked(void);
+            bool                needsCompaction(void) const;
+            void                requestCompaction(void);
+
+        private:
+
+            SemaphoreHandle_t                               _mutex = { nullptr };
+            SemaphoreHandle_t                               _compactionSignal = { nullptr };
+            WorkerTask*                                     _compactionTask = { nullptr };
+            FILE*                                           _file = { nullptr };
+            std::string                                     _fileName;
+            std::map<std::string, IndexEntry, std::less<>>  _index;             ///< transparent, lookups by c-string do not allocate
+            size_t                                          _end = { 0 };       ///< end of the last valid record
+            Statistics                                      _statistics = {};
+    };
+}
+
+#endif
@@ -0,0 +1,177 @@
+#include "MessageArena.h"
+#include "PerfCounters.h"
+#include "AllocationTracker.h"
+
+#include <stdlib.h>
+#include <cJSON.h>
+
+extern "C"
+{
+    #include "esp_log.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG         = "_2log::MessageArena";
+    const size_t    ARENA_ALIGNMENT = 8;
+}
+
+namespace _2log
+{
+    alignas(ARENA_ALIGNMENT) uint8_t    MessageArena::_buffer[MESSAGE_ARENA_SIZE];
+    size_t                              MessageArena::_offset       = 0;
+    uint32_t                            MessageArena::_depth        = 0;
+    uint32_t                            MessageArena::_suspendDepth = 0;
+    std::atomic<TaskHandle_t>           MessageArena::_owner        = { nullptr };
+    std::atomic<bool>                   MessageArena::_installed    = { false };
+    MessageArena::Statistics            MessageArena::_statistics   = {};
+
+    MessageArena::Scope::Scope()
+    {
+        if ( ! _installed )
+        {
+            return;
+        }
+
+        TaskHandle_t currentTask    = xTaskGetCurrentTaskHandle();
+        TaskHandle_t expected       = nullptr;
+
+        if ( _owner.load() == currentTask )
+        {
+            // nested scope of the same task
+            _depth++;
+            _active = true;
+        }
+        else if ( _owner.compare_exchange_strong(expected, currentTask) )
+        {
+            _depth = 1;
+            _active = true;
+            _statistics.scopes++;
+        }
+    }
+
+    MessageArena::Scope::~Scope()
+    {
+        if ( ! _active )
+        {
+            return;
+        }
+
+        _depth--;
+
+        if ( _depth == 0 )
+        {
+            reset();
+            _owner.store(nullptr);
+        }
+    }
+
+    bool MessageArena::Scope::isActive() const
+    {
+        return _active;
+    }
+
+    MessageArena::Suspend::Suspend()
+    {
+        // only the owner task touches the suspend depth
+        if ( _owner.load() == xTaskGetCurrentTaskHandle() )
+        {
+            _suspendDepth++;
+            _suspended = true;
+        }
+    }
+
+    MessageArena::Suspend::~Suspend()
+    {
+        if ( _suspended )
+        {
+            _suspendDepth--;
+        }
+    }
+
+    void MessageArena::install()
+    {
+        if ( _installed.exchange(true) )
+        {
+            return;
+        }
+
+        cJSON_Hooks hooks;
+        hooks.malloc_fn = &MessageArena::allocate;
+        hooks.free_fn   = &MessageArena::release;
+
+        cJSON_InitHooks(&hooks);
+
+        ESP_LOGD(LOG_TAG, "cJSON arena hooks installed (%u bytes)", static_cast<unsigned>(MESSAGE_ARENA_SIZE) );
+    }
+
+    MessageArena::Statistics MessageArena::getStatistics()
+    {
+        return _statistics;
+    }
+
+    void *MessageArena::allocate(size_t size)
+    {
+        PERF_COUNT_ALLOCATION(size);
+
+        if ( _owner.load() != xTaskGetCurrentTaskHandle() || _suspendDepth > 0 )
+        {
+            return AllocationTracker::allocate(size);
+        }
+
+        size_t alignedSize = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+        if ( alignedSize > MESSAGE_ARENA_SIZE - _offset )
+        {
+            _statistics.fallbacks++;
+            return AllocationTracker::allocate(size);
+        }
+
+        void *pointer = &_buffer[_offset];
+        _offset += alignedSize;
+
+        _statistics.allocations++;
+
+        if ( _offset > _statistics.highWaterMark )
+        {
+            _statistics.highWaterMark = _offset;
+        }
+
+        return pointer;
+    }
+
+    void MessageArena::release(void *pointer)
+    {
+        // arena memory is released as a whole when the scope is left
+        if ( ! contains(pointer) )
+        {
+            AllocationTracker::release(pointer);
+        }
+    }
+
+    bool MessageArena::contains(const void *pointer)
+    {
+        const uint8_t *bytePointer = static_cast<const uint8_t*>(pointer);
+        return bytePointer >= _buffer && bytePointer < _buffer + MESSAGE_ARENA_SIZE;
+    }
+
+    void MessageArena::reset()
+    {
+        _offset = 0;
+    }
+}
+
+namespace
+{
+    /*
+     * The hooks are installed before app_main() or main(), so no cJSON data allocated with plain malloc() is
+     * ever released through them, which would hand a block without a header to AllocationTracker::release().
+     */
+    struct HookInstaller
+    {
+        HookInstaller()
+        {
+            _2log::MessageArena::install();
+        }
+    } hookInstaller;
+}
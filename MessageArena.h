@@ -0,0 +1,127 @@
+#ifndef MESSAGEARENA_H
+#define MESSAGEARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+extern "C"
+{
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/task.h>
+}
+
+#ifndef MESSAGE_ARENA_SIZE
+    #define MESSAGE_ARENA_SIZE      4096
+#endif
+
+namespace _2log
+{
+    /**
+     * @brief The MessageArena class provides a message scoped bump allocator for cJSON.
+     *
+     * Once installed via cJSON_InitHooks, all cJSON allocations made by the task that currently holds a
+     * MessageArena::Scope are served from a static buffer, which is reset as a whole when the outermost
+     * scope is left. Allocations of all other tasks, and allocations that do not fit into the remaining
+     * arena space, are passed on to malloc(). This keeps the many short-lived cJSON nodes and strings of
+     * a single QuickHub message away from the general heap.
+     *
+     * cJSON memory that is allocated inside a scope must not be used after the scope was left. Connection and
+     * DeviceNode call event handlers and application callbacks under a MessageArena::Suspend, so those only
+     * have to keep the received message itself out of their own data.
+     */
+    class MessageArena
+    {
+        public:
+
+            /**
+             * @brief The Scope class marks the lifetime of a single message.
+             *
+             * Scopes of the same task can be nested, the arena is reset when the outermost scope is left.
+             * If another task already holds the arena, the scope is inactive and cJSON falls back to malloc().
+             */
+            class Scope
+            {
+                public:
+
+                                Scope(void);
+                                ~Scope(void);
+
+                                Scope(Scope const&)             = delete;
+                    void        operator=(Scope const&)         = delete;
+
+                    /**
+                     * @brief Check if this scope actually allocates from the arena
+                     * @return  \c true if the arena is held by this scope, \c false otherwise
+                     */
+                    bool        isActive(void) const;
+
+                private:
+
+                    bool        _active = { false };
+            };
+
+            /**
+             * @brief The Suspend class temporarily passes the cJSON allocations of the current task to malloc().
+             *
+             * Use it inside a scope to create cJSON data that has to outlive the current message.
+             */
+            class Suspend
+            {
+                public:
+
+                                Suspend(void);
+                                ~Suspend(void);
+
+                                Suspend(Suspend const&)         = delete;
+                    void        operator=(Suspend const&)       = delete;
+
+                private:
+
+                    bool        _suspended = { false };
+            };
+
+            /**
+             * @brief The Statistics struct summarizes the arena usage since boot
+             */
+            struct Statistics
+            {
+                uint32_t    scopes;             ///< number of outermost scopes that held the arena
+                uint32_t    allocations;        ///< number of allocations served from the arena
+                uint32_t    fallbacks;          ///< number of allocations passed to malloc() because the arena was exhausted
+                size_t      highWaterMark;      ///< maximum number of arena bytes used by a single message
+            };
+
+            /**
+             * @brief Install the arena allocator as cJSON memory hooks. Calling this more than once is safe.
+             *
+             * Done during static initialization already, as soon as MessageArena is linked in.
+             */
+            static void         install(void);
+
+            /**
+             * @brief Get the arena usage statistics
+             * @return  a copy of the current statistics
+             */
+            static Statistics   getStatistics(void);
+
+        private:
+
+            static void*        allocate(size_t size);
+            static void         release(void *pointer);
+            static bool         contains(const void *pointer);
+            static void         reset(void);
+
+        private:
+
+            static uint8_t                      _buffer[MESSAGE_ARENA_SIZE];
+            static size_t                       _offset;
+            static uint32_t                     _depth;
+            static uint32_t                     _suspendDepth;
+            static std::atomic<TaskHandle_t>    _owner;
+            static std::atomic<bool>            _installed;
+            static Statistics                   _statistics;
+    };
+}
+
+#endif
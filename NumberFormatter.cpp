@@ -0,0 +1,541 @@
+#include "NumberFormatter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+namespace
+{
+    // Ryu float-to-string tables and helpers, see Ulf Adams: "Ryu: fast float-to-string conversion" (PLDI 2018)
+
+    const int       FLOAT_MANTISSA_BITS     = 23;
+    const int       FLOAT_EXPONENT_BITS     = 8;
+    const int       FLOAT_BIAS              = 127;
+
+    const int       FLOAT_POW5_INV_BITCOUNT = 59;
+    const int       FLOAT_POW5_BITCOUNT     = 61;
+
+    // floor(2^(pow5bits(i) - 1 + FLOAT_POW5_INV_BITCOUNT) / 5^i) + 1
+    const uint64_t  FLOAT_POW5_INV_SPLIT[31] =
+    {
+        576460752303423489u, 461168601842738791u, 368934881474191033u,
+        295147905179352826u, 472236648286964522u, 377789318629571618u,
+        302231454903657294u, 483570327845851670u, 386856262276681336u,
+        309485009821345069u, 495176015714152110u, 396140812571321688u,
+        316912650057057351u, 507060240091291761u, 405648192073033409u,
+        324518553658426727u, 519229685853482763u, 415383748682786211u,
+        332306998946228969u, 531691198313966350u, 425352958651173080u,
+        340282366920938464u, 544451787073501542u, 435561429658801234u,
+        348449143727040987u, 557518629963265579u, 446014903970612463u,
+        356811923176489971u, 570899077082383953u, 456719261665907162u,
+        365375409332725730u
+    };
+
+    // 5^i scaled to FLOAT_POW5_BITCOUNT bits
+    const uint64_t  FLOAT_POW5_SPLIT[47] =
+    {
+        1152921504606846976u, 1441151880758558720u, 1801439850948198400u,
+        2251799813685248000u, 1407374883553280000u, 1759218604441600000u,
+        2199023255552000000u, 1374389534720000000u, 1717986918400000000u,
+        2147483648000000000u, 1342177280000000000u, 1677721600000000000u,
+        2097152000000000000u, 1310720000000000000u, 1638400000000000000u,
+        2048000000000000000u, 1280000000000000000u, 1600000000000000000u,
+        2000000000000000000u, 1250000000000000000u, 1562500000000000000u,
+        1953125000000000000u, 1220703125000000000u, 1525878906250000000u,
+        1907348632812500000u, 1192092895507812500u, 1490116119384765625u,
+        1862645149230957031u, 1164153218269348144u, 1455191522836685180u,
+        1818989403545856475u, 2273736754432320594u, 1421085471520200371u,
+        1776356839400250464u, 2220446049250313080u, 1387778780781445675u,
+        1734723475976807094u, 2168404344971008868u, 1355252715606880542u,
+        1694065894508600678u, 2117582368135750847u, 1323488980084844279u,
+        1654361225106055349u, 2067951531382569187u, 1292469707114105741u,
+        1615587133892632177u, 2019483917365790221u
+    };
+
+    const uint32_t  POWERS_OF_10[10] =
+    {
+        1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u
+    };
+
+    // returns ceil(log2(5^e)) for e > 0
+    inline int32_t pow5bits(int32_t e)
+    {
+        return static_cast<int32_t>( ( static_cast<uint32_t>(e) * 1217359u ) >> 19 ) + 1;
+    }
+
+    // returns floor(log10(2^e))
+    inline uint32_t log10Pow2(int32_t e)
+    {
+        return ( static_cast<uint32_t>(e) * 78913u ) >> 18;
+    }
+
+    // returns floor(log10(5^e))
+    inline uint32_t log10Pow5(int32_t e)
+    {
+        return ( static_cast<uint32_t>(e) * 732923u ) >> 20;
+    }
+
+    inline uint32_t pow5Factor(uint32_t value)
+    {
+        uint32_t count = 0;
+
+        while ( value % 5 == 0 )
+        {
+            value /= 5;
+            count++;
+        }
+
+        return count;
+    }
+
+    inline bool multipleOfPowerOf5(uint32_t value, uint32_t p)
+    {
+        return pow5Factor(value) >= p;
+    }
+
+    inline bool multipleOfPowerOf2(uint32_t value, uint32_t p)
+    {
+        return ( value & ( (1u << p) - 1 ) ) == 0;
+    }
+
+    // 32x64 bit multiplication with a right shift, without 128 bit integers
+    inline uint32_t mulShift(uint32_t m, uint64_t factor, int32_t shift)
+    {
+        const uint32_t factorLo     = static_cast<uint32_t>(factor);
+        const uint32_t factorHi     = static_cast<uint32_t>(factor >> 32);
+        const uint64_t bits0        = static_cast<uint64_t>(m) * factorLo;
+        const uint64_t bits1        = static_cast<uint64_t>(m) * factorHi;
+        const uint64_t sum          = (bits0 >> 32) + bits1;
+
+        return static_cast<uint32_t>( sum >> (shift - 32) );
+    }
+
+    inline uint32_t mulPow5InvDivPow2(uint32_t m, uint32_t q, int32_t j)
+    {
+        return mulShift(m, FLOAT_POW5_INV_SPLIT[q], j);
+    }
+
+    inline uint32_t mulPow5DivPow2(uint32_t m, uint32_t i, int32_t j)
+    {
+        return mulShift(m, FLOAT_POW5_SPLIT[i], j);
+    }
+
+    inline uint32_t decimalLength(uint32_t value)
+    {
+        uint32_t length = 1;
+
+        while ( length < 10 && value >= POWERS_OF_10[length] )
+        {
+            length++;
+        }
+
+        return length;
+    }
+
+    /**
+     * @brief Compute the shortest decimal representation digits * 10^exponent of a finite, non-zero float
+     */
+    void floatToDecimal(uint32_t ieeeMantissa, uint32_t ieeeExponent, uint32_t &digits, int32_t &exponent)
+    {
+        int32_t     e2;
+        uint32_t    m2;
+
+        if ( ieeeExponent == 0 )
+        {
+            e2 = 1 - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+            m2 = ieeeMantissa;
+        }
+        else
+        {
+            e2 = static_cast<int32_t>(ieeeExponent) - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+            m2 = (1u << FLOAT_MANTISSA_BITS) | ieeeMantissa;
+        }
+
+        const bool      even            = (m2 & 1) == 0;
+        const bool      acceptBounds    = even;
+
+        // step 2: determine the interval of valid decimal representations
+        const uint32_t  mv              = 4 * m2;
+        const uint32_t  mp              = 4 * m2 + 2;
+        const uint32_t  mmShift         = ieeeMantissa != 0 || ieeeExponent <= 1;
+        const uint32_t  mm              = 4 * m2 - 1 - mmShift;
+
+        // step 3: convert to a decimal power base using 64-bit arithmetic
+        uint32_t    vr, vp, vm;
+        int32_t     e10;
+        bool        vmIsTrailingZeros   = false;
+        bool        vrIsTrailingZeros   = false;
+        uint8_t     lastRemovedDigit    = 0;
+
+        if ( e2 >= 0 )
+        {
+            const uint32_t  q = log10Pow2(e2);
+            e10 = static_cast<int32_t>(q);
+            const int32_t   k = FLOAT_POW5_INV_BITCOUNT + pow5bits(static_cast<int32_t>(q)) - 1;
+            const int32_t   i = -e2 + static_cast<int32_t>(q) + k;
+
+            vr = mulPow5InvDivPow2(mv, q, i);
+            vp = mulPow5InvDivPow2(mp, q, i);
+            vm = mulPow5InvDivPow2(mm, q, i);
+
+            if ( q != 0 && (vp - 1) / 10 <= vm / 10 )
+            {
+                // we need to know one removed digit even if we are not going to loop below
+                const int32_t l = FLOAT_POW5_INV_BITCOUNT + pow5bits(static_cast<int32_t>(q) - 1) - 1;
+                lastRemovedDigit = static_cast<uint8_t>( mulPow5InvDivPow2(mv, q - 1, -e2 + static_cast<int32_t>(q) - 1 + l) % 10 );
+            }
+
+            if ( q <= 9 )
+            {
+                // only one of mp, mv, and mm can be a multiple of 5, if any
+                if ( mv % 5 == 0 )
+                {
+                    vrIsTrailingZeros = multipleOfPowerOf5(mv, q);
+                }
+                else if ( acceptBounds )
+                {
+                    vmIsTrailingZeros = multipleOfPowerOf5(mm, q);
+                }
+                else
+                {
+                    vp -= multipleOfPowerOf5(mp, q);
+                }
+            }
+        }
+        else
+        {
+            const uint32_t  q = log10Pow5(-e2);
+            e10 = static_cast<int32_t>(q) + e2;
+            const int32_t   i = -e2 - static_cast<int32_t>(q);
+            const int32_t   k = pow5bits(i) - FLOAT_POW5_BITCOUNT;
+            int32_t         j = static_cast<int32_t>(q) - k;
+
+            vr = mulPow5DivPow2(mv, static_cast<uint32_t>(i), j);
+            vp = mulPow5DivPow2(mp, static_cast<uint32_t>(i), j);
+            vm = mulPow5DivPow2(mm, static_cast<uint32_t>(i), j);
+
+            if ( q != 0 && (vp - 1) / 10 <= vm / 10 )
+            {
+                j = static_cast<int32_t>(q) - 1 - ( pow5bits(i + 1) - FLOAT_POW5_BITCOUNT );
+                lastRemovedDigit = static_cast<uint8_t>( mulPow5DivPow2(mv, static_cast<uint32_t>(i + 1), j) % 10 );
+            }
+
+            if ( q <= 1 )
+            {
+                // mv = 4 * m2 always has at least two trailing 0 bits
+                vrIsTrailingZeros = true;
+
+                if ( acceptBounds )
+                {
+                    // mm = mv - 1 - mmShift, so it has 1 trailing 0 bit iff mmShift == 1
+                    vmIsTrailingZeros = mmShift == 1;
+                }
+                else
+                {
+                    // mp = mv + 2, so it always has at least one trailing 0 bit
+                    --vp;
+                }
+            }
+            else if ( q < 31 )
+            {
+                vrIsTrailingZeros = multipleOfPowerOf2(mv, q - 1);
+            }
+        }
+
+        // step 4: find the shortest decimal representation in the interval of valid representations
+        int32_t     removed = 0;
+        uint32_t    output;
+
+        if ( vmIsTrailingZeros || vrIsTrailingZeros )
+        {
+            // general case, which happens rarely
+            while ( vp / 10 > vm / 10 )
+            {
+                vmIsTrailingZeros &= vm % 10 == 0;
+                vrIsTrailingZeros &= lastRemovedDigit == 0;
+                lastRemovedDigit = static_cast<uint8_t>(vr % 10);
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                ++removed;
+            }
+
+            if ( vmIsTrailingZeros )
+            {
+                while ( vm % 10 == 0 )
+                {
+                    vrIsTrailingZeros &= lastRemovedDigit == 0;
+                    lastRemovedDigit = static_cast<uint8_t>(vr % 10);
+                    vr /= 10;
+                    vp /= 10;
+                    vm /= 10;
+                    ++removed;
+                }
+            }
+
+            if ( vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0 )
+            {
+                // round even if the exact number is .....50..0
+                lastRemovedDigit = 4;
+            }
+
+            // we need to take vr + 1 if vr is outside bounds or we need to round up
+            output = vr + ( ( vr == vm && ( ! acceptBounds || ! vmIsTrailingZeros ) ) || lastRemovedDigit >= 5 );
+        }
+        else
+        {
+            // specialized for the common case
+            while ( vp / 10 > vm / 10 )
+            {
+                lastRemovedDigit = static_cast<uint8_t>(vr % 10);
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                ++removed;
+            }
+
+            output = vr + ( vr == vm || lastRemovedDigit >= 5 );
+        }
+
+        digits      = output;
+        exponent    = e10 + removed;
+    }
+}
+
+namespace _2log
+{
+    size_t NumberFormatter::formatFloat(float value, char *buffer)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits) );
+
+        const bool      sign            = ( bits >> (FLOAT_MANTISSA_BITS + FLOAT_EXPONENT_BITS) ) != 0;
+        const uint32_t  ieeeMantissa    = bits & ( (1u << FLOAT_MANTISSA_BITS) - 1 );
+        const uint32_t  ieeeExponent    = ( bits >> FLOAT_MANTISSA_BITS ) & ( (1u << FLOAT_EXPONENT_BITS) - 1 );
+
+        if ( ieeeExponent == ( (1u << FLOAT_EXPONENT_BITS) - 1 ) )
+        {
+            // JSON can not represent NaN and infinity, cJSON prints null as well
+            memcpy(buffer, "null", 5);
+            return 4;
+        }
+
+        if ( ieeeExponent == 0 && ieeeMantissa == 0 )
+        {
+            buffer[0] = '0';
+            buffer[1] = '\0';
+            return 1;
+        }
+
+        uint32_t    digits;
+        int32_t     exponent;
+
+        floatToDecimal(ieeeMantissa, ieeeExponent, digits, exponent);
+
+        return formatDecimal(sign, digits, exponent, buffer);
+    }
+
+    size_t NumberFormatter::formatDouble(double value, char *buffer)
+    {
+        if ( ! isfinite(value) )
+        {
+            memcpy(buffer, "null", 5);
+            return 4;
+        }
+
+        const float floatValue = static_cast<float>(value);
+
+        if ( static_cast<double>(floatValue) == value )
+        {
+            return formatFloat(floatValue, buffer);
+        }
+
+        // integral values up to 2^53 are exact
+        if ( fabs(value) < 9007199254740992.0 && floor(value) == value )
+        {
+            return formatInteger( static_cast<int64_t>(value), buffer );
+        }
+
+        // rare path: no shortest conversion for doubles, but prefer 15 digits if they round-trip
+        int length = snprintf(buffer, BUFFER_SIZE, "%.15g", value);
+
+        if ( strtod(buffer, nullptr) != value )
+        {
+            length = snprintf(buffer, BUFFER_SIZE, "%.17g", value);
+        }
+
+        return length > 0 ? static_cast<size_t>(length) : 0;
+    }
+
+    size_t NumberFormatter::formatFixed(float value, uint8_t decimals, char *buffer)
+    {
+        if ( decimals > MAX_DECIMALS )
+        {
+            decimals = MAX_DECIMALS;
+        }
+
+        const double scaled = static_cast<double>(value) * POWERS_OF_10[decimals];
+
+        // out of range for an integer based conversion
+        if ( ! ( fabs(scaled) < 9.0e18 ) )
+        {
+            return formatFloat(value, buffer);
+        }
+
+        const bool  negative    = scaled < 0;
+        uint64_t    rounded     = static_cast<uint64_t>( ( negative ? -scaled : scaled ) + 0.5 );
+
+        if ( rounded == 0 )
+        {
+            buffer[0] = '0';
+            buffer[1] = '\0';
+            return 1;
+        }
+
+        const uint64_t  divisor         = POWERS_OF_10[decimals];
+        uint64_t        integerPart     = rounded / divisor;
+        uint64_t        fractionPart    = rounded % divisor;
+        uint8_t         fractionDigits  = decimals;
+
+        // drop trailing zeros of the fraction, they do not change the JSON value
+        while ( fractionDigits > 0 && fractionPart % 10 == 0 )
+        {
+            fractionPart /= 10;
+            fractionDigits--;
+        }
+
+        size_t length = 0;
+
+        if ( negative )
+        {
+            buffer[length++] = '-';
+        }
+
+        length += writeUnsigned(integerPart, buffer + length);
+
+        if ( fractionDigits > 0 )
+        {
+            buffer[length++] = '.';
+
+            for ( int i = fractionDigits - 1; i >= 0; i-- )
+            {
+                buffer[length + i] = static_cast<char>( '0' + fractionPart % 10 );
+                fractionPart /= 10;
+            }
+
+            length += fractionDigits;
+        }
+
+        buffer[length] = '\0';
+        return length;
+    }
+
+    size_t NumberFormatter::formatInteger(int64_t value, char *buffer)
+    {
+        if ( value < 0 )
+        {
+            buffer[0] = '-';
+            return 1 + writeUnsigned( static_cast<uint64_t>(0) - static_cast<uint64_t>(value), buffer + 1 );
+        }
+
+        return writeUnsigned( static_cast<uint64_t>(value), buffer );
+    }
+
+    size_t NumberFormatter::formatDecimal(bool negative, uint32_t digits, int32_t exponent, char *buffer)
+    {
+        char        digitString[10];
+        uint32_t    length      = decimalLength(digits);
+        size_t      position    = 0;
+
+        for ( int i = static_cast<int>(length) - 1; i >= 0; i-- )
+        {
+            digitString[i] = static_cast<char>( '0' + digits % 10 );
+            digits /= 10;
+        }
+
+        if ( negative )
+        {
+            buffer[position++] = '-';
+        }
+
+        // position of the decimal point relative to the first digit
+        const int32_t pointPosition = static_cast<int32_t>(length) + exponent;
+
+        if ( exponent >= 0 && pointPosition <= 9 )
+        {
+            // integer: 123, 1200
+            memcpy(buffer + position, digitString, length);
+            position += length;
+            memset(buffer + position, '0', static_cast<size_t>(exponent) );
+            position += static_cast<size_t>(exponent);
+        }
+        else if ( exponent < 0 && pointPosition > 0 )
+        {
+            // decimal point within the digits: 1.25
+            memcpy(buffer + position, digitString, static_cast<size_t>(pointPosition) );
+            position += static_cast<size_t>(pointPosition);
+            buffer[position++] = '.';
+            memcpy(buffer + position, digitString + pointPosition, length - static_cast<uint32_t>(pointPosition) );
+            position += length - static_cast<uint32_t>(pointPosition);
+        }
+        else if ( pointPosition <= 0 && pointPosition > -5 )
+        {
+            // small value with leading zeros: 0.00125
+            buffer[position++] = '0';
+            buffer[position++] = '.';
+            memset(buffer + position, '0', static_cast<size_t>(-pointPosition) );
+            position += static_cast<size_t>(-pointPosition);
+            memcpy(buffer + position, digitString, length);
+            position += length;
+        }
+        else
+        {
+            // scientific notation: 1.25e-7, 3e+20
+            buffer[position++] = digitString[0];
+
+            if ( length > 1 )
+            {
+                buffer[position++] = '.';
+                memcpy(buffer + position, digitString + 1, length - 1);
+                position += length - 1;
+            }
+
+            int32_t scientificExponent = pointPosition - 1;
+
+            buffer[position++] = 'e';
+            buffer[position++] = scientificExponent < 0 ? '-' : '+';
+
+            if ( scientificExponent < 0 )
+            {
+                scientificExponent = -scientificExponent;
+            }
+
+            position += writeUnsigned( static_cast<uint64_t>(scientificExponent), buffer + position );
+        }
+
+        buffer[position] = '\0';
+        return position;
+    }
+
+    size_t NumberFormatter::writeUnsigned(uint64_t value, char *buffer)
+    {
+        char    reversed[20];
+        size_t  length = 0;
+
+        do
+        {
+            reversed[length++] = static_cast<char>( '0' + value % 10 );
+            value /= 10;
+        }
+        while ( value != 0 );
+
+        for ( size_t i = 0; i < length; i++ )
+        {
+            buffer[i] = reversed[length - 1 - i];
+        }
+
+        buffer[length] = '\0';
+        return length;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef NUMBERFORMATTER_H
+#define NUMBERFORMATTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace _2log
+{
+    /**
+     * @brief The NumberFormatter class converts numbers to their JSON text representation.
+     *
+     * Unlike cJSON, which prints doubles with "%1.15g" and verifies the round trip with sscanf, floats are converted
+     * with the Ryu algorithm to the shortest decimal string that parses back to the same float, using integer
+     * arithmetic only (e.g. 0.3f is printed as "0.3").
+     */
+    class NumberFormatter
+    {
+        public:
+
+            /**
+             * @brief The buffer size required by all format functions, including the terminating null character
+             */
+            static const size_t BUFFER_SIZE = 32;
+
+            /**
+             * @brief The maximum number of decimals supported by formatFixed()
+             */
+            static const uint8_t MAX_DECIMALS = 9;
+
+            /**
+             * @brief Format a float as the shortest string that round-trips to the same value
+             * @param value     the float value
+             * @param buffer    the output buffer of at least \c BUFFER_SIZE bytes
+             *
+             * @return  the length of the null-terminated string written to the buffer
+             */
+            static size_t   formatFloat(float value, char *buffer);
+
+            /**
+             * @brief Format a double as JSON number
+             *
+             * Doubles that are exactly representable as float are formatted with formatFloat(), integral values
+             * are printed as integer, all other values fall back to "%.15g" or "%.17g".
+             *
+             * @param value     the double value
+             * @param buffer    the output buffer of at least \c BUFFER_SIZE bytes
+             *
+             * @return  the length of the null-terminated string written to the buffer
+             */
+            static size_t   formatDouble(double value, char *buffer);
+
+            /**
+             * @brief Format a float rounded to a fixed number of decimals. Trailing zeros are omitted.
+             * @param value     the float value
+             * @param decimals  the number of decimals (at most \c MAX_DECIMALS)
+             * @param buffer    the output buffer of at least \c BUFFER_SIZE bytes
+             *
+             * @return  the length of the null-terminated string written to the buffer
+             */
+            static size_t   formatFixed(float value, uint8_t decimals, char *buffer);
+
+            /**
+             * @brief Format a signed integer
+             * @param value     the integer value
+             * @param buffer    the output buffer of at least \c BUFFER_SIZE bytes
+             *
+             * @return  the length of the null-terminated string written to the buffer
+             */
+            static size_t   formatInteger(int64_t value, char *buffer);
+
+        private:
+
+            static size_t   formatDecimal(bool negative, uint32_t digits, int32_t exponent, char *buffer);
+            static size_t   writeUnsigned(uint64_t value, char *buffer);
+    };
+}
+
+#endif
@@ -0,0 +1,380 @@
+#include "NvsBackend.h"
+#include "Crc32.h"
+
+#include <stdio.h>
+#include <string.h>
+
+extern "C"
+{
+    #include "nvs_flash.h"
+    #include "esp_log.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG         = "_2log::NvsBackend";
+    const size_t    NVS_ENTRY_SIZE  = 32;
+
+    struct FileKeys
+    {
+        char    content[NVS_KEY_NAME_MAX_SIZE];
+        char    name[NVS_KEY_NAME_MAX_SIZE];
+    };
+
+    FileKeys getFileKeys(const char *fileName)
+    {
+        FileKeys    keys;
+        uint32_t    crc = _2log::updateCrc32(0, fileName, strlen(fileName) );
+
+        snprintf(keys.content, sizeof(keys.content), "f%08x", static_cast<unsigned>(crc) );
+        snprintf(keys.name, sizeof(keys.name), "n%08x", static_cast<unsigned>(crc) );
+
+        return keys;
+    }
+
+    /**
+     * @brief Read the file name stored under a name key
+     * @return  \c false if there is none
+     */
+    bool readName(nvs_handle_t handle, const char *key, std::string &name)
+    {
+        size_t length = 0;
+
+        if ( nvs_get_str(handle, key, nullptr, &length) != ESP_OK || length == 0 )
+        {
+            return false;
+        }
+
+        name.resize(length);
+
+        if ( nvs_get_str(handle, key, &name[0], &length) != ESP_OK )
+        {
+            return false;
+        }
+
+        name.resize(length - 1);
+
+        return true;
+    }
+}
+
+namespace _2log
+{
+    StorageBackendType NvsBackend::getType() const
+    {
+        return StorageBackendType::Nvs;
+    }
+
+    bool NvsBackend::mount(const char *mountPoint)
+    {
+        (void) mountPoint;
+
+        if ( _isMounted )
+        {
+            return true;
+        }
+
+        // BaseDevice initializes NVS before, a second init does nothing
+        esp_err_t err = nvs_flash_init();
+
+        if ( err == ESP_OK )
+        {
+            err = nvs_open(DATA_STORAGE_NVS_NAMESPACE, NVS_READWRITE, &_handle);
+        }
+
+        if ( err != ESP_OK )
+        {
+            ESP_LOGE(LOG_TAG, "Opening NVS namespace %s failed (%s)", DATA_STORAGE_NVS_NAMESPACE, esp_err_to_name(err) );
+            return false;
+        }
+
+        _isMounted = true;
+
+        return true;
+    }
+
+    bool NvsBackend::unmount()
+    {
+        if ( _isMounted )
+        {
+            nvs_close(_handle);
+        }
+
+        _isMounted = false;
+        return true;
+    }
+
+    bool NvsBackend::isMounted() const
+    {
+        return _isMounted;
+    }
+
+    bool NvsBackend::format()
+    {
+        esp_err_t err = nvs_erase_all(_handle);
+
+        if ( err == ESP_OK )
+        {
+            err = nvs_commit(_handle);
+        }
+
+        if ( err != ESP_OK )
+        {
+            ESP_LOGE(LOG_TAG, "Erasing NVS namespace %s failed (%s)", DATA_STORAGE_NVS_NAMESPACE, esp_err_to_name(err) );
+            return false;
+        }
+
+        return true;
+    }
+
+    bool NvsBackend::getInfo(size_t *totalBytes, size_t *usedBytes)
+    {
+        // the statistics cover the whole partition, including the namespaces of e.g. the WiFi driver
+        nvs_stats_t stats;
+
+        if ( nvs_get_stats(nullptr, &stats) != ESP_OK )
+        {
+            return false;
+        }
+
+        *totalBytes = stats.total_entries * NVS_ENTRY_SIZE;
+        *usedBytes  = stats.used_entries * NVS_ENTRY_SIZE;
+
+        return true;
+    }
+
+    bool NvsBackend::hasFileAccess() const
+    {
+        return false;
+    }
+
+    char *NvsBackend::readFile(const char *fileName, size_t *length)
+    {
+        size_t  fileLength  = 0;
+        char    *fileBuffer = loadFile(fileName, &fileLength);
+
+        if ( fileBuffer == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "File %s does not exist", fileName);
+            return nullptr;
+        }
+
+        if ( fileLength == 0 )
+        {
+            ESP_LOGE(LOG_TAG, "File %s is empty", fileName);
+            delete [] fileBuffer;
+            return nullptr;
+        }
+
+        if ( length != nullptr )
+        {
+            *length = fileLength;
+        }
+
+        return fileBuffer;
+    }
+
+    int NvsBackend::getFileSize(const char *fileName)
+    {
+        size_t length = 0;
+
+        return nvs_get_blob(_handle, getFileKeys(fileName).content, nullptr, &length) == ESP_OK ? static_cast<int>(length) : -1;
+    }
+
+    int NvsBackend::readData(const char *fileName, size_t offset, void *buffer, size_t size)
+    {
+        FileKeys    keys    = getFileKeys(fileName);
+        size_t      length  = 0;
+
+        if ( nvs_get_blob(_handle, keys.content, nullptr, &length) != ESP_OK )
+        {
+            ESP_LOGE(LOG_TAG, "File %s does not exist", fileName);
+            return -1;
+        }
+
+        if ( offset >= length )
+        {
+            return 0;
+        }
+
+        // a blob is only read as a whole, directly into the buffer if it fits
+        if ( offset == 0 && size >= length )
+        {
+            return nvs_get_blob(_handle, keys.content, buffer, &length) == ESP_OK ? static_cast<int>(length) : -1;
+        }
+
+        char *fileBuffer = loadFile(fileName, &length);
+
+        if ( fileBuffer == nullptr )
+        {
+            return -1;
+        }
+
+        size_t bytesRead = length - offset < size ? length - offset : size;
+
+        memcpy(buffer, fileBuffer + offset, bytesRead);
+        delete [] fileBuffer;
+
+        return static_cast<int>(bytesRead);
+    }
+
+    int NvsBackend::writeData(const char *fileName, const void *data, size_t length, bool append)
+    {
+        size_t  fileLength  = 0;
+        char    *fileBuffer = append ? loadFile(fileName, &fileLength) : nullptr;
+
+        if ( fileBuffer == nullptr )
+        {
+            return storeFile(fileName, data, length);
+        }
+
+        // the blob is written as a whole, with the appended data
+        std::string content(fileBuffer, fileLength);
+        delete [] fileBuffer;
+
+        content.append(static_cast<const char*>(data), length);
+
+        return storeFile(fileName, content.data(), content.size() ) < 0 ? -1 : static_cast<int>(length);
+    }
+
+    int NvsBackend::readChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, const ChunkReadFunction &consumer)
+    {
+        // the blob is read as a whole and handed out in chunks, the buffer is not needed
+        (void) buffer;
+
+        size_t  length      = 0;
+        char    *fileBuffer = loadFile(fileName, &length);
+
+        if ( fileBuffer == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "File %s does not exist", fileName);
+            return -1;
+        }
+
+        size_t offset = 0;
+
+        while ( offset < length )
+        {
+            size_t chunkLength = length - offset < bufferSize ? length - offset : bufferSize;
+
+            offset += chunkLength;
+
+            if ( ! consumer(reinterpret_cast<const uint8_t*>(fileBuffer) + offset - chunkLength, chunkLength) )
+            {
+                break;
+            }
+        }
+
+        delete [] fileBuffer;
+
+        return static_cast<int>(offset);
+    }
+
+    int NvsBackend::writeChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, const ChunkWriteFunction &producer)
+    {
+        // the blob is written as a whole, so the chunks are collected first
+        std::string content;
+        size_t      length;
+
+        while ( ( length = producer(buffer, bufferSize) ) > 0 )
+        {
+            content.append(reinterpret_cast<const char*>(buffer), length < bufferSize ? length : bufferSize);
+        }
+
+        return storeFile(fileName, content.data(), content.size() );
+    }
+
+    bool NvsBackend::deleteFile(const char *fileName)
+    {
+        FileKeys keys = getFileKeys(fileName);
+
+        bool success = nvs_erase_key(_handle, keys.content) == ESP_OK;
+        nvs_erase_key(_handle, keys.name);
+
+        return nvs_commit(_handle) == ESP_OK && success;
+    }
+
+    bool NvsBackend::listFiles(const char *directory, std::vector<std::string> &fileNames)
+    {
+        std::string     prefix      = std::string(directory) + "/";
+        nvs_iterator_t  iterator    = nvs_entry_find(NVS_DEFAULT_PART_NAME, DATA_STORAGE_NVS_NAMESPACE, NVS_TYPE_STR);
+
+        while ( iterator != nullptr )
+        {
+            nvs_entry_info_t    info;
+            std::string         name;
+
+            nvs_entry_info(iterator, &info);
+
+            // only the files directly in the directory, not in its subdirectories
+            if ( readName(_handle, info.key, name) && name.compare(0, prefix.size(), prefix) == 0 &&
+                 name.find('/', prefix.size() ) == std::string::npos )
+            {
+                fileNames.push_back( name.substr(prefix.size() ) );
+            }
+
+            iterator = nvs_entry_next(iterator);
+        }
+
+        return true;
+    }
+
+    int NvsBackend::storeFile(const char *fileName, const void *data, size_t length)
+    {
+        FileKeys    keys = getFileKeys(fileName);
+        std::string storedName;
+        esp_err_t   err = ESP_OK;
+
+        if ( ! readName(_handle, keys.name, storedName) )
+        {
+            err = nvs_set_str(_handle, keys.name, fileName);
+        }
+        else if ( storedName != fileName )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to write %s, its key is taken by %s", fileName, storedName.c_str() );
+            return -1;
+        }
+
+        if ( err == ESP_OK )
+        {
+            err = nvs_set_blob(_handle, keys.content, data, length);
+        }
+
+        if ( err == ESP_OK )
+        {
+            err = nvs_commit(_handle);
+        }
+
+        if ( err != ESP_OK )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to write %s (%s)", fileName, esp_err_to_name(err) );
+            return -1;
+        }
+
+        return static_cast<int>(length);
+    }
+
+    char *NvsBackend::loadFile(const char *fileName, size_t *length)
+    {
+        FileKeys keys = getFileKeys(fileName);
+
+        if ( nvs_get_blob(_handle, keys.content, nullptr, length) != ESP_OK )
+        {
+            return nullptr;
+        }
+
+        // one more byte for the terminator of readFile()
+        char *fileBuffer = new char[*length + 1];
+
+        if ( nvs_get_blob(_handle, keys.content, fileBuffer, length) != ESP_OK )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to read %s", fileName);
+            delete [] fileBuffer;
+            return nullptr;
+        }
+
+        fileBuffer[*length] = '\0';
+
+        return fileBuffer;
+    }
+}
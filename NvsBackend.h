@@ -0,0 +1,63 @@
+#ifndef NVSBACKEND_H
+#define NVSBACKEND_H
+
+#include "StorageBackend.h"
+
+extern "C"
+{
+    #include "nvs.h"
+}
+
+// at most 15 characters
+#ifndef DATA_STORAGE_NVS_NAMESPACE
+    #define DATA_STORAGE_NVS_NAMESPACE  "2log_files"
+#endif
+
+namespace _2log
+{
+    /**
+     * @brief The NvsBackend class stores every file as a blob in the NVS namespace DATA_STORAGE_NVS_NAMESPACE of
+     * the default NVS partition.
+     *
+     * NVS keys have at most 15 characters, so a file is stored under "f" and the hex CRC-32 of its name, and the
+     * name itself as a string under "n" and the same CRC, for listFiles() and to detect two names with the same
+     * CRC. Small files are read and written faster than on SPIFFS and NVS never stalls for a garbage collection,
+     * but the files can not be opened with fopen(), so the LogStore of DeviceProperties needs another backend.
+     * A blob is only read and written as a whole, so the chunked and partial functions hold the whole file in
+     * RAM; large files belong on a file system backend.
+     */
+    class NvsBackend : public StorageBackend
+    {
+        public:
+
+            StorageBackendType      getType(void) const override;
+
+            bool                    mount(const char *mountPoint) override;
+            bool                    unmount(void) override;
+            bool                    isMounted(void) const override;
+            bool                    format(void) override;
+            bool                    getInfo(size_t *totalBytes, size_t *usedBytes) override;
+            bool                    hasFileAccess(void) const override;
+
+            char*                   readFile(const char *fileName, size_t *length) override;
+            int                     getFileSize(const char *fileName) override;
+            int                     readData(const char *fileName, size_t offset, void *buffer, size_t size) override;
+            int                     writeData(const char *fileName, const void *data, size_t length, bool append) override;
+            int                     readChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, const ChunkReadFunction &consumer) override;
+            int                     writeChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, const ChunkWriteFunction &producer) override;
+            bool                    deleteFile(const char *fileName) override;
+            bool                    listFiles(const char *directory, std::vector<std::string> &fileNames) override;
+
+        private:
+
+            int                     storeFile(const char *fileName, const void *data, size_t length);
+            char*                   loadFile(const char *fileName, size_t *length);
+
+        private:
+
+            bool                    _isMounted = { false };
+            nvs_handle_t            _handle = { 0 };
+    };
+}
+
+#endif
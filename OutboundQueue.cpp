@@ -0,0 +1,170 @@
+#include "OutboundQueue.h"
+#include "PerfCounters.h"
+#include "AllocationTracker.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <cstddef>
+
+namespace
+{
+    static_assert(OUTBOUND_FRAME_POOL_SIZE <= 32, "the used blocks of the frame pool are a 32 bit mask");
+
+    struct alignas(std::max_align_t) FrameBlock
+    {
+        uint8_t     memory[OUTBOUND_FRAME_BLOCK_SIZE];
+    };
+
+    FrameBlock              framePool[OUTBOUND_FRAME_POOL_SIZE];
+    std::atomic<uint32_t>   usedFrameBlocks = { 0 };
+
+    void *acquireFrameBlock()
+    {
+        uint32_t used = usedFrameBlocks.load();
+
+        for ( size_t block = 0; block < OUTBOUND_FRAME_POOL_SIZE; block++ )
+        {
+            uint32_t bit = static_cast<uint32_t>(1) << block;
+
+            // a failed exchange updates used, the block is tried again with the current value
+            while ( ( used & bit ) == 0 )
+            {
+                if ( usedFrameBlocks.compare_exchange_weak(used, used | bit) )
+                {
+                    return framePool[block].memory;
+                }
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool releaseFrameBlock(void *memory)
+    {
+        FrameBlock *block = static_cast<FrameBlock*>(memory);
+
+        if ( block < &framePool[0] || block >= &framePool[OUTBOUND_FRAME_POOL_SIZE] )
+        {
+            return false;
+        }
+
+        usedFrameBlocks &= ~( static_cast<uint32_t>(1) << ( block - &framePool[0] ) );
+        return true;
+    }
+}
+
+namespace _2log
+{
+    OutboundFrame *OutboundFrame::create(const char *data, size_t length, uint32_t generation)
+    {
+        size_t size = sizeof(OutboundFrame) + length + 1;
+
+        // one block for the frame header and the data
+        void *memory = size <= OUTBOUND_FRAME_BLOCK_SIZE ? acquireFrameBlock() : nullptr;
+
+        if ( memory == nullptr )
+        {
+            PERF_COUNT_ALLOCATION(size);
+
+            memory = AllocationTracker::allocate(size);
+        }
+
+        if ( memory == nullptr )
+        {
+            return nullptr;
+        }
+
+        OutboundFrame *frame = new (memory) OutboundFrame();
+
+        frame->next.store(nullptr, std::memory_order_relaxed);
+        frame->generation   = generation;
+        frame->priority     = SendPriority::State;
+        frame->length       = length;
+        frame->data         = reinterpret_cast<char*>(frame + 1);
+
+        memcpy(frame->data, data, length);
+        frame->data[length] = '\0';
+
+        return frame;
+    }
+
+    void OutboundFrame::destroy(OutboundFrame *frame)
+    {
+        if ( frame == nullptr )
+        {
+            return;
+        }
+
+        frame->~OutboundFrame();
+
+        if ( ! releaseFrameBlock(frame) )
+        {
+            AllocationTracker::release(frame);
+        }
+    }
+
+    OutboundQueue::OutboundQueue() : _head(&_stub), _tail(&_stub)
+    {
+        _stub.next.store(nullptr, std::memory_order_relaxed);
+        _stub.generation    = 0;
+        _stub.priority      = SendPriority::State;
+        _stub.length        = 0;
+        _stub.data          = nullptr;
+    }
+
+    void OutboundQueue::push(OutboundFrame *frame)
+    {
+        frame->next.store(nullptr, std::memory_order_relaxed);
+
+        // serialization point for all producers
+        OutboundFrame *previous = _head.exchange(frame, std::memory_order_acq_rel);
+
+        // until this store the consumer sees the queue as (temporarily) empty at this point
+        previous->next.store(frame, std::memory_order_release);
+    }
+
+    OutboundFrame *OutboundQueue::pop()
+    {
+        OutboundFrame *tail = _tail;
+        OutboundFrame *next = tail->next.load(std::memory_order_acquire);
+
+        if ( tail == &_stub )
+        {
+            if ( next == nullptr )
+            {
+                return nullptr;
+            }
+
+            // skip the stub node
+            _tail   = next;
+            tail    = next;
+            next    = next->next.load(std::memory_order_acquire);
+        }
+
+        if ( next != nullptr )
+        {
+            _tail = next;
+            return tail;
+        }
+
+        if ( tail != _head.load(std::memory_order_acquire) )
+        {
+            // a producer has exchanged the head but not yet linked its frame
+            return nullptr;
+        }
+
+        // tail is the last frame: re-insert the stub so the last frame can be detached
+        push(&_stub);
+
+        next = tail->next.load(std::memory_order_acquire);
+
+        if ( next != nullptr )
+        {
+            _tail = next;
+            return tail;
+        }
+
+        return nullptr;
+    }
+}
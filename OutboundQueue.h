@@ -0,0 +1,91 @@
+#ifndef OUTBOUNDQUEUE_H
+#define OUTBOUNDQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "IConnection.h"
+
+#ifndef OUTBOUND_FRAME_POOL_SIZE
+    #define OUTBOUND_FRAME_POOL_SIZE    8
+#endif
+
+#ifndef OUTBOUND_FRAME_BLOCK_SIZE
+    #define OUTBOUND_FRAME_BLOCK_SIZE   256
+#endif
+
+namespace _2log
+{
+    /**
+     * @brief The OutboundFrame struct is a serialized message waiting to be written to the WebSocket.
+     *
+     * A frame and its data are a single block, independent of the cJSON hooks. Frames that fit into
+     * OUTBOUND_FRAME_BLOCK_SIZE bytes, e.g. property updates and pongs, take one of the OUTBOUND_FRAME_POOL_SIZE
+     * blocks of a static pool shared by all connections, larger ones and those that find the pool empty are
+     * allocated with malloc().
+     */
+    struct OutboundFrame
+    {
+        std::atomic<OutboundFrame*>     next;
+        uint32_t                        generation;     ///< the connection generation the frame was created for
+        SendPriority                    priority;       ///< the outbound lane of the frame
+        size_t                          length;         ///< the data length in bytes, excluding the null terminator
+        char*                           data;           ///< the null-terminated frame data
+        sendCompletionFunction          completion;     ///< optional callback for the final send status
+
+        /**
+         * @brief Create a frame with a copy of the data
+         * @param data          the frame data
+         * @param length        the data length in bytes
+         * @param generation    the connection generation
+         *
+         * @return  the new frame or \c nullptr if out of memory
+         */
+        static OutboundFrame*   create(const char *data, size_t length, uint32_t generation);
+
+        /**
+         * @brief Release a frame created with create()
+         * @param frame     the frame to release
+         */
+        static void             destroy(OutboundFrame *frame);
+    };
+
+    /**
+     * @brief The OutboundQueue class is a lock-free multi-producer single-consumer queue of outbound frames.
+     *
+     * Any number of tasks may push() concurrently, each push is a single atomic exchange and never blocks.
+     * Only a single task is allowed to pop(). Frames are returned in push order.
+     * The implementation follows Dmitry Vyukov's intrusive MPSC node-based queue.
+     */
+    class OutboundQueue
+    {
+        public:
+
+                                OutboundQueue(void);
+
+                                OutboundQueue(OutboundQueue const&) = delete;
+            void                operator=(OutboundQueue const&)     = delete;
+
+            /**
+             * @brief Append a frame to the queue, may be called from any task
+             * @param frame     the frame, ownership is passed to the queue
+             */
+            void                push(OutboundFrame *frame);
+
+            /**
+             * @brief Take the oldest frame from the queue, must only be called from the consumer task
+             *
+             * @return  the oldest frame, ownership is passed to the caller
+             * @return  \c nullptr if the queue is empty or a concurrent push is not yet completed
+             */
+            OutboundFrame*      pop(void);
+
+        private:
+
+            std::atomic<OutboundFrame*>     _head;
+            OutboundFrame*                  _tail;
+            OutboundFrame                   _stub;
+    };
+}
+
+#endif
@@ -0,0 +1,265 @@
+#include "PerfCounters.h"
+#include "DataStorage.h"
+
+#include <cJSON.h>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_timer.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG = "_2log::PerfCounters";
+
+    const char*     PROBE_NAMES[] =
+    {
+        "connection_send",
+        "connection_receive",
+        "node_set_property",
+        "node_register",
+        "node_call_rpc",
+        "property_save",
+        "property_get",
+        "settings_load"
+    };
+
+    static_assert(sizeof(PROBE_NAMES) / sizeof(PROBE_NAMES[0]) == static_cast<size_t>(_2log::PerfProbe::Count), "a name is required for every probe");
+
+    // allocations of the current task, a scope measures the difference
+    thread_local uint64_t   taskAllocations     = 0;
+    thread_local uint64_t   taskAllocatedBytes  = 0;
+
+    /**
+     * @brief The per operation values of a counter
+     */
+    struct OperationCost
+    {
+        double  time;           // nanoseconds
+        double  allocations;
+        double  bytes;
+    };
+
+    OperationCost getOperationCost(const _2log::PerfCounters::Counter &counter)
+    {
+        OperationCost cost = { 0.0, 0.0, 0.0 };
+
+        if ( counter.operations > 0 )
+        {
+            cost.time           = counter.totalTime * 1000.0 / counter.operations;
+            cost.allocations    = static_cast<double>(counter.allocations) / counter.operations;
+            cost.bytes          = static_cast<double>(counter.allocatedBytes) / counter.operations;
+        }
+
+        return cost;
+    }
+}
+
+namespace _2log
+{
+    PerfCounters::AtomicCounter PerfCounters::_counters[static_cast<size_t>(PerfProbe::Count)] = {};
+
+    PerfCounters::Scope::Scope(PerfProbe probe) : _probe(probe)
+    {
+        _startAllocations   = taskAllocations;
+        _startBytes         = taskAllocatedBytes;
+        _startTime          = esp_timer_get_time();
+    }
+
+    PerfCounters::Scope::~Scope()
+    {
+        uint32_t time = static_cast<uint32_t>( esp_timer_get_time() - _startTime );
+
+        AtomicCounter &counter = _counters[static_cast<size_t>(_probe)];
+
+        counter.operations.fetch_add(1, std::memory_order_relaxed);
+        counter.totalTime.fetch_add(time, std::memory_order_relaxed);
+        counter.allocations.fetch_add(taskAllocations - _startAllocations, std::memory_order_relaxed);
+        counter.allocatedBytes.fetch_add(taskAllocatedBytes - _startBytes, std::memory_order_relaxed);
+
+        uint32_t maxTime = counter.maxTime.load(std::memory_order_relaxed);
+
+        while ( time > maxTime && ! counter.maxTime.compare_exchange_weak(maxTime, time, std::memory_order_relaxed) )
+        {
+
+        }
+    }
+
+    void PerfCounters::countAllocation(size_t size)
+    {
+        taskAllocations++;
+        taskAllocatedBytes += size;
+    }
+
+    PerfCounters::Counter PerfCounters::getCounter(PerfProbe probe)
+    {
+        AtomicCounter &counter = _counters[static_cast<size_t>(probe)];
+
+        Counter result;
+        result.operations       = counter.operations.load(std::memory_order_relaxed);
+        result.totalTime        = counter.totalTime.load(std::memory_order_relaxed);
+        result.maxTime          = counter.maxTime.load(std::memory_order_relaxed);
+        result.allocations      = counter.allocations.load(std::memory_order_relaxed);
+        result.allocatedBytes   = counter.allocatedBytes.load(std::memory_order_relaxed);
+
+        return result;
+    }
+
+    const char *PerfCounters::getProbeName(PerfProbe probe)
+    {
+        return probe < PerfProbe::Count ? PROBE_NAMES[static_cast<size_t>(probe)] : "unknown";
+    }
+
+    void PerfCounters::reset()
+    {
+        for ( AtomicCounter &counter : _counters )
+        {
+            counter.operations      = 0;
+            counter.totalTime       = 0;
+            counter.maxTime         = 0;
+            counter.allocations     = 0;
+            counter.allocatedBytes  = 0;
+        }
+    }
+
+    void PerfCounters::logReport()
+    {
+        for ( size_t index = 0; index < static_cast<size_t>(PerfProbe::Count); index++ )
+        {
+            PerfProbe   probe   = static_cast<PerfProbe>(index);
+            Counter     counter = getCounter(probe);
+
+            if ( counter.operations == 0 )
+            {
+                continue;
+            }
+
+            OperationCost cost = getOperationCost(counter);
+
+            ESP_LOGI(LOG_TAG, "%-20s %8u ops %10.0f ns/op %6.1f allocs/op %8.1f bytes/op (max %u us)", getProbeName(probe), counter.operations,
+                     cost.time, cost.allocations, cost.bytes, counter.maxTime);
+        }
+    }
+
+    bool PerfCounters::saveBaseline(const char *fileName)
+    {
+        cJSON *baseline = cJSON_CreateObject();
+        cJSON *probes   = cJSON_AddObjectToObject(baseline, "probes");
+
+        if ( probes == nullptr )
+        {
+            cJSON_Delete(baseline);
+            return false;
+        }
+
+        for ( size_t index = 0; index < static_cast<size_t>(PerfProbe::Count); index++ )
+        {
+            PerfProbe   probe   = static_cast<PerfProbe>(index);
+            Counter     counter = getCounter(probe);
+
+            if ( counter.operations == 0 )
+            {
+                continue;
+            }
+
+            OperationCost cost = getOperationCost(counter);
+
+            cJSON *probeObject = cJSON_AddObjectToObject(probes, getProbeName(probe) );
+
+            cJSON_AddNumberToObject(probeObject, "ops", counter.operations);
+            cJSON_AddNumberToObject(probeObject, "ns", cost.time);
+            cJSON_AddNumberToObject(probeObject, "allocs", cost.allocations);
+            cJSON_AddNumberToObject(probeObject, "bytes", cost.bytes);
+        }
+
+        char *baselineString = cJSON_PrintUnformatted(baseline);
+        cJSON_Delete(baseline);
+
+        if ( baselineString == nullptr )
+        {
+            return false;
+        }
+
+        bool success = DataStorage::getInstance().writeTextFile(fileName, baselineString) > 0;
+        cJSON_free(baselineString);
+
+        if ( ! success )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to write baseline %s", fileName);
+        }
+
+        return success;
+    }
+
+    int PerfCounters::compareWithBaseline(const char *fileName, uint8_t tolerance)
+    {
+        const char *baselineString = DataStorage::getInstance().readTextFile(fileName);
+
+        if ( baselineString == nullptr )
+        {
+            return -1;
+        }
+
+        cJSON *baseline = cJSON_Parse(baselineString);
+        delete [] baselineString;
+
+        cJSON *probes = cJSON_GetObjectItemCaseSensitive(baseline, "probes");
+
+        if ( ! cJSON_IsObject(probes) )
+        {
+            ESP_LOGE(LOG_TAG, "Invalid baseline %s", fileName);
+            cJSON_Delete(baseline);
+            return -1;
+        }
+
+        int     regressions = 0;
+        double  factor      = 1.0 + tolerance / 100.0;
+
+        for ( size_t index = 0; index < static_cast<size_t>(PerfProbe::Count); index++ )
+        {
+            PerfProbe   probe           = static_cast<PerfProbe>(index);
+            Counter     counter         = getCounter(probe);
+            cJSON*      probeObject     = cJSON_GetObjectItemCaseSensitive(probes, getProbeName(probe) );
+
+            if ( counter.operations == 0 || ! cJSON_IsObject(probeObject) )
+            {
+                continue;
+            }
+
+            cJSON *baseTime         = cJSON_GetObjectItemCaseSensitive(probeObject, "ns");
+            cJSON *baseAllocations  = cJSON_GetObjectItemCaseSensitive(probeObject, "allocs");
+            cJSON *baseBytes        = cJSON_GetObjectItemCaseSensitive(probeObject, "bytes");
+
+            if ( ! cJSON_IsNumber(baseTime) || ! cJSON_IsNumber(baseAllocations) || ! cJSON_IsNumber(baseBytes) )
+            {
+                ESP_LOGW(LOG_TAG, "%-20s invalid baseline entry", getProbeName(probe) );
+                continue;
+            }
+
+            OperationCost cost = getOperationCost(counter);
+            OperationCost base = { baseTime->valuedouble, baseAllocations->valuedouble, baseBytes->valuedouble };
+
+            // allocation counts are deterministic, so every additional allocation counts
+            bool regressed = cost.time > base.time * factor || cost.allocations > base.allocations + 0.05 || cost.bytes > base.bytes * factor;
+
+            if ( regressed )
+            {
+                regressions++;
+                ESP_LOGW(LOG_TAG, "%-20s REGRESSION %10.0f ns/op (%+5.1f%%) %6.1f allocs/op (%+.1f) %8.1f bytes/op (%+.1f)", getProbeName(probe),
+                         cost.time, base.time > 0 ? ( cost.time / base.time - 1.0 ) * 100.0 : 0.0, cost.allocations,
+                         cost.allocations - base.allocations, cost.bytes, cost.bytes - base.bytes);
+            }
+            else
+            {
+                ESP_LOGI(LOG_TAG, "%-20s ok         %10.0f ns/op (%+5.1f%%) %6.1f allocs/op (%+.1f) %8.1f bytes/op (%+.1f)", getProbeName(probe),
+                         cost.time, base.time > 0 ? ( cost.time / base.time - 1.0 ) * 100.0 : 0.0, cost.allocations,
+                         cost.allocations - base.allocations, cost.bytes, cost.bytes - base.bytes);
+            }
+        }
+
+        cJSON_Delete(baseline);
+
+        return regressions;
+    }
+}
@@ -0,0 +1,143 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "BuildConfig.h"
+
+#ifndef PERFORMANCE_COUNTERS
+    #define PERFORMANCE_COUNTERS    0
+#endif
+
+#if PERFORMANCE_COUNTERS == 1
+    #define PERF_SCOPE(probe)               _2log::PerfCounters::Scope perfScope(probe)
+    #define PERF_COUNT_ALLOCATION(size)     _2log::PerfCounters::countAllocation(size)
+#else
+    #define PERF_SCOPE(probe)
+    #define PERF_COUNT_ALLOCATION(size)
+#endif
+
+namespace _2log
+{
+    /**
+     * @brief The PerfProbe enum enumerates the measured hot paths
+     */
+    enum class PerfProbe : uint8_t
+    {
+        ConnectionSend = 0,     ///< Connection::sendJSON(), serialization and queueing of a frame
+        ConnectionReceive,      ///< Connection::webSocketBinaryMessageReceived(), parsing and dispatch
+        NodeSetProperty,        ///< DeviceNode property update on the loop task, all setProperty() variants
+        NodeRegister,           ///< DeviceNode::registerNode()
+        NodeCallRPC,            ///< DeviceNode::callRPC() callback lookup, without the callback itself
+        PropertySave,           ///< DeviceProperties::saveProperty()
+        PropertyGet,            ///< DeviceProperties::getProperty()
+        SettingsLoad,           ///< DeviceSettings::loadDeviceSettings(), including the decryption
+        Count
+    };
+
+    /**
+     * @brief The PerfCounters class measures time, allocations and allocated bytes per operation of the hot paths.
+     *
+     * The counters are only compiled in with PERFORMANCE_COUNTERS == 1 in the BuildConfig, otherwise PERF_SCOPE
+     * and PERF_COUNT_ALLOCATION expand to nothing. Allocations are the cJSON allocations (arena or heap) and the
+     * outbound frames, counted for the task that made them. Nested probes are inclusive, e.g. NodeSetProperty
+     * contains the ConnectionSend of the update.
+     *
+     * Counters of a known good build can be stored as baseline in the DataStorage and compared later.
+     */
+    class PerfCounters
+    {
+        public:
+
+            /**
+             * @brief The Counter struct sums up all operations of a probe
+             */
+            struct Counter
+            {
+                uint32_t    operations;         ///< number of measured operations
+                uint64_t    totalTime;          ///< sum of all operation times in microseconds
+                uint32_t    maxTime;            ///< longest operation in microseconds
+                uint64_t    allocations;        ///< number of allocations
+                uint64_t    allocatedBytes;     ///< number of allocated bytes
+            };
+
+            /**
+             * @brief The Scope class measures a single operation of a probe
+             */
+            class Scope
+            {
+                public:
+
+                                Scope(PerfProbe probe);
+                                ~Scope(void);
+
+                                Scope(Scope const&)             = delete;
+                    void        operator=(Scope const&)         = delete;
+
+                private:
+
+                    PerfProbe   _probe;
+                    int64_t     _startTime;
+                    uint64_t    _startAllocations;
+                    uint64_t    _startBytes;
+            };
+
+            /**
+             * @brief Count an allocation of the calling task
+             * @param size  the allocation size in bytes
+             */
+            static void         countAllocation(size_t size);
+
+            /**
+             * @brief Get the counter of a probe
+             */
+            static Counter      getCounter(PerfProbe probe);
+
+            /**
+             * @brief Get the name of a probe, as used in the baseline file
+             */
+            static const char*  getProbeName(PerfProbe probe);
+
+            /**
+             * @brief Reset all counters
+             */
+            static void         reset(void);
+
+            /**
+             * @brief Log ns/op, allocations/op and bytes/op of all probes
+             */
+            static void         logReport(void);
+
+            /**
+             * @brief Store the per operation values of all probes as baseline
+             * @param fileName  the baseline file in the DataStorage
+             * @return  \c true on success, \c false otherwise
+             */
+            static bool         saveBaseline(const char *fileName);
+
+            /**
+             * @brief Compare the counters with a stored baseline and log the differences
+             * @param fileName      the baseline file in the DataStorage
+             * @param tolerance     the allowed increase of ns/op and bytes/op in percent
+             *
+             * @return  the number of probes that regressed, \c -1 if the baseline could not be read
+             */
+            static int          compareWithBaseline(const char *fileName, uint8_t tolerance = 10);
+
+        private:
+
+            struct AtomicCounter
+            {
+                std::atomic<uint32_t>   operations;
+                std::atomic<uint64_t>   totalTime;
+                std::atomic<uint32_t>   maxTime;
+                std::atomic<uint64_t>   allocations;
+                std::atomic<uint64_t>   allocatedBytes;
+            };
+
+            static AtomicCounter        _counters[static_cast<size_t>(PerfProbe::Count)];
+    };
+}
+
+#endif
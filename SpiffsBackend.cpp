@@ -0,0 +1,131 @@
+#include "SpiffsBackend.h"
+
+extern "C"
+{
+    #include "esp_spiffs.h"
+    #include "esp_log.h"
+    #include "esp_task_wdt.h"
+
+    #ifndef CONFIG_IDF_TARGET_ESP32
+    #include "FreeRTOS.h"
+    #include "freertos/task.h"
+    #endif
+}
+
+namespace
+{
+    const char* LOG_TAG = "_2log::SpiffsBackend";
+}
+
+namespace _2log
+{
+    StorageBackendType SpiffsBackend::getType() const
+    {
+        return StorageBackendType::Spiffs;
+    }
+
+    bool SpiffsBackend::mount(const char *mountPoint)
+    {
+        if ( _isMounted || esp_spiffs_mounted(nullptr) )
+        {
+            ESP_LOGW(LOG_TAG, "SPIFFS Already Mounted!");
+            _isMounted = true;
+            return true;
+        }
+
+        esp_vfs_spiffs_conf_t conf = {};
+
+        conf.base_path              = mountPoint;
+        conf.partition_label        = nullptr;
+        conf.max_files              = DATA_STORAGE_MAX_FILES;
+        conf.format_if_mount_failed = false;
+
+        esp_err_t err = esp_vfs_spiffs_register(&conf);
+        if(err == ESP_FAIL)
+        {
+            // automatically format on failure (first use)
+            if( format() )
+            {
+                err = esp_vfs_spiffs_register(&conf);
+            }
+        }
+        if(err != ESP_OK)
+        {
+            ESP_LOGE(LOG_TAG, "Mounting SPIFFS failed! Error: %d", err);
+            return false;
+        }
+
+        _mountPoint = mountPoint;
+        _isMounted  = true;
+
+        return true;
+    }
+
+    bool SpiffsBackend::unmount()
+    {
+        if( esp_spiffs_mounted(nullptr) )
+        {
+            esp_err_t err = esp_vfs_spiffs_unregister(nullptr);
+            if(err)
+            {
+                ESP_LOGE(LOG_TAG, "Unmounting SPIFFS failed! Error: %d", err);
+                return false;
+            }
+        }
+        _isMounted = false;
+        return true;
+    }
+
+    bool SpiffsBackend::format()
+    {
+        ESP_LOGI(LOG_TAG, "Format file system start..");
+
+        #ifdef CONFIG_IDF_TARGET_ESP32
+
+            UBaseType_t coreID = xPortGetCoreID();
+            TaskHandle_t idleTask = xTaskGetIdleTaskHandleForCPU( coreID );
+
+            // disable watchdog for current core, as esp_spiffs_format can take some time
+            if( idleTask == nullptr || esp_task_wdt_delete(idleTask) != ESP_OK )
+            {
+                ESP_LOGE(LOG_TAG, "Failed to remove Core %d IDLE task from WDT", coreID);
+            }
+
+        #endif
+
+            esp_err_t err = esp_spiffs_format(nullptr);
+
+        // re-enable watchdog
+        #ifdef CONFIG_IDF_TARGET_ESP32
+
+            if( idleTask == nullptr || esp_task_wdt_add(idleTask) != ESP_OK )
+            {
+                ESP_LOGE(LOG_TAG, "Failed to add Core %d IDLE task to WDT", coreID);
+            }
+
+        #endif
+
+        if(err)
+        {
+            ESP_LOGE(LOG_TAG, "Formatting SPIFFS failed! Error: %d", err);
+            return false;
+        }
+
+        ESP_LOGI(LOG_TAG, "Format file system finished..");
+
+        return true;
+    }
+
+    bool SpiffsBackend::getInfo(size_t *totalBytes, size_t *usedBytes)
+    {
+        esp_err_t err = esp_spiffs_info(nullptr, totalBytes, usedBytes);
+
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(LOG_TAG, "Failed to get SPIFFS partition information (%s)", esp_err_to_name(err) );
+            return false;
+        }
+
+        return true;
+    }
+}
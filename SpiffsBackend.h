@@ -0,0 +1,29 @@
+#ifndef SPIFFSBACKEND_H
+#define SPIFFSBACKEND_H
+
+#include "FileSystemBackend.h"
+
+// files that may be open at the same time
+#ifndef DATA_STORAGE_MAX_FILES
+    #define DATA_STORAGE_MAX_FILES  10
+#endif
+
+namespace _2log
+{
+    /**
+     * @brief The SpiffsBackend class mounts the first SPIFFS partition, it is formatted on first use
+     */
+    class SpiffsBackend : public FileSystemBackend
+    {
+        public:
+
+            StorageBackendType      getType(void) const override;
+
+            bool                    mount(const char *mountPoint) override;
+            bool                    unmount(void) override;
+            bool                    format(void) override;
+            bool                    getInfo(size_t *totalBytes, size_t *usedBytes) override;
+    };
+}
+
+#endif
@@ -0,0 +1,63 @@
+#include "StorageBackend.h"
+#include "SpiffsBackend.h"
+#include "LittleFsBackend.h"
+#include "NvsBackend.h"
+
+#include <string.h>
+
+extern "C"
+{
+    #include "esp_log.h"
+}
+
+namespace
+{
+    const char* LOG_TAG = "_2log::StorageBackend";
+}
+
+namespace _2log
+{
+    StorageBackend *StorageBackend::create(StorageBackendType type)
+    {
+        switch ( type )
+        {
+            case StorageBackendType::Spiffs:
+                return new SpiffsBackend();
+
+            case StorageBackendType::LittleFs:
+                #ifdef DATA_STORAGE_HAS_LITTLEFS
+                    return new LittleFsBackend();
+                #else
+                    ESP_LOGE(LOG_TAG, "LittleFS is not available, add the esp_littlefs component");
+                    return nullptr;
+                #endif
+
+            case StorageBackendType::Nvs:
+                return new NvsBackend();
+
+            case StorageBackendType::Posix:
+                return new PosixBackend();
+        }
+
+        ESP_LOGE(LOG_TAG, "Unknown storage backend %d", static_cast<int>(type) );
+        return nullptr;
+    }
+
+    const char *StorageBackend::getTypeName(StorageBackendType type)
+    {
+        switch ( type )
+        {
+            case StorageBackendType::Spiffs:    return "SPIFFS";
+            case StorageBackendType::LittleFs:  return "LittleFS";
+            case StorageBackendType::Nvs:       return "NVS";
+            case StorageBackendType::Posix:     return "POSIX";
+        }
+
+        return "unknown";
+    }
+
+    int StorageBackend::writeFile(const char *fileName, const char *content)
+    {
+        return writeData(fileName, content, strlen(content), false);
+    }
+}
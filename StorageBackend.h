@@ -0,0 +1,134 @@
+#ifndef STORAGEBACKEND_H
+#define STORAGEBACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+// the backend DataStorage starts with, one of Spiffs, LittleFs, Nvs and Posix
+#ifndef DATA_STORAGE_BACKEND
+    #define DATA_STORAGE_BACKEND    Spiffs
+#endif
+
+namespace _2log
+{
+    typedef std::function<bool(const uint8_t *data, size_t length)>    ChunkReadFunction;     ///< returns \c false to stop reading
+    typedef std::function<size_t(uint8_t *buffer, size_t size)>         ChunkWriteFunction;    ///< fills the buffer, returns \c 0 at the end
+
+    /**
+     * @brief The StorageBackendType enum enumerates the storage backends
+     */
+    enum class StorageBackendType : uint8_t
+    {
+        Spiffs,     ///< SPIFFS partition, the default
+        LittleFs,   ///< LittleFS partition, needs the esp_littlefs component
+        Nvs,        ///< every file is a blob in an NVS namespace, no fopen() access
+        Posix       ///< a directory of a file system that is registered elsewhere, e.g. FAT or the host
+    };
+
+    /**
+     * @brief The StorageBackend class is the file system below DataStorage.
+     *
+     * File names are absolute paths below the mount point, e.g. "/2log/auth.json". All functions are called by
+     * DataStorage, mostly on its storage task, and need not be thread safe.
+     */
+    class StorageBackend
+    {
+        public:
+
+            virtual                 ~StorageBackend(void) = default;
+
+            /**
+             * @brief Create a backend
+             * @param type  the type of the backend
+             * @return  the new backend, \c nullptr if the type is not compiled in
+             */
+            static StorageBackend*  create(StorageBackendType type);
+
+            static const char*      getTypeName(StorageBackendType type);
+
+            virtual StorageBackendType  getType(void) const = 0;
+
+            /**
+             * @brief Mount the backend, formatting it on first use
+             * @param mountPoint    the mount point as path, e.g. "/2log"
+             * @return  \c true on success, also if it was mounted before, \c false otherwise
+             */
+            virtual bool            mount(const char *mountPoint) = 0;
+            virtual bool            unmount(void) = 0;
+            virtual bool            isMounted(void) const = 0;
+
+            /**
+             * @brief Remove all files
+             */
+            virtual bool            format(void) = 0;
+
+            /**
+             * @brief Get the size and the used bytes
+             * @return  \c false if the backend can not tell
+             */
+            virtual bool            getInfo(size_t *totalBytes, size_t *usedBytes) = 0;
+
+            /**
+             * @brief Whether the files can also be opened with fopen(), e.g. by the LogStore
+             */
+            virtual bool            hasFileAccess(void) const = 0;
+
+            /**
+             * @brief Read a whole file
+             * @param length    receives the length of the content without the terminator, may be \c nullptr
+             * @return  the null-terminated content allocated with new[], \c nullptr if the file is missing or empty
+             */
+            virtual char*           readFile(const char *fileName, size_t *length) = 0;
+
+            /**
+             * @brief Replace a file with a string
+             * @return  the number of bytes written, <= \c 0 on failure
+             */
+            int                     writeFile(const char *fileName, const char *content);
+
+            /**
+             * @brief Get the size of a file
+             * @return  the size in bytes, \c -1 if the file is missing
+             */
+            virtual int             getFileSize(const char *fileName) = 0;
+
+            /**
+             * @brief Read a part of a file into a buffer, without a terminator
+             * @return  the number of bytes read, \c 0 at the end of the file, \c -1 on failure
+             */
+            virtual int             readData(const char *fileName, size_t offset, void *buffer, size_t size) = 0;
+
+            /**
+             * @brief Replace a file or append to it
+             * @return  the number of bytes written, \c -1 on failure
+             */
+            virtual int             writeData(const char *fileName, const void *data, size_t length, bool append) = 0;
+
+            /**
+             * @brief Read a file in chunks of up to \p bufferSize bytes
+             * @param consumer  called with every chunk, until it returns \c false
+             * @return  the number of bytes passed to the consumer, \c -1 on failure
+             */
+            virtual int             readChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, const ChunkReadFunction &consumer) = 0;
+
+            /**
+             * @brief Replace a file with chunks of up to \p bufferSize bytes
+             * @param producer  called for every chunk, until it returns \c 0
+             * @return  the number of bytes written, \c -1 on failure
+             */
+            virtual int             writeChunked(const char *fileName, uint8_t *buffer, size_t bufferSize, const ChunkWriteFunction &producer) = 0;
+
+            virtual bool            deleteFile(const char *fileName) = 0;
+
+            /**
+             * @brief List the files of a directory, without the directory
+             * @return  \c true if the directory could be read, also if it is empty
+             */
+            virtual bool            listFiles(const char *directory, std::vector<std::string> &fileNames) = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,174 @@
+#include "StorageBenchmark.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_timer.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG         = "_2log::StorageBenchmark";
+    const size_t    FILL_FILE_SIZE  = 4096;
+    const uint32_t  MAX_FILL_FILES  = 1024;
+
+    std::string getFileName(const char *mountPoint, const char *prefix, uint32_t index)
+    {
+        char fileName[32];
+        snprintf(fileName, sizeof(fileName), "/%s_%u.txt", prefix, static_cast<unsigned>(index) );
+
+        return std::string(mountPoint) + fileName;
+    }
+
+    uint32_t getPercentile(const std::vector<uint32_t> &sortedLatencies, uint32_t percent)
+    {
+        if ( sortedLatencies.empty() )
+        {
+            return 0;
+        }
+
+        return sortedLatencies[ ( sortedLatencies.size() - 1 ) * percent / 100 ];
+    }
+
+    uint32_t getElapsed(int64_t start)
+    {
+        return static_cast<uint32_t>( esp_timer_get_time() - start );
+    }
+}
+
+namespace _2log
+{
+    bool StorageBenchmark::run(StorageBackend &backend, const char *mountPoint, const Options &options, Result &result)
+    {
+        result = {};
+
+        int64_t start = esp_timer_get_time();
+
+        if ( ! backend.mount(mountPoint) )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to mount %s", StorageBackend::getTypeName( backend.getType() ) );
+            return false;
+        }
+
+        result.mountTime = getElapsed(start);
+
+        // fill the backend, a SPIFFS garbage collection gets more frequent the fuller it is
+        size_t      totalBytes  = 0;
+        size_t      usedBytes   = 0;
+        uint32_t    fillFiles   = 0;
+        std::string fillContent(FILL_FILE_SIZE, 'f');
+
+        if ( backend.getInfo(&totalBytes, &usedBytes) && totalBytes > 0 )
+        {
+            while ( usedBytes * 100 < totalBytes * options.fillPercent && fillFiles < MAX_FILL_FILES &&
+                    backend.writeFile(getFileName(mountPoint, "fill", fillFiles).c_str(), fillContent.c_str() ) > 0 )
+            {
+                fillFiles++;
+
+                if ( ! backend.getInfo(&totalBytes, &usedBytes) )
+                {
+                    break;
+                }
+            }
+
+            result.usedPercent = static_cast<uint8_t>( usedBytes * 100 / totalBytes );
+        }
+
+        std::vector<std::string>    fileNames;
+        std::vector<uint32_t>       latencies;
+        std::string                 content(options.fileSize, 'a');
+
+        for ( uint32_t file = 0; file < options.files; file++ )
+        {
+            fileNames.push_back( getFileName(mountPoint, "bench", file) );
+        }
+
+        latencies.reserve( std::max(options.writes, options.reads) );
+
+        int64_t writesStart = esp_timer_get_time();
+
+        for ( uint32_t write = 0; write < options.writes && ! fileNames.empty(); write++ )
+        {
+            // every write changes the content
+            content[0] = static_cast<char>( 'a' + write % 26 );
+
+            start = esp_timer_get_time();
+
+            if ( backend.writeFile(fileNames[write % fileNames.size()].c_str(), content.c_str() ) <= 0 )
+            {
+                result.failures++;
+            }
+
+            latencies.push_back( getElapsed(start) );
+        }
+
+        uint32_t writesTime = getElapsed(writesStart);
+
+        std::sort(latencies.begin(), latencies.end() );
+
+        result.writesPerSecond  = writesTime > 0 ? static_cast<uint32_t>( latencies.size() * 1000000ULL / writesTime ) : 0;
+        result.writeP50         = getPercentile(latencies, 50);
+        result.writeP99         = getPercentile(latencies, 99);
+        result.writeMax         = latencies.empty() ? 0 : latencies.back();
+        result.stalls           = static_cast<uint32_t>( latencies.end() - std::upper_bound(latencies.begin(), latencies.end(), std::max<uint32_t>(result.writeP50, 1) * STALL_FACTOR) );
+
+        latencies.clear();
+
+        for ( uint32_t read = 0; read < options.reads && ! fileNames.empty(); read++ )
+        {
+            start = esp_timer_get_time();
+
+            char *fileContent = backend.readFile(fileNames[read % fileNames.size()].c_str(), nullptr);
+
+            latencies.push_back( getElapsed(start) );
+
+            if ( fileContent == nullptr )
+            {
+                result.failures++;
+            }
+
+            delete [] fileContent;
+        }
+
+        std::sort(latencies.begin(), latencies.end() );
+
+        result.readP50 = getPercentile(latencies, 50);
+        result.readP99 = getPercentile(latencies, 99);
+
+        backend.unmount();
+
+        start = esp_timer_get_time();
+
+        if ( backend.mount(mountPoint) )
+        {
+            result.remountTime = getElapsed(start);
+
+            for ( const std::string &fileName : fileNames )
+            {
+                backend.deleteFile( fileName.c_str() );
+            }
+
+            for ( uint32_t file = 0; file < fillFiles; file++ )
+            {
+                backend.deleteFile( getFileName(mountPoint, "fill", file).c_str() );
+            }
+        }
+
+        backend.unmount();
+
+        return true;
+    }
+
+    void StorageBenchmark::logResult(const Result &result, StorageBackendType type)
+    {
+        ESP_LOGI(LOG_TAG, "%s: mount %u us, remount %u us, %u%% used, %u writes/s, write p50 %u us p99 %u us max %u us, %u stalls, "
+                 "read p50 %u us p99 %u us, %u failures", StorageBackend::getTypeName(type), result.mountTime, result.remountTime,
+                 result.usedPercent, result.writesPerSecond, result.writeP50, result.writeP99, result.writeMax, result.stalls,
+                 result.readP50, result.readP99, result.failures);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef STORAGEBENCHMARK_H
+#define STORAGEBENCHMARK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "StorageBackend.h"
+
+namespace _2log
+{
+    /**
+     * @brief The StorageBenchmark class measures a StorageBackend the way DataStorage uses it, on the device as
+     * well as on the host, to pick the backend of a product.
+     *
+     * The backend is mounted, filled to Options::fillPercent with 4 KB files and then written and read with
+     * small files. A write that takes STALL_FACTOR times the median is counted as a stall, on SPIFFS these are
+     * the garbage collections. Finally the backend is mounted again with all files in place, the files are
+     * deleted and it is unmounted. The backend must not be mounted by DataStorage at the same time.
+     */
+    class StorageBenchmark
+    {
+        public:
+
+            static const uint32_t   STALL_FACTOR = 10;
+
+            struct Options
+            {
+                uint32_t    files           = { 16 };       ///< small files that are written in turn
+                uint32_t    fileSize        = { 64 };
+                uint32_t    writes          = { 1000 };
+                uint32_t    reads           = { 1000 };
+                uint8_t     fillPercent     = { 50 };       ///< used space before the writes, if the backend tells
+            };
+
+            /**
+             * @brief The Result struct holds the measurements, all times in microseconds
+             */
+            struct Result
+            {
+                uint32_t    mountTime;          ///< first mount
+                uint32_t    remountTime;        ///< mount with all files in place
+                uint8_t     usedPercent;        ///< used space before the writes
+                uint32_t    writesPerSecond;
+                uint32_t    writeP50;
+                uint32_t    writeP99;
+                uint32_t    writeMax;
+                uint32_t    stalls;
+                uint32_t    readP50;            ///< open, read and close of a small file
+                uint32_t    readP99;
+                uint32_t    failures;           ///< failed writes and reads
+            };
+
+            /**
+             * @brief Run the benchmark
+             * @param backend       the backend, unmounted
+             * @param mountPoint    the mount point, the files are created directly below it
+             * @param options       the options
+             * @param result        receives the measurements
+             *
+             * @return  \c true if the backend could be mounted, \c false otherwise
+             */
+            static bool             run(StorageBackend &backend, const char *mountPoint, const Options &options, Result &result);
+
+            static void             logResult(const Result &result, StorageBackendType type);
+    };
+}
+
+#endif
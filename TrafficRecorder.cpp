@@ -0,0 +1,336 @@
+#include "TrafficRecorder.h"
+
+#include <string.h>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_timer.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG         = "_2log::TrafficRecorder";
+    const char      LOG_MAGIC[4]    = { 'Q', 'H', 'T', 'L' };
+
+    // a record header: type byte and two varints of at most 10 bytes each
+    const size_t    MAX_RECORD_HEADER_SIZE = 21;
+
+    size_t encodeVarint(uint64_t value, uint8_t *buffer)
+    {
+        size_t length = 0;
+
+        while ( value >= 0x80 )
+        {
+            buffer[length++] = static_cast<uint8_t>( value | 0x80 );
+            value >>= 7;
+        }
+
+        buffer[length++] = static_cast<uint8_t>(value);
+
+        return length;
+    }
+}
+
+namespace _2log
+{
+    TrafficRecorder::TrafficRecorder()
+    {
+        _mutex = xSemaphoreCreateMutex();
+    }
+
+    TrafficRecorder::~TrafficRecorder()
+    {
+        stop();
+
+        if ( _mutex != nullptr )
+        {
+            vSemaphoreDelete(_mutex);
+        }
+    }
+
+    bool TrafficRecorder::start(const char *fileName, size_t maxSize)
+    {
+        stop();
+
+        if ( _mutex == nullptr || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return false;
+        }
+
+        _file = fopen(fileName, "wb");
+
+        if ( _file == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to create traffic log %s", fileName);
+            xSemaphoreGive(_mutex);
+            return false;
+        }
+
+        uint8_t header[HEADER_SIZE] = { 0 };
+        memcpy(header, LOG_MAGIC, sizeof(LOG_MAGIC) );
+        header[4] = FORMAT_VERSION;
+
+        _statistics     = {};
+        _bufferLength   = 0;
+        _maxSize        = maxSize;
+        _lastTime       = esp_timer_get_time();
+
+        append(header, sizeof(header) );
+
+        _recording = true;
+
+        xSemaphoreGive(_mutex);
+
+        ESP_LOGI(LOG_TAG, "Recording traffic to %s", fileName);
+
+        return true;
+    }
+
+    void TrafficRecorder::stop()
+    {
+        if ( _mutex == nullptr || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return;
+        }
+
+        if ( _file != nullptr )
+        {
+            _recording = false;
+
+            flush();
+            fclose(_file);
+            _file = nullptr;
+
+            ESP_LOGI(LOG_TAG, "Traffic recording stopped: %u records, %u dropped, %u bytes", _statistics.records, _statistics.droppedRecords,
+                     static_cast<unsigned>(_statistics.size) );
+        }
+
+        xSemaphoreGive(_mutex);
+    }
+
+    bool TrafficRecorder::isRecording() const
+    {
+        return _recording.load(std::memory_order_relaxed);
+    }
+
+    void TrafficRecorder::record(TrafficRecordType type, const char *data, size_t length)
+    {
+        if ( ! isRecording() || xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE )
+        {
+            return;
+        }
+
+        // recording may have stopped while waiting for the mutex
+        if ( _file == nullptr )
+        {
+            xSemaphoreGive(_mutex);
+            return;
+        }
+
+        int64_t now = esp_timer_get_time();
+
+        uint8_t header[MAX_RECORD_HEADER_SIZE];
+        size_t  headerLength = 0;
+
+        header[headerLength++] = static_cast<uint8_t>(type);
+        headerLength += encodeVarint( static_cast<uint64_t>(now - _lastTime), header + headerLength);
+        headerLength += encodeVarint(length, header + headerLength);
+
+        if ( _statistics.size + headerLength + length > _maxSize )
+        {
+            _statistics.droppedRecords++;
+        }
+        else if ( append(header, headerLength) && append(reinterpret_cast<const uint8_t*>(data), length) )
+        {
+            _statistics.records++;
+            _lastTime = now;
+        }
+        else
+        {
+            // the log ends with a partial record, so nothing may follow it
+            _statistics.droppedRecords++;
+            _recording = false;
+        }
+
+        xSemaphoreGive(_mutex);
+    }
+
+    TrafficRecorder::Statistics TrafficRecorder::getStatistics()
+    {
+        Statistics statistics = {};
+
+        if ( _mutex != nullptr && xSemaphoreTake(_mutex, portMAX_DELAY) == pdTRUE )
+        {
+            statistics = _statistics;
+            xSemaphoreGive(_mutex);
+        }
+
+        return statistics;
+    }
+
+    bool TrafficRecorder::append(const uint8_t *data, size_t length)
+    {
+        if ( length == 0 )
+        {
+            return true;
+        }
+
+        if ( _bufferLength + length > sizeof(_buffer) && ! flush() )
+        {
+            return false;
+        }
+
+        if ( length > sizeof(_buffer) )
+        {
+            // large frames bypass the buffer
+            if ( fwrite(data, 1, length, _file) != length )
+            {
+                ESP_LOGE(LOG_TAG, "Failed to write traffic log");
+                return false;
+            }
+        }
+        else
+        {
+            memcpy(_buffer + _bufferLength, data, length);
+            _bufferLength += length;
+        }
+
+        _statistics.size += length;
+
+        return true;
+    }
+
+    bool TrafficRecorder::flush()
+    {
+        if ( _bufferLength == 0 )
+        {
+            return true;
+        }
+
+        size_t length   = _bufferLength;
+        _bufferLength   = 0;
+
+        if ( fwrite(_buffer, 1, length, _file) != length )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to write traffic log");
+            return false;
+        }
+
+        return true;
+    }
+
+    TrafficLogReader::TrafficLogReader()
+    {
+
+    }
+
+    TrafficLogReader::~TrafficLogReader()
+    {
+        close();
+    }
+
+    bool TrafficLogReader::open(const char *fileName)
+    {
+        close();
+
+        _file = fopen(fileName, "rb");
+
+        if ( _file == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to open traffic log %s", fileName);
+            return false;
+        }
+
+        uint8_t header[TrafficRecorder::HEADER_SIZE];
+
+        if ( fread(header, 1, sizeof(header), _file) != sizeof(header) || memcmp(header, LOG_MAGIC, sizeof(LOG_MAGIC) ) != 0 )
+        {
+            ESP_LOGE(LOG_TAG, "%s is not a traffic log", fileName);
+            close();
+            return false;
+        }
+
+        if ( header[4] != TrafficRecorder::FORMAT_VERSION )
+        {
+            ESP_LOGE(LOG_TAG, "Unsupported traffic log version %u", header[4]);
+            close();
+            return false;
+        }
+
+        _timestamp = 0;
+
+        return true;
+    }
+
+    void TrafficLogReader::close()
+    {
+        if ( _file != nullptr )
+        {
+            fclose(_file);
+            _file = nullptr;
+        }
+    }
+
+    bool TrafficLogReader::next(Record &record)
+    {
+        if ( _file == nullptr )
+        {
+            return false;
+        }
+
+        int type = fgetc(_file);
+
+        if ( type == EOF )
+        {
+            return false;
+        }
+
+        uint64_t timeDelta;
+        uint64_t length;
+
+        if ( ! readVarint(timeDelta) || ! readVarint(length) )
+        {
+            ESP_LOGE(LOG_TAG, "Truncated traffic log record");
+            return false;
+        }
+
+        _timestamp += timeDelta;
+
+        record.type         = static_cast<TrafficRecordType>(type);
+        record.timestamp    = _timestamp;
+        record.data.resize( static_cast<size_t>(length) );
+
+        if ( length > 0 && fread(&record.data[0], 1, record.data.size(), _file) != record.data.size() )
+        {
+            ESP_LOGE(LOG_TAG, "Truncated traffic log record");
+            return false;
+        }
+
+        return true;
+    }
+
+    bool TrafficLogReader::readVarint(uint64_t &value)
+    {
+        value = 0;
+
+        for ( unsigned shift = 0; shift < 64; shift += 7 )
+        {
+            int byte = fgetc(_file);
+
+            if ( byte == EOF )
+            {
+                return false;
+            }
+
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+            if ( ( byte & 0x80 ) == 0 )
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
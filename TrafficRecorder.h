@@ -0,0 +1,166 @@
+#ifndef TRAFFICRECORDER_H
+#define TRAFFICRECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <atomic>
+
+extern "C"
+{
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/semphr.h>
+}
+
+#ifndef TRAFFIC_RECORDER_BUFFER_SIZE
+    #define TRAFFIC_RECORDER_BUFFER_SIZE    512
+#endif
+
+#ifndef TRAFFIC_RECORDER_MAX_SIZE
+    #define TRAFFIC_RECORDER_MAX_SIZE       65536
+#endif
+
+namespace _2log
+{
+    /**
+     * @brief The TrafficRecordType enum enumerates the entries of a traffic log
+     */
+    enum class TrafficRecordType : uint8_t
+    {
+        Connected       = 1,    ///< the WebSocket was connected
+        Disconnected    = 2,    ///< the WebSocket was disconnected
+        Inbound         = 3,    ///< a frame received from the server
+        Outbound        = 4     ///< a frame written to the server
+    };
+
+    /**
+     * @brief The TrafficRecorder class writes the WebSocket traffic of a Connection to a compact binary log.
+     *
+     * The log starts with the 8 byte header "QHTL", version, 3 reserved bytes. Each record consists of the
+     * type byte, the time since the previous record in microseconds and the data length, both as unsigned
+     * LEB128 varints, followed by the data. Records are buffered in RAM and appended to the file whenever
+     * the buffer is full and when recording stops. Once the log reaches its size limit further records are
+     * counted as dropped, so a forgotten capture can not fill the flash.
+     *
+     * record() may be called from any task.
+     */
+    class TrafficRecorder
+    {
+        public:
+
+            static const uint8_t    FORMAT_VERSION = 1;
+            static const size_t     HEADER_SIZE = 8;
+
+            /**
+             * @brief The Statistics struct summarizes the current or last recording
+             */
+            struct Statistics
+            {
+                uint32_t    records;            ///< number of records written
+                uint32_t    droppedRecords;     ///< number of records dropped because of the size limit or a write error
+                size_t      size;               ///< log size in bytes
+            };
+
+                                TrafficRecorder(void);
+                                ~TrafficRecorder(void);
+
+                                TrafficRecorder(TrafficRecorder const&)     = delete;
+            void                operator=(TrafficRecorder const&)           = delete;
+
+            /**
+             * @brief Start recording, an existing log is overwritten
+             * @param fileName  the log file, e.g. on the DataStorage mount point
+             * @param maxSize   the size limit of the log in bytes
+             *
+             * @return  \c true if the log was created, \c false otherwise
+             */
+            bool                start(const char *fileName, size_t maxSize = TRAFFIC_RECORDER_MAX_SIZE);
+
+            /**
+             * @brief Stop recording and close the log
+             */
+            void                stop(void);
+
+            /**
+             * @brief Check if the recorder is recording, cheap enough for every frame
+             */
+            bool                isRecording(void) const;
+
+            /**
+             * @brief Append a record to the log, does nothing if not recording
+             * @param type      the record type
+             * @param data      the frame data or \c nullptr for events
+             * @param length    the data length in bytes
+             */
+            void                record(TrafficRecordType type, const char *data = nullptr, size_t length = 0);
+
+            Statistics          getStatistics(void);
+
+        private:
+
+            bool                append(const uint8_t *data, size_t length);
+            bool                flush(void);
+
+        private:
+
+            SemaphoreHandle_t           _mutex = { nullptr };
+            FILE*                       _file = { nullptr };
+            std::atomic<bool>           _recording = { false };
+            int64_t                     _lastTime = { 0 };
+            size_t                      _maxSize = { 0 };
+            Statistics                  _statistics = {};
+            size_t                      _bufferLength = { 0 };
+            uint8_t                     _buffer[TRAFFIC_RECORDER_BUFFER_SIZE];
+    };
+
+    /**
+     * @brief The TrafficLogReader class reads a log written by the TrafficRecorder
+     */
+    class TrafficLogReader
+    {
+        public:
+
+            /**
+             * @brief The Record struct is a single entry of the log
+             */
+            struct Record
+            {
+                TrafficRecordType   type;
+                uint64_t            timestamp;      ///< microseconds since the start of the recording
+                std::string         data;
+            };
+
+                                TrafficLogReader(void);
+                                ~TrafficLogReader(void);
+
+                                TrafficLogReader(TrafficLogReader const&)   = delete;
+            void                operator=(TrafficLogReader const&)          = delete;
+
+            /**
+             * @brief Open a log and check its header
+             * @return  \c true if the file is a traffic log of a supported version, \c false otherwise
+             */
+            bool                open(const char *fileName);
+
+            void                close(void);
+
+            /**
+             * @brief Read the next record
+             * @param record    receives the record
+             * @return  \c true if a record was read, \c false at the end of the log or if the record is truncated
+             */
+            bool                next(Record &record);
+
+        private:
+
+            bool                readVarint(uint64_t &value);
+
+        private:
+
+            FILE*               _file = { nullptr };
+            uint64_t            _timestamp = { 0 };
+    };
+}
+
+#endif
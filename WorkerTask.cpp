@@ -0,0 +1,97 @@
+#include "WorkerTask.h"
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include <freertos/task.h>
+}
+
+namespace
+{
+    const char* LOG_TAG = "_2log::WorkerTask";
+}
+
+namespace _2log
+{
+    WorkerTask::WorkerTask(const char *name, SemaphoreHandle_t wakeSignal, const StepFunction &step, uint32_t stackSize)
+        : _name(name), _stackSize(stackSize), _wakeSignal(wakeSignal), _step(step)
+    {
+        _stopped = xSemaphoreCreateBinary();
+    }
+
+    WorkerTask::~WorkerTask()
+    {
+        stop();
+
+        if ( _stopped != nullptr )
+        {
+            vSemaphoreDelete(_stopped);
+        }
+    }
+
+    bool WorkerTask::start()
+    {
+        if ( _runner != nullptr )
+        {
+            return true;
+        }
+
+        if ( _wakeSignal == nullptr || _stopped == nullptr )
+        {
+            return false;
+        }
+
+        _stopping   = false;
+        _runner     = new Runner(*this);
+
+        if ( ! _runner->startTask() )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to start task %s", _name);
+
+            delete _runner;
+            _runner = nullptr;
+
+            return false;
+        }
+
+        return true;
+    }
+
+    void WorkerTask::stop()
+    {
+        if ( _runner == nullptr )
+        {
+            return;
+        }
+
+        _stopping = true;
+        xSemaphoreGive(_wakeSignal);
+        xSemaphoreTake(_stopped, portMAX_DELAY);
+
+        // the task deleted itself, the Runner is not used anymore
+        delete _runner;
+        _runner = nullptr;
+    }
+
+    bool WorkerTask::isRunning() const
+    {
+        return _runner != nullptr;
+    }
+
+    WorkerTask::Runner::Runner(WorkerTask &worker) : IDFix::Task(worker._name, worker._stackSize), _worker(worker)
+    {
+
+    }
+
+    void WorkerTask::Runner::run()
+    {
+        while ( ! _worker._stopping )
+        {
+            _worker._step();
+        }
+
+        // the worker may be gone as soon as it is signalled, delete the task without returning into it
+        xSemaphoreGive(_worker._stopped);
+        vTaskDelete(nullptr);
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef WORKERTASK_H
+#define WORKERTASK_H
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+
+#include "IDFixTask.h"
+
+extern "C"
+{
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/semphr.h>
+}
+
+namespace _2log
+{
+    /**
+     * @brief The WorkerTask class runs a background loop, e.g. the compaction of a LogStore, between start() and stop().
+     *
+     * The step function is called over and over on its own task and is expected to block on the wake signal,
+     * with or without a timeout. stop() sets a flag, gives the wake signal and waits until the task has left its
+     * loop, so the owner can release everything the step function uses right after. Unlike an IDFix::Task, a
+     * WorkerTask can be started again after a stop, each start creates a new task.
+     */
+    class WorkerTask
+    {
+        public:
+
+            typedef std::function<void(void)>  StepFunction;
+
+            /**
+             * @param name          name of the task
+             * @param wakeSignal    the semaphore the step function waits for, given by stop()
+             * @param step          one iteration of the loop
+             */
+                                WorkerTask(const char *name, SemaphoreHandle_t wakeSignal, const StepFunction &step, uint32_t stackSize = 4096);
+                                ~WorkerTask(void);
+
+                                WorkerTask(WorkerTask const&)       = delete;
+            void                operator=(WorkerTask const&)        = delete;
+
+            /**
+             * @brief Start the task, does nothing if it is running
+             * @return  \c true if the task is running, \c false otherwise
+             */
+            bool                start(void);
+
+            /**
+             * @brief Stop the task and wait until it left its loop, the current step is finished first
+             *
+             * Must not be called from the step function or while holding a lock the step function takes.
+             */
+            void                stop(void);
+
+            bool                isRunning(void) const;
+
+        private:
+
+            class Runner : public IDFix::Task
+            {
+                public:
+
+                                Runner(WorkerTask &worker);
+
+                protected:
+
+                    void        run(void) override;
+
+                private:
+
+                    WorkerTask& _worker;
+            };
+
+        private:
+
+            const char*         _name;
+            uint32_t            _stackSize;
+            SemaphoreHandle_t   _wakeSignal;
+            SemaphoreHandle_t   _stopped = { nullptr };
+            StepFunction        _step;
+            Runner*             _runner = { nullptr };
+            std::atomic<bool>   _stopping = { false };
+    };
+}
+
+#endif
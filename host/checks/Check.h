@@ -0,0 +1,201 @@
+#ifndef HOST_CHECK_H
+#define HOST_CHECK_H
+
+/*
+ * Assertions of the host checks, which ctest runs (see host/CMakeLists.txt).
+ *
+ * A failed CHECK() prints the condition and its location, and the check goes on, so one run shows all
+ * failures. check::result() prints the summary and is the exit code of the check.
+ */
+
+#include <stdio.h>
+#include <dirent.h>
+#include <chrono>
+#include <thread>
+
+#if MEMORY_DEBUGGING == 1
+    #include "AllocationTracker.h"
+#endif
+
+#define CHECK(condition)                                                                            \
+    do                                                                                              \
+    {                                                                                               \
+        if ( ! ( condition ) )                                                                      \
+        {                                                                                           \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);           \
+            check::failures()++;                                                                    \
+        }                                                                                           \
+    } while ( false )
+
+namespace check
+{
+    inline int& failures()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    inline int result(const char *name)
+    {
+        if ( failures() > 0 )
+        {
+            printf("%s: %d checks failed\n", name, failures() );
+            return 1;
+        }
+
+        printf("%s: passed\n", name);
+        return 0;
+    }
+
+    /**
+     * @brief Number of threads of the process, i.e. of started and not yet deleted host tasks
+     */
+    inline int threadCount()
+    {
+        DIR     *directory  = opendir("/proc/self/task");
+        int     count       = 0;
+
+        while ( directory != nullptr && readdir(directory) != nullptr )
+        {
+            count++;
+        }
+
+        if ( directory != nullptr )
+        {
+            closedir(directory);
+        }
+
+        // without . and ..
+        return count - 2;
+    }
+
+    /**
+     * @brief Poll a condition that a background task makes true
+     * @return  \c true if it became true within the timeout, \c false otherwise
+     */
+    template<typename Condition>
+    bool waitFor(Condition condition, uint32_t milliseconds = 5000)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+
+        while ( ! condition() )
+        {
+            if ( std::chrono::steady_clock::now() > deadline )
+            {
+                return false;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1) );
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Number of threads once it did not change for a while, i.e. after just deleted tasks have exited
+     */
+    inline int settledThreadCount(uint32_t milliseconds = 100)
+    {
+        int     count       = threadCount();
+        auto    settled     = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+
+        while ( std::chrono::steady_clock::now() < settled )
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1) );
+
+            if ( threadCount() != count )
+            {
+                count   = threadCount();
+                settled = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+            }
+        }
+
+        return count;
+    }
+
+    /**
+     * @brief Wait until the process has this many threads, a deleted task takes a moment to exit
+     */
+    inline bool waitForThreadCount(int count)
+    {
+        return waitFor([count]() { return threadCount() == count; });
+    }
+
+    /**
+     * @brief Check that the background task of a store is stopped by close() and the destructor, the thread
+     *        count of the process shows it, and runs again after a new open()
+     * @param open      Opens a \c Store, returns \c true on success
+     * @param close     Closes a \c Store
+     * @param active    Gives the task of an open \c Store work, returns \c true once the task did it
+     */
+    template<typename Store, typename Open, typename Close, typename Active>
+    void taskLifecycle(Open open, Close close, Active active)
+    {
+        // the first task also starts the background thread of a sanitizer
+        {
+            Store store;
+            CHECK(open(store) );
+        }
+
+        int threads = settledThreadCount();
+
+        // constructing and destroying stores must neither leak tasks nor hang
+        for ( int round = 0; round < 20; round++ )
+        {
+            Store store;
+
+            CHECK(open(store) );
+
+            close(store);
+            CHECK(! store.isOpen() );
+            CHECK(waitForThreadCount(threads) );
+            CHECK(open(store) );
+        }
+
+        CHECK(waitForThreadCount(threads) );
+
+        // the task of a reopened store still runs
+        Store store;
+
+        CHECK(open(store) );
+        close(store);
+        CHECK(open(store) );
+        CHECK(active(store) );
+
+        close(store);
+        CHECK(waitForThreadCount(threads) );
+    }
+
+    /*
+     * Allocation counts of the checks that link quickhub_host_tracked, the library built with MEMORY_DEBUGGING.
+     */
+    #if MEMORY_DEBUGGING == 1
+
+        /**
+         * @brief Number of heap allocations of the calling task since start
+         */
+        inline uint32_t allocations()
+        {
+            return _2log::AllocationTracker::getTaskAllocations();
+        }
+
+        /**
+         * @brief Check the number of heap allocations of the calling task since start
+         */
+        inline bool allocated(uint32_t start, uint32_t count)
+        {
+            return allocations() - start == count;
+        }
+
+        /**
+         * @brief Bytes currently allocated by a subsystem
+         */
+        inline size_t liveBytes(_2log::AllocationSubsystem subsystem = _2log::AllocationSubsystem::Other)
+        {
+            return _2log::AllocationTracker::getStatistics(subsystem).liveBytes;
+        }
+
+    #endif
+}
+
+#endif
@@ -0,0 +1,354 @@
+/*
+ * Connection multi-producer check
+ *
+ * Several threads send payloads on three lanes at once while the peer reads slowly, another thread pings, and
+ * a monitor samples the lane backlogs:
+ *
+ * - no lane backlog goes above its limit, the control lane with the pongs included
+ * - every queued payload is completed exactly once, the sent ones arrive and per producer and lane in order
+ * - destroying the connection with frames in the lanes completes them all and frees the frames
+ *
+ * Build with -DQUICKHUB_SANITIZER=thread to run it under ThreadSanitizer.
+ */
+
+#include "Check.h"
+#include "Connection.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace _2log;
+using IDFix::Protocols::WebSocket;
+
+namespace
+{
+    const char*         URL             = "ws://check/connection";
+    const int           PRODUCERS       = 4;
+    const int           PAYLOADS        = 3000;
+    const size_t        LANE_LIMIT      = 1024;
+    const size_t        CONTROL_LIMIT   = 256;
+    const SendPriority  LANES[]         = { SendPriority::RPCResult, SendPriority::State, SendPriority::Bulk };
+    const int           LANE_COUNT      = sizeof(LANES) / sizeof(LANES[0]);
+
+    long readField(const char *data, const char *field)
+    {
+        const char *value = strstr(data, field);
+        return value != nullptr ? strtol(value + strlen(field), nullptr, 10) : -1;
+    }
+
+    /**
+     * @brief Answers the registration and checks the order of the payloads, without allocating
+     */
+    class Peer : public IDFix::Protocols::WebSocketPeer
+    {
+        public:
+
+            void peerConnected(WebSocket *socket) override
+            {
+                _socket = socket;
+            }
+
+            void peerDisconnected(WebSocket *) override
+            {
+                _socket = nullptr;
+            }
+
+            void peerMessageReceived(WebSocket *socket, const char *data, int length) override
+            {
+                char message[512];
+                size_t size = static_cast<size_t>(length) < sizeof(message) ? static_cast<size_t>(length) : sizeof(message) - 1;
+
+                memcpy(message, data, size);
+                message[size] = '\0';
+
+                if ( strstr(message, "connection:register") != nullptr )
+                {
+                    const char *reply = "{\"command\":\"connection:registered\",\"uuid\":0}";
+                    socket->deliverBinaryMessage(reply, static_cast<int>( strlen(reply) ) );
+                    return;
+                }
+
+                if ( strstr(message, "\"pong\"") != nullptr )
+                {
+                    pongs++;
+                    return;
+                }
+
+                long producer   = readField(message, "\"p\":");
+                long sequence   = readField(message, "\"s\":");
+                long lane       = readField(message, "\"l\":");
+
+                if ( producer < 0 || producer >= PRODUCERS || lane < 0 || lane >= LANE_COUNT )
+                {
+                    malformed++;
+                    return;
+                }
+
+                // the sender task is the only caller
+                if ( sequence <= _lastSequence[producer][lane] )
+                {
+                    reordered++;
+                }
+
+                _lastSequence[producer][lane] = sequence;
+                received++;
+
+                while ( blocked )
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1) );
+                }
+
+                // a slow link, so the lanes fill up
+                std::this_thread::sleep_for(std::chrono::microseconds(20) );
+            }
+
+            void ping()
+            {
+                const char *ping = "{\"command\":\"ping\"}";
+                WebSocket *socket = _socket;
+
+                if ( socket != nullptr )
+                {
+                    socket->deliverBinaryMessage(ping, static_cast<int>( strlen(ping) ) );
+                }
+            }
+
+        public:
+
+            std::atomic<uint32_t>   received = { 0 };
+            std::atomic<uint32_t>   pongs = { 0 };
+            std::atomic<uint32_t>   reordered = { 0 };
+            std::atomic<uint32_t>   malformed = { 0 };
+            std::atomic<bool>       blocked = { false };
+
+        private:
+
+            std::atomic<WebSocket*> _socket = { nullptr };
+            long                    _lastSequence[PRODUCERS][LANE_COUNT] = {};
+    };
+
+    class Events : public ConnectionEventHandler
+    {
+        public:
+
+            void connected() override
+            {
+                isConnected = true;
+            }
+
+            void disconnected() override
+            {
+                isConnected = false;
+            }
+
+            void jsonReceived(const cJSON *) override
+            {
+
+            }
+
+        public:
+
+            std::atomic<bool>   isConnected = { false };
+    };
+
+    struct Counters
+    {
+        std::atomic<uint32_t>   queued = { 0 };
+        std::atomic<uint32_t>   rejected = { 0 };
+        std::atomic<uint32_t>   sent = { 0 };
+        std::atomic<uint32_t>   dropped = { 0 };
+        std::atomic<uint32_t>   completedTwice = { 0 };
+    };
+
+    void produce(Connection &connection, Counters &counters, int producer, int payloads)
+    {
+        for ( int index = 0; index < payloads; index++ )
+        {
+            int     lane    = index % LANE_COUNT;
+            cJSON   *payload = cJSON_CreateObject();
+
+            cJSON_AddNumberToObject(payload, "p", producer);
+            cJSON_AddNumberToObject(payload, "s", index + 1);
+            cJSON_AddNumberToObject(payload, "l", lane);
+
+            std::shared_ptr<std::atomic<bool>> completed = std::make_shared<std::atomic<bool>>(false);
+
+            SendStatus status = connection.sendPayloadAsync(payload, [&counters, completed](SendStatus status)
+            {
+                if ( completed->exchange(true) )
+                {
+                    counters.completedTwice++;
+                }
+
+                ( status == SendStatus::Sent ? counters.sent : counters.dropped )++;
+            }, LANES[lane]);
+
+            cJSON_Delete(payload);
+
+            if ( status == SendStatus::Queued )
+            {
+                counters.queued++;
+            }
+            else if ( status == SendStatus::RejectedFull )
+            {
+                counters.rejected++;
+
+                // back off like a producer that waits for room
+                std::this_thread::sleep_for(std::chrono::microseconds(50) );
+            }
+        }
+    }
+
+    Connection* connect(Events &events)
+    {
+        Connection *connection = new Connection(URL);
+
+        connection->setConnectionEventHandler(&events);
+
+        connection->setLaneLimit(SendPriority::Control, CONTROL_LIMIT);
+
+        for ( SendPriority lane : LANES )
+        {
+            connection->setLaneLimit(lane, LANE_LIMIT);
+        }
+
+        CHECK(connection->connect() );
+
+        // payloads are only accepted once the peer answered the registration
+        CHECK(check::waitFor([&events]() { return events.isConnected.load(); }) );
+
+        return connection;
+    }
+
+    void disconnectAndDelete(Connection *connection, Events &events)
+    {
+        // the disconnect is handled on the WebSocket task, it must be done before the destruction
+        CHECK(connection->disconnect() );
+        CHECK(check::waitFor([&events]() { return ! events.isConnected; }) );
+
+        delete connection;
+    }
+
+    void checkProducers()
+    {
+        Peer                peer;
+        Events              events;
+        Counters            counters;
+        std::atomic<bool>   running = { true };
+        size_t              maxBacklog[Connection::LANE_COUNT] = {};
+
+        WebSocket::registerPeer(URL, &peer);
+
+        Connection *connection = connect(events);
+
+        std::thread monitor([&]()
+        {
+            while ( running )
+            {
+                for ( size_t lane = 0; lane < Connection::LANE_COUNT; lane++ )
+                {
+                    size_t backlog = connection->getBacklogSize(static_cast<SendPriority>(lane) );
+                    maxBacklog[lane] = backlog > maxBacklog[lane] ? backlog : maxBacklog[lane];
+                }
+            }
+        });
+
+        std::thread pinger([&]()
+        {
+            while ( running )
+            {
+                peer.ping();
+                std::this_thread::sleep_for(std::chrono::microseconds(200) );
+            }
+        });
+
+        std::vector<std::thread> producers;
+
+        for ( int producer = 0; producer < PRODUCERS; producer++ )
+        {
+            producers.emplace_back(produce, std::ref(*connection), std::ref(counters), producer, PAYLOADS);
+        }
+
+        for ( std::thread &producer : producers )
+        {
+            producer.join();
+        }
+
+        CHECK(check::waitFor([&counters]() { return counters.sent + counters.dropped == counters.queued; }, 60000) );
+
+        running = false;
+        monitor.join();
+        pinger.join();
+
+        printf("queued %u, rejected %u, sent %u, dropped %u, pongs %u, max backlog %u/%u/%u/%u bytes\n", counters.queued.load(),
+               counters.rejected.load(), counters.sent.load(), counters.dropped.load(), peer.pongs.load(),
+               static_cast<unsigned>(maxBacklog[0]), static_cast<unsigned>(maxBacklog[1]), static_cast<unsigned>(maxBacklog[2]),
+               static_cast<unsigned>(maxBacklog[3]) );
+
+        CHECK(counters.queued + counters.rejected == PRODUCERS * PAYLOADS);
+        CHECK(counters.rejected > 0);
+        CHECK(counters.completedTwice == 0);
+        CHECK(counters.sent == peer.received);
+        CHECK(peer.reordered == 0);
+        CHECK(peer.malformed == 0);
+        CHECK(peer.pongs > 0);
+        CHECK(maxBacklog[static_cast<size_t>(SendPriority::Control)] <= CONTROL_LIMIT);
+
+        for ( SendPriority lane : LANES )
+        {
+            CHECK(maxBacklog[static_cast<size_t>(lane)] <= LANE_LIMIT);
+        }
+
+        CHECK(connection->getBacklogSize() == 0);
+
+        disconnectAndDelete(connection, events);
+
+        WebSocket::registerPeer(URL, nullptr);
+    }
+
+    void checkDestruction()
+    {
+        Peer        peer;
+        Events      events;
+        Counters    counters;
+
+        WebSocket::registerPeer(URL, &peer);
+
+        Connection *connection = connect(events);
+
+        size_t liveBytes = check::liveBytes(AllocationSubsystem::Connection);
+
+        // the sender task hangs in the first write, the others stay in the lanes
+        peer.blocked = true;
+        produce(*connection, counters, 0, 30);
+
+        std::thread release([&peer]()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50) );
+            peer.blocked = false;
+        });
+
+        disconnectAndDelete(connection, events);
+        release.join();
+
+        CHECK(counters.queued > 1);
+        CHECK(counters.sent + counters.dropped == counters.queued);
+        CHECK(counters.completedTwice == 0);
+
+        CHECK(check::liveBytes(AllocationSubsystem::Connection) <= liveBytes);
+
+        WebSocket::registerPeer(URL, nullptr);
+    }
+}
+
+int main()
+{
+    checkProducers();
+    checkDestruction();
+
+    return check::result("Connection");
+}
@@ -0,0 +1,62 @@
+/*
+ * CounterStore check
+ *
+ * - the persist task is stopped by close() and the destructor, the thread count of the process shows it, and
+ *   runs again after a new open()
+ * - close() writes changed counters, the next open() continues with them
+ */
+
+#include "Check.h"
+#include "CounterStore.h"
+
+extern "C"
+{
+    #include "esp_partition.h"
+}
+
+using namespace _2log;
+
+namespace
+{
+    const char*     PARTITION   = "check";
+
+    void checkLifecycle()
+    {
+        uint64_t expected = 0;
+
+        // every open() continues with the counter written by the close() or destructor before it
+        check::taskLifecycle<CounterStore>([&expected](CounterStore &store)
+        {
+            if ( ! store.open(PARTITION) || store.get(0) != expected || ! store.add(0, 1) )
+            {
+                return false;
+            }
+
+            expected += 1;
+            return true;
+        },
+        [](CounterStore &store) { store.close(); },
+        [](CounterStore &store)
+        {
+            uint32_t writes = store.getStatistics().writes;
+
+            store.setPersistInterval(10);
+
+            return store.add(1, 7) && check::waitFor([&store, writes]() { return store.getStatistics().writes > writes; });
+        });
+    }
+}
+
+int main()
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION);
+
+    CHECK(partition != nullptr && esp_partition_erase_range(partition, 0, partition->size) == ESP_OK);
+
+    if ( partition != nullptr )
+    {
+        checkLifecycle();
+    }
+
+    return check::result("CounterStore");
+}
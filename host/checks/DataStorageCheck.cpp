@@ -0,0 +1,187 @@
+/*
+ * DataStorage binary file check
+ *
+ * With the Posix, Nvs and Spiffs backends, 300 bytes with null characters are
+ *
+ * - written, appended to and read at offsets into a buffer of the caller, up to and past the end of the file
+ * - written and read in 17 byte chunks through one buffer, the consumer can stop early
+ * - read back as text file with their length
+ *
+ * and every function fails with -1 while nothing is mounted or the file does not exist. unmount() waits for the
+ * low priority writes queued before it, a delete or a listing after it fails.
+ */
+
+#include "Check.h"
+#include "DataStorage.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+    #include "HostVFS.h"
+}
+
+using namespace _2log;
+
+namespace
+{
+    const char*     BINARY_FILE     = "/2log/binary.bin";
+    const char*     CHUNKED_FILE    = "/2log/chunked.bin";
+    const size_t    LENGTH          = 300;
+    const size_t    CHUNK_SIZE      = 17;
+    // as many as the queue takes without dropping, however slow the storage task is
+    const int       LATE_WRITES     = DATA_STORAGE_QUEUE_LENGTH;
+
+    void makeData(uint8_t *data)
+    {
+        for ( size_t i = 0; i < LENGTH; i++ )
+        {
+            data[i] = static_cast<uint8_t>(i * 7);
+        }
+
+        data[5]     = 0;
+        data[100]   = 0;
+    }
+
+    void checkBuffers(DataStorage &storage, const uint8_t *data)
+    {
+        uint8_t buffer[64];
+
+        CHECK(storage.writeFile(BINARY_FILE, data, LENGTH) == static_cast<int>(LENGTH) );
+        CHECK(storage.getFileSize(BINARY_FILE) == static_cast<int>(LENGTH) );
+
+        CHECK(storage.readFile(BINARY_FILE, buffer, sizeof(buffer), 90) == static_cast<int>( sizeof(buffer) ) );
+        CHECK(memcmp(buffer, data + 90, sizeof(buffer) ) == 0);
+
+        CHECK(storage.readFile(BINARY_FILE, buffer, sizeof(buffer), LENGTH - 20) == 20);
+        CHECK(memcmp(buffer, data + LENGTH - 20, 20) == 0);
+        CHECK(storage.readFile(BINARY_FILE, buffer, sizeof(buffer), LENGTH) == 0);
+
+        CHECK(storage.writeFile(BINARY_FILE, data, 50, true) == 50);
+        CHECK(storage.getFileSize(BINARY_FILE) == static_cast<int>(LENGTH) + 50);
+        CHECK(storage.readFile(BINARY_FILE, buffer, 50, LENGTH) == 50);
+        CHECK(memcmp(buffer, data, 50) == 0);
+
+        // replacing a file shortens it
+        CHECK(storage.writeFile(BINARY_FILE, data, 10) == 10);
+        CHECK(storage.getFileSize(BINARY_FILE) == 10);
+
+        CHECK(storage.getFileSize("/2log/missing.bin") == -1);
+        CHECK(storage.readFile("/2log/missing.bin", buffer, sizeof(buffer) ) == -1);
+
+        CHECK(storage.deleteFile(BINARY_FILE) );
+    }
+
+    void checkChunks(DataStorage &storage, const uint8_t *data)
+    {
+        uint8_t     buffer[CHUNK_SIZE];
+        size_t      position    = 0;
+        int         chunks      = 0;
+        std::string content;
+
+        CHECK(storage.writeFileChunked(CHUNKED_FILE, buffer, sizeof(buffer), [data, &position](uint8_t *chunk, size_t size) -> size_t
+        {
+            size_t length = std::min(size, LENGTH - position);
+
+            memcpy(chunk, data + position, length);
+            position += length;
+
+            return length;
+        }) == static_cast<int>(LENGTH) );
+
+        CHECK(storage.readFileChunked(CHUNKED_FILE, buffer, sizeof(buffer), [&content, &chunks](const uint8_t *chunk, size_t length)
+        {
+            CHECK(length <= CHUNK_SIZE);
+
+            content.append(reinterpret_cast<const char*>(chunk), length);
+            chunks++;
+
+            return true;
+        }) == static_cast<int>(LENGTH) );
+
+        CHECK(content.size() == LENGTH && memcmp(content.data(), data, LENGTH) == 0);
+        CHECK(chunks == static_cast<int>( ( LENGTH + CHUNK_SIZE - 1 ) / CHUNK_SIZE ) );
+
+        // the consumer stops after the first chunk
+        CHECK(storage.readFileChunked(CHUNKED_FILE, buffer, sizeof(buffer), [](const uint8_t *, size_t) { return false; }) == static_cast<int>(CHUNK_SIZE) );
+
+        size_t      length  = 0;
+        const char  *text   = storage.readTextFile(CHUNKED_FILE, &length);
+
+        CHECK(text != nullptr && length == LENGTH && memcmp(text, data, LENGTH) == 0);
+        CHECK(text != nullptr && text[LENGTH] == '\0');
+
+        delete [] text;
+
+        CHECK(storage.readFileChunked("/2log/missing.bin", buffer, sizeof(buffer), [](const uint8_t *, size_t) { return true; }) == -1);
+        CHECK(storage.deleteFile(CHUNKED_FILE) );
+    }
+
+    void checkUnmount(DataStorage &storage)
+    {
+        std::atomic<int>            written = { 0 };
+        std::vector<std::string>    fileNames;
+
+        for ( int i = 0; i < LATE_WRITES; i++ )
+        {
+            std::string fileName = "/2log/late" + std::to_string(i) + ".json";
+
+            CHECK(storage.writeTextFileAsync(fileName.c_str(), "{}", [&written](int bytesWritten)
+            {
+                if ( bytesWritten == 2 )
+                {
+                    written++;
+                }
+            }, StoragePriority::Low) );
+        }
+
+        CHECK(storage.unmount() );
+        CHECK(written == LATE_WRITES);
+
+        CHECK(! storage.deleteFile("/2log/late0.json") );
+        CHECK(! storage.listFiles("/2log", fileNames) );
+    }
+}
+
+int main()
+{
+    DataStorage &storage = DataStorage::getInstance();
+    uint8_t     data[LENGTH];
+    uint8_t     buffer[CHUNK_SIZE];
+
+    makeData(data);
+
+    CHECK(storage.getFileSize(BINARY_FILE) == -1);
+    CHECK(storage.writeFile(BINARY_FILE, data, LENGTH) == -1);
+    CHECK(storage.readFile(BINARY_FILE, buffer, sizeof(buffer) ) == -1);
+
+    const StorageBackendType backends[] = { StorageBackendType::Posix, StorageBackendType::Nvs, StorageBackendType::Spiffs };
+
+    for ( StorageBackendType backend : backends )
+    {
+        // the file system of the Posix backend is registered by the application
+        if ( backend == StorageBackendType::Posix )
+        {
+            CHECK(host_vfs_mount("/2log") == 0);
+        }
+
+        CHECK(storage.setBackend(backend) );
+        CHECK(storage.mount("/2log") );
+
+        checkBuffers(storage, data);
+        checkChunks(storage, data);
+        checkUnmount(storage);
+
+        if ( backend == StorageBackendType::Posix )
+        {
+            CHECK(host_vfs_unmount("/2log") == 0);
+        }
+    }
+
+    return check::result("DataStorage");
+}
@@ -0,0 +1,153 @@
+/*
+ * DeviceNode check
+ *
+ * - the destructor stops the loop task, the thread count of the process shows it, also while events are
+ *   still queued
+ * - the events queued before the destruction are handled, every completion is called exactly once
+ * - the destructor deletes the connection and releases what the queued events own
+ */
+
+#include "Check.h"
+#include "DeviceNode.h"
+
+#include <atomic>
+#include <thread>
+
+using namespace _2log;
+
+namespace
+{
+    const int   ROUNDS      = 20;
+    const int   PROPERTIES  = 6;
+
+    /**
+     * @brief Completes every payload right away, the first send can be held back to keep events in the queue
+     */
+    class HeldConnection : public IConnection
+    {
+        public:
+
+            HeldConnection(std::atomic<int> &deleted) : _deleted(deleted)
+            {
+
+            }
+
+            ~HeldConnection() override
+            {
+                _deleted++;
+            }
+
+            bool connect(uint32_t) override
+            {
+                return true;
+            }
+
+            bool disconnect() override
+            {
+                return true;
+            }
+
+            bool sendPayload(const cJSON *) override
+            {
+                return true;
+            }
+
+            SendStatus sendPayloadAsync(const cJSON *, sendCompletionFunction completion, SendPriority) override
+            {
+                while ( held )
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1) );
+                }
+
+                payloads++;
+
+                if ( completion )
+                {
+                    completion(SendStatus::Sent);
+                }
+
+                return SendStatus::Queued;
+            }
+
+            size_t getBacklogSize() const override
+            {
+                return 0;
+            }
+
+            bool setConnectionEventHandler(ConnectionEventHandler *) override
+            {
+                return true;
+            }
+
+        public:
+
+            std::atomic<bool>   held = { false };
+            std::atomic<int>    payloads = { 0 };
+
+        private:
+
+            std::atomic<int>&   _deleted;
+    };
+
+    void checkDestruction()
+    {
+        std::atomic<int> deleted = { 0 };
+
+        // the first task also starts the background thread of a sanitizer
+        delete new DeviceNode(new HeldConnection(deleted), nullptr, "check", "node", "node", 0);
+
+        int threads = check::settledThreadCount();
+
+        size_t liveBytes = check::liveBytes(AllocationSubsystem::DeviceNode);
+
+        for ( int round = 0; round < ROUNDS; round++ )
+        {
+            HeldConnection      *connection = new HeldConnection(deleted);
+            DeviceNode          *node       = new DeviceNode(connection, nullptr, "check", "node", "node", 0);
+            std::atomic<int>    completions = { 0 };
+            int                 queued      = 0;
+
+            // the registration hangs in the connection, the properties stay in the queue
+            connection->held = true;
+            node->connected();
+
+            for ( int property = 0; property < PROPERTIES; property++ )
+            {
+                SendStatus status;
+
+                // only accepted once the loop task handled the connected event
+                while ( ( status = node->setProperty("value", property, [&completions](SendStatus) { completions++; }) ) == SendStatus::Dropped )
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1) );
+                }
+
+                CHECK(status == SendStatus::Queued);
+                CHECK(node->setProperty("text", "a string value owned by the event") == SendStatus::Queued);
+                queued++;
+            }
+
+            std::thread release([connection]()
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20) );
+                connection->held = false;
+            });
+
+            delete node;
+            release.join();
+
+            CHECK(completions == queued);
+            CHECK(check::waitForThreadCount(threads) );
+        }
+
+        CHECK(deleted == ROUNDS + 1);
+
+        CHECK(check::liveBytes(AllocationSubsystem::DeviceNode) <= liveBytes);
+    }
+}
+
+int main()
+{
+    checkDestruction();
+
+    return check::result("DeviceNode");
+}
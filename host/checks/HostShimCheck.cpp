@@ -0,0 +1,173 @@
+/*
+ * Host shim check
+ *
+ * - a queue keeps the order of xQueueSend() and xQueueSendToFront(), a full or empty queue fails after the
+ *   ticks to wait, and a task blocked in xQueueReceive() is woken by another task
+ * - semaphores and mutexes are queues of items without data, a mutex is created given
+ * - timers fire on one service thread, a one-shot timer once and an auto-reload timer until it is stopped
+ * - paths below a mounted base path are redirected under HOST_VFS_ROOT, others and those of an unmounted base
+ *   path are used unchanged
+ */
+
+#include "Check.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+extern "C"
+{
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "freertos/queue.h"
+    #include "freertos/semphr.h"
+    #include "freertos/timers.h"
+    #include "HostVFS.h"
+}
+
+namespace
+{
+    struct TimerState
+    {
+        std::atomic<int>                fired   = { 0 };
+        std::atomic<std::thread::id>    thread;
+    };
+
+    void countTimer(TimerHandle_t timer)
+    {
+        TimerState *state = static_cast<TimerState*>( pvTimerGetTimerID(timer) );
+
+        state->thread = std::this_thread::get_id();
+        state->fired++;
+    }
+
+    void sendLater(void *parameter)
+    {
+        int value = 42;
+
+        vTaskDelay(pdMS_TO_TICKS(20) );
+        xQueueSend(static_cast<QueueHandle_t>(parameter), &value, portMAX_DELAY);
+
+        vTaskDelete(nullptr);
+    }
+
+    void checkQueues()
+    {
+        QueueHandle_t   queue   = xQueueCreate(2, sizeof(int) );
+        int             value   = 1;
+
+        CHECK(xQueueSend(queue, &value, 0) == pdTRUE);
+        value = 2;
+        CHECK(xQueueSendToFront(queue, &value, 0) == pdTRUE);
+        CHECK(uxQueueMessagesWaiting(queue) == 2 && uxQueueSpacesAvailable(queue) == 0);
+
+        TickType_t start = xTaskGetTickCount();
+        value = 3;
+        CHECK(xQueueSend(queue, &value, pdMS_TO_TICKS(20) ) == pdFALSE);
+        CHECK(xTaskGetTickCount() - start >= pdMS_TO_TICKS(20) );
+
+        CHECK(xQueueReceive(queue, &value, 0) == pdTRUE && value == 2);
+        CHECK(xQueueReceive(queue, &value, 0) == pdTRUE && value == 1);
+        CHECK(xQueueReceive(queue, &value, 0) == pdFALSE);
+
+        CHECK(xTaskCreate(sendLater, "sendLater", 2048, queue, 5, nullptr) == pdPASS);
+        CHECK(xQueueReceive(queue, &value, pdMS_TO_TICKS(5000) ) == pdTRUE && value == 42);
+
+        vQueueDelete(queue);
+
+        SemaphoreHandle_t binary = xSemaphoreCreateBinary();
+
+        CHECK(xSemaphoreTake(binary, 0) == pdFALSE);
+        CHECK(xSemaphoreGive(binary) == pdTRUE);
+        CHECK(xSemaphoreGive(binary) == pdFALSE);
+        CHECK(xSemaphoreTake(binary, 0) == pdTRUE);
+
+        vSemaphoreDelete(binary);
+
+        SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+
+        CHECK(xSemaphoreTake(mutex, 0) == pdTRUE);
+        CHECK(xSemaphoreTake(mutex, 0) == pdFALSE);
+        CHECK(xSemaphoreGive(mutex) == pdTRUE);
+
+        vSemaphoreDelete(mutex);
+    }
+
+    void checkTimers()
+    {
+        TimerState      once;
+        TimerState      periodic;
+        TimerHandle_t   onceTimer       = xTimerCreate("once", pdMS_TO_TICKS(10), pdFALSE, &once, countTimer);
+        TimerHandle_t   periodicTimer   = xTimerCreate("periodic", pdMS_TO_TICKS(5), pdTRUE, &periodic, countTimer);
+
+        CHECK(xTimerIsTimerActive(onceTimer) == pdFALSE);
+        CHECK(xTimerStart(onceTimer, 0) == pdPASS);
+        CHECK(xTimerStart(periodicTimer, 0) == pdPASS);
+
+        CHECK(check::waitFor([&once, &periodic]() { return once.fired == 1 && periodic.fired >= 3; }) );
+        CHECK(xTimerIsTimerActive(onceTimer) == pdFALSE);
+        CHECK(xTimerIsTimerActive(periodicTimer) == pdTRUE);
+
+        CHECK(xTimerStop(periodicTimer, 0) == pdPASS);
+
+        // let a callback finish that was already running when the timer was stopped
+        vTaskDelay(pdMS_TO_TICKS(20) );
+
+        int fired = periodic.fired;
+
+        vTaskDelay(pdMS_TO_TICKS(50) );
+
+        CHECK(periodic.fired == fired);
+        CHECK(once.fired == 1);
+        CHECK(once.thread.load() == periodic.thread.load() );
+        CHECK(once.thread.load() != std::this_thread::get_id() );
+
+        CHECK(xTimerDelete(onceTimer, 0) == pdPASS);
+        CHECK(xTimerDelete(periodicTimer, 0) == pdPASS);
+    }
+
+    void checkPaths()
+    {
+        const char  *root   = getenv("HOST_VFS_ROOT");
+        std::string prefix  = std::string(root != nullptr ? root : "./host_vfs") + "/shim";
+
+        CHECK(strcmp(host_vfs_path("/shim/file.txt"), "/shim/file.txt") == 0);
+
+        CHECK(host_vfs_mount("/shim") == 0);
+        CHECK(host_vfs_is_mounted("/shim") );
+        CHECK(host_vfs_path("/shim/file.txt") == prefix + "/file.txt");
+        CHECK(strcmp(host_vfs_path("/shimmer/file.txt"), "/shimmer/file.txt") == 0);
+
+        FILE *file = fopen("/shim/file.txt", "wb");
+        CHECK(file != nullptr && fwrite("12345", 1, 5, file) == 5);
+
+        if ( file != nullptr )
+        {
+            fclose(file);
+        }
+
+        struct stat status;
+
+        CHECK(::stat( ( prefix + "/file.txt" ).c_str(), &status) == 0 && status.st_size == 5);
+        CHECK(host_vfs_used_bytes("/shim") == 5);
+
+        CHECK(host_vfs_format("/shim") == 0);
+        CHECK(stat("/shim/file.txt", &status) != 0);
+        CHECK(host_vfs_used_bytes("/shim") == 0);
+
+        CHECK(host_vfs_unmount("/shim") == 0);
+        CHECK(host_vfs_unmount("/shim") == -1);
+        CHECK(strcmp(host_vfs_path("/shim/file.txt"), "/shim/file.txt") == 0);
+    }
+}
+
+int main()
+{
+    checkQueues();
+    checkTimers();
+    checkPaths();
+
+    return check::result("HostShim");
+}
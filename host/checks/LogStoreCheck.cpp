@@ -0,0 +1,111 @@
+/*
+ * LogStore check
+ *
+ * - the compaction task is stopped by close() and the destructor, the thread count of the process shows it,
+ *   and runs again after a new open()
+ * - a record or batch whose sync fails is not in the store after the next open(), also when a shorter
+ *   record was appended behind the last valid one in between
+ */
+
+#include "Check.h"
+#include "LogStore.h"
+
+#include <string.h>
+#include <string>
+
+extern "C"
+{
+    #include "HostVFS.h"
+}
+
+using namespace _2log;
+
+namespace
+{
+    const char*     STORE   = "/2log/check.kv";
+
+    bool hasValue(LogStore &store, const char *key, const std::string &expected)
+    {
+        std::string value;
+        return store.get(key, value) && value == expected;
+    }
+
+    void checkLifecycle()
+    {
+        // every open() finds the value put before the last close() or destructor
+        bool put = false;
+
+        check::taskLifecycle<LogStore>([&put](LogStore &store)
+        {
+            if ( ! store.open(STORE) || ( put && ! hasValue(store, "key", "value") ) )
+            {
+                return false;
+            }
+
+            put = store.put("key", "value", 5);
+            return put;
+        },
+        [](LogStore &store) { store.close(); },
+        [](LogStore &store)
+        {
+            std::string value(200, 'x');
+
+            for ( int update = 0; update < 100; update++ )
+            {
+                if ( ! store.put("big", value.data(), value.size() ) )
+                {
+                    return false;
+                }
+            }
+
+            return check::waitFor([&store]() { return store.getStatistics().compactions > 0; }) && hasValue(store, "big", value);
+        });
+    }
+
+    void checkFailedSync()
+    {
+        unlink(STORE);
+
+        {
+            LogStore store;
+
+            CHECK(store.open(STORE) );
+            CHECK(store.put("kept", "1", 1) );
+
+            host_vfs_set_sync_failures(1);
+            CHECK(! store.put("lost", "2", 1) );
+            CHECK(! store.contains("lost") );
+
+            LogStore::Batch batch;
+            batch.put("batch_a", "aaaa", 4);
+            batch.put("batch_b", "bbbb", 4);
+
+            host_vfs_set_sync_failures(1);
+            CHECK(! store.write(batch) );
+
+            // as long as the BEGIN record of the failed batch, the PUT records of the batch would follow it
+            CHECK(store.put("k", "123", 3) );
+        }
+
+        LogStore store;
+
+        CHECK(store.open(STORE) );
+        CHECK(hasValue(store, "kept", "1") );
+        CHECK(hasValue(store, "k", "123") );
+        CHECK(! store.contains("lost") );
+        CHECK(! store.contains("batch_a") );
+        CHECK(! store.contains("batch_b") );
+        CHECK(store.getStatistics().keys == 2);
+    }
+}
+
+int main()
+{
+    host_vfs_mount("/2log");
+    host_vfs_format("/2log");
+
+    checkLifecycle();
+    checkFailedSync();
+
+    return check::result("LogStore");
+}
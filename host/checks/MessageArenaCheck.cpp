@@ -0,0 +1,278 @@
+/*
+ * MessageArena check
+ *
+ * - the cJSON allocations of a task holding a scope come from the arena and are not counted as heap
+ *   allocations (AllocationTracker of quickhub_host_tracked), the arena is reused once the outermost scope
+ *   is left
+ * - nested scopes keep the arena until the outermost one is left
+ * - an allocation that does not fit falls back to the heap and is released again, as are the allocations of
+ *   another task while the arena is held and those inside a Suspend, which outlive the scope
+ * - the hooks are installed before main(), no cJSON data of the plain heap is released through them later
+ * - a RPC callback of a DeviceNode runs outside of the arena, the copy and the printed string it keeps of its
+ *   argument are still intact after the next message
+ */
+
+#include "Check.h"
+#include "MessageArena.h"
+#include "DeviceNode.h"
+
+#include <cJSON.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+using namespace _2log;
+
+namespace
+{
+    /**
+     * @brief Accepts every payload, the node only needs a connection to exist
+     */
+    class NullConnection : public IConnection
+    {
+        public:
+
+            bool connect(uint32_t) override
+            {
+                return true;
+            }
+
+            bool disconnect() override
+            {
+                return true;
+            }
+
+            bool sendPayload(const cJSON *) override
+            {
+                return true;
+            }
+
+            SendStatus sendPayloadAsync(const cJSON *, sendCompletionFunction, SendPriority) override
+            {
+                return SendStatus::Queued;
+            }
+
+            size_t getBacklogSize() const override
+            {
+                return 0;
+            }
+
+            bool setConnectionEventHandler(ConnectionEventHandler *) override
+            {
+                return true;
+            }
+    };
+
+    cJSON* createMessage()
+    {
+        cJSON *message = cJSON_CreateObject();
+
+        cJSON_AddStringToObject(message, "command", "node:property");
+        cJSON_AddNumberToObject(message, "value", 21.5);
+
+        return message;
+    }
+
+    void checkScopes()
+    {
+        MessageArena::Statistics    statistics  = MessageArena::getStatistics();
+        uint32_t                    start       = check::allocations();
+        const void                  *first;
+
+        {
+            MessageArena::Scope scope;
+            CHECK(scope.isActive() );
+
+            cJSON *message = createMessage();
+            first = message;
+
+            char *text = cJSON_PrintUnformatted(message);
+            CHECK(text != nullptr && strstr(text, "node:property") != nullptr);
+
+            cJSON_free(text);
+            cJSON_Delete(message);
+        }
+
+        CHECK(check::allocated(start, 0) );
+        CHECK(MessageArena::getStatistics().scopes == statistics.scopes + 1);
+        CHECK(MessageArena::getStatistics().allocations > statistics.allocations);
+        CHECK(MessageArena::getStatistics().fallbacks == statistics.fallbacks);
+
+        // the next message starts at the beginning of the arena again
+        {
+            MessageArena::Scope scope;
+
+            cJSON *message = createMessage();
+            CHECK(static_cast<const void*>(message) == first);
+            cJSON_Delete(message);
+        }
+
+        // an inner scope does not reset the arena
+        {
+            MessageArena::Scope outer;
+            cJSON *outerMessage = createMessage();
+            cJSON *innerMessage;
+
+            {
+                MessageArena::Scope inner;
+                CHECK(inner.isActive() );
+
+                innerMessage = cJSON_CreateObject();
+            }
+
+            cJSON *laterMessage = cJSON_CreateObject();
+            CHECK(laterMessage != innerMessage);
+
+            cJSON_Delete(laterMessage);
+            cJSON_Delete(innerMessage);
+            cJSON_Delete(outerMessage);
+        }
+
+        CHECK(MessageArena::getStatistics().scopes == statistics.scopes + 3);
+        CHECK(check::allocated(start, 0) );
+    }
+
+    void checkFallbacks()
+    {
+        std::string                 large(MESSAGE_ARENA_SIZE, 'x');
+        MessageArena::Statistics    statistics  = MessageArena::getStatistics();
+        size_t                      live        = check::liveBytes();
+
+        {
+            MessageArena::Scope scope;
+
+            cJSON *message = cJSON_CreateObject();
+            cJSON_AddStringToObject(message, "large", large.c_str() );
+
+            cJSON *item = cJSON_GetObjectItem(message, "large");
+            CHECK(cJSON_IsString(item) && large == item->valuestring);
+            CHECK(MessageArena::getStatistics().fallbacks > statistics.fallbacks);
+
+            cJSON_Delete(message);
+        }
+
+        CHECK(check::liveBytes() <= live);
+
+        cJSON *kept = nullptr;
+
+        {
+            MessageArena::Scope scope;
+
+            // another task neither gets the arena nor disturbs it
+            std::thread other([&large]()
+            {
+                MessageArena::Scope otherScope;
+                CHECK(! otherScope.isActive() );
+
+                uint32_t    start   = check::allocations();
+                cJSON       *string = cJSON_CreateString(large.c_str() );
+
+                CHECK(check::allocations() > start);
+                CHECK(string != nullptr && large == string->valuestring);
+
+                cJSON_Delete(string);
+            });
+
+            other.join();
+
+            {
+                MessageArena::Suspend suspend;
+                kept = createMessage();
+            }
+        }
+
+        // created during the suspend, it outlives the scope
+        {
+            MessageArena::Scope scope;
+
+            cJSON *overwrite = createMessage();
+            cJSON_AddStringToObject(overwrite, "command", "something else");
+            cJSON_Delete(overwrite);
+        }
+
+        cJSON *command = cJSON_GetObjectItem(kept, "command");
+        CHECK(cJSON_IsString(command) && strcmp(command->valuestring, "node:property") == 0);
+
+        cJSON_Delete(kept);
+
+        CHECK(check::liveBytes() <= live);
+    }
+
+    void checkCallbacks()
+    {
+        DeviceNode          *node       = new DeviceNode(new NullConnection(), nullptr, "check", "node", "node", 0);
+        std::atomic<int>    calls       = { 0 };
+        cJSON               *kept       = nullptr;
+        char                *printed    = nullptr;
+
+        node->registerRPC("keep", [&calls, &kept, &printed](const cJSON *argument)
+        {
+            cJSON   *copy   = cJSON_Duplicate(argument, true);
+            char    *text   = cJSON_PrintUnformatted(argument);
+
+            // only the data of the first call is kept, the later calls would overwrite it in a reused arena
+            if ( kept == nullptr )
+            {
+                kept    = copy;
+                printed = text;
+            }
+            else
+            {
+                cJSON_Delete(copy);
+                cJSON_free(text);
+            }
+
+            calls++;
+        });
+
+        const char *messages[] =
+        {
+            "{\"cmd\":\"call\",\"params\":{\"keep\":{\"level\":1,\"target\":\"lamp\"}}}",
+            "{\"cmd\":\"call\",\"params\":{\"keep\":{\"level\":2,\"target\":\"a much longer target that overwrites the first message\"}}}"
+        };
+
+        for ( const char *text : messages )
+        {
+            int     expected    = calls + 1;
+            cJSON   *message    = cJSON_Parse(text);
+
+            node->jsonReceived(message);
+            cJSON_Delete(message);
+
+            CHECK(check::waitFor([&calls, expected]() { return calls == expected; }) );
+        }
+
+        delete node;
+
+        cJSON *level    = cJSON_GetObjectItem(kept, "level");
+        cJSON *target   = cJSON_GetObjectItem(kept, "target");
+
+        CHECK(cJSON_IsNumber(level) && level->valueint == 1);
+        CHECK(cJSON_IsString(target) && strcmp(target->valuestring, "lamp") == 0);
+        CHECK(printed != nullptr && strcmp(printed, "{\"level\":1,\"target\":\"lamp\"}") == 0);
+
+        cJSON_Delete(kept);
+        cJSON_free(printed);
+    }
+}
+
+int main()
+{
+    // the hooks are installed before main(), cJSON data created here is tracked and released through them
+    uint32_t    start       = check::allocations();
+    size_t      liveBytes   = check::liveBytes();
+    cJSON       *early      = cJSON_CreateObject();
+
+    CHECK(check::allocations() > start && check::liveBytes() > liveBytes);
+
+    cJSON_Delete(early);
+
+    CHECK(check::liveBytes() == liveBytes);
+
+    checkScopes();
+    checkFallbacks();
+    checkCallbacks();
+
+    return check::result("MessageArena");
+}
@@ -0,0 +1,371 @@
+/*
+ * NumberFormatter check
+ *
+ * - formatFloat() of every finite float is a JSON number that strtof() reads back as the same float, with no
+ *   more significant digits than the shortest "%.<n>e" that does, and NaN and infinity are null
+ * - formatFixed(), formatDouble() and formatInteger() of edge cases, doubles read back as the same double, or as
+ *   the same float if they are one
+ *
+ * ctest runs every 251st bit pattern, which reaches all exponents, and the edge cases. All 2^32 patterns are
+ * checked on all cores with
+ *
+ *   quickhub_check_number_formatter --exhaustive
+ */
+
+#include "Check.h"
+#include "NumberFormatter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace _2log;
+
+namespace
+{
+    const uint64_t  PATTERN_COUNT   = static_cast<uint64_t>(1) << 32;
+    const uint32_t  DEFAULT_STRIDE  = 251;
+
+    // the shortest representation is searched with snprintf(), which is slow, so only for every n-th checked float
+    const uint32_t  SHORTEST_STRIDE = 16;
+
+    struct Result
+    {
+        std::atomic<uint64_t>   checked = { 0 };
+        std::atomic<uint64_t>   notRoundTripped = { 0 };
+        std::atomic<uint64_t>   notShortest = { 0 };
+        std::atomic<uint64_t>   notJSON = { 0 };
+    };
+
+    float fromBits(uint32_t bits)
+    {
+        float value;
+        memcpy(&value, &bits, sizeof(value) );
+        return value;
+    }
+
+    bool isDigit(char character)
+    {
+        return character >= '0' && character <= '9';
+    }
+
+    /**
+     * @brief Check the JSON number grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+     */
+    bool isJSONNumber(const char *text)
+    {
+        if ( *text == '-' )
+        {
+            text++;
+        }
+
+        if ( *text == '0' )
+        {
+            text++;
+        }
+        else if ( *text >= '1' && *text <= '9' )
+        {
+            while ( isDigit(*text) ) text++;
+        }
+        else
+        {
+            return false;
+        }
+
+        if ( *text == '.' )
+        {
+            text++;
+
+            if ( ! isDigit(*text) )
+            {
+                return false;
+            }
+
+            while ( isDigit(*text) ) text++;
+        }
+
+        if ( *text == 'e' || *text == 'E' )
+        {
+            text++;
+
+            if ( *text == '+' || *text == '-' )
+            {
+                text++;
+            }
+
+            if ( ! isDigit(*text) )
+            {
+                return false;
+            }
+
+            while ( isDigit(*text) ) text++;
+        }
+
+        return *text == '\0';
+    }
+
+    /**
+     * @brief Number of significant digits of a formatted number, without leading and trailing zeros
+     */
+    int significantDigits(const char *text)
+    {
+        char    digits[NumberFormatter::BUFFER_SIZE];
+        int     count = 0;
+
+        for ( ; *text != '\0' && *text != 'e' && *text != 'E'; text++ )
+        {
+            if ( isDigit(*text) && ( count > 0 || *text != '0' ) )
+            {
+                digits[count++] = *text;
+            }
+        }
+
+        while ( count > 0 && digits[count - 1] == '0' )
+        {
+            count--;
+        }
+
+        return count;
+    }
+
+    int shortestDigits(float value)
+    {
+        char buffer[64];
+
+        for ( int digits = 1; digits < 9; digits++ )
+        {
+            snprintf(buffer, sizeof(buffer), "%.*e", digits - 1, static_cast<double>(value) );
+
+            if ( strtof(buffer, nullptr) == value )
+            {
+                return digits;
+            }
+        }
+
+        return 9;
+    }
+
+    void checkPattern(uint32_t bits, bool shortest, Result &result)
+    {
+        char    buffer[NumberFormatter::BUFFER_SIZE];
+        float   value   = fromBits(bits);
+        size_t  length  = NumberFormatter::formatFloat(value, buffer);
+
+        result.checked.fetch_add(1, std::memory_order_relaxed);
+
+        if ( ! isfinite(value) )
+        {
+            if ( strcmp(buffer, "null") != 0 )
+            {
+                result.notJSON++;
+            }
+
+            return;
+        }
+
+        if ( length != strlen(buffer) || ! isJSONNumber(buffer) )
+        {
+            if ( result.notJSON++ < 5 )
+            {
+                fprintf(stderr, "%08x: \"%s\" is no JSON number\n", bits, buffer);
+            }
+
+            return;
+        }
+
+        // -0 is written as 0
+        if ( strtof(buffer, nullptr) != value )
+        {
+            if ( result.notRoundTripped++ < 5 )
+            {
+                fprintf(stderr, "%08x: %.9g was written as %s\n", bits, static_cast<double>(value), buffer);
+            }
+
+            return;
+        }
+
+        if ( shortest && significantDigits(buffer) > shortestDigits(value) )
+        {
+            if ( result.notShortest++ < 5 )
+            {
+                fprintf(stderr, "%08x: %s is longer than %d digits\n", bits, buffer, shortestDigits(value) );
+            }
+        }
+    }
+
+    void checkPatterns(uint32_t stride)
+    {
+        Result      result;
+        unsigned    threads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+
+        std::vector<std::thread> workers;
+
+        for ( unsigned worker = 0; worker < threads; worker++ )
+        {
+            workers.emplace_back([&result, stride, threads, worker]()
+            {
+                uint64_t index = 0;
+
+                for ( uint64_t pattern = static_cast<uint64_t>(worker) * stride; pattern < PATTERN_COUNT; pattern += static_cast<uint64_t>(threads) * stride )
+                {
+                    checkPattern(static_cast<uint32_t>(pattern), index++ % SHORTEST_STRIDE == 0, result);
+                }
+            });
+        }
+
+        for ( std::thread &worker : workers )
+        {
+            worker.join();
+        }
+
+        printf("%llu floats, %llu not round-tripped, %llu not shortest, %llu no JSON number\n",
+               static_cast<unsigned long long>(result.checked.load() ), static_cast<unsigned long long>(result.notRoundTripped.load() ),
+               static_cast<unsigned long long>(result.notShortest.load() ), static_cast<unsigned long long>(result.notJSON.load() ) );
+
+        CHECK(result.notRoundTripped == 0);
+        CHECK(result.notShortest == 0);
+        CHECK(result.notJSON == 0);
+    }
+
+    void checkFloatEdgeCases()
+    {
+        const float values[] =
+        {
+            0.0f, -0.0f, 1.0f, -1.0f, 0.1f, 0.3f, 1e-45f, FLT_MIN, FLT_MAX, -FLT_MAX, 16777216.0f, 16777217.0f,
+            123456789.0f, 1e10f, 1e-10f, 3.14159265f, 2.5f, 100.0f, 1e21f, 1e-7f, nextafterf(FLT_MIN, 0.0f)
+        };
+
+        Result result;
+
+        for ( float value : values )
+        {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits) );
+
+            checkPattern(bits, true, result);
+        }
+
+        CHECK(result.notRoundTripped == 0);
+        CHECK(result.notShortest == 0);
+        CHECK(result.notJSON == 0);
+
+        char buffer[NumberFormatter::BUFFER_SIZE];
+
+        NumberFormatter::formatFloat(0.1f, buffer);
+        CHECK(strcmp(buffer, "0.1") == 0);
+
+        NumberFormatter::formatFloat(NAN, buffer);
+        CHECK(strcmp(buffer, "null") == 0);
+
+        NumberFormatter::formatFloat(-INFINITY, buffer);
+        CHECK(strcmp(buffer, "null") == 0);
+    }
+
+    void checkOtherFormats()
+    {
+        char buffer[NumberFormatter::BUFFER_SIZE];
+
+        struct FixedCase
+        {
+            float       value;
+            uint8_t     decimals;
+            const char* expected;
+        };
+
+        const FixedCase fixedCases[] =
+        {
+            { 3.14159f,     2,  "3.14" },
+            { 12.5f,        0,  "13" },
+            { -1.0f,        3,  "-1" },
+            { 0.0f,         2,  "0" },
+            { -0.0004f,     2,  "0" },
+            { 1234.5678f,   2,  "1234.57" },
+            { 1.5f,         9,  "1.5" }
+        };
+
+        for ( const FixedCase &fixedCase : fixedCases )
+        {
+            NumberFormatter::formatFixed(fixedCase.value, fixedCase.decimals, buffer);
+
+            if ( strcmp(buffer, fixedCase.expected) != 0 )
+            {
+                fprintf(stderr, "formatFixed(%g, %u) is %s instead of %s\n", static_cast<double>(fixedCase.value), fixedCase.decimals, buffer,
+                        fixedCase.expected);
+            }
+
+            CHECK(strcmp(buffer, fixedCase.expected) == 0);
+            CHECK(isJSONNumber(buffer) );
+        }
+
+        const double doubles[] = { 0.1, 1e300, -2.5e-300, 123456789.123, 1e22, 9007199254740993.0, 0.30000000000000004, -7.0 };
+
+        for ( double value : doubles )
+        {
+            NumberFormatter::formatDouble(value, buffer);
+
+            CHECK(isJSONNumber(buffer) );
+
+            // doubles that are exactly a float are written as the float, e.g. 2^53 as 9.007199e+15
+            if ( static_cast<double>( static_cast<float>(value) ) == value )
+            {
+                CHECK(strtof(buffer, nullptr) == static_cast<float>(value) );
+            }
+            else
+            {
+                CHECK(strtod(buffer, nullptr) == value);
+            }
+        }
+
+        NumberFormatter::formatDouble(INFINITY, buffer);
+        CHECK(strcmp(buffer, "null") == 0);
+
+        const int64_t integers[] = { INT64_MIN, INT64_MIN + 1, -1, 0, 1, 10, INT32_MAX, INT64_MAX };
+
+        for ( int64_t value : integers )
+        {
+            char expected[NumberFormatter::BUFFER_SIZE];
+            snprintf(expected, sizeof(expected), "%lld", static_cast<long long>(value) );
+
+            NumberFormatter::formatInteger(value, buffer);
+            CHECK(strcmp(buffer, expected) == 0);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t stride = DEFAULT_STRIDE;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( strcmp(argv[i], "--exhaustive") == 0 )
+        {
+            stride = 1;
+        }
+        else if ( strcmp(argv[i], "--stride") == 0 && i + 1 < argc )
+        {
+            stride = static_cast<uint32_t>( strtoul(argv[++i], nullptr, 10) );
+        }
+        else
+        {
+            printf("Usage: %s [--exhaustive | --stride N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if ( stride == 0 )
+    {
+        stride = 1;
+    }
+
+    checkFloatEdgeCases();
+    checkOtherFormats();
+    checkPatterns(stride);
+
+    return check::result("NumberFormatter");
+}
@@ -0,0 +1,95 @@
+/*
+ * DeviceProperties on the Nvs backend check
+ *
+ * - with DataStorage on NVS, DeviceProperties starts and keeps its segment on the SPIFFS stand-in at "/2log"
+ * - a legacy property file in NVS is migrated into the segment
+ * - saved properties are written to the segment, the files of DataStorage stay in NVS
+ */
+
+#include "Check.h"
+#include "DeviceProperties.h"
+#include "LogStore.h"
+
+#include <stdio.h>
+#include <string>
+
+extern "C"
+{
+    #include "HostVFS.h"
+}
+
+using namespace _2log;
+
+namespace
+{
+    const char*     SEGMENT         = "/2log/properties.kv";
+    const char*     SEGMENT_COPY    = "/2log/copy.kv";
+    const char*     LEGACY_FILE     = "/2log/prop/legacy";
+    const char*     DATA_FILE       = "/2log/data.json";
+
+    bool copyFile(const char *source, const char *destination)
+    {
+        FILE *input     = fopen(source, "rb");
+        FILE *output    = fopen(destination, "wb");
+        bool success    = input != nullptr && output != nullptr;
+        char buffer[512];
+        size_t length;
+
+        while ( success && ( length = fread(buffer, 1, sizeof(buffer), input) ) > 0 )
+        {
+            success = fwrite(buffer, 1, length, output) == length;
+        }
+
+        if ( input != nullptr )
+        {
+            fclose(input);
+        }
+
+        if ( output != nullptr )
+        {
+            success = fclose(output) == 0 && success;
+        }
+
+        return success;
+    }
+}
+
+int main()
+{
+    DataStorage &storage = DataStorage::getInstance();
+
+    CHECK(storage.setBackend(StorageBackendType::Nvs) );
+    CHECK(storage.mount("/2log") );
+    CHECK(storage.writeTextFile(LEGACY_FILE, "{\"type\":0,\"val\":7}") > 0);
+
+    DeviceProperties &properties = DeviceProperties::instance();
+
+    CHECK(properties.getProperty<int>("legacy", 0) == 7);
+    CHECK(properties.saveProperty(".configReset", true) );
+    CHECK(properties.saveProperty("name", std::string("lamp") ) );
+    CHECK(properties.sync() );
+    CHECK(properties.getStorageStatistics().keys == 3);
+
+    // the segment is a file of the SPIFFS stand-in, the legacy file is gone from NVS
+    CHECK(host_vfs_is_mounted("/2log") );
+    CHECK(copyFile(SEGMENT, SEGMENT_COPY) );
+    CHECK(storage.getFileSize(LEGACY_FILE) == -1);
+    CHECK(storage.getFileSize(SEGMENT) == -1);
+
+    LogStore copy;
+    std::string value;
+
+    CHECK(copy.open(SEGMENT_COPY) );
+    CHECK(copy.contains("legacy") && copy.contains(".configReset") && copy.get("name", value) );
+    copy.close();
+
+    // DataStorage still writes to NVS
+    CHECK(storage.writeTextFile(DATA_FILE, "{}") == 2);
+    CHECK(storage.getFileSize(DATA_FILE) == 2);
+
+    struct stat status;
+
+    CHECK(stat(DATA_FILE, &status) != 0);
+
+    return check::result("PropertiesNvs");
+}
@@ -0,0 +1,156 @@
+/*
+ * PropertyValue check
+ *
+ * - values of every type, strings and bytes up to PROPERTY_VALUE_INLINE_SIZE included, are built, copied,
+ *   moved and read without a heap allocation (counted by the AllocationTracker of quickhub_host_tracked)
+ * - a longer string allocates once per copy, never when moved, and its copies are released again
+ * - copies keep their value, a moved-from value is INVALID, an assignment to itself keeps the value
+ */
+
+#include "Check.h"
+#include "DeviceProperties.h"
+
+#include <string.h>
+#include <string>
+#include <utility>
+
+using namespace _2log;
+
+namespace
+{
+    typedef DeviceProperties::PropertyValue PropertyValue;
+
+    const char*     SHORT_STRING    = "fifteen chars!!";
+    const char*     LONG_STRING     = "sixteen chars!!!";
+
+    static_assert(PROPERTY_VALUE_INLINE_SIZE == 15, "the strings of the check are made for the default inline size");
+
+    bool hasString(const PropertyValue &value, const char *expected)
+    {
+        bool        success;
+        const char  *string = value.asCstring(&success);
+
+        return success && strcmp(string, expected) == 0;
+    }
+
+    void checkShortValues()
+    {
+        const uint8_t bytes[] = { 0x00, 0x01, 0x02, 0xff, 0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80, 0x90, 0xa0 };
+
+        uint32_t start = check::allocations();
+
+        {
+            PropertyValue values[] =
+            {
+                PropertyValue(42),
+                PropertyValue(static_cast<int64_t>(1) << 40),
+                PropertyValue(21.5f),
+                PropertyValue(0.1),
+                PropertyValue(true),
+                PropertyValue(static_cast<int32_t>(1234), static_cast<uint8_t>(2) ),
+                PropertyValue(SHORT_STRING),
+                PropertyValue::fromBytes(bytes, sizeof(bytes) ),
+                PropertyValue("")
+            };
+
+            for ( const PropertyValue &value : values )
+            {
+                PropertyValue copy(value);
+                PropertyValue assigned;
+                assigned = copy;
+
+                PropertyValue moved(std::move(copy) );
+                PropertyValue moveAssigned;
+                moveAssigned = std::move(moved);
+
+                CHECK(! value.isHeapAllocated() );
+                CHECK(assigned.getType() == value.getType() );
+                CHECK(moveAssigned.getType() == value.getType() );
+                CHECK(copy.getType() == PropertyValue::INVALID);
+                CHECK(moved.getType() == PropertyValue::INVALID);
+
+                assigned = assigned;
+                CHECK(assigned.getType() == value.getType() );
+            }
+
+            CHECK(hasString(values[6], SHORT_STRING) );
+
+            size_t          length;
+            const uint8_t   *data = values[7].asBytes(&length);
+
+            CHECK(length == sizeof(bytes) && memcmp(data, bytes, length) == 0);
+
+            int     integer;
+            int64_t integer64;
+            float   real;
+            double  real64;
+            bool    boolean;
+
+            CHECK(values[0].get(integer) && integer == 42);
+            CHECK(values[1].get(integer64) && integer64 == static_cast<int64_t>(1) << 40);
+            CHECK(values[2].get(real) && real == 21.5f);
+            CHECK(values[3].get(real64) && real64 == 0.1);
+            CHECK(values[4].get(boolean) && boolean);
+
+            // rewriting a value of one type with another
+            PropertyValue value(SHORT_STRING);
+
+            value.setInt(1);
+            value.setBytes(bytes, 4);
+            value.setString("short");
+            value.setScaled(5, 1);
+            value.setString(SHORT_STRING, 3);
+            CHECK(hasString(value, "fif") );
+        }
+
+        printf("short values: %u allocations\n", check::allocations() - start);
+
+        CHECK(check::allocated(start, 0) );
+    }
+
+    void checkLongValues()
+    {
+        size_t      live    = check::liveBytes();
+        uint32_t    start   = check::allocations();
+
+        {
+            PropertyValue value(LONG_STRING);
+
+            CHECK(value.isHeapAllocated() );
+            CHECK(check::allocated(start, 1) );
+
+            PropertyValue copy(value);
+            PropertyValue assigned;
+            assigned = copy;
+
+            CHECK(check::allocated(start, 3) );
+            CHECK(hasString(copy, LONG_STRING) );
+            CHECK(hasString(assigned, LONG_STRING) );
+
+            PropertyValue moved(std::move(copy) );
+            assigned = std::move(moved);
+
+            CHECK(check::allocated(start, 3) );
+            CHECK(hasString(assigned, LONG_STRING) );
+            CHECK(copy.getType() == PropertyValue::INVALID);
+
+            assigned = assigned;
+            CHECK(hasString(assigned, LONG_STRING) );
+
+            // back to the inline storage
+            assigned.setString(SHORT_STRING);
+            CHECK(! assigned.isHeapAllocated() );
+            CHECK(hasString(assigned, SHORT_STRING) );
+        }
+
+        CHECK(check::liveBytes() <= live);
+    }
+}
+
+int main()
+{
+    checkShortValues();
+    checkLongValues();
+
+    return check::result("PropertyValue");
+}
@@ -0,0 +1,255 @@
+/*
+ * Steady state allocation check
+ *
+ * A DeviceNode on a Connection publishes properties of every type, with and without completion, and answers
+ * pings, one after another so the message arena is free for each of them:
+ *
+ * - once the node is registered neither the node nor the connection allocate, the AllocationTracker counts
+ *   all allocations of both subsystems
+ * - the property names and string values copied into the events arrive unchanged, also those too long for
+ *   the text of an event, whose heap copies are released again
+ *
+ * The check links quickhub_host_tracked, so the allocations are counted in every build.
+ */
+
+#include "Check.h"
+#include "Connection.h"
+#include "DeviceNode.h"
+#include "DeviceNodeEventHandler.h"
+#include "AllocationTracker.h"
+
+#include <string.h>
+#include <atomic>
+#include <mutex>
+
+using namespace _2log;
+using IDFix::Protocols::WebSocket;
+
+namespace
+{
+    const char*     URL     = "ws://check/steady_state";
+    const int       ROUNDS  = 1000;
+
+    /**
+     * @brief Answers the registration, counts the pongs and keeps the last property update, without allocating
+     */
+    class Peer : public IDFix::Protocols::WebSocketPeer
+    {
+        public:
+
+            void peerConnected(WebSocket *socket) override
+            {
+                _socket = socket;
+            }
+
+            void peerDisconnected(WebSocket *) override
+            {
+                _socket = nullptr;
+            }
+
+            void peerMessageReceived(WebSocket *socket, const char *data, int length) override
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                size_t size = static_cast<size_t>(length) < sizeof(_message) ? static_cast<size_t>(length) : sizeof(_message) - 1;
+
+                memcpy(_message, data, size);
+                _message[size] = '\0';
+
+                if ( strstr(_message, "connection:register") != nullptr )
+                {
+                    const char *reply = "{\"command\":\"connection:registered\",\"uuid\":0}";
+                    socket->deliverBinaryMessage(reply, static_cast<int>( strlen(reply) ) );
+                }
+                else if ( strstr(_message, "node:register") != nullptr )
+                {
+                    registered = true;
+                }
+                else if ( strstr(_message, "\"pong\"") != nullptr )
+                {
+                    pongs++;
+                }
+                else
+                {
+                    memcpy(_lastUpdate, _message, size + 1);
+                    updates++;
+                }
+            }
+
+            void ping()
+            {
+                const char *ping = "{\"command\":\"ping\"}";
+                WebSocket *socket = _socket;
+
+                if ( socket != nullptr )
+                {
+                    socket->deliverBinaryMessage(ping, static_cast<int>( strlen(ping) ) );
+                }
+            }
+
+            bool lastUpdateContains(const char *text)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return strstr(_lastUpdate, text) != nullptr;
+            }
+
+        public:
+
+            std::atomic<bool>       registered = { false };
+            std::atomic<uint32_t>   updates = { 0 };
+            std::atomic<uint32_t>   pongs = { 0 };
+
+        private:
+
+            std::atomic<WebSocket*> _socket = { nullptr };
+            std::mutex              _mutex;
+            char                    _message[512] = {};
+            char                    _lastUpdate[512] = {};
+    };
+
+    class Events : public DeviceNodeEventHandler
+    {
+        public:
+
+            void deviceNodeConnected() override
+            {
+                isConnected = true;
+            }
+
+            void deviceNodeDisconnected() override
+            {
+                isConnected = false;
+            }
+
+            void deviceNodeAuthKeyChanged(uint32_t) override
+            {
+
+            }
+
+        public:
+
+            std::atomic<bool>   isConnected = { false };
+    };
+
+    uint32_t countAllocations()
+    {
+        return AllocationTracker::getStatistics(AllocationSubsystem::Connection).allocations +
+               AllocationTracker::getStatistics(AllocationSubsystem::DeviceNode).allocations;
+    }
+
+    size_t countLiveBytes()
+    {
+        return check::liveBytes(AllocationSubsystem::Connection) + check::liveBytes(AllocationSubsystem::DeviceNode);
+    }
+
+    /**
+     * @brief Wait until the peer got the update, the message arena is free again once it arrived
+     */
+    bool published(Peer &peer, uint32_t &updates)
+    {
+        updates++;
+        return check::waitFor([&peer, updates]() { return peer.updates >= updates; });
+    }
+
+    void runRound(DeviceNode &node, Peer &peer, uint32_t &updates, std::atomic<uint32_t> &completions, int round)
+    {
+        CHECK(node.setProperty("count", round) == SendStatus::Queued);
+        CHECK(published(peer, updates) );
+
+        CHECK(node.setProperty("temperature", 21.5f) == SendStatus::Queued);
+        CHECK(published(peer, updates) );
+
+        CHECK(node.setProperty("enabled", round % 2 == 0) == SendStatus::Queued);
+        CHECK(published(peer, updates) );
+
+        CHECK(node.setProperty("mode", "heating") == SendStatus::Queued);
+        CHECK(published(peer, updates) );
+
+        CHECK(node.setScaledProperty("power", 1234) == SendStatus::Queued);
+        CHECK(published(peer, updates) );
+
+        uint32_t completed = completions + 1;
+
+        CHECK(node.setProperty("count", round, [&completions](SendStatus status) { completions += status == SendStatus::Sent ? 1 : 0; }) == SendStatus::Queued);
+        CHECK(published(peer, updates) );
+        CHECK(check::waitFor([&completions, completed]() { return completions >= completed; }) );
+
+        uint32_t pongs = peer.pongs + 1;
+
+        peer.ping();
+        CHECK(check::waitFor([&peer, pongs]() { return peer.pongs >= pongs; }) );
+    }
+
+    void checkSteadyState()
+    {
+        Peer                    peer;
+        Events                  events;
+        std::atomic<uint32_t>   completions = { 0 };
+        uint32_t                updates     = 0;
+
+        WebSocket::registerPeer(URL, &peer);
+
+        DeviceNode *node = new DeviceNode(new Connection(URL), &events, "check", "node", "node", 0);
+
+        node->declareScaledProperty("power", 2);
+        CHECK(node->connect() );
+        CHECK(check::waitFor([&peer, &events]() { return peer.registered && events.isConnected; }) );
+
+        CHECK(node->setProperty("count", 0) == SendStatus::Queued);
+        CHECK(published(peer, updates) );
+
+        // the first round creates what lives as long as the node, e.g. the precision lookup
+        runRound(*node, peer, updates, completions, 0);
+
+        uint32_t allocations = countAllocations();
+
+        for ( int round = 1; round <= ROUNDS; round++ )
+        {
+            runRound(*node, peer, updates, completions, round);
+        }
+
+        uint32_t steadyStateAllocations = countAllocations() - allocations;
+
+        printf("%d rounds, %u updates, %u pongs, %u allocations\n", ROUNDS, peer.updates.load(), peer.pongs.load(), steadyStateAllocations);
+
+        CHECK(steadyStateAllocations == 0);
+
+        CHECK(node->setProperty("mode", "cooling") == SendStatus::Queued);
+        CHECK(published(peer, updates) );
+        CHECK(peer.lastUpdateContains("\"mode\"") );
+        CHECK(peer.lastUpdateContains("\"cooling\"") );
+
+        // too long for the text of the event, the copies are made on the heap
+        const char *name    = "a_property_with_a_name_that_does_not_fit_into_an_event";
+        const char *value   = "a string value that does not fit into the text of an event either";
+        size_t liveBytes    = countLiveBytes();
+
+        CHECK(node->setProperty(name, value) == SendStatus::Queued);
+        CHECK(published(peer, updates) );
+        CHECK(peer.lastUpdateContains(name) );
+        CHECK(peer.lastUpdateContains(value) );
+        CHECK(countLiveBytes() <= liveBytes);
+
+        // a short name with a long value
+        CHECK(node->setProperty("mode", value) == SendStatus::Queued);
+        CHECK(published(peer, updates) );
+        CHECK(peer.lastUpdateContains("\"mode\"") );
+        CHECK(peer.lastUpdateContains(value) );
+        CHECK(countLiveBytes() <= liveBytes);
+
+        // the disconnect is handled on the WebSocket task, it must be done before the destruction
+        CHECK(node->disconnect() );
+        CHECK(check::waitFor([&events]() { return ! events.isConnected; }) );
+
+        delete node;
+
+        WebSocket::registerPeer(URL, nullptr);
+    }
+}
+
+int main()
+{
+    checkSteadyState();
+
+    return check::result("SteadyState");
+}
@@ -0,0 +1,262 @@
+/*
+ * DeviceProperties transaction check
+ *
+ * - a JSON record written before the binary format is read at init, one of an unknown type is not, its
+ *   getProperty() returns the default
+ * - the changes of a transaction are invisible until commit(), then all of them are visible and written as one
+ *   batch, also over a key that was still dirty with an older value, which the next flush must not write back
+ * - a rolled back transaction changes nothing
+ * - the segment holds the committed values, read by a second LogStore from a copy of it
+ * - a batch torn by a truncated segment is dropped as a whole on open(), the values before it are back
+ * - saves that race with flushes and transactions, which write without holding the cache, are not lost: after
+ *   a last sync() nothing is dirty and the segment holds the last values
+ */
+
+#include "Check.h"
+#include "DeviceProperties.h"
+#include "LogStore.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+extern "C"
+{
+    #include "HostVFS.h"
+}
+
+using namespace _2log;
+
+namespace
+{
+    const char*     SEGMENT         = "/2log/properties.kv";
+    const char*     SEGMENT_COPY    = "/2log/copy.kv";
+    const char*     TORN_STORE      = "/2log/torn.kv";
+    const int       SAVES           = 2000;
+
+    bool hasValue(LogStore &store, const char *key, const std::string &expected)
+    {
+        std::string value;
+        return store.get(key, value) && value == expected;
+    }
+
+    bool copyFile(const char *source, const char *destination)
+    {
+        FILE *input     = fopen(source, "rb");
+        FILE *output    = fopen(destination, "wb");
+        bool success    = input != nullptr && output != nullptr;
+        char buffer[512];
+        size_t length;
+
+        while ( success && ( length = fread(buffer, 1, sizeof(buffer), input) ) > 0 )
+        {
+            success = fwrite(buffer, 1, length, output) == length;
+        }
+
+        if ( input != nullptr )
+        {
+            fclose(input);
+        }
+
+        if ( output != nullptr )
+        {
+            success = fclose(output) == 0 && success;
+        }
+
+        return success;
+    }
+
+    void checkJsonRecords()
+    {
+        {
+            LogStore store;
+
+            CHECK(store.open(SEGMENT) );
+            CHECK(store.put("json", "{\"type\":0,\"val\":7}", 18) );
+            CHECK(store.put("unknown", "{\"type\":99,\"val\":7}", 19) );
+        }
+
+        DeviceProperties &properties = DeviceProperties::instance();
+
+        CHECK(properties.getCacheStatistics().preloaded == 1);
+        CHECK(properties.getProperty<int>("json", 0) == 7);
+        CHECK(properties.getProperty<int>("unknown", 3) == 3);
+        CHECK(properties.deleteProperty("json") );
+        CHECK(properties.deleteProperty("unknown") );
+        CHECK(properties.sync() );
+    }
+
+    void checkTransactions()
+    {
+        DeviceProperties &properties = DeviceProperties::instance();
+
+        CHECK(properties.saveProperty("a", 1) );
+        CHECK(properties.saveProperty("gone", 5) );
+        CHECK(properties.sync() );
+
+        // dirty with a value older than the transaction
+        CHECK(properties.saveProperty("a", 2) );
+
+        uint32_t batches        = properties.getStorageStatistics().batches;
+        uint32_t transactions   = properties.getCacheStatistics().transactions;
+
+        DeviceProperties::Transaction transaction = properties.beginTransaction();
+
+        CHECK(transaction.saveProperty("a", 3) );
+        CHECK(transaction.saveProperty("cal0", 1.5) );
+        CHECK(transaction.saveProperty("cal1", std::string("x") ) );
+        CHECK(transaction.deleteProperty("gone") );
+        CHECK(transaction.saveProperty("cal0", 2.5) );
+
+        CHECK(properties.getProperty<double>("cal0", 0.0) == 0.0);
+        CHECK(properties.getProperty<int>("gone", -1) == 5);
+
+        CHECK(transaction.commit() );
+
+        CHECK(properties.getStorageStatistics().batches == batches + 1);
+        CHECK(properties.getCacheStatistics().transactions == transactions + 1);
+        CHECK(properties.getProperty<int>("a", 0) == 3);
+        CHECK(properties.getProperty<double>("cal0", 0.0) == 2.5);
+        CHECK(properties.getProperty<std::string>("cal1", "") == "x");
+        CHECK(properties.getProperty<int>("gone", -1) == -1);
+
+        DeviceProperties::Transaction rolledBack = properties.beginTransaction();
+
+        CHECK(rolledBack.saveProperty("rolled", 1) );
+        CHECK(rolledBack.saveProperty("a", 4) );
+        rolledBack.rollback();
+        CHECK(rolledBack.commit() );
+
+        CHECK(properties.getProperty<int>("rolled", -1) == -1);
+        CHECK(properties.getProperty<int>("a", 0) == 3);
+
+        // the older dirty value of "a" must not be flushed over the committed one
+        CHECK(properties.sync() );
+        CHECK(properties.getCacheStatistics().dirtyProperties == 0);
+        CHECK(properties.getProperty<int>("a", 0) == 3);
+
+        CHECK(copyFile(SEGMENT, SEGMENT_COPY) );
+
+        LogStore store;
+
+        CHECK(store.open(SEGMENT_COPY) );
+        CHECK(store.contains("a") );
+        CHECK(store.contains("cal0") );
+        CHECK(store.contains("cal1") );
+        CHECK(! store.contains("gone") );
+        CHECK(! store.contains("rolled") );
+    }
+
+    void checkConcurrentWrites()
+    {
+        DeviceProperties    &properties = DeviceProperties::instance();
+        std::atomic<bool>   running     = { true };
+        std::atomic<int>    rounds      = { 0 };
+
+        std::thread writer([&properties, &running, &rounds]()
+        {
+            for ( int round = 0; running; round++ )
+            {
+                CHECK(properties.sync() );
+
+                DeviceProperties::Transaction transaction = properties.beginTransaction();
+
+                CHECK(transaction.saveProperty("pair0", round) );
+                CHECK(transaction.saveProperty("pair1", round) );
+                CHECK(transaction.commit() );
+                rounds++;
+            }
+        });
+
+        for ( int value = 1; value <= SAVES; value++ )
+        {
+            CHECK(properties.saveProperty("counter", value) );
+            CHECK(properties.saveProperty("pair1", -value) );
+        }
+
+        // with one CPU the writer may not have had a turn yet
+        CHECK(check::waitFor([&rounds]() { return rounds >= 3; }) );
+
+        running = false;
+        writer.join();
+
+        const char *keys[] = { "counter", "pair0", "pair1" };
+
+        CHECK(properties.getProperty<int>("counter", 0) == SAVES);
+
+        // the cached values once more under other keys, the records of the same value are the same
+        for ( const char *key : keys )
+        {
+            CHECK(properties.saveProperty( ( std::string("expected_") + key ).c_str(), properties.getProperty<int>(key, 0) ) );
+        }
+
+        CHECK(properties.sync() );
+        CHECK(properties.getCacheStatistics().dirtyProperties == 0);
+        CHECK(copyFile(SEGMENT, SEGMENT_COPY) );
+
+        LogStore store;
+        CHECK(store.open(SEGMENT_COPY) );
+
+        for ( const char *key : keys )
+        {
+            std::string record;
+            std::string expected;
+
+            CHECK(store.get(key, record) && store.get( ( std::string("expected_") + key ).c_str(), expected) && record == expected);
+        }
+    }
+
+    void checkTornBatch()
+    {
+        struct stat status;
+
+        {
+            LogStore store;
+
+            CHECK(store.open(TORN_STORE) );
+            CHECK(store.put("k", "1", 1) );
+
+            LogStore::Batch batch;
+            batch.put("k", "2", 1);
+            batch.put("x", "3", 1);
+            batch.remove("k");
+            batch.put("k", "4", 1);
+
+            CHECK(store.write(batch) );
+        }
+
+        {
+            LogStore store;
+
+            CHECK(store.open(TORN_STORE) );
+            CHECK(hasValue(store, "k", "4") );
+            CHECK(hasValue(store, "x", "3") );
+        }
+
+        // a power loss while the COMMIT record was written
+        CHECK(stat(TORN_STORE, &status) == 0);
+        CHECK(truncate(host_vfs_path(TORN_STORE), status.st_size - 3) == 0);
+
+        LogStore store;
+
+        CHECK(store.open(TORN_STORE) );
+        CHECK(hasValue(store, "k", "1") );
+        CHECK(! store.contains("x") );
+        CHECK(store.getStatistics().keys == 1);
+    }
+}
+
+int main()
+{
+    host_vfs_mount("/2log");
+    host_vfs_format("/2log");
+
+    checkJsonRecords();
+    checkTransactions();
+    checkConcurrentWrites();
+    checkTornBatch();
+
+    return check::result("Transaction");
+}
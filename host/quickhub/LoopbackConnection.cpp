@@ -0,0 +1,253 @@
+#include "LoopbackConnection.h"
+#include "ConnectionEventHandler.h"
+#include "MessageArena.h"
+
+#include <cJSON.h>
+#include <string.h>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_timer.h"
+    #include <freertos/task.h>
+}
+
+namespace
+{
+    const char*     LOG_TAG = "host::LoopbackConnection";
+}
+
+namespace _2log
+{
+    LoopbackConnection::LoopbackConnection(QuickHubServer *server) : IDFix::Task("loopback"), _server(server)
+    {
+        MessageArena::install();
+
+        _deliverySignal = xSemaphoreCreateBinary();
+
+        if ( _deliverySignal == nullptr || ! startTask() )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to start loopback task");
+        }
+    }
+
+    LoopbackConnection::~LoopbackConnection()
+    {
+        if ( _socketOpen )
+        {
+            _server->clientDisconnected(this);
+        }
+    }
+
+    bool LoopbackConnection::connect(uint32_t delayTime)
+    {
+        return post(EntryType::Connect, std::string(), delayTime);
+    }
+
+    bool LoopbackConnection::disconnect()
+    {
+        return post(EntryType::Close, std::string(), 0);
+    }
+
+    bool LoopbackConnection::sendPayload(const cJSON *payload)
+    {
+        return sendPayloadAsync(payload) == SendStatus::Queued;
+    }
+
+    SendStatus LoopbackConnection::sendPayloadAsync(const cJSON *payload, sendCompletionFunction completion, SendPriority priority)
+    {
+        (void) priority;
+
+        if ( ! _connected )
+        {
+            return SendStatus::Dropped;
+        }
+
+        if ( payload == nullptr || cJSON_IsInvalid(payload) )
+        {
+            return SendStatus::Dropped;
+        }
+
+        MessageArena::Scope arenaScope;
+
+        cJSON *envelope = cJSON_CreateObject();
+        cJSON_AddStringToObject(envelope, "command", "send");
+        cJSON_AddNumberToObject(envelope, "uuid", _connectionID);
+
+        // add payload as reference(!) so it won't be deleted by cJSON_Delete
+        cJSON_AddItemReferenceToObject(envelope, "payload", const_cast<cJSON*>(payload) );
+
+        bool sent = sendMessage(envelope);
+
+        if ( completion )
+        {
+            completion(sent ? SendStatus::Sent : SendStatus::Dropped);
+        }
+
+        return sent ? SendStatus::Queued : SendStatus::Dropped;
+    }
+
+    size_t LoopbackConnection::getBacklogSize() const
+    {
+        return 0;
+    }
+
+    bool LoopbackConnection::setConnectionEventHandler(ConnectionEventHandler *eventHandler)
+    {
+        _eventHandler = eventHandler;
+        return true;
+    }
+
+    void LoopbackConnection::deliverMessage(const std::string &message, uint32_t delayTime)
+    {
+        post(EntryType::Message, message, delayTime);
+    }
+
+    void LoopbackConnection::closeClient()
+    {
+        post(EntryType::Close, std::string(), 0);
+    }
+
+    bool LoopbackConnection::post(EntryType type, std::string message, uint32_t delayTime)
+    {
+        if ( _deliverySignal == nullptr )
+        {
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_deliveryMutex);
+            _deliveryQueue.push_back( Entry{ type, esp_timer_get_time() + static_cast<int64_t>(delayTime) * 1000, std::move(message) } );
+        }
+
+        // never blocks, a pending signal already covers the new entry
+        xSemaphoreGive(_deliverySignal);
+
+        return true;
+    }
+
+    void LoopbackConnection::run()
+    {
+        while ( true )
+        {
+            Entry entry;
+
+            {
+                std::unique_lock<std::mutex> lock(_deliveryMutex);
+
+                if ( _deliveryQueue.empty() )
+                {
+                    lock.unlock();
+                    xSemaphoreTake(_deliverySignal, portMAX_DELAY);
+                    continue;
+                }
+
+                entry = std::move(_deliveryQueue.front() );
+                _deliveryQueue.pop_front();
+            }
+
+            // entries are delivered in order, a constant latency keeps them sorted by due time
+            int64_t remaining = entry.due - esp_timer_get_time();
+
+            if ( remaining > 0 )
+            {
+                vTaskDelay(pdMS_TO_TICKS( static_cast<uint32_t>( (remaining + 999) / 1000 ) ) );
+            }
+
+            switch ( entry.type )
+            {
+                case EntryType::Connect:
+                    if ( ! _socketOpen )
+                    {
+                        _socketOpen = true;
+                        _server->clientConnected(this);
+
+                        cJSON *registerCommand = cJSON_CreateObject();
+                        cJSON_AddStringToObject(registerCommand, "command", "connection:register");
+                        cJSON_AddNumberToObject(registerCommand, "uuid", _connectionID);
+                        sendMessage(registerCommand);
+                    }
+                    break;
+
+                case EntryType::Close:
+                    if ( _socketOpen )
+                    {
+                        _socketOpen = false;
+                        _connected  = false;
+                        _server->clientDisconnected(this);
+
+                        if ( _eventHandler )
+                        {
+                            _eventHandler->disconnected();
+                        }
+                    }
+                    break;
+
+                case EntryType::Message:
+                    if ( _socketOpen )
+                    {
+                        handleMessage(entry.message);
+                    }
+                    break;
+            }
+        }
+    }
+
+    bool LoopbackConnection::sendMessage(cJSON *message)
+    {
+        char *messageString = cJSON_PrintUnformatted(message);
+        cJSON_Delete(message);
+
+        if ( messageString == nullptr )
+        {
+            return false;
+        }
+
+        _server->clientMessageReceived(this, messageString, strlen(messageString) );
+        cJSON_free(messageString);
+
+        return true;
+    }
+
+    void LoopbackConnection::handleMessage(const std::string &message)
+    {
+        MessageArena::Scope arenaScope;
+
+        cJSON *jsonMessage  = cJSON_Parse(message.c_str() );
+        cJSON *command      = cJSON_GetObjectItemCaseSensitive(jsonMessage, "command");
+
+        if ( ! cJSON_IsString(command) )
+        {
+            ESP_LOGE(LOG_TAG, "Invalid message received");
+            cJSON_Delete(jsonMessage);
+            return;
+        }
+
+        if ( strcmp(command->valuestring, "ping") == 0 )
+        {
+            cJSON *pongCommand = cJSON_CreateObject();
+            cJSON_AddStringToObject(pongCommand, "command", "pong");
+            sendMessage(pongCommand);
+        }
+        else if ( strcmp(command->valuestring, "connection:registered") == 0 )
+        {
+            _connected = true;
+
+            if ( _eventHandler )
+            {
+                _eventHandler->connected();
+            }
+        }
+        else if ( strcmp(command->valuestring, "send") == 0 )
+        {
+            cJSON *payload = cJSON_GetObjectItemCaseSensitive(jsonMessage, "payload");
+
+            if ( cJSON_IsObject(payload) && _eventHandler )
+            {
+                _eventHandler->jsonReceived(payload);
+            }
+        }
+
+        cJSON_Delete(jsonMessage);
+    }
+}
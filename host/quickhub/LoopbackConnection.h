@@ -0,0 +1,89 @@
+#ifndef LOOPBACKCONNECTION_H
+#define LOOPBACKCONNECTION_H
+
+#include <string>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include "IConnection.h"
+#include "IDFixTask.h"
+#include "QuickHubServer.h"
+
+extern "C"
+{
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/semphr.h>
+}
+
+namespace _2log
+{
+    class ConnectionEventHandler;
+
+    /**
+     * @brief The LoopbackConnection class is an in-memory IConnection to a QuickHubServer.
+     *
+     * Payloads are serialized and handed to the server on the calling task, without WebSocket, outbound
+     * lanes or sender task, so benchmarks of a DeviceNode measure the node itself. Server messages are
+     * handled on the "loopback" task, which calls the ConnectionEventHandler like the Connection class
+     * does on the WebSocket task.
+     *
+     * The completion callback of sendPayloadAsync() is called with \c SendStatus::Sent before it returns.
+     * The delivery queue is unbounded, so the server never blocks while it holds its lock.
+     */
+    class LoopbackConnection : public IConnection, public QuickHubServer::Client, private IDFix::Task
+    {
+        public:
+
+                                LoopbackConnection(QuickHubServer *server);
+            virtual             ~LoopbackConnection() override;
+
+            virtual bool        connect(uint32_t delayTime = 0) override;
+            virtual bool        disconnect(void) override;
+            virtual bool        sendPayload(const cJSON *payload) override;
+            virtual SendStatus  sendPayloadAsync(const cJSON *payload, sendCompletionFunction completion = nullptr,
+                                                 SendPriority priority = SendPriority::State) override;
+            virtual size_t      getBacklogSize(void) const override;
+            virtual bool        setConnectionEventHandler(ConnectionEventHandler *eventHandler) override;
+
+            virtual void        deliverMessage(const std::string &message, uint32_t delayTime) override;
+            virtual void        closeClient(void) override;
+
+        private:
+
+            enum class EntryType : uint8_t
+            {
+                Connect,
+                Close,
+                Message
+            };
+
+            /**
+             * @brief The Entry struct is an item of the delivery queue
+             */
+            struct Entry
+            {
+                EntryType       type;
+                int64_t         due;            ///< esp_timer time of the delivery
+                std::string     message;        ///< the message of a Message entry
+            };
+
+            virtual void        run(void) override;
+
+            bool                post(EntryType type, std::string message, uint32_t delayTime);
+            bool                sendMessage(cJSON *message);
+            void                handleMessage(const std::string &message);
+
+        private:
+
+            QuickHubServer*                 _server;
+            ConnectionEventHandler*         _eventHandler = { nullptr };
+            std::mutex                      _deliveryMutex;
+            std::deque<Entry>               _deliveryQueue;
+            SemaphoreHandle_t               _deliverySignal = { nullptr };
+            std::atomic<bool>               _socketOpen = { false };
+            std::atomic<bool>               _connected = { false };
+            uint8_t                         _connectionID = { 0 };
+    };
+}
+
+#endif
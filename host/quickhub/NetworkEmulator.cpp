@@ -0,0 +1,463 @@
+#include "NetworkEmulator.h"
+
+#include <math.h>
+#include <algorithm>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_timer.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG     = "host::NetworkEmulator";
+    const int64_t   NEVER       = INT64_MAX;
+}
+
+namespace _2log
+{
+    /**
+     * @brief The LinkClient class passes the server messages of a link through the emulator
+     */
+    class NetworkEmulator::LinkClient : public QuickHubServer::Client
+    {
+        public:
+
+            LinkClient(NetworkEmulator *emulator, uint32_t linkID) : _emulator(emulator), _linkID(linkID)
+            {
+
+            }
+
+            virtual void deliverMessage(const std::string &message, uint32_t delayTime) override
+            {
+                _emulator->sendFrame(_linkID, Down, message, delayTime);
+            }
+
+            virtual void closeClient() override
+            {
+                _emulator->closeLink(_linkID);
+            }
+
+        private:
+
+            NetworkEmulator*    _emulator;
+            uint32_t            _linkID;
+    };
+
+    NetworkEmulator::NetworkEmulator(QuickHubServer *server, uint32_t seed, bool virtualClock)
+        : IDFix::Task("netem"), _server(server), _seed(seed), _virtualClock(virtualClock)
+    {
+        if ( _virtualClock )
+        {
+            return;
+        }
+
+        _signal = xSemaphoreCreateBinary();
+
+        if ( _signal == nullptr || ! startTask() )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to start netem task");
+        }
+    }
+
+    NetworkEmulator::~NetworkEmulator()
+    {
+        for ( const std::string &url : _urls )
+        {
+            IDFix::Protocols::WebSocket::registerPeer(url, nullptr);
+        }
+    }
+
+    void NetworkEmulator::listen(const std::string &url)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _urls.push_back(url);
+        }
+
+        IDFix::Protocols::WebSocket::registerPeer(url, this);
+    }
+
+    void NetworkEmulator::setConditions(const NetworkConditions &conditions)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _conditions = conditions;
+
+        for ( auto &link : _links )
+        {
+            link.second.nextDisconnect = scheduleDisconnect(link.second);
+        }
+
+        if ( _signal )
+        {
+            xSemaphoreGive(_signal);
+        }
+    }
+
+    void NetworkEmulator::partition(uint32_t duration)
+    {
+        std::vector<IDFix::Protocols::WebSocket*> sockets;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _partitionEnd = clockTime() + static_cast<int64_t>(duration) * 1000;
+
+            for ( auto &link : _links )
+            {
+                sockets.push_back(link.second.socket);
+                _statistics.forcedDisconnects++;
+            }
+        }
+
+        for ( IDFix::Protocols::WebSocket *socket : sockets )
+        {
+            socket->close();
+        }
+    }
+
+    void NetworkEmulator::advance(uint32_t time)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            if ( ! _virtualClock )
+            {
+                ESP_LOGE(LOG_TAG, "advance() requires the virtual clock");
+                return;
+            }
+
+            _virtualTime += static_cast<int64_t>(time) * 1000;
+        }
+
+        process();
+    }
+
+    int64_t NetworkEmulator::now()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return clockTime();
+    }
+
+    size_t NetworkEmulator::getFramesInFlight()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _frames.size();
+    }
+
+    NetworkEmulator::Statistics NetworkEmulator::getStatistics()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _statistics;
+    }
+
+    void NetworkEmulator::peerConnected(IDFix::Protocols::WebSocket *socket)
+    {
+        std::shared_ptr<LinkClient> client;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            if ( clockTime() < _partitionEnd )
+            {
+                _statistics.refusedLinks++;
+            }
+            else
+            {
+                uint32_t linkID = _nextLinkID++;
+
+                Link &link = _links[linkID];
+                link.socket     = socket;
+                link.client     = std::make_shared<LinkClient>(this, linkID);
+                link.random.seed(_seed + linkID * 0x9E3779B9u);
+                link.lanes[Up]      = Lane{ 0, 0 };
+                link.lanes[Down]    = Lane{ 0, 0 };
+                link.nextDisconnect = scheduleDisconnect(link);
+
+                _socketLinks[socket] = linkID;
+                _statistics.links++;
+
+                client = link.client;
+            }
+        }
+
+        if ( ! client )
+        {
+            // the device sees the connection drop right after it was opened
+            socket->close();
+            return;
+        }
+
+        _server->clientConnected(client.get() );
+    }
+
+    void NetworkEmulator::peerDisconnected(IDFix::Protocols::WebSocket *socket)
+    {
+        std::shared_ptr<LinkClient> client;
+
+        // no delivery may be running for the link while the server forgets it
+        std::lock_guard<std::mutex> deliveryLock(_deliveryMutex);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            auto socketLink = _socketLinks.find(socket);
+
+            if ( socketLink == _socketLinks.end() )
+            {
+                return;
+            }
+
+            client = _links[socketLink->second].client;
+
+            _links.erase(socketLink->second);
+            _socketLinks.erase(socketLink);
+        }
+
+        _server->clientDisconnected(client.get() );
+    }
+
+    void NetworkEmulator::peerMessageReceived(IDFix::Protocols::WebSocket *socket, const char *data, int length)
+    {
+        uint32_t linkID;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            auto socketLink = _socketLinks.find(socket);
+
+            if ( socketLink == _socketLinks.end() )
+            {
+                return;
+            }
+
+            linkID = socketLink->second;
+        }
+
+        sendFrame(linkID, Up, std::string(data, static_cast<size_t>(length) ), 0);
+    }
+
+    void NetworkEmulator::run()
+    {
+        while ( true )
+        {
+            process();
+
+            int64_t next = NEVER;
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                if ( ! _frames.empty() )
+                {
+                    next = _frames.begin()->first;
+                }
+
+                for ( auto &link : _links )
+                {
+                    next = std::min(next, link.second.nextDisconnect);
+                }
+            }
+
+            if ( next == NEVER )
+            {
+                xSemaphoreTake(_signal, portMAX_DELAY);
+                continue;
+            }
+
+            int64_t remaining = next - esp_timer_get_time();
+
+            if ( remaining > 0 )
+            {
+                xSemaphoreTake(_signal, pdMS_TO_TICKS( static_cast<uint32_t>( (remaining + 999) / 1000 ) ) );
+            }
+        }
+    }
+
+    void NetworkEmulator::sendFrame(uint32_t linkID, Direction direction, std::string data, uint32_t delayTime)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        auto link = _links.find(linkID);
+
+        if ( link == _links.end() )
+        {
+            return;
+        }
+
+        int64_t now     = clockTime();
+        Lane &lane      = link->second.lanes[direction];
+
+        // the bandwidth limit serializes the frames of a lane
+        int64_t transmissionTime = _conditions.bandwidth ? static_cast<int64_t>(data.size() ) * 1000000 / _conditions.bandwidth : 0;
+
+        lane.busyUntil = std::max(now, lane.busyUntil) + transmissionTime;
+
+        int64_t due = lane.busyUntil + ( static_cast<int64_t>(_conditions.latency) + delayTime ) * 1000;
+
+        if ( _conditions.jitter )
+        {
+            due += link->second.random() % ( static_cast<uint64_t>(_conditions.jitter) * 1000 + 1 );
+        }
+
+        if ( _conditions.lossRate > 0.0f && randomFraction(link->second) < _conditions.lossRate )
+        {
+            if ( _conditions.retransmitDelay == 0 )
+            {
+                _statistics.lostFrames++;
+                return;
+            }
+
+            due += static_cast<int64_t>(_conditions.retransmitDelay) * 1000;
+            _statistics.retransmittedFrames++;
+        }
+
+        if ( _conditions.reorderRate > 0.0f && randomFraction(link->second) < _conditions.reorderRate )
+        {
+            // a held back frame does not delay the frames behind it
+            due += static_cast<int64_t>(_conditions.reorderDelay) * 1000;
+            _statistics.reorderedFrames++;
+        }
+        else
+        {
+            due = std::max(due, lane.lastDue);
+            lane.lastDue = due;
+        }
+
+        bool first = _frames.empty() || due < _frames.begin()->first;
+
+        _frames.emplace(due, Frame{ linkID, direction, now, std::move(data) });
+
+        if ( first && _signal )
+        {
+            xSemaphoreGive(_signal);
+        }
+    }
+
+    void NetworkEmulator::closeLink(uint32_t linkID)
+    {
+        IDFix::Protocols::WebSocket *socket = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            auto link = _links.find(linkID);
+
+            if ( link != _links.end() )
+            {
+                socket = link->second.socket;
+            }
+        }
+
+        if ( socket )
+        {
+            socket->close();
+        }
+    }
+
+    void NetworkEmulator::process()
+    {
+        std::vector<Frame>                          dueFrames;
+        std::vector<IDFix::Protocols::WebSocket*>   disconnects;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            int64_t now = clockTime();
+
+            while ( ! _frames.empty() && _frames.begin()->first <= now )
+            {
+                Frame &frame = _frames.begin()->second;
+
+                _statistics.maxFrameDelay = std::max<uint32_t>(_statistics.maxFrameDelay, static_cast<uint32_t>(now - frame.sent) );
+
+                dueFrames.push_back( std::move(frame) );
+                _frames.erase(_frames.begin() );
+            }
+
+            for ( auto &link : _links )
+            {
+                if ( link.second.nextDisconnect <= now )
+                {
+                    disconnects.push_back(link.second.socket);
+                    link.second.nextDisconnect = scheduleDisconnect(link.second);
+                    _statistics.forcedDisconnects++;
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> deliveryLock(_deliveryMutex);
+
+        for ( Frame &frame : dueFrames )
+        {
+            IDFix::Protocols::WebSocket*    socket = nullptr;
+            std::shared_ptr<LinkClient>     client;
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                auto link = _links.find(frame.linkID);
+
+                // frames of a closed link are lost with it
+                if ( link == _links.end() )
+                {
+                    continue;
+                }
+
+                socket = link->second.socket;
+                client = link->second.client;
+
+                if ( frame.direction == Up )
+                {
+                    _statistics.framesUp++;
+                    _statistics.bytesUp += frame.data.size();
+                }
+                else
+                {
+                    _statistics.framesDown++;
+                    _statistics.bytesDown += frame.data.size();
+                }
+            }
+
+            if ( frame.direction == Up )
+            {
+                _server->clientMessageReceived(client.get(), frame.data.data(), frame.data.size() );
+            }
+            else
+            {
+                socket->deliverBinaryMessage(frame.data.data(), static_cast<int>(frame.data.size() ) );
+            }
+        }
+
+        for ( IDFix::Protocols::WebSocket *socket : disconnects )
+        {
+            socket->close();
+        }
+    }
+
+    int64_t NetworkEmulator::clockTime() const
+    {
+        return _virtualClock ? _virtualTime : esp_timer_get_time();
+    }
+
+    int64_t NetworkEmulator::scheduleDisconnect(Link &link)
+    {
+        if ( _conditions.meanTimeBetweenDisconnects == 0 )
+        {
+            return NEVER;
+        }
+
+        // exponentially distributed, so disconnects are independent of each other
+        double interval = -log(1.0 - randomFraction(link) ) * _conditions.meanTimeBetweenDisconnects * 1000.0;
+
+        return clockTime() + static_cast<int64_t>(interval);
+    }
+
+    float NetworkEmulator::randomFraction(Link &link)
+    {
+        // 24 random bits, independent of the standard library distributions
+        return static_cast<float>( link.random() >> 8 ) / static_cast<float>(1 << 24);
+    }
+}
@@ -0,0 +1,189 @@
+#ifndef NETWORKEMULATOR_H
+#define NETWORKEMULATOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdint.h>
+#include "WebSocket.h"
+#include "IDFixTask.h"
+#include "QuickHubServer.h"
+
+extern "C"
+{
+    #include <freertos/FreeRTOS.h>
+    #include <freertos/semphr.h>
+}
+
+namespace _2log
+{
+    /**
+     * @brief The NetworkConditions struct describes the emulated link between a device and the server
+     *
+     * All values apply to each direction separately.
+     */
+    struct NetworkConditions
+    {
+        uint32_t    latency = { 0 };                        ///< one-way base latency in milliseconds
+        uint32_t    jitter = { 0 };                         ///< maximum random additional latency in milliseconds
+        uint32_t    bandwidth = { 0 };                      ///< link capacity in bytes per second, 0 for unlimited
+        float       lossRate = { 0.0f };                    ///< probability that a frame is lost
+        uint32_t    retransmitDelay = { 200 };              ///< delay of a lost frame until it is retransmitted, 0 to drop lost frames
+        float       reorderRate = { 0.0f };                 ///< probability that a frame is held back and overtaken by later frames
+        uint32_t    reorderDelay = { 50 };                  ///< time a reordered frame is held back in milliseconds
+        uint32_t    meanTimeBetweenDisconnects = { 0 };     ///< mean time between forced disconnects of a link in milliseconds, 0 for none
+    };
+
+    /**
+     * @brief The NetworkEmulator class injects network conditions between loopback WebSockets and a QuickHubServer.
+     *
+     * It is registered for a URL instead of the server and forwards every frame in both directions with
+     * the configured latency, jitter, bandwidth limit, loss, reordering and forced disconnects. Frames of a
+     * link stay in order unless they are reordered on purpose, so a lost frame that is retransmitted also
+     * delays the frames behind it, like on a TCP connection.
+     *
+     * All random decisions of a link are drawn from its own generator, seeded with the emulator seed and
+     * the number of the link, so the same message sequence always sees the same conditions. Timestamps are
+     * taken from the emulator clock: the real clock, where the "netem" task delivers frames when they are
+     * due, or a virtual clock that only moves with advance(), which delivers the due frames on the caller.
+     */
+    class NetworkEmulator : public IDFix::Protocols::WebSocketPeer, private IDFix::Task
+    {
+        public:
+
+            /**
+             * @brief The Statistics struct summarizes the emulated traffic
+             */
+            struct Statistics
+            {
+                uint32_t    links;                  ///< number of accepted links
+                uint32_t    refusedLinks;           ///< number of links closed during a partition
+                uint32_t    framesUp;               ///< frames forwarded to the server
+                uint32_t    framesDown;             ///< frames forwarded to the devices
+                uint64_t    bytesUp;                ///< bytes forwarded to the server
+                uint64_t    bytesDown;              ///< bytes forwarded to the devices
+                uint32_t    lostFrames;             ///< frames dropped by loss
+                uint32_t    retransmittedFrames;    ///< lost frames that were delayed by a retransmission
+                uint32_t    reorderedFrames;        ///< frames that were held back
+                uint32_t    forcedDisconnects;      ///< links closed by the emulator
+                uint32_t    maxFrameDelay;          ///< maximum time a frame spent on the link in microseconds
+            };
+
+            /**
+             * @brief Constructs a new NetworkEmulator
+             * @param server        the server all links are forwarded to
+             * @param seed          the seed of the random decisions
+             * @param virtualClock  \c true to use a virtual clock that is moved with advance()
+             */
+                                NetworkEmulator(QuickHubServer *server, uint32_t seed, bool virtualClock = false);
+            virtual             ~NetworkEmulator() override;
+
+                                NetworkEmulator(NetworkEmulator const&)     = delete;
+            void                operator=(NetworkEmulator const&)           = delete;
+
+            /**
+             * @brief Accept loopback WebSocket connections to a URL, instead of the server
+             * @param url   the URL the devices connect to
+             */
+            void                listen(const std::string &url);
+
+            /**
+             * @brief Set the conditions of all links, frames already in flight are not affected
+             */
+            void                setConditions(const NetworkConditions &conditions);
+
+            /**
+             * @brief Close all links and refuse new ones for a while
+             * @param duration  the duration of the partition in milliseconds
+             */
+            void                partition(uint32_t duration);
+
+            /**
+             * @brief Move the virtual clock forward and deliver all frames that became due
+             * @param time  the time in milliseconds
+             */
+            void                advance(uint32_t time);
+
+            /**
+             * @brief Get the current time of the emulator clock
+             * @return  the time in microseconds
+             */
+            int64_t             now(void);
+
+            /**
+             * @brief Get the number of frames on the links
+             */
+            size_t              getFramesInFlight(void);
+
+            Statistics          getStatistics(void);
+
+            virtual void        peerConnected(IDFix::Protocols::WebSocket *socket) override;
+            virtual void        peerDisconnected(IDFix::Protocols::WebSocket *socket) override;
+            virtual void        peerMessageReceived(IDFix::Protocols::WebSocket *socket, const char *data, int length) override;
+
+        private:
+
+            enum Direction
+            {
+                Up = 0,
+                Down = 1
+            };
+
+            class LinkClient;
+
+            struct Lane
+            {
+                int64_t         busyUntil;          ///< end of the last transmission, for the bandwidth limit
+                int64_t         lastDue;            ///< due time of the last in-order frame
+            };
+
+            struct Link
+            {
+                IDFix::Protocols::WebSocket*    socket;
+                std::shared_ptr<LinkClient>     client;
+                std::mt19937                    random;
+                Lane                            lanes[2];
+                int64_t                         nextDisconnect;
+            };
+
+            struct Frame
+            {
+                uint32_t        linkID;
+                Direction       direction;
+                int64_t         sent;
+                std::string     data;
+            };
+
+            virtual void        run(void) override;
+
+            void                sendFrame(uint32_t linkID, Direction direction, std::string data, uint32_t delayTime);
+            void                closeLink(uint32_t linkID);
+            void                process(void);
+            int64_t             clockTime(void) const;
+            int64_t             scheduleDisconnect(Link &link);
+            static float        randomFraction(Link &link);
+
+        private:
+
+            QuickHubServer*                         _server;
+            uint32_t                                _seed;
+            bool                                    _virtualClock;
+            int64_t                                 _virtualTime = { 0 };
+            std::mutex                              _mutex;
+            std::mutex                              _deliveryMutex;     ///< orders deliveries against the removal of links
+            SemaphoreHandle_t                       _signal = { nullptr };
+            NetworkConditions                       _conditions;
+            std::map<uint32_t, Link>                _links;
+            std::map<IDFix::Protocols::WebSocket*, uint32_t>    _socketLinks;
+            std::multimap<int64_t, Frame>           _frames;
+            uint32_t                                _nextLinkID = { 0 };
+            int64_t                                 _partitionEnd = { 0 };
+            std::vector<std::string>                _urls;
+            Statistics                              _statistics = {};
+    };
+}
+
+#endif
@@ -0,0 +1,555 @@
+#include "QuickHubServer.h"
+
+#include <cJSON.h>
+#include <string.h>
+#include <chrono>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_timer.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG = "host::QuickHubServer";
+}
+
+namespace _2log
+{
+    QuickHubServer::Client::~Client()
+    {
+
+    }
+
+    /**
+     * @brief The WebSocketClient class delivers server messages through a loopback WebSocket
+     */
+    class QuickHubServer::WebSocketClient : public QuickHubServer::Client
+    {
+        public:
+
+            WebSocketClient(IDFix::Protocols::WebSocket *socket) : _socket(socket)
+            {
+
+            }
+
+            virtual void deliverMessage(const std::string &message, uint32_t delayTime) override
+            {
+                _socket->deliverBinaryMessage(message.data(), static_cast<int>(message.size()), delayTime);
+            }
+
+            virtual void closeClient() override
+            {
+                _socket->close();
+            }
+
+        private:
+
+            IDFix::Protocols::WebSocket*    _socket;
+    };
+
+    QuickHubServer::QuickHubServer()
+    {
+
+    }
+
+    QuickHubServer::~QuickHubServer()
+    {
+        for ( const std::string &url : _urls )
+        {
+            IDFix::Protocols::WebSocket::registerPeer(url, nullptr);
+        }
+    }
+
+    void QuickHubServer::listen(const std::string &url)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _urls.push_back(url);
+        }
+
+        IDFix::Protocols::WebSocket::registerPeer(url, this);
+    }
+
+    void QuickHubServer::setLatency(uint32_t latency)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _latency = latency;
+    }
+
+    void QuickHubServer::setAcknowledge(bool acknowledge)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _acknowledge = acknowledge;
+    }
+
+    void QuickHubServer::setPayloadHandler(payloadHandlerFunction handler)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _payloadHandler = handler;
+    }
+
+    bool QuickHubServer::waitForNode(const std::string &nodeID, uint32_t timeout)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        return _condition.wait_for(lock, std::chrono::milliseconds(timeout), [this, &nodeID]()
+        {
+            for ( auto &session : _sessions )
+            {
+                if ( session.second.nodeID == nodeID )
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        });
+    }
+
+    bool QuickHubServer::waitForPropertyUpdates(uint32_t count, uint32_t timeout)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        return _condition.wait_for(lock, std::chrono::milliseconds(timeout), [this, count]()
+        {
+            return _statistics.propertyUpdates >= count;
+        });
+    }
+
+    bool QuickHubServer::callRPC(const std::string &nodeID, const std::string &function, const std::string &arguments)
+    {
+        cJSON *argumentsObject = cJSON_Parse(arguments.c_str() );
+
+        if ( argumentsObject == nullptr || ! cJSON_IsObject(argumentsObject) )
+        {
+            ESP_LOGE(LOG_TAG, "RPC arguments must be a JSON object: %s", arguments.c_str() );
+            cJSON_Delete(argumentsObject);
+            return false;
+        }
+
+        cJSON *payload  = cJSON_CreateObject();
+        cJSON_AddStringToObject(payload, "cmd", "call");
+
+        cJSON *params   = cJSON_AddObjectToObject(payload, "params");
+        cJSON_AddItemToObject(params, function.c_str(), argumentsObject);
+
+        return sendPayload(nodeID, payload);
+    }
+
+    bool QuickHubServer::setAuthKey(const std::string &nodeID, uint32_t authKey)
+    {
+        cJSON *payload = cJSON_CreateObject();
+        cJSON_AddStringToObject(payload, "cmd", "setkey");
+        cJSON_AddNumberToObject(payload, "params", authKey);
+
+        return sendPayload(nodeID, payload);
+    }
+
+    bool QuickHubServer::ping(const std::string &nodeID)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        Client *client = findClient(nodeID);
+
+        if ( client == nullptr )
+        {
+            return false;
+        }
+
+        cJSON *message = cJSON_CreateObject();
+        cJSON_AddStringToObject(message, "command", "ping");
+        send(client, message);
+
+        return true;
+    }
+
+    void QuickHubServer::pingAll()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        for ( auto &session : _sessions )
+        {
+            cJSON *message = cJSON_CreateObject();
+            cJSON_AddStringToObject(message, "command", "ping");
+            send(session.first, message);
+        }
+    }
+
+    bool QuickHubServer::closeNode(const std::string &nodeID)
+    {
+        Client *client = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            client = findClient(nodeID);
+        }
+
+        if ( client == nullptr )
+        {
+            return false;
+        }
+
+        client->closeClient();
+
+        return true;
+    }
+
+    std::string QuickHubServer::getProperty(const std::string &nodeID, const std::string &property)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        for ( auto &session : _sessions )
+        {
+            if ( session.second.nodeID == nodeID )
+            {
+                auto value = session.second.properties.find(property);
+                return value != session.second.properties.end() ? value->second : std::string();
+            }
+        }
+
+        return std::string();
+    }
+
+    std::vector<std::string> QuickHubServer::getFunctions(const std::string &nodeID)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        for ( auto &session : _sessions )
+        {
+            if ( session.second.nodeID == nodeID )
+            {
+                return session.second.functions;
+            }
+        }
+
+        return std::vector<std::string>();
+    }
+
+    size_t QuickHubServer::getNodeCount()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _sessions.size();
+    }
+
+    QuickHubServer::Statistics QuickHubServer::getStatistics()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _statistics;
+    }
+
+    std::vector<uint32_t> QuickHubServer::getRegistrationTimes()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _registrationTimes;
+    }
+
+    std::vector<uint32_t> QuickHubServer::getRPCRoundTrips()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _rpcRoundTrips;
+    }
+
+    void QuickHubServer::clientConnected(Client *client)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        Session &session        = _sessions[client];
+        session.uuid            = 0;
+        session.connectedTime   = esp_timer_get_time();
+        session.pendingCallTime = 0;
+
+        _statistics.connections++;
+    }
+
+    void QuickHubServer::clientDisconnected(Client *client)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _sessions.erase(client);
+        _condition.notify_all();
+    }
+
+    void QuickHubServer::clientMessageReceived(Client *client, const char *data, size_t length)
+    {
+        cJSON *message = cJSON_ParseWithLength(data, length);
+
+        if ( message == nullptr || ! cJSON_IsObject(message) )
+        {
+            ESP_LOGE(LOG_TAG, "Invalid message received: %.*s", static_cast<int>(length), data);
+            cJSON_Delete(message);
+            return;
+        }
+
+        payloadHandlerFunction  payloadHandler;
+        std::string             nodeID;
+        cJSON*                  payload = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            auto session = _sessions.find(client);
+
+            if ( session == _sessions.end() )
+            {
+                ESP_LOGE(LOG_TAG, "Message of an unknown client");
+                cJSON_Delete(message);
+                return;
+            }
+
+            _statistics.messagesReceived++;
+            _statistics.bytesReceived += length;
+
+            cJSON *command = cJSON_GetObjectItemCaseSensitive(message, "command");
+
+            if ( ! cJSON_IsString(command) )
+            {
+                ESP_LOGE(LOG_TAG, "Message without command");
+            }
+            else if ( strcmp(command->valuestring, "connection:register") == 0 )
+            {
+                cJSON *uuid = cJSON_GetObjectItemCaseSensitive(message, "uuid");
+                session->second.uuid = cJSON_IsNumber(uuid) ? static_cast<uint8_t>(uuid->valueint) : 0;
+
+                cJSON *reply = cJSON_CreateObject();
+                cJSON_AddStringToObject(reply, "command", "connection:registered");
+                cJSON_AddNumberToObject(reply, "uuid", session->second.uuid);
+                send(client, reply);
+            }
+            else if ( strcmp(command->valuestring, "pong") == 0 )
+            {
+                _statistics.pongs++;
+            }
+            else if ( strcmp(command->valuestring, "send") == 0 )
+            {
+                cJSON *sentPayload = cJSON_GetObjectItemCaseSensitive(message, "payload");
+
+                if ( cJSON_IsObject(sentPayload) )
+                {
+                    handlePayload(client, session->second, sentPayload);
+
+                    payloadHandler  = _payloadHandler;
+                    nodeID          = session->second.nodeID;
+                    payload         = sentPayload;
+                }
+
+                if ( _acknowledge )
+                {
+                    cJSON *reply = cJSON_CreateObject();
+                    cJSON_AddStringToObject(reply, "command", "ACK");
+                    send(client, reply);
+                }
+            }
+        }
+
+        if ( payloadHandler && payload != nullptr )
+        {
+            payloadHandler(nodeID, payload);
+        }
+
+        cJSON_Delete(message);
+    }
+
+    void QuickHubServer::handlePayload(Client *client, Session &session, const cJSON *payload)
+    {
+        (void) client;
+
+        int64_t now = esp_timer_get_time();
+
+        // any payload after a call ends the RPC round trip
+        if ( session.pendingCallTime != 0 )
+        {
+            _rpcRoundTrips.push_back(static_cast<uint32_t>(now - session.pendingCallTime) );
+            session.pendingCallTime = 0;
+        }
+
+        cJSON *command  = cJSON_GetObjectItemCaseSensitive(payload, "command");
+        cJSON *cmd      = cJSON_GetObjectItemCaseSensitive(payload, "cmd");
+
+        if ( cJSON_IsString(command) && strcmp(command->valuestring, "node:register") == 0 )
+        {
+            cJSON *parameters   = cJSON_GetObjectItemCaseSensitive(payload, "parameters");
+            cJSON *id           = cJSON_GetObjectItemCaseSensitive(parameters, "id");
+
+            if ( ! cJSON_IsString(id) )
+            {
+                ESP_LOGE(LOG_TAG, "node:register without id");
+                return;
+            }
+
+            session.nodeID = id->valuestring;
+            session.functions.clear();
+
+            cJSON *function;
+            cJSON_ArrayForEach(function, cJSON_GetObjectItemCaseSensitive(parameters, "functions") )
+            {
+                cJSON *name = cJSON_GetObjectItemCaseSensitive(function, "name");
+
+                if ( cJSON_IsString(name) )
+                {
+                    session.functions.push_back(name->valuestring);
+                }
+            }
+
+            storeProperties(session, cJSON_GetObjectItemCaseSensitive(parameters, "properties") );
+
+            _registrationTimes.push_back(static_cast<uint32_t>(now - session.connectedTime) );
+            _statistics.nodeRegistrations++;
+            _condition.notify_all();
+
+            return;
+        }
+
+        if ( cJSON_IsString(cmd) && strcmp(cmd->valuestring, "set") == 0 )
+        {
+            storeProperties(session, cJSON_GetObjectItemCaseSensitive(payload, "params") );
+
+            _statistics.propertyUpdates++;
+            _condition.notify_all();
+
+            return;
+        }
+
+        if ( cJSON_IsString(cmd) && strcmp(cmd->valuestring, "msg") == 0 )
+        {
+            _statistics.dataMessages++;
+            return;
+        }
+    }
+
+    void QuickHubServer::storeProperties(Session &session, const cJSON *properties)
+    {
+        cJSON *property;
+        cJSON_ArrayForEach(property, properties)
+        {
+            char *value = cJSON_PrintUnformatted(property);
+
+            if ( value != nullptr )
+            {
+                session.properties[property->string] = value;
+                cJSON_free(value);
+            }
+        }
+    }
+
+    void QuickHubServer::send(Client *client, cJSON *message)
+    {
+        char *messageString = cJSON_PrintUnformatted(message);
+        cJSON_Delete(message);
+
+        if ( messageString == nullptr )
+        {
+            return;
+        }
+
+        std::string serialized = messageString;
+        cJSON_free(messageString);
+
+        _statistics.bytesSent += serialized.size();
+
+        client->deliverMessage(serialized, _latency);
+    }
+
+    QuickHubServer::Client *QuickHubServer::findClient(const std::string &nodeID)
+    {
+        for ( auto &session : _sessions )
+        {
+            if ( session.second.nodeID == nodeID )
+            {
+                return session.first;
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool QuickHubServer::sendPayload(const std::string &nodeID, cJSON *payload)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        Client *client = findClient(nodeID);
+
+        if ( client == nullptr )
+        {
+            cJSON_Delete(payload);
+            return false;
+        }
+
+        Session &session = _sessions[client];
+
+        cJSON *message = cJSON_CreateObject();
+        cJSON_AddStringToObject(message, "command", "send");
+        cJSON_AddNumberToObject(message, "uuid", session.uuid);
+        cJSON_AddItemToObject(message, "payload", payload);
+
+        cJSON *cmd = cJSON_GetObjectItemCaseSensitive(payload, "cmd");
+
+        if ( cJSON_IsString(cmd) && strcmp(cmd->valuestring, "call") == 0 )
+        {
+            session.pendingCallTime = esp_timer_get_time();
+            _statistics.rpcCalls++;
+        }
+
+        send(client, message);
+
+        return true;
+    }
+
+    void QuickHubServer::peerConnected(IDFix::Protocols::WebSocket *socket)
+    {
+        Client *client = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            std::unique_ptr<Client> &webSocketClient = _webSocketClients[socket];
+            webSocketClient.reset(new WebSocketClient(socket) );
+            client = webSocketClient.get();
+        }
+
+        clientConnected(client);
+    }
+
+    void QuickHubServer::peerDisconnected(IDFix::Protocols::WebSocket *socket)
+    {
+        std::unique_ptr<Client> client;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            auto webSocketClient = _webSocketClients.find(socket);
+
+            if ( webSocketClient == _webSocketClients.end() )
+            {
+                return;
+            }
+
+            client = std::move(webSocketClient->second);
+            _webSocketClients.erase(webSocketClient);
+        }
+
+        clientDisconnected(client.get() );
+    }
+
+    void QuickHubServer::peerMessageReceived(IDFix::Protocols::WebSocket *socket, const char *data, int length)
+    {
+        Client *client = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            auto webSocketClient = _webSocketClients.find(socket);
+
+            if ( webSocketClient != _webSocketClients.end() )
+            {
+                client = webSocketClient->second.get();
+            }
+        }
+
+        if ( client != nullptr )
+        {
+            clientMessageReceived(client, data, static_cast<size_t>(length) );
+        }
+    }
+}
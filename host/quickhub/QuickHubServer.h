@@ -0,0 +1,215 @@
+#ifndef QUICKHUBSERVER_H
+#define QUICKHUBSERVER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdint.h>
+#include "WebSocket.h"
+
+struct cJSON;
+
+namespace _2log
+{
+    /**
+     * @brief The QuickHubServer class is a local stand-in for a QuickHub instance.
+     *
+     * It implements the device facing part of the QuickHub protocol: connection:register, node:register,
+     * ping/pong, send/ACK and RPC calls. Devices connect either through the loopback WebSocket (register
+     * the server for a URL with listen()) or directly through a LoopbackConnection.
+     *
+     * Nodes are addressed by the ID they sent in node:register. All functions are thread-safe.
+     */
+    class QuickHubServer : public IDFix::Protocols::WebSocketPeer
+    {
+        public:
+
+            /**
+             * @brief The Client class is the transport of a single device connection
+             */
+            class Client
+            {
+                public:
+
+                    virtual         ~Client();
+
+                    /**
+                     * @brief Deliver a protocol message to the device
+                     * @param message       the serialized message
+                     * @param delayTime     the delivery delay in milliseconds
+                     */
+                    virtual void    deliverMessage(const std::string &message, uint32_t delayTime) = 0;
+
+                    /**
+                     * @brief Close the connection from the server side
+                     */
+                    virtual void    closeClient(void) = 0;
+            };
+
+            /**
+             * @brief The Statistics struct summarizes the server activity
+             */
+            struct Statistics
+            {
+                uint32_t    connections;            ///< number of accepted connections
+                uint32_t    nodeRegistrations;      ///< number of node:register messages
+                uint32_t    messagesReceived;       ///< number of protocol messages received
+                uint32_t    propertyUpdates;        ///< number of set messages received
+                uint32_t    dataMessages;           ///< number of msg messages received
+                uint32_t    pongs;                  ///< number of pong messages received
+                uint32_t    rpcCalls;               ///< number of RPC calls sent
+                uint64_t    bytesReceived;          ///< protocol bytes received
+                uint64_t    bytesSent;              ///< protocol bytes sent
+            };
+
+            typedef std::function<void(const std::string &nodeID, const cJSON *payload)>   payloadHandlerFunction;
+
+                                QuickHubServer(void);
+            virtual             ~QuickHubServer() override;
+
+                                QuickHubServer(QuickHubServer const&)   = delete;
+            void                operator=(QuickHubServer const&)        = delete;
+
+            /**
+             * @brief Accept loopback WebSocket connections to a URL
+             * @param url   the URL the devices connect to
+             */
+            void                listen(const std::string &url);
+
+            /**
+             * @brief Set the one-way latency of all messages sent to the devices
+             * @param latency   the latency in milliseconds
+             */
+            void                setLatency(uint32_t latency);
+
+            /**
+             * @brief Enable or disable the ACK reply to each send message of a device (enabled by default)
+             */
+            void                setAcknowledge(bool acknowledge);
+
+            /**
+             * @brief Set a function that is called for every payload a device sends, outside of the server lock
+             */
+            void                setPayloadHandler(payloadHandlerFunction handler);
+
+            /**
+             * @brief Wait until a node has registered
+             * @param nodeID    the node ID
+             * @param timeout   the timeout in milliseconds
+             * @return  \c true if the node is registered, \c false on timeout
+             */
+            bool                waitForNode(const std::string &nodeID, uint32_t timeout);
+
+            /**
+             * @brief Wait until a number of property updates has been received in total
+             * @param count     the total number of updates
+             * @param timeout   the timeout in milliseconds
+             * @return  \c true if the updates were received, \c false on timeout
+             */
+            bool                waitForPropertyUpdates(uint32_t count, uint32_t timeout);
+
+            /**
+             * @brief Call a RPC of a node, the round trip ends with the next payload of the node
+             * @param nodeID        the node ID
+             * @param function      the RPC name
+             * @param arguments     the RPC argument as JSON object
+             * @return  \c true if the call was sent, \c false if the node is not connected or the arguments are invalid
+             */
+            bool                callRPC(const std::string &nodeID, const std::string &function, const std::string &arguments = "{}");
+
+            /**
+             * @brief Send a new authentication key to a node
+             */
+            bool                setAuthKey(const std::string &nodeID, uint32_t authKey);
+
+            /**
+             * @brief Send a ping to a node or to all connected nodes
+             */
+            bool                ping(const std::string &nodeID);
+            void                pingAll(void);
+
+            /**
+             * @brief Close the connection of a node from the server side
+             */
+            bool                closeNode(const std::string &nodeID);
+
+            /**
+             * @brief Get the last value of a node property
+             * @return  the value as JSON text, an empty string if unknown
+             */
+            std::string         getProperty(const std::string &nodeID, const std::string &property);
+
+            /**
+             * @brief Get the RPC functions a node registered
+             */
+            std::vector<std::string>    getFunctions(const std::string &nodeID);
+
+            /**
+             * @brief Get the number of connected nodes
+             */
+            size_t              getNodeCount(void);
+
+            Statistics          getStatistics(void);
+
+            /**
+             * @brief Get the times from connecting to node:register of all registrations in microseconds
+             */
+            std::vector<uint32_t>   getRegistrationTimes(void);
+
+            /**
+             * @brief Get the RPC round trip times in microseconds
+             */
+            std::vector<uint32_t>   getRPCRoundTrips(void);
+
+            /**
+             * @brief Transport callbacks
+             */
+            void                clientConnected(Client *client);
+            void                clientDisconnected(Client *client);
+            void                clientMessageReceived(Client *client, const char *data, size_t length);
+
+            virtual void        peerConnected(IDFix::Protocols::WebSocket *socket) override;
+            virtual void        peerDisconnected(IDFix::Protocols::WebSocket *socket) override;
+            virtual void        peerMessageReceived(IDFix::Protocols::WebSocket *socket, const char *data, int length) override;
+
+        private:
+
+            struct Session
+            {
+                uint8_t                                 uuid;
+                std::string                             nodeID;
+                int64_t                                 connectedTime;
+                int64_t                                 pendingCallTime;
+                std::vector<std::string>                functions;
+                std::map<std::string, std::string>      properties;
+            };
+
+            class WebSocketClient;
+
+            void                handlePayload(Client *client, Session &session, const cJSON *payload);
+            void                storeProperties(Session &session, const cJSON *properties);
+            void                send(Client *client, cJSON *message);
+            Client*             findClient(const std::string &nodeID);
+            bool                sendPayload(const std::string &nodeID, cJSON *payload);
+
+        private:
+
+            std::mutex                                                      _mutex;
+            std::condition_variable                                         _condition;
+            std::map<Client*, Session>                                      _sessions;
+            std::map<IDFix::Protocols::WebSocket*, std::unique_ptr<Client>> _webSocketClients;
+            std::vector<std::string>                                        _urls;
+            uint32_t                                                        _latency = { 0 };
+            bool                                                            _acknowledge = { true };
+            payloadHandlerFunction                                          _payloadHandler;
+            Statistics                                                      _statistics = {};
+            std::vector<uint32_t>                                           _registrationTimes;
+            std::vector<uint32_t>                                           _rpcRoundTrips;
+    };
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HOST_BUILDCONFIG_H
+#define HOST_BUILDCONFIG_H
+
+/*
+ * Build configuration of the host build. On the device this file is provided by the main project.
+ */
+
+#ifndef PING_TIMEOUT
+    #define PING_TIMEOUT            30000
+#endif
+
+#ifndef PING_TIMEOUT_TIMER
+    #define PING_TIMEOUT_TIMER      10000
+#endif
+
+#ifndef DEVICE_DEBUGGING
+    #define DEVICE_DEBUGGING        0
+#endif
+
+#ifndef MEMORY_DEBUGGING
+    #define MEMORY_DEBUGGING        0
+#endif
+
+#ifndef PERFORMANCE_COUNTERS
+    #define PERFORMANCE_COUNTERS    0
+#endif
+
+#endif
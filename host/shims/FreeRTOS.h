@@ -0,0 +1,7 @@
+#ifndef HOST_FREERTOS_FORWARD_H
+#define HOST_FREERTOS_FORWARD_H
+
+// some sources include FreeRTOS.h without the freertos/ prefix
+#include "freertos/FreeRTOS.h"
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef HOST_SCHEDULER_H
+#define HOST_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Cooperative scheduling for large simulations.
+ *
+ * By default every task of the host build is a POSIX thread. After host_scheduler_start(), tasks created
+ * with xTaskCreate() (and IDFix::Task, the loopback WebSocket and the timer service) run as fibers on one
+ * scheduler thread instead, like all tasks share the single core of the device. A fiber only gives up the
+ * CPU when it blocks in a queue, semaphore or vTaskDelay(). The scheduler waits for timeouts and wake-ups
+ * from other threads with epoll, so thousands of tasks cost only their (lazily committed) stacks.
+ *
+ * Threads that are not fibers, e.g. the main thread, can use all primitives as before.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    uint32_t    fibers;             ///< number of live fibers
+    uint64_t    contextSwitches;    ///< number of switches from the scheduler to a fiber
+    uint64_t    wakeups;            ///< number of times the scheduler woke up from epoll_wait()
+    size_t      stackBytes;         ///< reserved fiber stack bytes
+} host_scheduler_stats_t;
+
+/**
+ * @brief Start the scheduler thread, tasks created afterwards are fibers. Calling this more than once is safe.
+ */
+void    host_scheduler_start(void);
+
+/**
+ * @brief Check if the scheduler was started
+ */
+int     host_scheduler_is_running(void);
+
+/**
+ * @brief Get the scheduler statistics
+ */
+void    host_scheduler_get_stats(host_scheduler_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
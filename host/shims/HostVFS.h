@@ -0,0 +1,75 @@
+#ifndef HOSTVFS_H
+#define HOSTVFS_H
+
+/*
+ * Path redirection for the host build.
+ *
+ * On the device, file systems are mounted at absolute paths like "/2log". On the host, paths below a
+ * mounted base path are redirected into the directory given by the HOST_VFS_ROOT environment variable
+ * (default "./host_vfs"), so "/2log/auth.json" becomes "./host_vfs/2log/auth.json". All other paths are
+ * used unchanged.
+ *
+ * The redirection is done with function-like macros for the POSIX calls used by DataStorage, so this
+ * header has to be included before they are called. It is included by the file system shims (esp_spiffs.h).
+ * Names that clash with the C++ library, like remove() and open(), are deliberately not redirected.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Mount or unmount a base path, mounting creates the host directory.
+ */
+int             host_vfs_mount(const char *basePath);
+int             host_vfs_unmount(const char *basePath);
+int             host_vfs_is_mounted(const char *basePath);
+
+/*
+ * Map a device path to the host path. The returned string is valid until the next call in the same thread.
+ */
+const char*     host_vfs_path(const char *path);
+
+/*
+ * Sum of the file sizes below a mounted base path, and removal of all its files.
+ */
+size_t          host_vfs_used_bytes(const char *basePath);
+int             host_vfs_format(const char *basePath);
+
+FILE*           host_vfs_fopen(const char *path, const char *mode);
+int             host_vfs_stat(const char *path, struct stat *buffer);
+int             host_vfs_unlink(const char *path);
+int             host_vfs_rename(const char *oldPath, const char *newPath);
+int             host_vfs_mkdir(const char *path, mode_t mode);
+int             host_vfs_rmdir(const char *path);
+DIR*            host_vfs_opendir(const char *path);
+int             host_vfs_fsync(int fd);
+
+/*
+ * Let the next this many fsync() calls fail with EIO, to test the handling of a failed sync.
+ */
+void            host_vfs_set_sync_failures(int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifndef HOST_VFS_IMPLEMENTATION
+    #define fopen(path, mode)           host_vfs_fopen(path, mode)
+    #define stat(path, buffer)          host_vfs_stat(path, buffer)
+    #define unlink(path)                host_vfs_unlink(path)
+    #define rename(oldPath, newPath)    host_vfs_rename(oldPath, newPath)
+    #define mkdir(path, mode)           host_vfs_mkdir(path, mode)
+    #define rmdir(path)                 host_vfs_rmdir(path)
+    #define opendir(path)               host_vfs_opendir(path)
+    #define fsync(fd)                   host_vfs_fsync(fd)
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef HOST_IDFIXTASK_H
+#define HOST_IDFIXTASK_H
+
+#include <string>
+#include <stdint.h>
+
+extern "C"
+{
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+}
+
+namespace IDFix
+{
+    /**
+     * @brief Host stand-in for IDFix::Task, backed by a FreeRTOS shim task (a POSIX thread)
+     */
+    class Task
+    {
+        public:
+
+                                Task(const char *name, uint32_t stackSize = 4096, UBaseType_t priority = 5);
+            virtual             ~Task();
+
+            /**
+             * @brief Start the task, run() is called on the new thread
+             * @return  \c true if the thread was started, \c false otherwise
+             */
+            bool                startTask(void);
+
+            static void         delay(uint32_t milliseconds);
+            static std::string  getRunningTaskName(void);
+
+        protected:
+
+            virtual void        run(void) = 0;
+
+        private:
+
+            static void         taskFunction(void *parameter);
+
+        private:
+
+            std::string         _name;
+            uint32_t            _stackSize;
+            UBaseType_t         _priority;
+            TaskHandle_t        _handle = { nullptr };
+    };
+}
+
+#endif
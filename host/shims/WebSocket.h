@@ -0,0 +1,113 @@
+#ifndef HOST_WEBSOCKET_H
+#define HOST_WEBSOCKET_H
+
+#include <string>
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include "WebSocketEventHandler.h"
+
+namespace IDFix
+{
+    namespace Protocols
+    {
+        class WebSocket;
+
+        /**
+         * @brief The WebSocketPeer class is the server side of a loopback WebSocket.
+         *
+         * Peers are registered for a URL. When a WebSocket with that URL connects, the peer is attached to it
+         * and receives all messages sent by the device. Peer callbacks are called on the sending thread, so
+         * implementations have to be thread-safe.
+         */
+        class WebSocketPeer
+        {
+            public:
+
+                virtual         ~WebSocketPeer() {}
+
+                virtual void    peerConnected(WebSocket *socket) = 0;
+                virtual void    peerDisconnected(WebSocket *socket) = 0;
+                virtual void    peerMessageReceived(WebSocket *socket, const char *data, int length) = 0;
+        };
+
+        /**
+         * @brief Host stand-in for the IDFix WebSocket client, connecting to an in-process WebSocketPeer.
+         *
+         * Like on the device, all WebSocketEventHandler callbacks of a socket are called on its own event
+         * task ("websocket_task"), which is started with start().
+         */
+        class WebSocket
+        {
+            public:
+
+                                WebSocket(WebSocketEventHandler *eventHandler);
+                                ~WebSocket();
+
+                                WebSocket(WebSocket const&)     = delete;
+                void            operator=(WebSocket const&)     = delete;
+
+                bool            start(void);
+                void            setURL(const std::string &url);
+                void            setCaCertificate(const char *caCertificate);
+
+                /**
+                 * @brief Connect to the peer registered for the URL
+                 * @param delayTime     time to wait before the attempt in milliseconds
+                 * @return  \c true if the attempt was queued, \c false otherwise
+                 */
+                bool            connect(uint32_t delayTime = 0);
+                bool            disconnect(void);
+                bool            isConnected(void) const;
+
+                /**
+                 * @brief Send a message to the peer
+                 * @return  the number of bytes sent, 0 if not connected
+                 */
+                int             sendBinaryMessage(const char *data, int length);
+
+                /**
+                 * @brief Deliver a message from the peer to the device, may be called from any thread
+                 * @param delayTime     optional delivery delay in milliseconds
+                 * @return  \c true if the message was queued, \c false if the socket is not connected
+                 */
+                bool            deliverBinaryMessage(const char *data, int length, uint32_t delayTime = 0);
+
+                /**
+                 * @brief Close the connection from the peer side, may be called from any thread
+                 */
+                void            close(void);
+
+                /**
+                 * @brief Register the peer that accepts connections to a URL
+                 * @param url   the URL
+                 * @param peer  the peer or \c nullptr to remove the registration
+                 */
+                static void     registerPeer(const std::string &url, WebSocketPeer *peer);
+
+            private:
+
+                struct EventLoop;
+
+                void            post(std::function<void()> action, uint32_t delayTime);
+                static void     eventTask(void *parameter);
+                void            eventLoop(void);
+                void            openConnection(void);
+                void            closeConnection(void);
+
+            private:
+
+                WebSocketEventHandler*      _eventHandler;
+                std::string                 _url;
+                WebSocketPeer*              _peer = { nullptr };
+                std::atomic<bool>           _connected = { false };
+                std::mutex                  _peerMutex;
+
+                std::unique_ptr<EventLoop>  _eventLoop;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef HOST_WEBSOCKETEVENTHANDLER_H
+#define HOST_WEBSOCKETEVENTHANDLER_H
+
+namespace IDFix
+{
+    namespace Protocols
+    {
+        /**
+         * @brief Host stand-in for the IDFix WebSocket event interface
+         */
+        class WebSocketEventHandler
+        {
+            public:
+
+                virtual         ~WebSocketEventHandler() {}
+
+                virtual void    webSocketConnected(void) = 0;
+                virtual void    webSocketDisconnected(void) = 0;
+                virtual void    webSocketBinaryMessageReceived(const char *data, int length) = 0;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef HOST_AUXILIARY_H
+#define HOST_AUXILIARY_H
+
+#include <stdint.h>
+
+/**
+ * @brief Milliseconds since the process started
+ */
+uint64_t    getTickMs(void);
+
+#endif
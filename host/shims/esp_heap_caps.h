@@ -0,0 +1,38 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MALLOC_CAP_8BIT         (1 << 2)
+#define MALLOC_CAP_DEFAULT      (1 << 12)
+
+/*
+ * The heap of the host process has no device like layout. Without a model the free size is the one of
+ * esp_get_free_heap_size() and the largest free block equals the free size, i.e. no fragmentation is visible.
+ *
+ * A tool that simulates the device heap, e.g. the soak test, installs a model with host_heap_set_model(),
+ * which then answers all heap_caps_*() and esp_get_*_heap_size() queries. The capabilities are ignored.
+ */
+typedef struct
+{
+    size_t  (*free_size)(void);
+    size_t  (*minimum_free_size)(void);
+    size_t  (*largest_free_block)(void);
+} host_heap_model_t;
+
+void    host_heap_set_model(const host_heap_model_t *model);
+
+size_t  heap_caps_get_free_size(uint32_t caps);
+size_t  heap_caps_get_minimum_free_size(uint32_t caps);
+size_t  heap_caps_get_largest_free_block(uint32_t caps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef HOST_ESP_LITTLEFS_H
+#define HOST_ESP_LITTLEFS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "HostVFS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * LittleFS stand-in (esp_littlefs component): registering a partition mounts its base path as a directory below
+ * the host VFS root, like the SPIFFS stand-in. The size reported by esp_littlefs_info() is
+ * HOST_LITTLEFS_PARTITION_SIZE.
+ */
+
+#ifndef HOST_LITTLEFS_PARTITION_SIZE
+    #define HOST_LITTLEFS_PARTITION_SIZE    ( 1024 * 1024 )
+#endif
+
+typedef struct
+{
+    const char*     base_path;
+    const char*     partition_label;
+    uint8_t         format_if_mount_failed:1;
+    uint8_t         dont_mount:1;
+} esp_vfs_littlefs_conf_t;
+
+esp_err_t   esp_vfs_littlefs_register(const esp_vfs_littlefs_conf_t *conf);
+esp_err_t   esp_vfs_littlefs_unregister(const char *partition_label);
+bool        esp_littlefs_mounted(const char *partition_label);
+esp_err_t   esp_littlefs_format(const char *partition_label);
+esp_err_t   esp_littlefs_info(const char *partition_label, size_t *total_bytes, size_t *used_bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+/*
+ * Log output goes to stderr. The default level is ESP_LOG_INFO and can be changed with the
+ * HOST_LOG_LEVEL environment variable (0 = none ... 5 = verbose) or esp_log_level_set("*", level).
+ */
+void        esp_log_level_set(const char *tag, esp_log_level_t level);
+void        esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+uint32_t    esp_log_timestamp(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define HOST_LOG_FORMAT(letter, format)     #letter " (%u) %s: " format "\n"
+
+#define ESP_LOGE(tag, format, ...)  esp_log_write(ESP_LOG_ERROR,   tag, HOST_LOG_FORMAT(E, format), esp_log_timestamp(), tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  esp_log_write(ESP_LOG_WARN,    tag, HOST_LOG_FORMAT(W, format), esp_log_timestamp(), tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  esp_log_write(ESP_LOG_INFO,    tag, HOST_LOG_FORMAT(I, format), esp_log_timestamp(), tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  esp_log_write(ESP_LOG_DEBUG,   tag, HOST_LOG_FORMAT(D, format), esp_log_timestamp(), tag, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)  esp_log_write(ESP_LOG_VERBOSE, tag, HOST_LOG_FORMAT(V, format), esp_log_timestamp(), tag, ##__VA_ARGS__)
+
+#endif
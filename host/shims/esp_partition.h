@@ -0,0 +1,74 @@
+#ifndef HOST_ESP_PARTITION_H
+#define HOST_ESP_PARTITION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Flash partition stand-in: every data partition that is looked up exists, with HOST_PARTITION_SIZE bytes,
+ * backed by "<HOST_VFS_ROOT>/partitions/<label>.bin" so its content survives a restart of the process.
+ * Like NOR flash, a write can only clear bits and an erase sets whole sectors to 0xFF. The erases of every
+ * sector are counted, and a power loss can be simulated by cutting off the writes after a number of bytes.
+ */
+
+#ifndef HOST_PARTITION_SIZE
+    #define HOST_PARTITION_SIZE     ( 64 * 1024 )
+#endif
+
+#ifndef SPI_FLASH_SEC_SIZE
+    #define SPI_FLASH_SEC_SIZE      4096
+#endif
+
+typedef enum
+{
+    ESP_PARTITION_TYPE_APP  = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01
+} esp_partition_type_t;
+
+typedef enum
+{
+    ESP_PARTITION_SUBTYPE_DATA_OTA      = 0x00,
+    ESP_PARTITION_SUBTYPE_DATA_PHY      = 0x01,
+    ESP_PARTITION_SUBTYPE_DATA_NVS      = 0x02,
+    ESP_PARTITION_SUBTYPE_DATA_FAT      = 0x81,
+    ESP_PARTITION_SUBTYPE_DATA_SPIFFS   = 0x82,
+    ESP_PARTITION_SUBTYPE_ANY           = 0xff
+} esp_partition_subtype_t;
+
+typedef struct
+{
+    esp_partition_type_t    type;
+    esp_partition_subtype_t subtype;
+    uint32_t                address;
+    uint32_t                size;
+    char                    label[17];
+    bool                    encrypted;
+} esp_partition_t;
+
+const esp_partition_t*  esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label);
+esp_err_t               esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t               esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+esp_err_t               esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+/*
+ * Number of erases of a sector since the partition was first looked up by the process.
+ */
+uint32_t                host_partition_get_erase_count(const esp_partition_t *partition, size_t sector);
+
+/*
+ * Let the next writes succeed for this many bytes, the write that crosses the limit is torn and fails like
+ * every following one. A negative limit removes it.
+ */
+void                    host_partition_set_write_limit(const esp_partition_t *partition, int64_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
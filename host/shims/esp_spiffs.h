@@ -0,0 +1,40 @@
+#ifndef HOST_ESP_SPIFFS_H
+#define HOST_ESP_SPIFFS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "HostVFS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * SPIFFS stand-in: registering a partition mounts its base path as a directory below the host VFS root.
+ * The partition size reported by esp_spiffs_info() is HOST_SPIFFS_PARTITION_SIZE.
+ */
+
+#ifndef HOST_SPIFFS_PARTITION_SIZE
+    #define HOST_SPIFFS_PARTITION_SIZE      ( 1024 * 1024 )
+#endif
+
+typedef struct
+{
+    const char*     base_path;
+    const char*     partition_label;
+    size_t          max_files;
+    bool            format_if_mount_failed;
+} esp_vfs_spiffs_conf_t;
+
+esp_err_t   esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf);
+esp_err_t   esp_vfs_spiffs_unregister(const char *partition_label);
+bool        esp_spiffs_mounted(const char *partition_label);
+esp_err_t   esp_spiffs_format(const char *partition_label);
+esp_err_t   esp_spiffs_info(const char *partition_label, size_t *total_bytes, size_t *used_bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
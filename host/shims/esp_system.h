@@ -0,0 +1,45 @@
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    ESP_MAC_WIFI_STA,
+    ESP_MAC_WIFI_SOFTAP,
+    ESP_MAC_BT,
+    ESP_MAC_ETH
+} esp_mac_type_t;
+
+typedef void (*shutdown_handler_t)(void);
+
+/*
+ * esp_read_mac() returns the base MAC set with host_set_base_mac() (default 24:0A:C4:00:00:01),
+ * with the last byte incremented by the interface type like on the ESP32.
+ */
+esp_err_t   esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+void        host_set_base_mac(const uint8_t *mac);
+
+/*
+ * esp_restart() runs the registered shutdown handlers and exits the process.
+ */
+void        esp_restart(void) __attribute__((noreturn));
+esp_err_t   esp_register_shutdown_handler(shutdown_handler_t handle);
+esp_err_t   esp_unregister_shutdown_handler(shutdown_handler_t handle);
+
+uint32_t    esp_random(void);
+void        esp_fill_random(void *buffer, size_t length);
+uint32_t    esp_get_free_heap_size(void);
+uint32_t    esp_get_minimum_free_heap_size(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
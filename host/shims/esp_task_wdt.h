@@ -0,0 +1,22 @@
+#ifndef HOST_ESP_TASK_WDT_H
+#define HOST_ESP_TASK_WDT_H
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// there is no task watchdog on the host, all calls succeed
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t   esp_task_wdt_add(TaskHandle_t handle);
+esp_err_t   esp_task_wdt_delete(TaskHandle_t handle);
+esp_err_t   esp_task_wdt_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
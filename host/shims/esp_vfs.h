@@ -0,0 +1,10 @@
+#ifndef HOST_ESP_VFS_H
+#define HOST_ESP_VFS_H
+
+/*
+ * VFS stand-in: the file functions are redirected by HostVFS.h, see there.
+ */
+
+#include "HostVFS.h"
+
+#endif
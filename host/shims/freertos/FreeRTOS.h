@@ -0,0 +1,31 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+/*
+ * Host stand-in for the FreeRTOS kernel configuration.
+ *
+ * Only the subset of the FreeRTOS API used by this component is provided. Tasks are POSIX threads,
+ * one tick is one millisecond.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t            TickType_t;
+typedef int                 BaseType_t;
+typedef unsigned int        UBaseType_t;
+
+#define pdFALSE             ( ( BaseType_t ) 0 )
+#define pdTRUE              ( ( BaseType_t ) 1 )
+#define pdPASS              ( pdTRUE )
+#define pdFAIL              ( pdFALSE )
+
+#define configTICK_RATE_HZ      1000
+#define configMAX_PRIORITIES    25
+#define portTICK_PERIOD_MS      ( ( TickType_t ) 1000 / configTICK_RATE_HZ )
+#define portMAX_DELAY           ( TickType_t ) 0xffffffffUL
+#define pdMS_TO_TICKS(xTimeInMs)    ( ( TickType_t ) ( ( ( TickType_t ) ( xTimeInMs ) * ( TickType_t ) configTICK_RATE_HZ ) / ( TickType_t ) 1000 ) )
+
+#define tskNO_AFFINITY          0x7FFFFFFF
+
+#endif
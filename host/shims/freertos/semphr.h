@@ -0,0 +1,29 @@
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include "queue.h"
+
+/*
+ * Like in FreeRTOS, semaphores are queues with an item size of zero.
+ * Mutexes do not implement priority inheritance.
+ */
+
+typedef QueueHandle_t   SemaphoreHandle_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+SemaphoreHandle_t   xSemaphoreCreateMutex(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define xSemaphoreCreateBinary()                    xQueueCreate(1, 0)
+#define xSemaphoreCreateCounting(uxMax, uxInitial)  xQueueCreate(uxMax, 0)
+#define xSemaphoreTake(xSemaphore, xBlockTime)      xQueueReceive(xSemaphore, NULL, xBlockTime)
+#define xSemaphoreGive(xSemaphore)                  xQueueSend(xSemaphore, NULL, 0)
+#define vSemaphoreDelete(xSemaphore)                vQueueDelete(xSemaphore)
+
+#endif
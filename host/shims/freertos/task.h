@@ -0,0 +1,31 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tskTaskControlBlock*     TaskHandle_t;
+typedef void                            (*TaskFunction_t)(void*);
+
+BaseType_t      xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters,
+                            UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask);
+BaseType_t      xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters,
+                                        UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask, BaseType_t xCoreID);
+void            vTaskDelete(TaskHandle_t xTaskToDelete);
+void            vTaskDelay(TickType_t xTicksToDelay);
+TickType_t      xTaskGetTickCount(void);
+TaskHandle_t    xTaskGetCurrentTaskHandle(void);
+char*           pcTaskGetTaskName(TaskHandle_t xTaskToQuery);
+TaskHandle_t    xTaskGetIdleTaskHandleForCPU(UBaseType_t cpuid);
+BaseType_t      xPortGetCoreID(void);
+
+#define pcTaskGetName(xTask)    pcTaskGetTaskName(xTask)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
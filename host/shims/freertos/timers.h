@@ -0,0 +1,31 @@
+#ifndef HOST_FREERTOS_TIMERS_H
+#define HOST_FREERTOS_TIMERS_H
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Software timers. All callbacks run on a single timer service thread, like the FreeRTOS timer daemon task.
+ */
+
+typedef struct tmrTimerControl*     TimerHandle_t;
+typedef void                        (*TimerCallbackFunction_t)(TimerHandle_t xTimer);
+
+TimerHandle_t   xTimerCreate(const char *pcTimerName, TickType_t xTimerPeriodInTicks, UBaseType_t uxAutoReload,
+                             void *pvTimerID, TimerCallbackFunction_t pxCallbackFunction);
+BaseType_t      xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait);
+BaseType_t      xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait);
+BaseType_t      xTimerReset(TimerHandle_t xTimer, TickType_t xTicksToWait);
+BaseType_t      xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait);
+BaseType_t      xTimerDelete(TimerHandle_t xTimer, TickType_t xTicksToWait);
+BaseType_t      xTimerIsTimerActive(TimerHandle_t xTimer);
+void*           pvTimerGetTimerID(TimerHandle_t xTimer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
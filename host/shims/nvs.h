@@ -0,0 +1,92 @@
+#ifndef HOST_NVS_H
+#define HOST_NVS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * NVS stand-in: every entry is a file "<HOST_VFS_ROOT>/nvs/<namespace>/<key>", so the entries survive a restart
+ * of the process. Only strings and blobs are supported. The partition has HOST_NVS_PARTITION_SIZE bytes and an
+ * entry takes 32 bytes per started 32 bytes of data plus one for its header, like on the device, so a full
+ * partition fails with ESP_ERR_NVS_NOT_ENOUGH_SPACE.
+ */
+
+#ifndef HOST_NVS_PARTITION_SIZE
+    #define HOST_NVS_PARTITION_SIZE         0x6000
+#endif
+
+#define NVS_DEFAULT_PART_NAME               "nvs"
+#define NVS_KEY_NAME_MAX_SIZE               16
+
+#define ESP_ERR_NVS_BASE                    0x1100
+#define ESP_ERR_NVS_NOT_INITIALIZED         ( ESP_ERR_NVS_BASE + 0x01 )
+#define ESP_ERR_NVS_NOT_FOUND               ( ESP_ERR_NVS_BASE + 0x02 )
+#define ESP_ERR_NVS_TYPE_MISMATCH           ( ESP_ERR_NVS_BASE + 0x03 )
+#define ESP_ERR_NVS_READ_ONLY               ( ESP_ERR_NVS_BASE + 0x04 )
+#define ESP_ERR_NVS_NOT_ENOUGH_SPACE        ( ESP_ERR_NVS_BASE + 0x05 )
+#define ESP_ERR_NVS_INVALID_NAME            ( ESP_ERR_NVS_BASE + 0x06 )
+#define ESP_ERR_NVS_INVALID_HANDLE          ( ESP_ERR_NVS_BASE + 0x07 )
+#define ESP_ERR_NVS_KEY_TOO_LONG            ( ESP_ERR_NVS_BASE + 0x09 )
+#define ESP_ERR_NVS_INVALID_LENGTH          ( ESP_ERR_NVS_BASE + 0x0c )
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum
+{
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+
+typedef enum
+{
+    NVS_TYPE_STR    = 0x21,
+    NVS_TYPE_BLOB   = 0x42,
+    NVS_TYPE_ANY    = 0xff
+} nvs_type_t;
+
+typedef struct
+{
+    char        namespace_name[16];
+    char        key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_type_t  type;
+} nvs_entry_info_t;
+
+typedef struct
+{
+    size_t      used_entries;
+    size_t      free_entries;
+    size_t      total_entries;
+    size_t      namespace_count;
+} nvs_stats_t;
+
+typedef struct nvs_opaque_iterator_t *nvs_iterator_t;
+
+esp_err_t       nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle);
+void            nvs_close(nvs_handle_t handle);
+esp_err_t       nvs_set_str(nvs_handle_t handle, const char *key, const char *value);
+esp_err_t       nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length);
+esp_err_t       nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+esp_err_t       nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length);
+esp_err_t       nvs_erase_key(nvs_handle_t handle, const char *key);
+esp_err_t       nvs_erase_all(nvs_handle_t handle);
+esp_err_t       nvs_commit(nvs_handle_t handle);
+esp_err_t       nvs_get_stats(const char *part_name, nvs_stats_t *nvs_stats);
+
+/*
+ * The iterator functions of ESP-IDF 4.x: nvs_entry_next() releases the iterator after the last entry.
+ */
+nvs_iterator_t  nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type);
+nvs_iterator_t  nvs_entry_next(nvs_iterator_t iterator);
+void            nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t *out_info);
+void            nvs_release_iterator(nvs_iterator_t iterator);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
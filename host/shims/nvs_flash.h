@@ -0,0 +1,18 @@
+#ifndef HOST_NVS_FLASH_H
+#define HOST_NVS_FLASH_H
+
+#include "esp_err.h"
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t   nvs_flash_init(void);
+esp_err_t   nvs_flash_erase(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
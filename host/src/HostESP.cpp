@@ -0,0 +1,291 @@
+#include "HostTask.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <malloc.h>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "auxiliary.h"
+
+extern "C"
+{
+    #include "esp_err.h"
+    #include "esp_log.h"
+    #include "esp_system.h"
+    #include "esp_heap_caps.h"
+    #include "esp_timer.h"
+    #include "esp_task_wdt.h"
+}
+
+#ifndef HOST_HEAP_SIZE
+    #define HOST_HEAP_SIZE      ( 64 * 1024 * 1024 )
+#endif
+
+namespace
+{
+    esp_log_level_t     logLevel        = ESP_LOG_INFO;
+    bool                logLevelLoaded  = false;
+    std::mutex          logMutex;
+
+    uint8_t             baseMAC[6]      = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 };
+
+    std::mutex                          shutdownMutex;
+    std::vector<shutdown_handler_t>     shutdownHandlers;
+
+    uint32_t            minimumFreeHeap = HOST_HEAP_SIZE;
+
+    std::atomic<const host_heap_model_t*>   heapModel = { nullptr };
+}
+
+/*
+ * Errors and logging
+ */
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch ( code )
+    {
+        case ESP_OK:                    return "ESP_OK";
+        case ESP_FAIL:                  return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+        default:                        return "UNKNOWN ERROR";
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    // per tag levels are not supported, every tag sets the global level
+    (void) tag;
+
+    std::lock_guard<std::mutex> lock(logMutex);
+
+    logLevel        = level;
+    logLevelLoaded  = true;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    (void) tag;
+
+    std::lock_guard<std::mutex> lock(logMutex);
+
+    if ( ! logLevelLoaded )
+    {
+        const char *environmentLevel = getenv("HOST_LOG_LEVEL");
+
+        if ( environmentLevel != nullptr )
+        {
+            logLevel = static_cast<esp_log_level_t>( atoi(environmentLevel) );
+        }
+
+        logLevelLoaded = true;
+    }
+
+    if ( level > logLevel )
+    {
+        return;
+    }
+
+    va_list arguments;
+    va_start(arguments, format);
+    vfprintf(stderr, format, arguments);
+    va_end(arguments);
+}
+
+uint32_t esp_log_timestamp()
+{
+    return static_cast<uint32_t>( hostMonotonicMicroseconds() / 1000 );
+}
+
+/*
+ * System
+ */
+
+void host_set_base_mac(const uint8_t *mac)
+{
+    memcpy(baseMAC, mac, sizeof(baseMAC) );
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    if ( mac == nullptr )
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(mac, baseMAC, sizeof(baseMAC) );
+    mac[5] = static_cast<uint8_t>( mac[5] + static_cast<uint8_t>(type) );
+
+    return ESP_OK;
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handle)
+{
+    std::lock_guard<std::mutex> lock(shutdownMutex);
+
+    if ( std::find(shutdownHandlers.begin(), shutdownHandlers.end(), handle) != shutdownHandlers.end() )
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    shutdownHandlers.push_back(handle);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_unregister_shutdown_handler(shutdown_handler_t handle)
+{
+    std::lock_guard<std::mutex> lock(shutdownMutex);
+
+    auto handler = std::find(shutdownHandlers.begin(), shutdownHandlers.end(), handle);
+
+    if ( handler == shutdownHandlers.end() )
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    shutdownHandlers.erase(handler);
+
+    return ESP_OK;
+}
+
+void esp_restart()
+{
+    std::vector<shutdown_handler_t> handlers;
+
+    {
+        std::lock_guard<std::mutex> lock(shutdownMutex);
+        handlers = shutdownHandlers;
+    }
+
+    // ESP-IDF calls the handlers in reverse order of registration
+    for ( auto handler = handlers.rbegin(); handler != handlers.rend(); ++handler )
+    {
+        (*handler)();
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    _Exit(0);
+}
+
+uint32_t esp_random()
+{
+    static thread_local std::mt19937 generator( std::random_device{}() );
+    return generator();
+}
+
+void esp_fill_random(void *buffer, size_t length)
+{
+    uint8_t *bytes = static_cast<uint8_t*>(buffer);
+
+    for ( size_t index = 0; index < length; index++ )
+    {
+        bytes[index] = static_cast<uint8_t>( esp_random() );
+    }
+}
+
+uint32_t esp_get_free_heap_size()
+{
+    const host_heap_model_t *model = heapModel.load();
+
+    if ( model != nullptr )
+    {
+        return static_cast<uint32_t>( model->free_size() );
+    }
+
+    // model the device heap: the bytes in use by the process are taken from HOST_HEAP_SIZE
+    struct mallinfo2 info = mallinfo2();
+
+    uint32_t freeHeap = info.uordblks < HOST_HEAP_SIZE ? static_cast<uint32_t>(HOST_HEAP_SIZE - info.uordblks) : 0;
+
+    if ( freeHeap < minimumFreeHeap )
+    {
+        minimumFreeHeap = freeHeap;
+    }
+
+    return freeHeap;
+}
+
+uint32_t esp_get_minimum_free_heap_size()
+{
+    const host_heap_model_t *model = heapModel.load();
+
+    if ( model != nullptr )
+    {
+        return static_cast<uint32_t>( model->minimum_free_size() );
+    }
+
+    esp_get_free_heap_size();
+    return minimumFreeHeap;
+}
+
+void host_heap_set_model(const host_heap_model_t *model)
+{
+    heapModel = model;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void) caps;
+    return esp_get_free_heap_size();
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    (void) caps;
+    return esp_get_minimum_free_heap_size();
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    (void) caps;
+
+    const host_heap_model_t *model = heapModel.load();
+
+    return model != nullptr ? model->largest_free_block() : esp_get_free_heap_size();
+}
+
+int64_t esp_timer_get_time()
+{
+    return hostMonotonicMicroseconds();
+}
+
+uint64_t getTickMs()
+{
+    return static_cast<uint64_t>( hostMonotonicMicroseconds() / 1000 );
+}
+
+/*
+ * Task watchdog
+ */
+
+esp_err_t esp_task_wdt_add(TaskHandle_t handle)
+{
+    (void) handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_delete(TaskHandle_t handle)
+{
+    (void) handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reset()
+{
+    return ESP_OK;
+}
@@ -0,0 +1,147 @@
+#ifndef HOSTFIBER_H
+#define HOSTFIBER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+extern "C"
+{
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+}
+
+/*
+ * Internal fiber interface of the host scheduler, see HostScheduler.h.
+ */
+
+struct HostFiber;
+
+typedef std::chrono::steady_clock   HostClock;
+
+/**
+ * @brief Create a fiber for a task and make it ready
+ * @return  \c true if the fiber was created, \c false otherwise
+ */
+bool            hostFiberCreate(TaskHandle_t task, TaskFunction_t function, void *parameter, size_t stackSize);
+
+/**
+ * @brief Get the fiber running on the calling thread
+ * @return  the fiber or \c nullptr if the caller is a thread
+ */
+HostFiber*      hostFiberCurrent(void);
+
+/**
+ * @brief Prepare the current fiber to block, wake-ups with an older token are ignored
+ * @return  the wait token for hostFiberWake()
+ */
+uint64_t        hostFiberPrepareWait(HostFiber *fiber);
+
+/**
+ * @brief Switch to the scheduler until the fiber was woken up or the deadline has passed
+ */
+void            hostFiberBlock(HostFiber *fiber, HostClock::time_point deadline);
+
+/**
+ * @brief Make a blocked fiber ready, may be called from any thread
+ * @param token     the token returned by hostFiberPrepareWait()
+ */
+void            hostFiberWake(HostFiber *fiber, uint64_t token);
+
+/**
+ * @brief Let other ready fibers run
+ */
+void            hostFiberYield(void);
+
+/**
+ * @brief Sleep until the deadline
+ */
+void            hostFiberSleepUntil(HostClock::time_point deadline);
+
+/**
+ * @brief End the current fiber, never returns
+ */
+void            hostFiberExit(void) __attribute__((noreturn));
+
+/**
+ * @brief The HostCondition class is a condition variable that can be waited on by threads and fibers
+ *
+ * Like std::condition_variable it is used with a mutex that protects the condition. notifyAll() has to be
+ * called with that mutex held.
+ */
+class HostCondition
+{
+    public:
+
+        template<typename Predicate>
+        bool waitUntil(std::unique_lock<std::mutex> &lock, HostClock::time_point deadline, Predicate predicate)
+        {
+            HostFiber *fiber = hostFiberCurrent();
+
+            if ( fiber == nullptr )
+            {
+                if ( deadline == HostClock::time_point::max() )
+                {
+                    _condition.wait(lock, predicate);
+                    return true;
+                }
+
+                return _condition.wait_until(lock, deadline, predicate);
+            }
+
+            while ( ! predicate() )
+            {
+                if ( HostClock::now() >= deadline )
+                {
+                    return false;
+                }
+
+                _fibers.push_back( Waiter{ fiber, hostFiberPrepareWait(fiber) } );
+
+                lock.unlock();
+                hostFiberBlock(fiber, deadline);
+                lock.lock();
+
+                // remove the entry of a timed out wait
+                _fibers.erase(std::remove_if(_fibers.begin(), _fibers.end(), [fiber](const Waiter &waiter) { return waiter.fiber == fiber; }),
+                              _fibers.end() );
+            }
+
+            return true;
+        }
+
+        template<typename Predicate>
+        void wait(std::unique_lock<std::mutex> &lock, Predicate predicate)
+        {
+            waitUntil(lock, HostClock::time_point::max(), predicate);
+        }
+
+        void notifyAll()
+        {
+            _condition.notify_all();
+
+            for ( const Waiter &waiter : _fibers )
+            {
+                hostFiberWake(waiter.fiber, waiter.token);
+            }
+
+            _fibers.clear();
+        }
+
+    private:
+
+        struct Waiter
+        {
+            HostFiber*  fiber;
+            uint64_t    token;
+        };
+
+        std::condition_variable     _condition;
+        std::vector<Waiter>         _fibers;
+};
+
+#endif
@@ -0,0 +1,557 @@
+#include "HostTask.h"
+#include "HostFiber.h"
+#include "HostScheduler.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+extern "C"
+{
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "freertos/queue.h"
+    #include "freertos/semphr.h"
+    #include "freertos/timers.h"
+    #include "esp_log.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG = "host::FreeRTOS";
+
+    typedef HostClock   Clock;
+
+    const Clock::time_point     processStart = Clock::now();
+
+    Clock::time_point deadlineAfter(TickType_t ticks)
+    {
+        if ( ticks == portMAX_DELAY )
+        {
+            return Clock::time_point::max();
+        }
+
+        return Clock::now() + std::chrono::milliseconds(ticks * portTICK_PERIOD_MS);
+    }
+
+}
+
+struct tskTaskControlBlock
+{
+    char                name[16];
+    TaskFunction_t      function;
+    void*               parameter;
+};
+
+namespace
+{
+    thread_local tskTaskControlBlock*   currentTask = nullptr;
+
+    void *taskEntry(void *argument)
+    {
+        currentTask = static_cast<tskTaskControlBlock*>(argument);
+        currentTask->function(currentTask->parameter);
+
+        // like on FreeRTOS, a task function must not return
+        ESP_LOGE(LOG_TAG, "task %s returned from its task function", currentTask->name);
+        abort();
+    }
+}
+
+void hostTaskSetCurrent(TaskHandle_t task)
+{
+    currentTask = task;
+}
+
+TaskHandle_t hostTaskAdopt(const char *name)
+{
+    if ( currentTask == nullptr )
+    {
+        // never freed, like the TCB of a task that is never deleted
+        currentTask = static_cast<tskTaskControlBlock*>( calloc(1, sizeof(tskTaskControlBlock)) );
+    }
+
+    strncpy(currentTask->name, name, sizeof(currentTask->name) - 1);
+
+    return currentTask;
+}
+
+int64_t hostMonotonicMicroseconds()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - processStart).count();
+}
+
+/*
+ * Tasks
+ */
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask, BaseType_t xCoreID)
+{
+    (void) uxPriority;
+    (void) xCoreID;
+
+    tskTaskControlBlock *task = static_cast<tskTaskControlBlock*>( calloc(1, sizeof(tskTaskControlBlock)) );
+
+    if ( task == nullptr )
+    {
+        return pdFAIL;
+    }
+
+    strncpy(task->name, pcName != nullptr ? pcName : "", sizeof(task->name) - 1);
+    task->function  = pxTaskCode;
+    task->parameter = pvParameters;
+
+    // the stack depth is given in bytes on ESP-IDF, host code needs more stack than the device
+    size_t stackSize = std::max<size_t>(usStackDepth * 4, HOST_TASK_MIN_STACK_SIZE);
+
+    if ( host_scheduler_is_running() )
+    {
+        if ( ! hostFiberCreate(task, pxTaskCode, pvParameters, stackSize) )
+        {
+            free(task);
+            return pdFAIL;
+        }
+
+        if ( pxCreatedTask != nullptr )
+        {
+            *pxCreatedTask = task;
+        }
+
+        return pdPASS;
+    }
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, stackSize);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    int error = pthread_create(&thread, &attributes, &taskEntry, task);
+
+    pthread_attr_destroy(&attributes);
+
+    if ( error != 0 )
+    {
+        ESP_LOGE(LOG_TAG, "pthread_create failed for task %s (%s)", task->name, strerror(error) );
+        free(task);
+        return pdFAIL;
+    }
+
+    if ( pxCreatedTask != nullptr )
+    {
+        *pxCreatedTask = task;
+    }
+
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask)
+{
+    return xTaskCreatePinnedToCore(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    if ( xTaskToDelete == nullptr || xTaskToDelete == currentTask )
+    {
+        if ( hostFiberCurrent() != nullptr )
+        {
+            hostFiberExit();
+        }
+
+        // the control block stays allocated, other tasks may still hold the handle
+        pthread_exit(nullptr);
+    }
+
+    ESP_LOGE(LOG_TAG, "vTaskDelete() of another task is not supported on the host");
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    if ( xTicksToDelay == 0 )
+    {
+        hostFiberYield();
+        return;
+    }
+
+    hostFiberSleepUntil(Clock::now() + std::chrono::milliseconds(xTicksToDelay * portTICK_PERIOD_MS) );
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return static_cast<TickType_t>( hostMonotonicMicroseconds() / 1000 / portTICK_PERIOD_MS );
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    if ( currentTask == nullptr )
+    {
+        return hostTaskAdopt("pthread");
+    }
+
+    return currentTask;
+}
+
+char *pcTaskGetTaskName(TaskHandle_t xTaskToQuery)
+{
+    if ( xTaskToQuery == nullptr )
+    {
+        xTaskToQuery = xTaskGetCurrentTaskHandle();
+    }
+
+    return xTaskToQuery->name;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpuid)
+{
+    (void) cpuid;
+    return nullptr;
+}
+
+BaseType_t xPortGetCoreID()
+{
+    return 0;
+}
+
+/*
+ * Queues and semaphores
+ */
+
+struct QueueDefinition
+{
+    UBaseType_t                 length;
+    UBaseType_t                 itemSize;
+    std::vector<uint8_t>        storage;        // ring of length items, allocated once like the storage of a FreeRTOS queue
+    UBaseType_t                 first = { 0 };  // index of the oldest item
+    UBaseType_t                 count = { 0 };
+    std::mutex                  mutex;
+    HostCondition               notEmpty;
+    HostCondition               notFull;
+};
+
+namespace
+{
+    BaseType_t queueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait, bool toFront)
+    {
+        std::unique_lock<std::mutex> lock(queue->mutex);
+
+        if ( ! queue->notFull.waitUntil(lock, deadlineAfter(ticksToWait), [queue]() { return queue->count < queue->length; }) )
+        {
+            return pdFALSE;
+        }
+
+        UBaseType_t index;
+
+        if ( toFront )
+        {
+            queue->first    = ( queue->first + queue->length - 1 ) % queue->length;
+            index           = queue->first;
+        }
+        else
+        {
+            index = ( queue->first + queue->count ) % queue->length;
+        }
+
+        if ( queue->itemSize > 0 )
+        {
+            memcpy(&queue->storage[index * queue->itemSize], item, queue->itemSize);
+        }
+
+        queue->count++;
+        queue->notEmpty.notifyAll();
+
+        return pdTRUE;
+    }
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    if ( uxQueueLength == 0 )
+    {
+        return nullptr;
+    }
+
+    QueueHandle_t queue = new QueueDefinition();
+    queue->length   = uxQueueLength;
+    queue->itemSize = uxItemSize;
+    queue->storage.resize(static_cast<size_t>(uxQueueLength) * uxItemSize);
+
+    return queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+
+    // a mutex is created in the given state
+    xSemaphoreGive(mutex);
+
+    return mutex;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    delete xQueue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return queueSend(xQueue, pvItemToQueue, xTicksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return queueSend(xQueue, pvItemToQueue, xTicksToWait, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    std::unique_lock<std::mutex> lock(xQueue->mutex);
+
+    if ( ! xQueue->notEmpty.waitUntil(lock, deadlineAfter(xTicksToWait), [xQueue]() { return xQueue->count > 0; }) )
+    {
+        return pdFALSE;
+    }
+
+    if ( xQueue->itemSize > 0 )
+    {
+        memcpy(pvBuffer, &xQueue->storage[xQueue->first * xQueue->itemSize], xQueue->itemSize);
+    }
+
+    xQueue->first = ( xQueue->first + 1 ) % xQueue->length;
+    xQueue->count--;
+    xQueue->notFull.notifyAll();
+
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+    std::lock_guard<std::mutex> lock(xQueue->mutex);
+    return xQueue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue)
+{
+    std::lock_guard<std::mutex> lock(xQueue->mutex);
+    return xQueue->length - xQueue->count;
+}
+
+/*
+ * Software timers
+ */
+
+struct tmrTimerControl
+{
+    std::string                 name;
+    TickType_t                  period;
+    bool                        autoReload;
+    void*                       timerID;
+    TimerCallbackFunction_t     callback;
+    bool                        active;
+    Clock::time_point           expiry;
+};
+
+namespace
+{
+    /**
+     * @brief The TimerService class runs all timer callbacks on one thread, like the FreeRTOS timer daemon task
+     */
+    class TimerService
+    {
+        public:
+
+            static TimerService& getInstance()
+            {
+                // never destroyed, the service thread keeps waiting on the condition variable until the process exits
+                static TimerService *instance = new TimerService();
+                return *instance;
+            }
+
+            void schedule(TimerHandle_t timer, bool active)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                timer->active = active;
+
+                if ( active )
+                {
+                    timer->expiry = Clock::now() + std::chrono::milliseconds(timer->period * portTICK_PERIOD_MS);
+                }
+
+                if ( std::find(_timers.begin(), _timers.end(), timer) == _timers.end() )
+                {
+                    _timers.push_back(timer);
+                }
+
+                _changed = true;
+
+                _condition.notifyAll();
+            }
+
+            void changePeriod(TimerHandle_t timer, TickType_t period)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    timer->period = period;
+                }
+
+                // like FreeRTOS, changing the period also starts the timer
+                schedule(timer, true);
+            }
+
+            void remove(TimerHandle_t timer)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                _timers.erase(std::remove(_timers.begin(), _timers.end(), timer), _timers.end() );
+                delete timer;
+            }
+
+            bool isActive(TimerHandle_t timer)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return timer->active;
+            }
+
+        private:
+
+            TimerService()
+            {
+                xTaskCreate(&TimerService::serviceTask, "Tmr Svc", 4096, this, configMAX_PRIORITIES - 1, nullptr);
+            }
+
+            static void serviceTask(void *parameter)
+            {
+                static_cast<TimerService*>(parameter)->run();
+            }
+
+            void run()
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+
+                while ( true )
+                {
+                    Clock::time_point next = Clock::time_point::max();
+                    TimerHandle_t expired = nullptr;
+
+                    for ( TimerHandle_t timer : _timers )
+                    {
+                        if ( timer->active && timer->expiry < next )
+                        {
+                            next    = timer->expiry;
+                            expired = timer;
+                        }
+                    }
+
+                    if ( next > Clock::now() )
+                    {
+                        // woken up early whenever a timer is scheduled
+                        _changed = false;
+                        _condition.waitUntil(lock, next, [this]() { return _changed; });
+                        continue;
+                    }
+
+                    if ( expired->autoReload )
+                    {
+                        expired->expiry += std::chrono::milliseconds(expired->period * portTICK_PERIOD_MS);
+                    }
+                    else
+                    {
+                        expired->active = false;
+                    }
+
+                    // callbacks may start, stop or delete timers
+                    lock.unlock();
+                    expired->callback(expired);
+                    lock.lock();
+                }
+            }
+
+        private:
+
+            std::mutex                      _mutex;
+            HostCondition                   _condition;
+            bool                            _changed = { false };
+            std::vector<TimerHandle_t>      _timers;
+    };
+}
+
+TimerHandle_t xTimerCreate(const char *pcTimerName, TickType_t xTimerPeriodInTicks, UBaseType_t uxAutoReload,
+                           void *pvTimerID, TimerCallbackFunction_t pxCallbackFunction)
+{
+    if ( xTimerPeriodInTicks == 0 || pxCallbackFunction == nullptr )
+    {
+        return nullptr;
+    }
+
+    TimerHandle_t timer = new tmrTimerControl();
+    timer->name         = pcTimerName != nullptr ? pcTimerName : "";
+    timer->period       = xTimerPeriodInTicks;
+    timer->autoReload   = uxAutoReload != pdFALSE;
+    timer->timerID      = pvTimerID;
+    timer->callback     = pxCallbackFunction;
+    timer->active       = false;
+
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    (void) xTicksToWait;
+
+    TimerService::getInstance().schedule(xTimer, true);
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    return xTimerStart(xTimer, xTicksToWait);
+}
+
+BaseType_t xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    (void) xTicksToWait;
+
+    TimerService::getInstance().schedule(xTimer, false);
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait)
+{
+    if ( xNewPeriod == 0 )
+    {
+        return pdFAIL;
+    }
+
+    (void) xTicksToWait;
+
+    TimerService::getInstance().changePeriod(xTimer, xNewPeriod);
+    return pdPASS;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    (void) xTicksToWait;
+
+    TimerService::getInstance().remove(xTimer);
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t xTimer)
+{
+    return TimerService::getInstance().isActive(xTimer) ? pdTRUE : pdFALSE;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t xTimer)
+{
+    return xTimer->timerID;
+}
@@ -0,0 +1,340 @@
+#include "HostTask.h"
+#include "HostFiber.h"
+#include "IDFixTask.h"
+#include "WebSocket.h"
+
+#include <map>
+#include <deque>
+
+extern "C"
+{
+    #include "esp_log.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG = "host::IDFix";
+
+    std::mutex                                                      peerRegistryMutex;
+    std::map<std::string, IDFix::Protocols::WebSocketPeer*>         peerRegistry;
+}
+
+namespace IDFix
+{
+    /*
+     * Task
+     */
+
+    Task::Task(const char *name, uint32_t stackSize, UBaseType_t priority) : _name(name), _stackSize(stackSize), _priority(priority)
+    {
+
+    }
+
+    Task::~Task()
+    {
+
+    }
+
+    bool Task::startTask()
+    {
+        if ( _handle != nullptr )
+        {
+            return true;
+        }
+
+        return xTaskCreate(&Task::taskFunction, _name.c_str(), _stackSize, this, _priority, &_handle) == pdPASS;
+    }
+
+    void Task::taskFunction(void *parameter)
+    {
+        static_cast<Task*>(parameter)->run();
+        vTaskDelete(nullptr);
+    }
+
+    void Task::delay(uint32_t milliseconds)
+    {
+        vTaskDelay(pdMS_TO_TICKS(milliseconds) );
+    }
+
+    std::string Task::getRunningTaskName()
+    {
+        return pcTaskGetTaskName(nullptr);
+    }
+
+    namespace Protocols
+    {
+        /*
+         * WebSocket
+         */
+
+        struct WebSocket::EventLoop
+        {
+            struct Event
+            {
+                HostClock::time_point   due;
+                std::function<void()>   action;
+            };
+
+            std::mutex              mutex;
+            HostCondition           condition;
+            std::deque<Event>       events;
+            bool                    running = { false };
+            bool                    stopping = { false };
+            bool                    stopped = { false };
+        };
+
+        WebSocket::WebSocket(WebSocketEventHandler *eventHandler) : _eventHandler(eventHandler), _eventLoop(new EventLoop())
+        {
+
+        }
+
+        WebSocket::~WebSocket()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_eventLoop->mutex);
+
+                if ( _eventLoop->running )
+                {
+                    _eventLoop->stopping = true;
+                    _eventLoop->condition.notifyAll();
+                    _eventLoop->condition.wait(lock, [this]() { return _eventLoop->stopped; });
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(_peerMutex);
+
+            if ( _peer != nullptr )
+            {
+                _peer->peerDisconnected(this);
+                _peer = nullptr;
+            }
+        }
+
+        bool WebSocket::start()
+        {
+            std::lock_guard<std::mutex> lock(_eventLoop->mutex);
+
+            if ( ! _eventLoop->running )
+            {
+                if ( xTaskCreate(&WebSocket::eventTask, "websocket_task", 4096, this, 5, nullptr) != pdPASS )
+                {
+                    ESP_LOGE(LOG_TAG, "Failed to start websocket task");
+                    return false;
+                }
+
+                _eventLoop->running = true;
+            }
+
+            return true;
+        }
+
+        void WebSocket::setURL(const std::string &url)
+        {
+            _url = url;
+        }
+
+        void WebSocket::setCaCertificate(const char *caCertificate)
+        {
+            // the loopback connection is not encrypted
+            (void) caCertificate;
+        }
+
+        bool WebSocket::connect(uint32_t delayTime)
+        {
+            if ( ! _eventLoop->running )
+            {
+                return false;
+            }
+
+            post([this]() { openConnection(); }, delayTime);
+            return true;
+        }
+
+        bool WebSocket::disconnect()
+        {
+            if ( ! _eventLoop->running )
+            {
+                return false;
+            }
+
+            post([this]() { closeConnection(); }, 0);
+            return true;
+        }
+
+        bool WebSocket::isConnected() const
+        {
+            return _connected.load();
+        }
+
+        int WebSocket::sendBinaryMessage(const char *data, int length)
+        {
+            std::lock_guard<std::mutex> lock(_peerMutex);
+
+            if ( ! _connected || _peer == nullptr )
+            {
+                return 0;
+            }
+
+            _peer->peerMessageReceived(this, data, length);
+
+            return length;
+        }
+
+        bool WebSocket::deliverBinaryMessage(const char *data, int length, uint32_t delayTime)
+        {
+            if ( ! _connected )
+            {
+                return false;
+            }
+
+            std::string message(data, static_cast<size_t>(length) );
+
+            post([this, message]()
+            {
+                // the connection may have been closed while the message was in flight
+                if ( _connected )
+                {
+                    _eventHandler->webSocketBinaryMessageReceived(message.data(), static_cast<int>(message.size()) );
+                }
+            }, delayTime);
+
+            return true;
+        }
+
+        void WebSocket::close()
+        {
+            post([this]() { closeConnection(); }, 0);
+        }
+
+        void WebSocket::registerPeer(const std::string &url, WebSocketPeer *peer)
+        {
+            std::lock_guard<std::mutex> lock(peerRegistryMutex);
+
+            if ( peer == nullptr )
+            {
+                peerRegistry.erase(url);
+            }
+            else
+            {
+                peerRegistry[url] = peer;
+            }
+        }
+
+        void WebSocket::post(std::function<void()> action, uint32_t delayTime)
+        {
+            std::lock_guard<std::mutex> lock(_eventLoop->mutex);
+
+            EventLoop::Event event;
+            event.due       = HostClock::now() + std::chrono::milliseconds(delayTime);
+            event.action    = std::move(action);
+
+            // keep the events ordered by due time, events with the same due time in post order
+            auto position = _eventLoop->events.end();
+
+            while ( position != _eventLoop->events.begin() && (position - 1)->due > event.due )
+            {
+                --position;
+            }
+
+            _eventLoop->events.insert(position, std::move(event) );
+            _eventLoop->condition.notifyAll();
+        }
+
+        void WebSocket::eventTask(void *parameter)
+        {
+            static_cast<WebSocket*>(parameter)->eventLoop();
+            vTaskDelete(nullptr);
+        }
+
+        void WebSocket::eventLoop()
+        {
+            std::unique_lock<std::mutex> lock(_eventLoop->mutex);
+
+            while ( ! _eventLoop->stopping )
+            {
+                HostClock::time_point due = _eventLoop->events.empty() ? HostClock::time_point::max() : _eventLoop->events.front().due;
+
+                if ( due > HostClock::now() )
+                {
+                    // woken up by every post, so an earlier event is not missed
+                    size_t pending = _eventLoop->events.size();
+
+                    _eventLoop->condition.waitUntil(lock, due, [this, pending]()
+                    {
+                        return _eventLoop->stopping || _eventLoop->events.size() != pending;
+                    });
+
+                    continue;
+                }
+
+                std::function<void()> action = std::move(_eventLoop->events.front().action);
+                _eventLoop->events.pop_front();
+
+                lock.unlock();
+                action();
+                lock.lock();
+            }
+
+            _eventLoop->stopped = true;
+            _eventLoop->condition.notifyAll();
+        }
+
+        void WebSocket::openConnection()
+        {
+            if ( _connected )
+            {
+                return;
+            }
+
+            WebSocketPeer *peer = nullptr;
+
+            {
+                std::lock_guard<std::mutex> lock(peerRegistryMutex);
+
+                auto registeredPeer = peerRegistry.find(_url);
+
+                if ( registeredPeer != peerRegistry.end() )
+                {
+                    peer = registeredPeer->second;
+                }
+            }
+
+            if ( peer == nullptr )
+            {
+                ESP_LOGW(LOG_TAG, "No loopback peer registered for %s", _url.c_str() );
+                _eventHandler->webSocketDisconnected();
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_peerMutex);
+                _peer = peer;
+                _connected = true;
+            }
+
+            peer->peerConnected(this);
+            _eventHandler->webSocketConnected();
+        }
+
+        void WebSocket::closeConnection()
+        {
+            WebSocketPeer *peer = nullptr;
+
+            {
+                std::lock_guard<std::mutex> lock(_peerMutex);
+
+                if ( ! _connected )
+                {
+                    return;
+                }
+
+                peer        = _peer;
+                _peer       = nullptr;
+                _connected  = false;
+            }
+
+            peer->peerDisconnected(this);
+            _eventHandler->webSocketDisconnected();
+        }
+    }
+}
@@ -0,0 +1,484 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
+
+extern "C"
+{
+    #include "nvs.h"
+    #include "nvs_flash.h"
+}
+
+struct nvs_opaque_iterator_t
+{
+    std::vector<nvs_entry_info_t>   entries;
+    size_t                          index;
+};
+
+namespace
+{
+    const char*     DEFAULT_ROOT    = "./host_vfs";
+    const size_t    ENTRY_SIZE      = 32;
+    const size_t    PAGE_SIZE       = 4096;
+    const size_t    ENTRIES_PER_PAGE = 126;
+
+    struct Handle
+    {
+        std::string     namespaceName;
+        bool            writable;
+    };
+
+    std::mutex                      nvsMutex;
+    std::map<nvs_handle_t, Handle>  handles;
+    nvs_handle_t                    nextHandle = 1;
+    size_t                          usedEntries = SIZE_MAX;     ///< counted on first use, SIZE_MAX to count again
+
+    std::string getDirectory()
+    {
+        const char *root = getenv("HOST_VFS_ROOT");
+        return std::string( root != nullptr ? root : DEFAULT_ROOT ) + "/nvs";
+    }
+
+    std::vector<std::string> listDirectory(const std::string &path, bool directories)
+    {
+        std::vector<std::string>    names;
+        DIR                         *directory = opendir(path.c_str() );
+
+        if ( directory == nullptr )
+        {
+            return names;
+        }
+
+        struct dirent *entry;
+
+        while ( ( entry = readdir(directory) ) != nullptr )
+        {
+            if ( entry->d_name[0] != '.' && ( entry->d_type == DT_DIR ) == directories )
+            {
+                names.push_back(entry->d_name);
+            }
+        }
+
+        closedir(directory);
+
+        return names;
+    }
+
+    size_t getEntryCount(size_t dataLength)
+    {
+        return 1 + ( dataLength + ENTRY_SIZE - 1 ) / ENTRY_SIZE;
+    }
+
+    /**
+     * @brief Read an entry, the first byte of the file is its type
+     */
+    bool readEntry(const std::string &path, nvs_type_t *type, std::vector<uint8_t> &data)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+
+        if ( file == nullptr )
+        {
+            return false;
+        }
+
+        int typeByte = fgetc(file);
+        uint8_t buffer[256];
+        size_t length;
+
+        data.clear();
+
+        while ( ( length = fread(buffer, 1, sizeof(buffer), file) ) > 0 )
+        {
+            data.insert(data.end(), buffer, buffer + length);
+        }
+
+        fclose(file);
+
+        *type = static_cast<nvs_type_t>(typeByte);
+
+        return typeByte != EOF;
+    }
+
+    size_t getFileEntries(const std::string &path)
+    {
+        struct stat entryStat;
+
+        return stat(path.c_str(), &entryStat) == 0 && entryStat.st_size > 0 ? getEntryCount(static_cast<size_t>(entryStat.st_size) - 1) : 0;
+    }
+
+    /**
+     * @brief The entries in use over all namespaces, a namespace takes one
+     */
+    size_t getUsedEntries()
+    {
+        if ( usedEntries != SIZE_MAX )
+        {
+            return usedEntries;
+        }
+
+        std::string directory   = getDirectory();
+        size_t      used        = 0;
+
+        for ( const std::string &namespaceName : listDirectory(directory, true) )
+        {
+            used++;
+
+            for ( const std::string &key : listDirectory(directory + "/" + namespaceName, false) )
+            {
+                used += getFileEntries(directory + "/" + namespaceName + "/" + key);
+            }
+        }
+
+        usedEntries = used;
+
+        return used;
+    }
+
+    size_t getTotalEntries()
+    {
+        // one page is kept free for the garbage collection
+        return ( HOST_NVS_PARTITION_SIZE / PAGE_SIZE - 1 ) * ENTRIES_PER_PAGE;
+    }
+
+    esp_err_t findHandle(nvs_handle_t handle, bool write, Handle **found)
+    {
+        auto entry = handles.find(handle);
+
+        if ( entry == handles.end() )
+        {
+            return ESP_ERR_NVS_INVALID_HANDLE;
+        }
+
+        if ( write && ! entry->second.writable )
+        {
+            return ESP_ERR_NVS_READ_ONLY;
+        }
+
+        *found = &entry->second;
+
+        return ESP_OK;
+    }
+
+    std::string getPath(const Handle &handle, const char *key)
+    {
+        return getDirectory() + "/" + handle.namespaceName + "/" + key;
+    }
+
+    esp_err_t setEntry(nvs_handle_t handle, const char *key, nvs_type_t type, const void *value, size_t length)
+    {
+        std::lock_guard<std::mutex> lock(nvsMutex);
+
+        Handle      *found;
+        esp_err_t   err = findHandle(handle, true, &found);
+
+        if ( err != ESP_OK )
+        {
+            return err;
+        }
+
+        if ( key == nullptr || strlen(key) >= NVS_KEY_NAME_MAX_SIZE )
+        {
+            return ESP_ERR_NVS_KEY_TOO_LONG;
+        }
+
+        std::string path    = getPath(*found, key);
+        size_t      used    = getUsedEntries() - getFileEntries(path) + getEntryCount(length);
+
+        if ( used > getTotalEntries() )
+        {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+
+        FILE *file = fopen(path.c_str(), "wb");
+
+        if ( file == nullptr )
+        {
+            return ESP_FAIL;
+        }
+
+        bool success = fputc(type, file) != EOF && ( length == 0 || fwrite(value, 1, length, file) == length );
+        success = fclose(file) == 0 && success;
+
+        // a failed write leaves a partial entry, count again
+        usedEntries = success ? used : SIZE_MAX;
+
+        return success ? ESP_OK : ESP_FAIL;
+    }
+
+    esp_err_t getEntry(nvs_handle_t handle, const char *key, nvs_type_t type, void *out_value, size_t *length)
+    {
+        std::lock_guard<std::mutex> lock(nvsMutex);
+
+        Handle      *found;
+        esp_err_t   err = findHandle(handle, false, &found);
+
+        if ( err != ESP_OK )
+        {
+            return err;
+        }
+
+        nvs_type_t              storedType;
+        std::vector<uint8_t>    data;
+
+        if ( key == nullptr || length == nullptr || ! readEntry(getPath(*found, key), &storedType, data) )
+        {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        if ( storedType != type )
+        {
+            return ESP_ERR_NVS_TYPE_MISMATCH;
+        }
+
+        if ( out_value == nullptr )
+        {
+            *length = data.size();
+            return ESP_OK;
+        }
+
+        if ( *length < data.size() )
+        {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+
+        memcpy(out_value, data.data(), data.size() );
+        *length = data.size();
+
+        return ESP_OK;
+    }
+}
+
+esp_err_t nvs_flash_init()
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase()
+{
+    std::lock_guard<std::mutex> lock(nvsMutex);
+
+    std::string directory = getDirectory();
+
+    for ( const std::string &namespaceName : listDirectory(directory, true) )
+    {
+        for ( const std::string &key : listDirectory(directory + "/" + namespaceName, false) )
+        {
+            unlink( ( directory + "/" + namespaceName + "/" + key ).c_str() );
+        }
+
+        rmdir( ( directory + "/" + namespaceName ).c_str() );
+    }
+
+    usedEntries = SIZE_MAX;
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if ( name == nullptr || strlen(name) >= NVS_KEY_NAME_MAX_SIZE || out_handle == nullptr )
+    {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+
+    std::lock_guard<std::mutex> lock(nvsMutex);
+
+    std::string directory = getDirectory();
+    std::string root = directory.substr(0, directory.rfind('/') );
+
+    mkdir(root.c_str(), 0755);
+    mkdir(directory.c_str(), 0755);
+
+    if ( mkdir( ( directory + "/" + name ).c_str(), 0755) != 0 && errno != EEXIST )
+    {
+        return ESP_FAIL;
+    }
+
+    *out_handle = nextHandle++;
+    handles[*out_handle] = { name, open_mode == NVS_READWRITE };
+    usedEntries = SIZE_MAX;
+
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    handles.erase(handle);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return value != nullptr ? setEntry(handle, key, NVS_TYPE_STR, value, strlen(value) + 1) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return getEntry(handle, key, NVS_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return value != nullptr || length == 0 ? setEntry(handle, key, NVS_TYPE_BLOB, value, length) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return getEntry(handle, key, NVS_TYPE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    std::lock_guard<std::mutex> lock(nvsMutex);
+
+    Handle      *found;
+    esp_err_t   err = findHandle(handle, true, &found);
+
+    if ( err != ESP_OK )
+    {
+        return err;
+    }
+
+    if ( key == nullptr )
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    std::string path    = getPath(*found, key);
+    size_t      erased  = getFileEntries(path);
+
+    if ( unlink(path.c_str() ) != 0 )
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    usedEntries = getUsedEntries() - erased;
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    std::lock_guard<std::mutex> lock(nvsMutex);
+
+    Handle      *found;
+    esp_err_t   err = findHandle(handle, true, &found);
+
+    if ( err != ESP_OK )
+    {
+        return err;
+    }
+
+    std::string directory = getDirectory() + "/" + found->namespaceName;
+
+    for ( const std::string &key : listDirectory(directory, false) )
+    {
+        unlink( ( directory + "/" + key ).c_str() );
+    }
+
+    usedEntries = SIZE_MAX;
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    // every set is written right away
+    std::lock_guard<std::mutex> lock(nvsMutex);
+
+    Handle *found;
+
+    return findHandle(handle, false, &found);
+}
+
+esp_err_t nvs_get_stats(const char *part_name, nvs_stats_t *nvs_stats)
+{
+    (void) part_name;
+
+    if ( nvs_stats == nullptr )
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> lock(nvsMutex);
+
+    nvs_stats->total_entries    = getTotalEntries();
+    nvs_stats->used_entries     = getUsedEntries();
+    nvs_stats->free_entries     = nvs_stats->total_entries - std::min(nvs_stats->used_entries, nvs_stats->total_entries);
+    nvs_stats->namespace_count  = listDirectory(getDirectory(), true).size();
+
+    return ESP_OK;
+}
+
+nvs_iterator_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type)
+{
+    (void) part_name;
+
+    std::lock_guard<std::mutex> lock(nvsMutex);
+
+    std::string             directory   = getDirectory();
+    nvs_iterator_t          iterator    = new nvs_opaque_iterator_t();
+
+    iterator->index = 0;
+
+    for ( const std::string &namespaceName : listDirectory(directory, true) )
+    {
+        if ( namespace_name != nullptr && namespaceName != namespace_name )
+        {
+            continue;
+        }
+
+        for ( const std::string &key : listDirectory(directory + "/" + namespaceName, false) )
+        {
+            nvs_entry_info_t        info = {};
+            std::vector<uint8_t>    data;
+
+            if ( ! readEntry(directory + "/" + namespaceName + "/" + key, &info.type, data) || ( type != NVS_TYPE_ANY && info.type != type ) )
+            {
+                continue;
+            }
+
+            strncpy(info.namespace_name, namespaceName.c_str(), sizeof(info.namespace_name) - 1);
+            strncpy(info.key, key.c_str(), sizeof(info.key) - 1);
+
+            iterator->entries.push_back(info);
+        }
+    }
+
+    if ( iterator->entries.empty() )
+    {
+        delete iterator;
+        return nullptr;
+    }
+
+    return iterator;
+}
+
+nvs_iterator_t nvs_entry_next(nvs_iterator_t iterator)
+{
+    if ( iterator == nullptr || ++iterator->index >= iterator->entries.size() )
+    {
+        delete iterator;
+        return nullptr;
+    }
+
+    return iterator;
+}
+
+void nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t *out_info)
+{
+    *out_info = iterator->entries[iterator->index];
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator)
+{
+    delete iterator;
+}
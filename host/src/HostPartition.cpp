@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_partition.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG         = "host::Partition";
+    const char*     DEFAULT_ROOT    = "./host_vfs";
+    const uint32_t  BASE_ADDRESS    = 0x110000;
+
+    struct HostPartition
+    {
+        esp_partition_t         partition;
+        uint8_t*                data;           ///< the mapped backing file
+        std::vector<uint32_t>   eraseCounts;
+        int64_t                 writeLimit;
+    };
+
+    std::mutex                                      partitionMutex;
+    std::vector<std::unique_ptr<HostPartition>>     partitions;
+
+    std::string getRoot()
+    {
+        const char *root = getenv("HOST_VFS_ROOT");
+        return root != nullptr ? root : DEFAULT_ROOT;
+    }
+
+    HostPartition *findPartition(const esp_partition_t *partition)
+    {
+        for ( const auto &hostPartition : partitions )
+        {
+            if ( &hostPartition->partition == partition )
+            {
+                return hostPartition.get();
+            }
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Map the backing file of a partition, a new file is erased flash
+     */
+    uint8_t *mapFile(const char *label)
+    {
+        std::string directory = getRoot() + "/partitions";
+
+        ::mkdir(getRoot().c_str(), 0755);
+
+        if ( ::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST )
+        {
+            return nullptr;
+        }
+
+        std::string path    = directory + "/" + label + ".bin";
+        int         file    = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        struct stat fileStat;
+
+        if ( file < 0 || fstat(file, &fileStat) != 0 )
+        {
+            return nullptr;
+        }
+
+        bool created = fileStat.st_size != HOST_PARTITION_SIZE;
+
+        if ( created && ftruncate(file, HOST_PARTITION_SIZE) != 0 )
+        {
+            ::close(file);
+            return nullptr;
+        }
+
+        void *data = mmap(nullptr, HOST_PARTITION_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        ::close(file);
+
+        if ( data == MAP_FAILED )
+        {
+            return nullptr;
+        }
+
+        if ( created )
+        {
+            memset(data, 0xFF, HOST_PARTITION_SIZE);
+        }
+
+        return static_cast<uint8_t*>(data);
+    }
+
+    bool isInside(const esp_partition_t *partition, size_t offset, size_t size)
+    {
+        return partition != nullptr && offset <= partition->size && size <= partition->size - offset;
+    }
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    (void) subtype;
+
+    if ( type != ESP_PARTITION_TYPE_DATA || label == nullptr || strlen(label) >= sizeof(esp_partition_t::label) )
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(partitionMutex);
+
+    for ( const auto &hostPartition : partitions )
+    {
+        if ( strcmp(hostPartition->partition.label, label) == 0 )
+        {
+            return &hostPartition->partition;
+        }
+    }
+
+    uint8_t *data = mapFile(label);
+
+    if ( data == nullptr )
+    {
+        ESP_LOGE(LOG_TAG, "Failed to map the partition %s", label);
+        return nullptr;
+    }
+
+    std::unique_ptr<HostPartition> hostPartition(new HostPartition() );
+
+    hostPartition->partition.type       = ESP_PARTITION_TYPE_DATA;
+    hostPartition->partition.subtype    = subtype;
+    hostPartition->partition.address    = BASE_ADDRESS + static_cast<uint32_t>( partitions.size() ) * HOST_PARTITION_SIZE;
+    hostPartition->partition.size       = HOST_PARTITION_SIZE;
+    hostPartition->partition.encrypted  = false;
+    hostPartition->data                 = data;
+    hostPartition->writeLimit           = -1;
+    hostPartition->eraseCounts.resize(HOST_PARTITION_SIZE / SPI_FLASH_SEC_SIZE);
+
+    strcpy(hostPartition->partition.label, label);
+
+    partitions.push_back( std::move(hostPartition) );
+
+    return &partitions.back()->partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    std::lock_guard<std::mutex> lock(partitionMutex);
+
+    HostPartition *hostPartition = findPartition(partition);
+
+    if ( hostPartition == nullptr || dst == nullptr )
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if ( ! isInside(partition, src_offset, size) )
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(dst, hostPartition->data + src_offset, size);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    std::lock_guard<std::mutex> lock(partitionMutex);
+
+    HostPartition *hostPartition = findPartition(partition);
+
+    if ( hostPartition == nullptr || src == nullptr )
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if ( ! isInside(partition, dst_offset, size) )
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t written = size;
+
+    if ( hostPartition->writeLimit >= 0 && static_cast<int64_t>(size) > hostPartition->writeLimit )
+    {
+        written = static_cast<size_t>(hostPartition->writeLimit);
+    }
+
+    // programming can only clear bits
+    const uint8_t *bytes = static_cast<const uint8_t*>(src);
+
+    for ( size_t index = 0; index < written; index++ )
+    {
+        hostPartition->data[dst_offset + index] &= bytes[index];
+    }
+
+    if ( hostPartition->writeLimit >= 0 )
+    {
+        hostPartition->writeLimit -= static_cast<int64_t>(written);
+    }
+
+    return written == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    std::lock_guard<std::mutex> lock(partitionMutex);
+
+    HostPartition *hostPartition = findPartition(partition);
+
+    if ( hostPartition == nullptr )
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if ( ! isInside(partition, offset, size) || offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0 )
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // a cut off power also stops an erase
+    if ( hostPartition->writeLimit == 0 )
+    {
+        return ESP_FAIL;
+    }
+
+    memset(hostPartition->data + offset, 0xFF, size);
+
+    for ( size_t sector = offset / SPI_FLASH_SEC_SIZE; sector < ( offset + size ) / SPI_FLASH_SEC_SIZE; sector++ )
+    {
+        hostPartition->eraseCounts[sector]++;
+    }
+
+    return ESP_OK;
+}
+
+uint32_t host_partition_get_erase_count(const esp_partition_t *partition, size_t sector)
+{
+    std::lock_guard<std::mutex> lock(partitionMutex);
+
+    HostPartition *hostPartition = findPartition(partition);
+
+    return hostPartition != nullptr && sector < hostPartition->eraseCounts.size() ? hostPartition->eraseCounts[sector] : 0;
+}
+
+void host_partition_set_write_limit(const esp_partition_t *partition, int64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(partitionMutex);
+
+    HostPartition *hostPartition = findPartition(partition);
+
+    if ( hostPartition != nullptr )
+    {
+        hostPartition->writeLimit = bytes;
+    }
+}
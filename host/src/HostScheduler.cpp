@@ -0,0 +1,447 @@
+#include "HostFiber.h"
+#include "HostTask.h"
+#include "HostScheduler.h"
+
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <thread>
+
+extern "C"
+{
+    #include "esp_log.h"
+}
+
+namespace
+{
+    const char*         LOG_TAG = "host::Scheduler";
+
+    thread_local bool   onSchedulerThread = false;
+}
+
+enum class FiberState
+{
+    Ready,
+    Running,
+    Waiting,
+    Finished
+};
+
+struct HostFiber
+{
+    ucontext_t                                              context;
+    TaskHandle_t                                            task;
+    TaskFunction_t                                          function;
+    void*                                                   parameter;
+    void*                                                   stack;
+    size_t                                                  stackSize;
+    FiberState                                              state;
+    uint64_t                                                waitToken;
+    bool                                                    sleeping;
+    std::multimap<HostClock::time_point, HostFiber*>::iterator  sleeper;
+};
+
+namespace
+{
+    /**
+     * @brief The Scheduler class runs all fibers on one thread
+     */
+    class Scheduler
+    {
+        public:
+
+            static Scheduler& getInstance()
+            {
+                // never destroyed, fibers may run until the process exits
+                static Scheduler *instance = new Scheduler();
+                return *instance;
+            }
+
+            void start()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                if ( _running )
+                {
+                    return;
+                }
+
+                _epoll      = epoll_create1(EPOLL_CLOEXEC);
+                _eventFD    = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+                epoll_event event = {};
+                event.events    = EPOLLIN;
+                event.data.fd   = _eventFD;
+                epoll_ctl(_epoll, EPOLL_CTL_ADD, _eventFD, &event);
+
+                _running = true;
+                std::thread(&Scheduler::run, this).detach();
+            }
+
+            bool isRunning()
+            {
+                return _running.load();
+            }
+
+            bool create(TaskHandle_t task, TaskFunction_t function, void *parameter, size_t stackSize)
+            {
+                long pageSize = sysconf(_SC_PAGESIZE);
+                stackSize = ( stackSize + pageSize - 1 ) / pageSize * pageSize;
+
+                // the lowest page is a guard page, the rest is only committed when touched
+                void *stack = mmap(nullptr, stackSize + pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+
+                if ( stack == MAP_FAILED )
+                {
+                    ESP_LOGE(LOG_TAG, "Failed to map fiber stack (%s)", strerror(errno) );
+                    return false;
+                }
+
+                mprotect(stack, pageSize, PROT_NONE);
+
+                HostFiber *fiber    = new HostFiber();
+                fiber->task         = task;
+                fiber->function     = function;
+                fiber->parameter    = parameter;
+                fiber->stack        = stack;
+                fiber->stackSize    = stackSize + pageSize;
+                fiber->state        = FiberState::Ready;
+                fiber->waitToken    = 0;
+                fiber->sleeping     = false;
+
+                getcontext(&fiber->context);
+                fiber->context.uc_stack.ss_sp   = static_cast<char*>(stack) + pageSize;
+                fiber->context.uc_stack.ss_size = stackSize;
+                fiber->context.uc_link          = nullptr;
+                makecontext(&fiber->context, &Scheduler::fiberEntry, 0);
+
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                _fiberCount++;
+                _stackBytes += fiber->stackSize;
+                _ready.push_back(fiber);
+
+                signal();
+
+                return true;
+            }
+
+            HostFiber* current()
+            {
+                // fibers only run on the scheduler thread
+                return onSchedulerThread ? _current : nullptr;
+            }
+
+            uint64_t prepareWait(HostFiber *fiber)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                fiber->state = FiberState::Waiting;
+
+                return ++fiber->waitToken;
+            }
+
+            void block(HostFiber *fiber, HostClock::time_point deadline)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+
+                    // a wake-up may already have made the fiber ready again
+                    if ( fiber->state == FiberState::Waiting && deadline != HostClock::time_point::max() )
+                    {
+                        fiber->sleeper  = _sleepers.emplace(deadline, fiber);
+                        fiber->sleeping = true;
+                    }
+                }
+
+                switchToScheduler(fiber);
+            }
+
+            void wake(HostFiber *fiber, uint64_t token)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                if ( fiber->state != FiberState::Waiting || fiber->waitToken != token )
+                {
+                    return;
+                }
+
+                makeReady(fiber);
+                signal();
+            }
+
+            void yield(HostFiber *fiber)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    fiber->state = FiberState::Ready;
+                    _ready.push_back(fiber);
+                }
+
+                switchToScheduler(fiber);
+            }
+
+            void sleepUntil(HostFiber *fiber, HostClock::time_point deadline)
+            {
+                prepareWait(fiber);
+                block(fiber, deadline);
+            }
+
+            [[noreturn]] void finish(HostFiber *fiber)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    fiber->state = FiberState::Finished;
+                }
+
+                switchToScheduler(fiber);
+
+                // a finished fiber is never resumed
+                abort();
+            }
+
+            void getStatistics(host_scheduler_stats_t *stats)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                stats->fibers           = _fiberCount;
+                stats->contextSwitches  = _contextSwitches;
+                stats->wakeups          = _wakeups;
+                stats->stackBytes       = _stackBytes;
+            }
+
+        private:
+
+            Scheduler()
+            {
+
+            }
+
+            static void fiberEntry()
+            {
+                HostFiber *fiber = getInstance()._current;
+
+                fiber->function(fiber->parameter);
+
+                ESP_LOGE(LOG_TAG, "task %s returned from its task function", pcTaskGetTaskName(fiber->task) );
+                abort();
+            }
+
+            // called with _mutex held
+            void makeReady(HostFiber *fiber)
+            {
+                if ( fiber->sleeping )
+                {
+                    _sleepers.erase(fiber->sleeper);
+                    fiber->sleeping = false;
+                }
+
+                fiber->state = FiberState::Ready;
+                fiber->waitToken++;
+                _ready.push_back(fiber);
+            }
+
+            // called with _mutex held
+            void signal()
+            {
+                // the scheduler thread itself looks at the ready queue before it waits again
+                if ( onSchedulerThread )
+                {
+                    return;
+                }
+
+                uint64_t one = 1;
+
+                if ( write(_eventFD, &one, sizeof(one) ) < 0 && errno != EAGAIN )
+                {
+                    ESP_LOGE(LOG_TAG, "eventfd write failed (%s)", strerror(errno) );
+                }
+            }
+
+            void switchToScheduler(HostFiber *fiber)
+            {
+                swapcontext(&fiber->context, &_schedulerContext);
+
+                // resumed by the scheduler
+                hostTaskSetCurrent(fiber->task);
+            }
+
+            void run()
+            {
+                onSchedulerThread   = true;
+                TaskHandle_t schedulerTask = hostTaskAdopt("host_scheduler");
+
+                epoll_event events[4];
+
+                while ( true )
+                {
+                    HostFiber *fiber = nullptr;
+                    int timeout = -1;
+
+                    {
+                        std::lock_guard<std::mutex> lock(_mutex);
+
+                        HostClock::time_point now = HostClock::now();
+
+                        while ( ! _sleepers.empty() && _sleepers.begin()->first <= now )
+                        {
+                            makeReady(_sleepers.begin()->second);
+                        }
+
+                        if ( ! _ready.empty() )
+                        {
+                            fiber = _ready.front();
+                            _ready.pop_front();
+
+                            fiber->state = FiberState::Running;
+                            _current = fiber;
+                            _contextSwitches++;
+                        }
+                        else if ( ! _sleepers.empty() )
+                        {
+                            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(_sleepers.begin()->first - now).count() + 1;
+                            timeout = static_cast<int>( std::min<long long>(wait, 60000) );
+                        }
+                    }
+
+                    if ( fiber == nullptr )
+                    {
+                        int count = epoll_wait(_epoll, events, 4, timeout);
+
+                        if ( count > 0 )
+                        {
+                            uint64_t value;
+
+                            while ( read(_eventFD, &value, sizeof(value) ) > 0 )
+                            {
+
+                            }
+                        }
+
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _wakeups++;
+
+                        continue;
+                    }
+
+                    hostTaskSetCurrent(fiber->task);
+                    swapcontext(&_schedulerContext, &fiber->context);
+                    hostTaskSetCurrent(schedulerTask);
+
+                    std::lock_guard<std::mutex> lock(_mutex);
+
+                    _current = nullptr;
+
+                    if ( fiber->state == FiberState::Finished )
+                    {
+                        // the task control block stays allocated, other tasks may still hold the handle
+                        munmap(fiber->stack, fiber->stackSize);
+
+                        _fiberCount--;
+                        _stackBytes -= fiber->stackSize;
+
+                        delete fiber;
+                    }
+                }
+            }
+
+        private:
+
+            std::mutex                                          _mutex;
+            std::atomic<bool>                                   _running = { false };
+            int                                                 _epoll = { -1 };
+            int                                                 _eventFD = { -1 };
+            ucontext_t                                          _schedulerContext;
+            HostFiber*                                          _current = { nullptr };
+            std::deque<HostFiber*>                              _ready;
+            std::multimap<HostClock::time_point, HostFiber*>    _sleepers;
+            uint32_t                                            _fiberCount = { 0 };
+            uint64_t                                            _contextSwitches = { 0 };
+            uint64_t                                            _wakeups = { 0 };
+            size_t                                              _stackBytes = { 0 };
+    };
+}
+
+bool hostFiberCreate(TaskHandle_t task, TaskFunction_t function, void *parameter, size_t stackSize)
+{
+    return Scheduler::getInstance().create(task, function, parameter, stackSize);
+}
+
+HostFiber *hostFiberCurrent()
+{
+    if ( ! Scheduler::getInstance().isRunning() )
+    {
+        return nullptr;
+    }
+
+    return Scheduler::getInstance().current();
+}
+
+uint64_t hostFiberPrepareWait(HostFiber *fiber)
+{
+    return Scheduler::getInstance().prepareWait(fiber);
+}
+
+void hostFiberBlock(HostFiber *fiber, HostClock::time_point deadline)
+{
+    Scheduler::getInstance().block(fiber, deadline);
+}
+
+void hostFiberWake(HostFiber *fiber, uint64_t token)
+{
+    Scheduler::getInstance().wake(fiber, token);
+}
+
+void hostFiberYield()
+{
+    HostFiber *fiber = hostFiberCurrent();
+
+    if ( fiber == nullptr )
+    {
+        std::this_thread::yield();
+        return;
+    }
+
+    Scheduler::getInstance().yield(fiber);
+}
+
+void hostFiberSleepUntil(HostClock::time_point deadline)
+{
+    HostFiber *fiber = hostFiberCurrent();
+
+    if ( fiber == nullptr )
+    {
+        std::this_thread::sleep_until(deadline);
+        return;
+    }
+
+    Scheduler::getInstance().sleepUntil(fiber, deadline);
+}
+
+void hostFiberExit()
+{
+    Scheduler::getInstance().finish(hostFiberCurrent() );
+}
+
+void host_scheduler_start()
+{
+    Scheduler::getInstance().start();
+}
+
+int host_scheduler_is_running()
+{
+    return Scheduler::getInstance().isRunning() ? 1 : 0;
+}
+
+void host_scheduler_get_stats(host_scheduler_stats_t *stats)
+{
+    Scheduler::getInstance().getStatistics(stats);
+}
@@ -0,0 +1,38 @@
+#ifndef HOSTTASK_H
+#define HOSTTASK_H
+
+#include <stdint.h>
+
+extern "C"
+{
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+}
+
+/*
+ * Internal helpers of the host shims.
+ */
+
+#ifndef HOST_TASK_MIN_STACK_SIZE
+    #define HOST_TASK_MIN_STACK_SIZE    ( 64 * 1024 )
+#endif
+
+/**
+ * @brief Name the calling thread as FreeRTOS task, used by shim threads that are not created with xTaskCreate()
+ * @param name  the task name
+ * @return  the task handle of the calling thread
+ */
+TaskHandle_t    hostTaskAdopt(const char *name);
+
+/**
+ * @brief Set the task handle of the calling thread, used by the scheduler when it switches between fibers
+ * @param task  the task handle
+ */
+void            hostTaskSetCurrent(TaskHandle_t task);
+
+/**
+ * @brief Microseconds since the process started
+ */
+int64_t         hostMonotonicMicroseconds(void);
+
+#endif
@@ -0,0 +1,427 @@
+#define HOST_VFS_IMPLEMENTATION
+
+#include "HostVFS.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_spiffs.h"
+    #include "esp_littlefs.h"
+}
+
+namespace
+{
+    const char*     LOG_TAG         = "host::VFS";
+    const char*     DEFAULT_ROOT    = "./host_vfs";
+
+    std::mutex                  mountMutex;
+    std::vector<std::string>    mountPoints;
+
+    // base paths of the registered SPIFFS and LittleFS partitions
+    std::string                 spiffsBasePath;
+    std::string                 littlefsBasePath;
+
+    std::atomic<int>            syncFailures = { 0 };
+
+    std::string getRoot()
+    {
+        const char *root = getenv("HOST_VFS_ROOT");
+        return root != nullptr ? root : DEFAULT_ROOT;
+    }
+
+    bool isBelow(const std::string &path, const std::string &basePath)
+    {
+        return path.compare(0, basePath.size(), basePath) == 0 && ( path.size() == basePath.size() || path[basePath.size()] == '/' );
+    }
+
+    bool isRedirected(const char *path)
+    {
+        std::lock_guard<std::mutex> lock(mountMutex);
+
+        for ( const std::string &mountPoint : mountPoints )
+        {
+            if ( isBelow(path, mountPoint) )
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    int createDirectories(const std::string &path)
+    {
+        for ( size_t separator = path.find('/', 1); ; separator = path.find('/', separator + 1) )
+        {
+            std::string directory = path.substr(0, separator);
+
+            if ( ::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST )
+            {
+                return -1;
+            }
+
+            if ( separator == std::string::npos )
+            {
+                return 0;
+            }
+        }
+    }
+
+    size_t usedBytes(const std::string &directoryPath)
+    {
+        DIR *directory = ::opendir(directoryPath.c_str() );
+
+        if ( directory == nullptr )
+        {
+            return 0;
+        }
+
+        size_t used = 0;
+        struct dirent *entry;
+
+        while ( ( entry = readdir(directory) ) != nullptr )
+        {
+            if ( strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 )
+            {
+                continue;
+            }
+
+            std::string entryPath = directoryPath + "/" + entry->d_name;
+            struct stat entryStat;
+
+            if ( ::stat(entryPath.c_str(), &entryStat) != 0 )
+            {
+                continue;
+            }
+
+            used += S_ISDIR(entryStat.st_mode) ? usedBytes(entryPath) : static_cast<size_t>(entryStat.st_size);
+        }
+
+        closedir(directory);
+
+        return used;
+    }
+
+    void removeFiles(const std::string &directoryPath)
+    {
+        DIR *directory = ::opendir(directoryPath.c_str() );
+
+        if ( directory == nullptr )
+        {
+            return;
+        }
+
+        struct dirent *entry;
+
+        while ( ( entry = readdir(directory) ) != nullptr )
+        {
+            if ( strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 )
+            {
+                continue;
+            }
+
+            std::string entryPath = directoryPath + "/" + entry->d_name;
+            struct stat entryStat;
+
+            if ( ::stat(entryPath.c_str(), &entryStat) == 0 && S_ISDIR(entryStat.st_mode) )
+            {
+                removeFiles(entryPath);
+                ::rmdir(entryPath.c_str() );
+            }
+            else
+            {
+                ::unlink(entryPath.c_str() );
+            }
+        }
+
+        closedir(directory);
+    }
+}
+
+int host_vfs_mount(const char *basePath)
+{
+    if ( basePath == nullptr || basePath[0] != '/' )
+    {
+        return -1;
+    }
+
+    std::string hostPath = getRoot() + basePath;
+
+    if ( createDirectories(hostPath) != 0 )
+    {
+        ESP_LOGE(LOG_TAG, "Failed to create %s (%s)", hostPath.c_str(), strerror(errno) );
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mountMutex);
+
+    if ( std::find(mountPoints.begin(), mountPoints.end(), basePath) == mountPoints.end() )
+    {
+        mountPoints.push_back(basePath);
+    }
+
+    return 0;
+}
+
+int host_vfs_unmount(const char *basePath)
+{
+    std::lock_guard<std::mutex> lock(mountMutex);
+
+    auto mountPoint = std::find(mountPoints.begin(), mountPoints.end(), basePath);
+
+    if ( mountPoint == mountPoints.end() )
+    {
+        return -1;
+    }
+
+    mountPoints.erase(mountPoint);
+
+    return 0;
+}
+
+int host_vfs_is_mounted(const char *basePath)
+{
+    std::lock_guard<std::mutex> lock(mountMutex);
+    return std::find(mountPoints.begin(), mountPoints.end(), basePath) != mountPoints.end();
+}
+
+const char *host_vfs_path(const char *path)
+{
+    static thread_local std::string hostPath;
+
+    if ( path == nullptr || ! isRedirected(path) )
+    {
+        return path;
+    }
+
+    hostPath = getRoot() + path;
+
+    return hostPath.c_str();
+}
+
+size_t host_vfs_used_bytes(const char *basePath)
+{
+    return usedBytes(getRoot() + basePath);
+}
+
+int host_vfs_format(const char *basePath)
+{
+    removeFiles(getRoot() + basePath);
+    return 0;
+}
+
+FILE *host_vfs_fopen(const char *path, const char *mode)
+{
+    return ::fopen(host_vfs_path(path), mode);
+}
+
+int host_vfs_stat(const char *path, struct stat *buffer)
+{
+    return ::stat(host_vfs_path(path), buffer);
+}
+
+int host_vfs_unlink(const char *path)
+{
+    return ::unlink(host_vfs_path(path) );
+}
+
+int host_vfs_rename(const char *oldPath, const char *newPath)
+{
+    // host_vfs_path() returns a thread local buffer, so keep a copy of the first path
+    std::string hostOldPath = host_vfs_path(oldPath);
+
+    return ::rename(hostOldPath.c_str(), host_vfs_path(newPath) );
+}
+
+int host_vfs_mkdir(const char *path, mode_t mode)
+{
+    return ::mkdir(host_vfs_path(path), mode);
+}
+
+int host_vfs_rmdir(const char *path)
+{
+    return ::rmdir(host_vfs_path(path) );
+}
+
+DIR *host_vfs_opendir(const char *path)
+{
+    return ::opendir(host_vfs_path(path) );
+}
+
+int host_vfs_fsync(int fd)
+{
+    int failures = syncFailures.load();
+
+    while ( failures > 0 )
+    {
+        if ( syncFailures.compare_exchange_weak(failures, failures - 1) )
+        {
+            errno = EIO;
+            return -1;
+        }
+    }
+
+    return ::fsync(fd);
+}
+
+void host_vfs_set_sync_failures(int count)
+{
+    syncFailures = count;
+}
+
+/*
+ * SPIFFS
+ */
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf)
+{
+    if ( conf == nullptr || conf->base_path == nullptr )
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if ( ! spiffsBasePath.empty() )
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if ( host_vfs_mount(conf->base_path) != 0 )
+    {
+        return ESP_FAIL;
+    }
+
+    spiffsBasePath = conf->base_path;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_spiffs_unregister(const char *partition_label)
+{
+    (void) partition_label;
+
+    if ( spiffsBasePath.empty() )
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    host_vfs_unmount(spiffsBasePath.c_str() );
+    spiffsBasePath.clear();
+
+    return ESP_OK;
+}
+
+bool esp_spiffs_mounted(const char *partition_label)
+{
+    (void) partition_label;
+    return ! spiffsBasePath.empty();
+}
+
+esp_err_t esp_spiffs_format(const char *partition_label)
+{
+    (void) partition_label;
+
+    if ( spiffsBasePath.empty() )
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return host_vfs_format(spiffsBasePath.c_str() ) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_spiffs_info(const char *partition_label, size_t *total_bytes, size_t *used_bytes)
+{
+    (void) partition_label;
+
+    if ( spiffsBasePath.empty() )
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    *total_bytes    = HOST_SPIFFS_PARTITION_SIZE;
+    *used_bytes     = host_vfs_used_bytes(spiffsBasePath.c_str() );
+
+    return ESP_OK;
+}
+
+/*
+ * LittleFS
+ */
+
+esp_err_t esp_vfs_littlefs_register(const esp_vfs_littlefs_conf_t *conf)
+{
+    if ( conf == nullptr || conf->base_path == nullptr )
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if ( ! littlefsBasePath.empty() )
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if ( host_vfs_mount(conf->base_path) != 0 )
+    {
+        return ESP_FAIL;
+    }
+
+    littlefsBasePath = conf->base_path;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_littlefs_unregister(const char *partition_label)
+{
+    (void) partition_label;
+
+    if ( littlefsBasePath.empty() )
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    host_vfs_unmount(littlefsBasePath.c_str() );
+    littlefsBasePath.clear();
+
+    return ESP_OK;
+}
+
+bool esp_littlefs_mounted(const char *partition_label)
+{
+    (void) partition_label;
+    return ! littlefsBasePath.empty();
+}
+
+esp_err_t esp_littlefs_format(const char *partition_label)
+{
+    (void) partition_label;
+
+    if ( littlefsBasePath.empty() )
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return host_vfs_format(littlefsBasePath.c_str() ) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_littlefs_info(const char *partition_label, size_t *total_bytes, size_t *used_bytes)
+{
+    (void) partition_label;
+
+    if ( littlefsBasePath.empty() )
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    *total_bytes    = HOST_LITTLEFS_PARTITION_SIZE;
+    *used_bytes     = host_vfs_used_bytes(littlefsBasePath.c_str() );
+
+    return ESP_OK;
+}
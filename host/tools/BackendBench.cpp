@@ -0,0 +1,129 @@
+/*
+ * Storage backend benchmark
+ *
+ * Runs the StorageBenchmark, the same one a device firmware can run, against every storage backend: the mount
+ * time, the write throughput and latency of small files with the stalls among them, and the latency of opening
+ * and reading a small file, with the backend filled to a given percentage:
+ *
+ *   quickhub_backend_bench --writes 2000 --files 16 --size 64 --fill 50
+ *
+ * On the host all backends are stand-ins on the host file system, so the numbers compare the work of the
+ * backend classes rather than the flash; run the StorageBenchmark on the device to choose the backend of a
+ * product. The files are created below HOST_VFS_ROOT (default ./host_vfs) and deleted at the end.
+ */
+
+#include "StorageBackend.h"
+#include "StorageBenchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "HostVFS.h"
+}
+
+using namespace _2log;
+
+namespace
+{
+    const char*     MOUNT_POINT = "/bench";
+
+    const StorageBackendType BACKENDS[] =
+    {
+        StorageBackendType::Spiffs,
+        StorageBackendType::LittleFs,
+        StorageBackendType::Nvs,
+        StorageBackendType::Posix
+    };
+
+    void printUsage(const char *program)
+    {
+        printf("Usage: %s [options]\n"
+               "  --writes N             number of small file writes (default 1000)\n"
+               "  --reads N              number of small file reads (default 1000)\n"
+               "  --files N              number of distinct small files (default 16)\n"
+               "  --size N               size of a small file in bytes (default 64)\n"
+               "  --fill N               used space before the writes in percent (default 50)\n", program);
+    }
+
+    bool parseOptions(int argc, char *argv[], StorageBenchmark::Options &options)
+    {
+        for ( int i = 1; i < argc; i++ )
+        {
+            if ( i + 1 >= argc )
+            {
+                return false;
+            }
+
+            const char *name    = argv[i];
+            const char *value   = argv[++i];
+
+            if ( strcmp(name, "--writes") == 0 )            options.writes      = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--reads") == 0 )        options.reads       = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--files") == 0 )        options.files       = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--size") == 0 )         options.fileSize    = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--fill") == 0 )         options.fillPercent = static_cast<uint8_t>( strtoul(value, nullptr, 10) );
+            else
+            {
+                return false;
+            }
+        }
+
+        return options.writes > 0 && options.files > 0 && options.fileSize > 0 && options.fillPercent <= 95;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    StorageBenchmark::Options options;
+
+    if ( ! parseOptions(argc, argv, options) )
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    printf("%-9s %9s %9s %5s %9s %8s %8s %8s %7s %8s %8s\n", "backend", "mount_us", "remount", "used", "writes/s",
+           "w_p50", "w_p99", "w_max", "stalls", "r_p50", "r_p99");
+
+    for ( StorageBackendType type : BACKENDS )
+    {
+        std::unique_ptr<StorageBackend> backend( StorageBackend::create(type) );
+        StorageBenchmark::Result        result;
+
+        // the file system of a POSIX backend is registered by the application
+        if ( type == StorageBackendType::Posix )
+        {
+            host_vfs_mount(MOUNT_POINT);
+        }
+
+        bool success = backend != nullptr && StorageBenchmark::run(*backend, MOUNT_POINT, options, result);
+
+        if ( type == StorageBackendType::Posix )
+        {
+            host_vfs_unmount(MOUNT_POINT);
+        }
+
+        if ( ! success )
+        {
+            printf("%-9s not available\n", StorageBackend::getTypeName(type) );
+            continue;
+        }
+
+        printf("%-9s %9u %9u %4u%% %9u %8u %8u %8u %7u %8u %8u\n", StorageBackend::getTypeName(type), result.mountTime,
+               result.remountTime, result.usedPercent, result.writesPerSecond, result.writeP50, result.writeP99, result.writeMax,
+               result.stalls, result.readP50, result.readP99);
+
+        printf("RESULT backend=%s mount_us=%u writes_per_s=%u write_p99_us=%u write_max_us=%u stalls=%u read_p99_us=%u failures=%u\n",
+               StorageBackend::getTypeName(type), result.mountTime, result.writesPerSecond, result.writeP99, result.writeMax,
+               result.stalls, result.readP99, result.failures);
+    }
+
+    return 0;
+}
@@ -0,0 +1,371 @@
+/*
+ * Control latency benchmark
+ *
+ * Saturates a Connection with property updates over a link of limited bandwidth while the peer pings, and
+ * prints the percentiles of the ping to pong round trip:
+ *
+ *   quickhub_control_latency_bench --duration 5000 --bandwidth 50000 --payload 200
+ *
+ * It runs three times: with the lanes in SchedulingMode::Strict and Weighted, the telemetry on the State and
+ * Bulk lanes, and with the telemetry on the Control lane, where the pongs wait behind the telemetry backlog
+ * like in a single outbound queue. The peer sleeps for the link time of every frame it receives, so the sender
+ * task can not write faster than the bandwidth allows and the lanes stay full.
+ */
+
+#include "Connection.h"
+
+#include <cJSON.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace _2log;
+using IDFix::Protocols::WebSocket;
+
+namespace
+{
+    const char*     URL     = "ws://bench/control_latency";
+
+    struct Options
+    {
+        uint32_t    duration        = { 3000 };
+        uint32_t    bandwidth       = { 50000 };
+        uint32_t    payload         = { 200 };
+        uint32_t    pingInterval    = { 50 };
+        uint32_t    laneLimit       = { 16384 };
+    };
+
+    struct Result
+    {
+        uint32_t    pings;
+        uint32_t    lostPings;
+        uint32_t    p50;
+        uint32_t    p90;
+        uint32_t    p99;
+        uint32_t    max;
+        double      telemetryBytesPerSecond;
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @brief Answers the registration, takes the link time of every frame and times the pongs
+     */
+    class Peer : public IDFix::Protocols::WebSocketPeer
+    {
+        public:
+
+            explicit Peer(uint32_t bandwidth) : _bandwidth(bandwidth)
+            {
+
+            }
+
+            void peerConnected(WebSocket *socket) override
+            {
+                _socket = socket;
+            }
+
+            void peerDisconnected(WebSocket *) override
+            {
+                _socket = nullptr;
+            }
+
+            void peerMessageReceived(WebSocket *socket, const char *data, int length) override
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds( static_cast<uint64_t>(length) * 1000000 / _bandwidth ) );
+
+                std::string message(data, static_cast<size_t>(length) );
+
+                if ( message.find("connection:register") != std::string::npos )
+                {
+                    const char *reply = "{\"command\":\"connection:registered\",\"uuid\":0}";
+                    socket->deliverBinaryMessage(reply, static_cast<int>( strlen(reply) ) );
+                }
+                else if ( message.find("\"pong\"") != std::string::npos )
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+
+                    if ( _pingPending )
+                    {
+                        _latencies.push_back( static_cast<uint32_t>( std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - _pingSent).count() ) );
+                        _pingPending = false;
+                    }
+                }
+                else
+                {
+                    telemetryBytes += static_cast<uint64_t>(length);
+                }
+            }
+
+            /**
+             * @brief Send a ping unless the last one is still unanswered, after a second it is counted as lost
+             * @return  \c true if a ping was sent
+             */
+            bool ping()
+            {
+                const char *ping = "{\"command\":\"ping\"}";
+
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                WebSocket *socket = _socket;
+
+                if ( _pingPending && Clock::now() - _pingSent > std::chrono::seconds(1) )
+                {
+                    // the pong was rejected by a full lane
+                    lostPings++;
+                    _pingPending = false;
+                }
+
+                if ( _pingPending || socket == nullptr )
+                {
+                    return false;
+                }
+
+                _pingPending    = true;
+                _pingSent       = Clock::now();
+
+                return socket->deliverBinaryMessage(ping, static_cast<int>( strlen(ping) ) );
+            }
+
+            std::vector<uint32_t> takeLatencies()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                std::vector<uint32_t> latencies;
+                latencies.swap(_latencies);
+                _pingPending = false;
+
+                return latencies;
+            }
+
+        public:
+
+            std::atomic<uint64_t>   telemetryBytes = { 0 };
+            std::atomic<uint32_t>   lostPings = { 0 };
+
+        private:
+
+            uint32_t                _bandwidth;
+            std::atomic<WebSocket*> _socket = { nullptr };
+            std::mutex              _mutex;
+            bool                    _pingPending = { false };
+            Clock::time_point       _pingSent;
+            std::vector<uint32_t>   _latencies;
+    };
+
+    class Events : public ConnectionEventHandler
+    {
+        public:
+
+            void connected() override
+            {
+                isConnected = true;
+            }
+
+            void disconnected() override
+            {
+                isConnected = false;
+            }
+
+            void jsonReceived(const cJSON *) override
+            {
+
+            }
+
+        public:
+
+            std::atomic<bool>   isConnected = { false };
+    };
+
+    bool waitFor(std::atomic<bool> &flag, bool value)
+    {
+        for ( int i = 0; i < 5000 && flag != value; i++ )
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1) );
+        }
+
+        return flag == value;
+    }
+
+    uint32_t percentile(const std::vector<uint32_t> &sorted, uint32_t percent)
+    {
+        return sorted.empty() ? 0 : sorted[ ( sorted.size() - 1 ) * percent / 100 ];
+    }
+
+    /**
+     * @brief Run the telemetry and the pings for the duration
+     * @param mode          the scheduling mode of the lanes
+     * @param singleQueue   \c true to send the telemetry on the Control lane
+     */
+    Result run(const Options &options, Connection::SchedulingMode mode, bool singleQueue)
+    {
+        Peer                peer(options.bandwidth);
+        Events              events;
+        std::atomic<bool>   running = { true };
+        Result              result = {};
+
+        WebSocket::registerPeer(URL, &peer);
+
+        Connection *connection = new Connection(URL);
+
+        connection->setConnectionEventHandler(&events);
+        connection->setSchedulingMode(mode);
+
+        for ( size_t lane = 0; lane < Connection::LANE_COUNT; lane++ )
+        {
+            connection->setLaneLimit(static_cast<SendPriority>(lane), options.laneLimit);
+        }
+
+        if ( ! connection->connect() || ! waitFor(events.isConnected, true) )
+        {
+            printf("the connection was not registered\n");
+            exit(1);
+        }
+
+        cJSON *payload = cJSON_CreateObject();
+        cJSON_AddNumberToObject(payload, "id", 1);
+        cJSON_AddStringToObject(payload, "value", std::string(options.payload, 'x').c_str() );
+
+        std::thread producer([&]()
+        {
+            for ( uint32_t index = 0; running; index++ )
+            {
+                SendPriority lane = singleQueue ? SendPriority::Control : ( index % 2 == 0 ? SendPriority::State : SendPriority::Bulk );
+
+                if ( connection->sendPayloadAsync(payload, nullptr, lane) != SendStatus::Queued )
+                {
+                    // back off like a producer that waits for room
+                    std::this_thread::sleep_for(std::chrono::microseconds(200) );
+                }
+            }
+        });
+
+        // let the lanes fill up before the first ping
+        std::this_thread::sleep_for(std::chrono::milliseconds(200) );
+
+        uint64_t            startBytes  = peer.telemetryBytes;
+        Clock::time_point   start       = Clock::now();
+        Clock::time_point   end         = start + std::chrono::milliseconds(options.duration);
+
+        while ( Clock::now() < end )
+        {
+            if ( peer.ping() )
+            {
+                result.pings++;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.pingInterval) );
+        }
+
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        result.telemetryBytesPerSecond = ( peer.telemetryBytes - startBytes ) / seconds;
+
+        running = false;
+        producer.join();
+
+        // the pong of the last ping and the telemetry before it
+        for ( int i = 0; i < 5000 && connection->getBacklogSize() > 0; i++ )
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1) );
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10) );
+
+        // the disconnect is handled on the WebSocket task, it must be done before the destruction
+        connection->disconnect();
+        waitFor(events.isConnected, false);
+
+        delete connection;
+        cJSON_Delete(payload);
+
+        WebSocket::registerPeer(URL, nullptr);
+
+        std::vector<uint32_t> latencies = peer.takeLatencies();
+        std::sort(latencies.begin(), latencies.end() );
+
+        result.lostPings    = peer.lostPings;
+        result.p50          = percentile(latencies, 50);
+        result.p90          = percentile(latencies, 90);
+        result.p99          = percentile(latencies, 99);
+        result.max          = latencies.empty() ? 0 : latencies.back();
+
+        return result;
+    }
+
+    void printResult(const char *name, const Result &result)
+    {
+        printf("%-10s %8u %8u %10.1f %10.1f %10.1f %10.1f %14.0f\n", name, result.pings, result.lostPings, result.p50 / 1000.0,
+               result.p90 / 1000.0, result.p99 / 1000.0, result.max / 1000.0, result.telemetryBytesPerSecond);
+    }
+
+    void printUsage(const char *program)
+    {
+        printf("Usage: %s [options]\n"
+               "  --duration MS          measured time per scheduling mode (default 3000)\n"
+               "  --bandwidth N          link capacity in bytes per second (default 50000)\n"
+               "  --payload N            size of the string of a telemetry payload (default 200)\n"
+               "  --ping-interval MS     time between two pings (default 50)\n"
+               "  --lane-limit N         backlog limit of every lane in bytes (default 16384)\n", program);
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        for ( int i = 1; i < argc; i++ )
+        {
+            if ( i + 1 >= argc )
+            {
+                return false;
+            }
+
+            const char *name    = argv[i];
+            const char *value   = argv[++i];
+
+            if ( strcmp(name, "--duration") == 0 )              options.duration        = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--bandwidth") == 0 )        options.bandwidth       = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--payload") == 0 )          options.payload         = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--ping-interval") == 0 )    options.pingInterval    = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--lane-limit") == 0 )       options.laneLimit       = strtoul(value, nullptr, 10);
+            else
+            {
+                return false;
+            }
+        }
+
+        return options.duration > 0 && options.bandwidth > 0 && options.pingInterval > 0 && options.laneLimit > 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    if ( ! parseOptions(argc, argv, options) )
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Result strict   = run(options, Connection::SchedulingMode::Strict, false);
+    Result weighted = run(options, Connection::SchedulingMode::Weighted, false);
+    Result single   = run(options, Connection::SchedulingMode::Strict, true);
+
+    printf("ping round trip in ms under saturating telemetry, %u bytes/s link, %u bytes lane limit\n", options.bandwidth, options.laneLimit);
+    printf("%-10s %8s %8s %10s %10s %10s %10s %14s\n", "lanes", "pings", "lost", "p50", "p90", "p99", "max", "telemetry B/s");
+    printResult("strict", strict);
+    printResult("weighted", weighted);
+    printResult("single", single);
+
+    printf("RESULT bandwidth=%u lane_limit=%u strict_p99_us=%u weighted_p99_us=%u single_p99_us=%u strict_telemetry_bps=%.0f "
+           "single_telemetry_bps=%.0f\n", options.bandwidth, options.laneLimit, strict.p99, weighted.p99, single.p99,
+           strict.telemetryBytesPerSecond, single.telemetryBytesPerSecond);
+
+    return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Counter store wear simulation
+ *
+ * Persists counters the way a device does, e.g. the energy, operating seconds and relay cycles every 5 seconds,
+ * for the simulated time on the flash partition stand-in, with restarts and power losses in between:
+ *
+ *   quickhub_counter_wear --years 1 --interval 5 --restart-every 10000 --power-loss-every 50000
+ *
+ * A power loss cuts off the flash writes in the middle of a slot, the store is opened again without a clean
+ * close and has to continue with the counters of the last complete slot. The erases of every sector are
+ * reported together with the years until the most erased sector reaches the endurance of the flash.
+ *
+ * The partition "wear" is created below HOST_VFS_ROOT (default ./host_vfs) and erased first.
+ */
+
+#include "CounterStore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_partition.h"
+}
+
+using namespace _2log;
+
+namespace
+{
+    const char*     LOG_TAG         = "host::CounterWear";
+    const char*     PARTITION       = "wear";
+    const double    ERASE_CYCLES    = 100000.0;
+    const double    YEAR_SECONDS    = 365.0 * 24.0 * 3600.0;
+
+    enum Counter : uint8_t
+    {
+        Energy = 0,
+        OperatingSeconds,
+        RelayCycles,
+        CounterCount
+    };
+
+    struct Options
+    {
+        double      years           = { 1.0 };
+        uint32_t    interval        = { 5 };
+        uint32_t    restartEvery    = { 10000 };
+        uint32_t    powerLossEvery  = { 50000 };
+    };
+
+    struct Expected
+    {
+        uint64_t    values[CounterCount];
+    };
+
+    bool verify(CounterStore &store, const Expected &expected, const char *event)
+    {
+        for ( uint8_t counter = 0; counter < CounterCount; counter++ )
+        {
+            if ( store.get(counter) != expected.values[counter] )
+            {
+                ESP_LOGE(LOG_TAG, "Counter %u is %llu instead of %llu after %s", counter, static_cast<unsigned long long>( store.get(counter) ),
+                         static_cast<unsigned long long>(expected.values[counter]), event);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void printUsage(const char *program)
+    {
+        printf("Usage: %s [options]\n"
+               "  --years N              simulated time (default 1)\n"
+               "  --interval N           seconds between two persists (default 5)\n"
+               "  --restart-every N      persists between two clean restarts, 0 for none (default 10000)\n"
+               "  --power-loss-every N   persists between two power losses, 0 for none (default 50000)\n", program);
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        for ( int i = 1; i < argc; i++ )
+        {
+            if ( i + 1 >= argc )
+            {
+                return false;
+            }
+
+            const char *name    = argv[i];
+            const char *value   = argv[++i];
+
+            if ( strcmp(name, "--years") == 0 )                     options.years           = strtod(value, nullptr);
+            else if ( strcmp(name, "--interval") == 0 )             options.interval        = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--restart-every") == 0 )        options.restartEvery    = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--power-loss-every") == 0 )     options.powerLossEvery  = strtoul(value, nullptr, 10);
+            else
+            {
+                return false;
+            }
+        }
+
+        return options.years > 0.0 && options.interval > 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    if ( ! parseOptions(argc, argv, options) )
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION);
+
+    if ( partition == nullptr || esp_partition_erase_range(partition, 0, partition->size) != ESP_OK )
+    {
+        ESP_LOGE(LOG_TAG, "Failed to prepare the partition");
+        return 1;
+    }
+
+    size_t                  sectors = partition->size / SPI_FLASH_SEC_SIZE;
+    std::vector<uint32_t>   baseline(sectors);
+
+    for ( size_t sector = 0; sector < sectors; sector++ )
+    {
+        baseline[sector] = host_partition_get_erase_count(partition, sector);
+    }
+
+    // persists are driven by the loop only
+    CounterStore store;
+    store.setPersistInterval(0x7FFFFFFF);
+
+    if ( ! store.open(PARTITION) )
+    {
+        return 1;
+    }
+
+    std::mt19937    random(42);
+    Expected        expected    = {};
+    uint64_t        persists    = static_cast<uint64_t>( options.years * YEAR_SECONDS / options.interval );
+    uint32_t        restarts    = 0;
+    uint32_t        powerLosses = 0;
+    bool            consistent  = true;
+
+    for ( uint64_t persist = 1; persist <= persists && consistent; persist++ )
+    {
+        uint64_t energy = random() % 20;
+        uint64_t cycles = random() % 3;
+
+        store.add(Energy, energy);
+        store.add(OperatingSeconds, options.interval);
+        store.add(RelayCycles, cycles);
+
+        if ( options.powerLossEvery > 0 && persist % options.powerLossEvery == 0 )
+        {
+            // the write is torn somewhere in the slot, the open after the restart writes nothing either
+            esp_log_level_set("*", ESP_LOG_NONE);
+            host_partition_set_write_limit(partition, random() % CounterStore::SLOT_SIZE);
+            store.persist();
+            host_partition_set_write_limit(partition, 0);
+            store.open(PARTITION);
+            host_partition_set_write_limit(partition, -1);
+            esp_log_level_set("*", ESP_LOG_WARN);
+
+            consistent = verify(store, expected, "a power loss");
+            powerLosses++;
+            continue;
+        }
+
+        if ( ! store.persist() )
+        {
+            ESP_LOGE(LOG_TAG, "Persist %llu failed", static_cast<unsigned long long>(persist) );
+            consistent = false;
+            break;
+        }
+
+        expected.values[Energy]             += energy;
+        expected.values[OperatingSeconds]   += options.interval;
+        expected.values[RelayCycles]        += cycles;
+
+        if ( options.restartEvery > 0 && persist % options.restartEvery == 0 )
+        {
+            store.open(PARTITION);
+
+            consistent = verify(store, expected, "a restart");
+            restarts++;
+        }
+    }
+
+    CounterStore::Statistics statistics = store.getStatistics();
+
+    uint32_t    minimum = UINT32_MAX;
+    uint32_t    maximum = 0;
+    uint64_t    total   = 0;
+
+    printf("%-8s %10s\n", "sector", "erases");
+
+    for ( size_t sector = 0; sector < sectors; sector++ )
+    {
+        uint32_t erases = host_partition_get_erase_count(partition, sector) - baseline[sector];
+
+        minimum  = erases < minimum ? erases : minimum;
+        maximum  = erases > maximum ? erases : maximum;
+        total   += erases;
+
+        printf("%-8u %10u\n", static_cast<unsigned>(sector), erases);
+    }
+
+    double lifetime = maximum > 0 ? ERASE_CYCLES / ( maximum / options.years ) : 0.0;
+
+    printf("\n%llu persists every %u s over %.2f years, %u restarts, %u power losses, %u slots of %u bytes\n",
+           static_cast<unsigned long long>(persists), options.interval, options.years, restarts, powerLosses, statistics.slots,
+           static_cast<unsigned>(CounterStore::SLOT_SIZE) );
+    printf("erases per sector: min %u max %u mean %.1f, %.0f erase cycles last %.1f years\n", minimum, maximum,
+           static_cast<double>(total) / sectors, ERASE_CYCLES, lifetime);
+
+    printf("RESULT persists=%llu interval_s=%u years=%.2f max_erases=%u min_erases=%u lifetime_years=%.1f consistent=%d\n",
+           static_cast<unsigned long long>(persists), options.interval, options.years, maximum, minimum, lifetime, consistent ? 1 : 0);
+
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,635 @@
+/*
+ * Device fleet simulator
+ *
+ * Runs thousands of DeviceNode + Connection pairs in one process against a local QuickHubServer, to size
+ * servers and to validate device side changes under load. All device tasks are fibers of the cooperative
+ * host scheduler (see HostScheduler.h), the devices reach the server through the loopback WebSocket.
+ *
+ *   quickhub_fleet_simulator --devices 2000 --duration 60 --publish-interval 5000 --rpc-rate 50
+ *
+ * Each device runs one of the scripted profiles below, assigned round robin. The devices reach the server
+ * through a NetworkEmulator, so the fleet can be measured under lossy network conditions as well.
+ */
+
+#include "DeviceNode.h"
+#include "DeviceNodeEventHandler.h"
+#include "Connection.h"
+#include "QuickHubServer.h"
+#include "NetworkEmulator.h"
+#include "HostScheduler.h"
+#include "BuildConfig.h"
+
+#include <cJSON.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_timer.h"
+    #include "esp_system.h"
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/timers.h"
+}
+
+using namespace _2log;
+
+namespace
+{
+    const char*     LOG_TAG                 = "FleetSimulator";
+    const char*     SERVER_URL              = "ws://fleet.simulator/ws";
+    const uint32_t  RECONNECT_BASE_DELAY    = 500;
+    const uint32_t  RECONNECT_MAX_DELAY     = 30000;
+
+    struct Options
+    {
+        uint32_t    devices             = 100;
+        uint32_t    duration            = 30;       // seconds
+        uint32_t    publishInterval     = 5000;     // milliseconds
+        double      rpcRate             = 10;       // RPC calls per second, fleet wide
+        double      disconnectRate      = 0.5;      // server side disconnects per second, fleet wide
+        uint32_t    rampUp              = 5000;     // connection spread in milliseconds
+        uint32_t    seed                = 1;
+        NetworkConditions   network;
+    };
+
+    /**
+     * @brief The fleet wide counters, updated by all devices
+     */
+    struct FleetCounters
+    {
+        std::atomic<uint32_t>   connects            = { 0 };
+        std::atomic<uint32_t>   disconnects         = { 0 };
+        std::atomic<uint32_t>   reconnects          = { 0 };
+        std::atomic<uint64_t>   reconnectTime       = { 0 };    // microseconds from disconnect to connect
+        std::atomic<uint32_t>   maxReconnectTime    = { 0 };
+        std::atomic<uint32_t>   publishes           = { 0 };
+        std::atomic<uint32_t>   rejectedPublishes   = { 0 };
+        std::atomic<uint32_t>   rpcCallbacks        = { 0 };
+    };
+
+    FleetCounters       counters;
+    std::atomic<bool>   stopping = { false };     // set for the teardown, the devices neither publish nor reconnect anymore
+
+    enum class Profile : uint8_t
+    {
+        Sensor,     ///< publishes a temperature and the RSSI every interval, RPC "setInterval"
+        Switch,     ///< publishes its state only on change, RPC "toggle"
+        Logger      ///< publishes sample batches on the bulk lane at four times the rate, RPC "flush"
+    };
+
+    const char *profileName(Profile profile)
+    {
+        switch ( profile )
+        {
+            case Profile::Sensor:   return "sensor";
+            case Profile::Switch:   return "switch";
+            case Profile::Logger:   return "logger";
+        }
+
+        return "unknown";
+    }
+
+    const char *profileRPC(Profile profile)
+    {
+        switch ( profile )
+        {
+            case Profile::Sensor:   return "setInterval";
+            case Profile::Switch:   return "toggle";
+            case Profile::Logger:   return "flush";
+        }
+
+        return "";
+    }
+
+    /**
+     * @brief The SimulatedDevice class is a single device of the fleet
+     */
+    class SimulatedDevice : public DeviceNodeEventHandler
+    {
+        public:
+
+            SimulatedDevice(uint32_t index, Profile profile, const Options &options) : _profile(profile), _options(options)
+            {
+                char id[16];
+                snprintf(id, sizeof(id), "sim-%05u", index);
+                _id = id;
+
+                _node = new DeviceNode(new Connection(SERVER_URL, nullptr), this, profileName(profile), _id, _id, 1000 + index);
+
+                uint32_t interval = _profile == Profile::Logger ? _options.publishInterval / 4 : _options.publishInterval;
+                interval += esp_random() % ( interval / 4 + 1 );
+
+                _timer = xTimerCreate("publish", pdMS_TO_TICKS( std::max<uint32_t>(interval, 1) ), pdTRUE, this, &SimulatedDevice::publishTimer);
+
+                setupProfile();
+            }
+
+            ~SimulatedDevice()
+            {
+                delete _node;
+                xTimerDelete(_timer, portMAX_DELAY);
+            }
+
+            void start()
+            {
+                _node->connect(esp_random() % ( _options.rampUp + 1 ) );
+            }
+
+            void stop()
+            {
+                xTimerStop(_timer, portMAX_DELAY);
+            }
+
+            const std::string& getID() const
+            {
+                return _id;
+            }
+
+            Profile getProfile() const
+            {
+                return _profile;
+            }
+
+            DeviceNode::EventLoopStatistics getEventLoopStatistics() const
+            {
+                return _node->getEventLoopStatistics();
+            }
+
+            virtual void deviceNodeConnected() override
+            {
+                if ( stopping )
+                {
+                    return;
+                }
+
+                counters.connects++;
+
+                if ( _disconnectedTime != 0 )
+                {
+                    uint32_t reconnectTime = static_cast<uint32_t>( esp_timer_get_time() - _disconnectedTime );
+
+                    counters.reconnects++;
+                    counters.reconnectTime += reconnectTime;
+
+                    uint32_t maxReconnectTime = counters.maxReconnectTime.load();
+
+                    while ( reconnectTime > maxReconnectTime && ! counters.maxReconnectTime.compare_exchange_weak(maxReconnectTime, reconnectTime) )
+                    {
+
+                    }
+                }
+
+                _reconnectAttempts = 0;
+                _disconnectedTime = 0;
+
+                xTimerStart(_timer, 0);
+            }
+
+            virtual void deviceNodeDisconnected() override
+            {
+                if ( stopping )
+                {
+                    return;
+                }
+
+                counters.disconnects++;
+
+                xTimerStop(_timer, 0);
+
+                if ( _disconnectedTime == 0 )
+                {
+                    _disconnectedTime = esp_timer_get_time();
+                }
+
+                // exponential backoff with jitter, so a server restart does not cause a reconnect storm
+                uint32_t delay = RECONNECT_BASE_DELAY << std::min<uint32_t>(_reconnectAttempts, 6);
+                delay = std::min(delay, RECONNECT_MAX_DELAY);
+                delay = delay / 2 + esp_random() % ( delay / 2 + 1 );
+
+                _reconnectAttempts++;
+
+                _node->connect(delay);
+            }
+
+            virtual void deviceNodeAuthKeyChanged(uint32_t newAuthKey) override
+            {
+                (void) newAuthKey;
+            }
+
+        private:
+
+            void setupProfile()
+            {
+                switch ( _profile )
+                {
+                    case Profile::Sensor:
+                        _node->setPropertyPrecision("temperature", 1);
+                        _node->registerRPC("setInterval", [this](cJSON *arguments)
+                        {
+                            counters.rpcCallbacks++;
+
+                            cJSON *interval = cJSON_GetObjectItemCaseSensitive(arguments, "interval");
+                            int value = cJSON_IsNumber(interval) ? interval->valueint : static_cast<int>(_options.publishInterval);
+
+                            publish( _node->setProperty("interval", value) );
+                        });
+                        break;
+
+                    case Profile::Switch:
+                        _node->setPropertyPriority("on", SendPriority::RPCResult);
+                        _node->registerRPC("toggle", [this](cJSON *arguments)
+                        {
+                            (void) arguments;
+                            counters.rpcCallbacks++;
+
+                            _switchState = ! _switchState;
+                            publish( _node->setProperty("on", _switchState) );
+                        });
+                        break;
+
+                    case Profile::Logger:
+                        _node->setPropertyPriority("samples", SendPriority::Bulk);
+                        _node->registerRPC("flush", [this](cJSON *arguments)
+                        {
+                            (void) arguments;
+                            counters.rpcCallbacks++;
+
+                            publish( _node->setProperty("pending", 0) );
+                        });
+                        break;
+                }
+            }
+
+            static void publishTimer(TimerHandle_t timer)
+            {
+                if ( stopping )
+                {
+                    return;
+                }
+
+                static_cast<SimulatedDevice*>( pvTimerGetTimerID(timer) )->publishSample();
+            }
+
+            void publishSample()
+            {
+                switch ( _profile )
+                {
+                    case Profile::Sensor:
+                        _temperature += ( static_cast<int>( esp_random() % 11 ) - 5 ) / 10.0f;
+                        publish( _node->setProperty("temperature", _temperature) );
+                        publish( _node->setProperty("rssi", -40 - static_cast<int>( esp_random() % 50 ) ) );
+                        break;
+
+                    case Profile::Switch:
+                        // a switch only reports a change now and then
+                        if ( esp_random() % 10 == 0 )
+                        {
+                            _switchState = ! _switchState;
+                            publish( _node->setProperty("on", _switchState) );
+                        }
+                        break;
+
+                    case Profile::Logger:
+                    {
+                        char samples[96];
+                        int length = 0;
+
+                        for ( int i = 0; i < 8; i++ )
+                        {
+                            length += snprintf(samples + length, sizeof(samples) - length, i == 0 ? "%u" : ",%u", esp_random() % 4096);
+                        }
+
+                        publish( _node->setProperty("samples", samples) );
+                        break;
+                    }
+                }
+            }
+
+            void publish(SendStatus status)
+            {
+                if ( status == SendStatus::Queued )
+                {
+                    counters.publishes++;
+                }
+                else
+                {
+                    counters.rejectedPublishes++;
+                }
+            }
+
+        private:
+
+            std::string         _id;
+            Profile             _profile;
+            const Options&      _options;
+            DeviceNode*         _node = { nullptr };
+            TimerHandle_t       _timer = { nullptr };
+            uint32_t            _reconnectAttempts = { 0 };
+            int64_t             _disconnectedTime = { 0 };
+            float               _temperature = { 21.0f };
+            bool                _switchState = { false };
+    };
+
+    void printUsage(const char *program)
+    {
+        printf("Usage: %s [options]\n"
+               "  --devices N            number of simulated devices (default 100)\n"
+               "  --duration S           measurement duration in seconds (default 30)\n"
+               "  --publish-interval MS  property publish interval per device (default 5000)\n"
+               "  --rpc-rate R           RPC calls per second across the fleet (default 10)\n"
+               "  --disconnect-rate R    server side disconnects per second across the fleet (default 0.5)\n"
+               "  --ramp-up MS           spread of the initial connection attempts (default 5000)\n"
+               "  --seed N               seed of the network emulation (default 1)\n"
+               "  --latency MS           one-way network latency (default 0)\n"
+               "  --jitter MS            maximum additional random latency (default 0)\n"
+               "  --bandwidth B          link capacity per direction in bytes per second (default unlimited)\n"
+               "  --loss P               frame loss probability, lost frames are retransmitted (default 0)\n"
+               "  --reorder P            frame reorder probability (default 0)\n"
+               "  --mtbd MS              mean time between forced disconnects of a link (default none)\n", program);
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        for ( int i = 1; i < argc; i++ )
+        {
+            if ( i + 1 >= argc )
+            {
+                return false;
+            }
+
+            const char *name    = argv[i];
+            const char *value   = argv[++i];
+
+            if ( strcmp(name, "--devices") == 0 )                   options.devices         = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--duration") == 0 )             options.duration        = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--publish-interval") == 0 )     options.publishInterval = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--rpc-rate") == 0 )             options.rpcRate         = strtod(value, nullptr);
+            else if ( strcmp(name, "--disconnect-rate") == 0 )      options.disconnectRate  = strtod(value, nullptr);
+            else if ( strcmp(name, "--ramp-up") == 0 )              options.rampUp          = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--seed") == 0 )                 options.seed            = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--latency") == 0 )              options.network.latency     = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--jitter") == 0 )               options.network.jitter      = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--bandwidth") == 0 )            options.network.bandwidth   = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--loss") == 0 )                 options.network.lossRate    = strtof(value, nullptr);
+            else if ( strcmp(name, "--reorder") == 0 )              options.network.reorderRate = strtof(value, nullptr);
+            else if ( strcmp(name, "--mtbd") == 0 )                 options.network.meanTimeBetweenDisconnects = strtoul(value, nullptr, 10);
+            else
+            {
+                return false;
+            }
+        }
+
+        return options.devices > 0 && options.publishInterval > 0;
+    }
+
+    size_t heapInUse()
+    {
+        struct mallinfo2 info = mallinfo2();
+        return info.uordblks + info.hblkhd;
+    }
+
+    size_t residentSetSize()
+    {
+        FILE *file = fopen("/proc/self/statm", "r");
+
+        if ( file == nullptr )
+        {
+            return 0;
+        }
+
+        unsigned long size      = 0;
+        unsigned long resident  = 0;
+
+        if ( fscanf(file, "%lu %lu", &size, &resident) != 2 )
+        {
+            resident = 0;
+        }
+
+        fclose(file);
+
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+
+    uint32_t percentile(std::vector<uint32_t> &values, double fraction)
+    {
+        if ( values.empty() )
+        {
+            return 0;
+        }
+
+        size_t index = static_cast<size_t>( fraction * ( values.size() - 1 ) + 0.5 );
+        std::nth_element(values.begin(), values.begin() + index, values.end() );
+
+        return values[index];
+    }
+
+    void printDistribution(const char *name, std::vector<uint32_t> values)
+    {
+        if ( values.empty() )
+        {
+            printf("  %-22s no samples\n", name);
+            return;
+        }
+
+        uint32_t p50 = percentile(values, 0.50);
+        uint32_t p90 = percentile(values, 0.90);
+        uint32_t p99 = percentile(values, 0.99);
+        uint32_t max = *std::max_element(values.begin(), values.end() );
+
+        printf("  %-22s n=%zu p50=%.2fms p90=%.2fms p99=%.2fms max=%.2fms\n", name, values.size(),
+               p50 / 1000.0, p90 / 1000.0, p99 / 1000.0, max / 1000.0);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    if ( ! parseOptions(argc, argv, options) )
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // all tasks created from here on are fibers on one scheduler thread
+    host_scheduler_start();
+
+    QuickHubServer server;
+
+    NetworkEmulator network(&server, options.seed);
+    network.setConditions(options.network);
+    network.listen(SERVER_URL);
+
+    size_t heapBefore   = heapInUse();
+    size_t rssBefore    = residentSetSize();
+
+    std::vector<SimulatedDevice*> devices;
+    devices.reserve(options.devices);
+
+    for ( uint32_t i = 0; i < options.devices; i++ )
+    {
+        devices.push_back( new SimulatedDevice(i, static_cast<Profile>(i % 3), options) );
+    }
+
+    // let the node tasks start before measuring
+    std::this_thread::sleep_for(std::chrono::milliseconds(200) );
+
+    size_t heapPerDevice    = ( heapInUse() - heapBefore ) / options.devices;
+    size_t rssPerDevice     = ( residentSetSize() - rssBefore ) / options.devices;
+
+    ESP_LOGI(LOG_TAG, "%u devices created, %zu heap bytes and %zu RSS bytes per device", options.devices, heapPerDevice, rssPerDevice);
+
+    for ( SimulatedDevice *device : devices )
+    {
+        device->start();
+    }
+
+    // wait for the ramp up before the measurement starts
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.rampUp + 500) );
+
+    ESP_LOGI(LOG_TAG, "%zu of %u devices connected, measuring for %u seconds", server.getNodeCount(), options.devices, options.duration);
+
+    QuickHubServer::Statistics startStatistics = server.getStatistics();
+    size_t registrationsBefore  = server.getRegistrationTimes().size();
+    size_t roundTripsBefore     = server.getRPCRoundTrips().size();
+    uint32_t connectsBefore     = counters.connects.load();
+    uint32_t publishesBefore    = counters.publishes.load();
+
+    std::mt19937 random(12345);
+    std::poisson_distribution<uint32_t> rpcCalls(options.rpcRate / 10.0);
+    std::poisson_distribution<uint32_t> disconnects(options.disconnectRate / 10.0);
+    std::uniform_int_distribution<uint32_t> anyDevice(0, options.devices - 1);
+
+    uint32_t rpcsSent       = 0;
+    uint32_t closesSent     = 0;
+    int64_t startTime       = esp_timer_get_time();
+    int64_t nextPing        = startTime;
+
+    for ( uint32_t tick = 0; tick < options.duration * 10; tick++ )
+    {
+        std::this_thread::sleep_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(100) );
+
+        if ( esp_timer_get_time() >= nextPing )
+        {
+            server.pingAll();
+            nextPing += PING_TIMEOUT_TIMER * 1000LL;
+        }
+
+        for ( uint32_t call = rpcCalls(random); call > 0; call-- )
+        {
+            SimulatedDevice *device = devices[anyDevice(random)];
+
+            if ( server.callRPC(device->getID(), profileRPC(device->getProfile() ), "{\"interval\":1000}") )
+            {
+                rpcsSent++;
+            }
+        }
+
+        for ( uint32_t close = disconnects(random); close > 0; close-- )
+        {
+            if ( server.closeNode(devices[anyDevice(random)]->getID() ) )
+            {
+                closesSent++;
+            }
+        }
+    }
+
+    double elapsed = ( esp_timer_get_time() - startTime ) / 1000000.0;
+
+    QuickHubServer::Statistics statistics = server.getStatistics();
+
+    std::vector<uint32_t> registrationTimes = server.getRegistrationTimes();
+    std::vector<uint32_t> roundTrips        = server.getRPCRoundTrips();
+
+    registrationTimes.erase(registrationTimes.begin(), registrationTimes.begin() + std::min(registrationsBefore, registrationTimes.size() ) );
+    roundTrips.erase(roundTrips.begin(), roundTrips.begin() + std::min(roundTripsBefore, roundTrips.size() ) );
+
+    uint64_t processedEvents    = 0;
+    uint64_t rejectedEvents     = 0;
+    uint64_t totalLatency       = 0;
+    uint32_t maxLatency         = 0;
+    uint32_t maxHandlingTime    = 0;
+
+    for ( SimulatedDevice *device : devices )
+    {
+        DeviceNode::EventLoopStatistics loopStatistics = device->getEventLoopStatistics();
+
+        processedEvents += loopStatistics.processedEvents;
+        rejectedEvents  += loopStatistics.rejectedEvents;
+        totalLatency    += loopStatistics.totalLatency;
+        maxLatency      = std::max(maxLatency, loopStatistics.maxLatency);
+        maxHandlingTime = std::max(maxHandlingTime, loopStatistics.maxHandlingTime);
+    }
+
+    host_scheduler_stats_t schedulerStatistics;
+    host_scheduler_get_stats(&schedulerStatistics);
+
+    uint32_t reconnects = counters.reconnects.load();
+
+    NetworkEmulator::Statistics networkStatistics = network.getStatistics();
+
+    printf("\nFleet: %u devices, %.1f s, publish interval %u ms, latency %u ms\n", options.devices, elapsed, options.publishInterval, options.network.latency);
+
+    printf("Throughput\n");
+    printf("  messages received      %.1f/s (%.1f KiB/s)\n", ( statistics.messagesReceived - startStatistics.messagesReceived ) / elapsed,
+           ( statistics.bytesReceived - startStatistics.bytesReceived ) / elapsed / 1024.0);
+    printf("  property updates       %.1f/s\n", ( statistics.propertyUpdates - startStatistics.propertyUpdates ) / elapsed);
+    printf("  messages sent          %.1f KiB/s\n", ( statistics.bytesSent - startStatistics.bytesSent ) / elapsed / 1024.0);
+    printf("  device publishes       %.1f/s, %u rejected\n", ( counters.publishes.load() - publishesBefore ) / elapsed, counters.rejectedPublishes.load() );
+
+    printf("Latency\n");
+    printDistribution("RPC round trip", roundTrips);
+    printDistribution("registration", registrationTimes);
+    printf("  RPC calls              %u sent, %u handled\n", rpcsSent, counters.rpcCallbacks.load() );
+
+    printf("Reconnects\n");
+    printf("  server disconnects     %u\n", closesSent);
+    printf("  device disconnects     %u, reconnects %u\n", counters.disconnects.load(), reconnects);
+    printf("  reconnect time         avg %.1f ms, max %.1f ms\n", reconnects ? counters.reconnectTime.load() / 1000.0 / reconnects : 0.0,
+           counters.maxReconnectTime.load() / 1000.0);
+    printf("  connects in window     %u, %zu of %u connected at the end\n", counters.connects.load() - connectsBefore, server.getNodeCount(), options.devices);
+
+    printf("Network\n");
+    printf("  frames                 %u up, %u down, %u lost, %u retransmitted, %u reordered\n", networkStatistics.framesUp,
+           networkStatistics.framesDown, networkStatistics.lostFrames, networkStatistics.retransmittedFrames, networkStatistics.reorderedFrames);
+    printf("  forced disconnects     %u, max frame delay %.1f ms\n", networkStatistics.forcedDisconnects, networkStatistics.maxFrameDelay / 1000.0);
+
+    printf("Event loops\n");
+    printf("  events                 %llu processed, %llu rejected\n", static_cast<unsigned long long>(processedEvents), static_cast<unsigned long long>(rejectedEvents) );
+    printf("  latency                avg %.1f us, max %u us, max handling %u us\n", processedEvents ? static_cast<double>(totalLatency) / processedEvents : 0.0,
+           maxLatency, maxHandlingTime);
+
+    printf("Memory per device\n");
+    printf("  heap                   %zu bytes\n", heapPerDevice);
+    printf("  RSS                    %zu bytes (%zu KiB total)\n", rssPerDevice, residentSetSize() / 1024);
+    printf("  fibers                 %u, %llu context switches, %zu KiB stack reserved\n", schedulerStatistics.fibers,
+           static_cast<unsigned long long>(schedulerStatistics.contextSwitches), schedulerStatistics.stackBytes / 1024);
+
+    stopping = true;
+
+    for ( SimulatedDevice *device : devices )
+    {
+        device->stop();
+    }
+
+    // a publish that started before the timers were stopped finishes first
+    std::this_thread::sleep_for(std::chrono::milliseconds(100) );
+
+    for ( SimulatedDevice *device : devices )
+    {
+        delete device;
+    }
+
+    return 0;
+}
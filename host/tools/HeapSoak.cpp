@@ -0,0 +1,856 @@
+/*
+ * Heap fragmentation soak test
+ *
+ * Drives millions of mixed operations through a DeviceNode + Connection + DeviceProperties against a local
+ * QuickHubServer: property updates with strings of varying length, RPC calls that store settings, property
+ * saves and loads, pings and server side disconnects. Every heap allocation of the process is replayed on a
+ * model of the device heap, so the largest free block and the fragmentation can be followed over millions
+ * of operations, e.g. to validate pool and arena changes:
+ *
+ *   quickhub_heap_soak --operations 5000000 --heap 160000 --reconnect-every 50000
+ *
+ * The model places blocks like the TLSF heap of ESP-IDF (good fit, 4 byte header, 4 byte alignment) in an
+ * address space of --heap bytes. It only knows sizes and addresses, the memory itself comes from the C library.
+ * The server runs in the same process, so its allocations are part of the model as well.
+ */
+
+#include "DeviceNode.h"
+#include "DeviceNodeEventHandler.h"
+#include "Connection.h"
+#include "DeviceProperties.h"
+#include "HeapMonitor.h"
+#include "QuickHubServer.h"
+#include "HostScheduler.h"
+
+#include <cJSON.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <chrono>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_timer.h"
+    #include "esp_heap_caps.h"
+}
+
+using namespace _2log;
+
+/*
+ * Device heap model: the heap functions of the C library are wrapped and every allocation made while
+ * `modelAllocations` is set is placed in the model as well.
+ */
+
+extern "C"
+{
+    void*   __libc_malloc(size_t size);
+    void*   __libc_calloc(size_t count, size_t size);
+    void*   __libc_realloc(void *pointer, size_t size);
+    void    __libc_free(void *pointer);
+}
+
+namespace
+{
+    const size_t    MODEL_ALIGNMENT     = 4;
+    const size_t    MODEL_OVERHEAD      = 4;
+    const size_t    MODEL_MIN_BLOCK     = 16;
+    const int       SIZE_BUCKET_COUNT   = 10;   // up to 16, 32, ... 4096 bytes and larger, like the AllocationTracker
+
+    /**
+     * @brief The LibcAllocator class keeps the bookkeeping of the model out of the wrapped heap functions
+     */
+    template<typename T>
+    struct LibcAllocator
+    {
+        typedef T value_type;
+
+        LibcAllocator() = default;
+
+        template<typename U>
+        LibcAllocator(const LibcAllocator<U>&) {}
+
+        T *allocate(size_t count)
+        {
+            void *pointer = __libc_malloc(count * sizeof(T) );
+
+            if ( pointer == nullptr )
+            {
+                abort();
+            }
+
+            return static_cast<T*>(pointer);
+        }
+
+        void deallocate(T *pointer, size_t)
+        {
+            __libc_free(pointer);
+        }
+
+        template<typename U>
+        bool operator==(const LibcAllocator<U>&) const { return true; }
+
+        template<typename U>
+        bool operator!=(const LibcAllocator<U>&) const { return false; }
+    };
+
+    int sizeBucket(size_t size)
+    {
+        int bucket = 0;
+
+        while ( bucket < SIZE_BUCKET_COUNT - 1 && size > ( static_cast<size_t>(16) << bucket ) )
+        {
+            bucket++;
+        }
+
+        return bucket;
+    }
+
+    /**
+     * @brief The HeapModel class places allocations in a simulated device heap
+     */
+    class HeapModel
+    {
+        public:
+
+            struct Statistics
+            {
+                size_t      liveBlocks;
+                size_t      usedBytes;              ///< including the block headers
+                size_t      freeBytes;
+                size_t      minimumFreeBytes;
+                size_t      largestFreeBlock;
+                size_t      freeBlocks;
+                uint64_t    allocations;
+                uint64_t    failedAllocations;      ///< allocations that did not fit, the device would have failed them
+                uint64_t    sizeHistogram[SIZE_BUCKET_COUNT];
+                uint64_t    liveSizeHistogram[SIZE_BUCKET_COUNT];
+            };
+
+            void reset(size_t capacity)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                _freeByAddress.clear();
+                _freeBySize.clear();
+                _blocks.clear();
+
+                _capacity           = capacity;
+                _freeBytes          = capacity;
+                _minimumFreeBytes   = capacity;
+                _allocations        = 0;
+                _failedAllocations  = 0;
+
+                memset(_sizeHistogram, 0, sizeof(_sizeHistogram) );
+
+                insertFree(0, capacity);
+            }
+
+            void allocated(void *pointer, size_t size)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                _allocations++;
+                _sizeHistogram[sizeBucket(size)]++;
+
+                size_t blockSize = ( size + MODEL_OVERHEAD + MODEL_ALIGNMENT - 1 ) & ~( MODEL_ALIGNMENT - 1 );
+
+                if ( blockSize < MODEL_MIN_BLOCK )
+                {
+                    blockSize = MODEL_MIN_BLOCK;
+                }
+
+                // good fit: the smallest free block that is large enough, the lowest address among equals
+                auto candidate = _freeBySize.lower_bound( std::make_pair(blockSize, static_cast<size_t>(0) ) );
+
+                if ( candidate == _freeBySize.end() )
+                {
+                    _failedAllocations++;
+                    return;
+                }
+
+                size_t freeSize     = candidate->first;
+                size_t address      = candidate->second;
+
+                eraseFree(address, freeSize);
+
+                if ( freeSize - blockSize >= MODEL_MIN_BLOCK )
+                {
+                    insertFree(address + blockSize, freeSize - blockSize);
+                }
+                else
+                {
+                    blockSize = freeSize;
+                }
+
+                _blocks[reinterpret_cast<uintptr_t>(pointer)] = Block{ address, blockSize, size };
+                _freeBytes -= blockSize;
+
+                if ( _freeBytes < _minimumFreeBytes )
+                {
+                    _minimumFreeBytes = _freeBytes;
+                }
+            }
+
+            void released(void *pointer)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                auto block = _blocks.find( reinterpret_cast<uintptr_t>(pointer) );
+
+                // allocations from before the model started or that did not fit
+                if ( block == _blocks.end() )
+                {
+                    return;
+                }
+
+                size_t address      = block->second.address;
+                size_t blockSize    = block->second.size;
+
+                _blocks.erase(block);
+                _freeBytes += blockSize;
+
+                // merge with the free neighbours
+                auto next = _freeByAddress.lower_bound(address);
+
+                if ( next != _freeByAddress.end() && next->first == address + blockSize )
+                {
+                    size_t nextSize = next->second;
+                    eraseFree(next->first, nextSize);
+                    blockSize += nextSize;
+                }
+
+                auto previous = _freeByAddress.lower_bound(address);
+
+                if ( previous != _freeByAddress.begin() )
+                {
+                    --previous;
+
+                    if ( previous->first + previous->second == address )
+                    {
+                        size_t previousAddress  = previous->first;
+                        size_t previousSize     = previous->second;
+
+                        eraseFree(previousAddress, previousSize);
+
+                        address     = previousAddress;
+                        blockSize   += previousSize;
+                    }
+                }
+
+                insertFree(address, blockSize);
+            }
+
+            size_t getFreeBytes()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _freeBytes;
+            }
+
+            size_t getMinimumFreeBytes()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _minimumFreeBytes;
+            }
+
+            size_t getLargestFreeBlock()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return largestFreeBlock();
+            }
+
+            Statistics getStatistics()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                Statistics statistics;
+                statistics.liveBlocks           = _blocks.size();
+                statistics.usedBytes            = _capacity - _freeBytes;
+                statistics.freeBytes            = _freeBytes;
+                statistics.minimumFreeBytes     = _minimumFreeBytes;
+                statistics.largestFreeBlock     = largestFreeBlock();
+                statistics.freeBlocks           = _freeByAddress.size();
+                statistics.allocations          = _allocations;
+                statistics.failedAllocations    = _failedAllocations;
+
+                memcpy(statistics.sizeHistogram, _sizeHistogram, sizeof(_sizeHistogram) );
+                memset(statistics.liveSizeHistogram, 0, sizeof(statistics.liveSizeHistogram) );
+
+                for ( const auto &block : _blocks )
+                {
+                    statistics.liveSizeHistogram[sizeBucket(block.second.requestedSize)]++;
+                }
+
+                return statistics;
+            }
+
+        private:
+
+            struct Block
+            {
+                size_t  address;
+                size_t  size;
+                size_t  requestedSize;
+            };
+
+            // the usable size of the largest free block, without its header
+            size_t largestFreeBlock() const
+            {
+                if ( _freeBySize.empty() )
+                {
+                    return 0;
+                }
+
+                size_t size = _freeBySize.rbegin()->first;
+                return size > MODEL_OVERHEAD ? size - MODEL_OVERHEAD : 0;
+            }
+
+            void insertFree(size_t address, size_t size)
+            {
+                _freeByAddress[address] = size;
+                _freeBySize.insert( std::make_pair(size, address) );
+            }
+
+            void eraseFree(size_t address, size_t size)
+            {
+                _freeByAddress.erase(address);
+                _freeBySize.erase( std::make_pair(size, address) );
+            }
+
+        private:
+
+            typedef std::pair<const size_t, size_t>                 AddressEntry;
+            typedef std::pair<size_t, size_t>                       SizeEntry;
+            typedef std::pair<const uintptr_t, Block>               BlockEntry;
+
+            std::mutex                                                                  _mutex;
+            std::map<size_t, size_t, std::less<size_t>, LibcAllocator<AddressEntry>>    _freeByAddress;
+            std::set<SizeEntry, std::less<SizeEntry>, LibcAllocator<SizeEntry>>         _freeBySize;
+            std::unordered_map<uintptr_t, Block, std::hash<uintptr_t>, std::equal_to<uintptr_t>, LibcAllocator<BlockEntry>>    _blocks;
+            size_t                                                                      _capacity = { 0 };
+            size_t                                                                      _freeBytes = { 0 };
+            size_t                                                                      _minimumFreeBytes = { 0 };
+            uint64_t                                                                    _allocations = { 0 };
+            uint64_t                                                                    _failedAllocations = { 0 };
+            uint64_t                                                                    _sizeHistogram[SIZE_BUCKET_COUNT] = {};
+    };
+
+    HeapModel           heapModel;
+    std::atomic<bool>   modelAllocations = { false };
+
+    size_t modelFreeSize()
+    {
+        return heapModel.getFreeBytes();
+    }
+
+    size_t modelMinimumFreeSize()
+    {
+        return heapModel.getMinimumFreeBytes();
+    }
+
+    size_t modelLargestFreeBlock()
+    {
+        return heapModel.getLargestFreeBlock();
+    }
+
+    const host_heap_model_t deviceHeapModel = { &modelFreeSize, &modelMinimumFreeSize, &modelLargestFreeBlock };
+
+    /**
+     * @brief Stop modelling before the teardown, the model is destroyed with the other static objects
+     */
+    void leaveModel()
+    {
+        modelAllocations = false;
+        host_heap_set_model(nullptr);
+    }
+}
+
+extern "C" void *malloc(size_t size)
+{
+    void *pointer = __libc_malloc(size);
+
+    if ( pointer != nullptr && modelAllocations.load(std::memory_order_relaxed) )
+    {
+        heapModel.allocated(pointer, size);
+    }
+
+    return pointer;
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    void *pointer = __libc_calloc(count, size);
+
+    if ( pointer != nullptr && modelAllocations.load(std::memory_order_relaxed) )
+    {
+        heapModel.allocated(pointer, count * size);
+    }
+
+    return pointer;
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    void *newPointer = __libc_realloc(pointer, size);
+
+    if ( modelAllocations.load(std::memory_order_relaxed) && ( newPointer != nullptr || size == 0 ) )
+    {
+        if ( pointer != nullptr )
+        {
+            heapModel.released(pointer);
+        }
+
+        if ( newPointer != nullptr )
+        {
+            heapModel.allocated(newPointer, size);
+        }
+    }
+
+    return newPointer;
+}
+
+extern "C" void free(void *pointer)
+{
+    if ( pointer != nullptr && modelAllocations.load(std::memory_order_relaxed) )
+    {
+        heapModel.released(pointer);
+    }
+
+    __libc_free(pointer);
+}
+
+namespace
+{
+    const char*     LOG_TAG         = "HeapSoak";
+    const char*     SERVER_URL      = "ws://heap.soak/ws";
+    const char*     NODE_ID         = "soak-00001";
+    const uint32_t  WAIT_TIMEOUT    = 5000;
+    const uint32_t  BATCH_SIZE      = 256;
+    const uint32_t  PROPERTY_KEYS   = 24;
+    const uint32_t  STORED_KEYS     = 12;
+    const size_t    MAX_STRING      = 240;
+
+    struct Options
+    {
+        uint64_t    operations      = 1000000;
+        uint32_t    heapSize        = 160 * 1024;   // bytes, roughly the free heap of an ESP32 with WiFi running
+        uint32_t    sampleEvery     = 50000;        // operations
+        uint32_t    reconnectEvery  = 100000;       // operations, 0 disables the disconnects
+        uint32_t    seed            = 1;
+    };
+
+    struct SoakCounters
+    {
+        std::atomic<uint32_t>   connects            = { 0 };
+        std::atomic<uint32_t>   rpcCallbacks        = { 0 };
+        std::atomic<uint32_t>   storedSettings      = { 0 };
+        std::atomic<bool>       connected           = { false };
+    };
+
+    SoakCounters    counters;
+
+    std::string randomString(std::mt19937 &random, size_t maxLength)
+    {
+        // mostly short values with the odd long one, like real payloads
+        size_t length = random() % 4 == 0 ? random() % maxLength : random() % 16;
+
+        std::string value(length, 'x');
+
+        for ( char &character : value )
+        {
+            character = static_cast<char>( 'a' + random() % 26 );
+        }
+
+        return value;
+    }
+
+    /**
+     * @brief The SoakDevice class stands in for the application of the device
+     */
+    class SoakDevice : public DeviceNodeEventHandler
+    {
+        public:
+
+            SoakDevice()
+            {
+                _node = new DeviceNode(new Connection(SERVER_URL, nullptr), this, "soak", NODE_ID, NODE_ID, 4711);
+
+                _node->setPropertyPrecision("f0", 2);
+                _node->registerRPC("configure", [this](cJSON *arguments)
+                {
+                    counters.rpcCallbacks++;
+
+                    cJSON *key      = cJSON_GetObjectItemCaseSensitive(arguments, "key");
+                    cJSON *value    = cJSON_GetObjectItemCaseSensitive(arguments, "value");
+
+                    if ( cJSON_IsString(key) && cJSON_IsString(value) )
+                    {
+                        if ( DeviceProperties::instance().saveProperty(key->valuestring, DeviceProperties::PropertyValue(value->valuestring) ) )
+                        {
+                            counters.storedSettings++;
+                        }
+
+                        _node->setProperty(key->valuestring, value->valuestring);
+                    }
+                });
+            }
+
+            ~SoakDevice()
+            {
+                delete _node;
+            }
+
+            DeviceNode *getNode() const
+            {
+                return _node;
+            }
+
+            virtual void deviceNodeConnected() override
+            {
+                counters.connects++;
+                counters.connected = true;
+            }
+
+            virtual void deviceNodeDisconnected() override
+            {
+                counters.connected = false;
+                _node->connect(50);
+            }
+
+            virtual void deviceNodeAuthKeyChanged(uint32_t newAuthKey) override
+            {
+                (void) newAuthKey;
+            }
+
+        private:
+
+            DeviceNode*     _node = { nullptr };
+    };
+
+    void printUsage(const char *program)
+    {
+        printf("Usage: %s [options]\n"
+               "  --operations N         number of operations (default 1000000)\n"
+               "  --heap BYTES           size of the modelled device heap (default 163840)\n"
+               "  --sample-every N       operations between two heap samples (default 50000)\n"
+               "  --reconnect-every N    operations between two server side disconnects, 0 for none (default 100000)\n"
+               "  --seed N               seed of the operation mix (default 1)\n", program);
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        for ( int i = 1; i < argc; i++ )
+        {
+            if ( i + 1 >= argc )
+            {
+                return false;
+            }
+
+            const char *name    = argv[i];
+            const char *value   = argv[++i];
+
+            if ( strcmp(name, "--operations") == 0 )                options.operations      = strtoull(value, nullptr, 10);
+            else if ( strcmp(name, "--heap") == 0 )                 options.heapSize        = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--sample-every") == 0 )         options.sampleEvery     = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--reconnect-every") == 0 )      options.reconnectEvery  = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--seed") == 0 )                 options.seed            = strtoul(value, nullptr, 10);
+            else
+            {
+                return false;
+            }
+        }
+
+        return options.operations > 0 && options.heapSize > 0 && options.sampleEvery > 0;
+    }
+
+    bool waitForConnection(uint32_t timeout)
+    {
+        int64_t deadline = esp_timer_get_time() + timeout * 1000LL;
+
+        while ( ! counters.connected.load() )
+        {
+            if ( esp_timer_get_time() > deadline )
+            {
+                return false;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1) );
+        }
+
+        return true;
+    }
+
+    void printSample(uint64_t operations, double elapsed, const HeapModel::Statistics &statistics)
+    {
+        unsigned fragmentation = statistics.freeBytes > 0 ? static_cast<unsigned>( 100 - statistics.largestFreeBlock * 100 / statistics.freeBytes ) : 0;
+
+        printf("%12llu %8.1f %8zu %8zu %8zu %8zu %6zu %5u%% %8llu\n", static_cast<unsigned long long>(operations), elapsed, statistics.liveBlocks,
+               statistics.freeBytes, statistics.largestFreeBlock, statistics.minimumFreeBytes, statistics.freeBlocks, fragmentation,
+               static_cast<unsigned long long>(statistics.failedAllocations) );
+    }
+
+    void printHistogram(const char *name, const uint64_t histogram[SIZE_BUCKET_COUNT])
+    {
+        printf("  %-20s", name);
+
+        for ( int bucket = 0; bucket < SIZE_BUCKET_COUNT; bucket++ )
+        {
+            printf(" %9llu", static_cast<unsigned long long>(histogram[bucket]) );
+        }
+
+        printf("\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    if ( ! parseOptions(argc, argv, options) )
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    host_scheduler_start();
+
+    QuickHubServer server;
+    server.listen(SERVER_URL);
+
+    // from here on all allocations are placed in the model, the device allocations of the start included
+    heapModel.reset(options.heapSize);
+    host_heap_set_model(&deviceHeapModel);
+    modelAllocations = true;
+
+    SoakDevice device;
+    DeviceNode *node = device.getNode();
+
+    HeapMonitor monitor;
+
+    node->connect(0);
+
+    if ( ! waitForConnection(WAIT_TIMEOUT) || ! server.waitForNode(NODE_ID, WAIT_TIMEOUT) )
+    {
+        ESP_LOGE(LOG_TAG, "Node did not connect");
+        leaveModel();
+        return 1;
+    }
+
+    std::mt19937 random(options.seed);
+
+    uint64_t    publishes           = 0;
+    uint64_t    rejectedPublishes   = 0;
+    uint64_t    rpcCalls            = 0;
+    uint64_t    propertySaves       = 0;
+    uint64_t    propertyLoads       = 0;
+    uint64_t    pings               = 0;
+    uint32_t    disconnects         = 0;
+    uint32_t    expectedUpdates     = server.getStatistics().propertyUpdates;
+    int64_t     startTime           = esp_timer_get_time();
+
+    std::vector<HeapModel::Statistics, LibcAllocator<HeapModel::Statistics>> samples;
+
+    printf("\n%12s %8s %8s %8s %8s %8s %6s %6s %8s\n", "operations", "time/s", "blocks", "free", "largest", "min free", "holes", "frag", "failed");
+
+    for ( uint64_t operation = 0; operation <= options.operations; operation++ )
+    {
+        if ( operation % options.sampleEvery == 0 )
+        {
+            monitor.addSample();
+
+            HeapModel::Statistics statistics = heapModel.getStatistics();
+            samples.push_back(statistics);
+
+            printSample(operation, ( esp_timer_get_time() - startTime ) / 1e6, statistics);
+        }
+
+        if ( operation == options.operations )
+        {
+            break;
+        }
+
+        if ( options.reconnectEvery > 0 && operation > 0 && operation % options.reconnectEvery == 0 )
+        {
+            if ( server.closeNode(NODE_ID) )
+            {
+                disconnects++;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(10) );
+
+            if ( ! waitForConnection(WAIT_TIMEOUT) || ! server.waitForNode(NODE_ID, WAIT_TIMEOUT) )
+            {
+                ESP_LOGE(LOG_TAG, "Node did not reconnect");
+                break;
+            }
+
+            expectedUpdates = server.getStatistics().propertyUpdates;
+        }
+
+        // keep the device queues short, like the server round trips do on a real link
+        if ( operation % BATCH_SIZE == 0 )
+        {
+            server.waitForPropertyUpdates(expectedUpdates, 200);
+            expectedUpdates = server.getStatistics().propertyUpdates;
+        }
+
+        char key[8];
+        uint32_t choice = random() % 100;
+
+        if ( choice < 70 )
+        {
+            SendStatus status;
+            snprintf(key, sizeof(key), "%c%u", "ifbs"[random() % 4], static_cast<unsigned>( random() % PROPERTY_KEYS ) );
+
+            switch ( key[0] )
+            {
+                case 'i':   status = node->setProperty(key, static_cast<int>( random() ) );                    break;
+                case 'f':   status = node->setProperty(key, static_cast<float>( random() % 10000 ) / 100.0f);  break;
+                case 'b':   status = node->setProperty(key, random() % 2 == 0);                                 break;
+                default:    status = node->setProperty(key, randomString(random, MAX_STRING).c_str() );        break;
+            }
+
+            if ( status == SendStatus::Queued )
+            {
+                publishes++;
+                expectedUpdates++;
+            }
+            else
+            {
+                rejectedPublishes++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1) );
+            }
+        }
+        else if ( choice < 80 )
+        {
+            snprintf(key, sizeof(key), "c%u", static_cast<unsigned>( random() % STORED_KEYS ) );
+
+            cJSON *arguments = cJSON_CreateObject();
+            cJSON_AddStringToObject(arguments, "key", key);
+            cJSON_AddStringToObject(arguments, "value", randomString(random, MAX_STRING).c_str() );
+
+            char *argumentsString = cJSON_PrintUnformatted(arguments);
+
+            if ( server.callRPC(NODE_ID, "configure", argumentsString) )
+            {
+                rpcCalls++;
+            }
+
+            cJSON_free(argumentsString);
+            cJSON_Delete(arguments);
+        }
+        else if ( choice < 90 )
+        {
+            snprintf(key, sizeof(key), "s%u", static_cast<unsigned>( random() % STORED_KEYS ) );
+
+            if ( random() % 2 == 0 )
+            {
+                DeviceProperties::instance().saveProperty(key, DeviceProperties::PropertyValue( static_cast<int>( random() ) ) );
+            }
+            else
+            {
+                DeviceProperties::instance().saveProperty(key, DeviceProperties::PropertyValue( static_cast<float>( random() % 1000 ) / 10.0f ) );
+            }
+
+            propertySaves++;
+        }
+        else if ( choice < 97 )
+        {
+            snprintf(key, sizeof(key), "s%u", static_cast<unsigned>( random() % STORED_KEYS ) );
+            DeviceProperties::instance().getProperty(key, DeviceProperties::PropertyValue(0) );
+            propertyLoads++;
+        }
+        else
+        {
+            if ( server.ping(NODE_ID) )
+            {
+                pings++;
+            }
+        }
+    }
+
+    double elapsed = ( esp_timer_get_time() - startTime ) / 1e6;
+
+    HeapModel::Statistics first = samples.front();
+    HeapModel::Statistics last  = samples.back();
+
+    size_t worstLargestFreeBlock = first.largestFreeBlock;
+
+    for ( const HeapModel::Statistics &sample : samples )
+    {
+        worstLargestFreeBlock = std::min(worstLargestFreeBlock, sample.largestFreeBlock);
+    }
+
+    // change of the largest free block per million operations, least squares over all samples
+    double meanOperation    = ( samples.size() - 1 ) / 2.0;
+    double meanBlock        = 0.0;
+
+    for ( const HeapModel::Statistics &sample : samples )
+    {
+        meanBlock += sample.largestFreeBlock;
+    }
+
+    meanBlock /= samples.size();
+
+    double covariance   = 0.0;
+    double variance     = 0.0;
+
+    for ( size_t index = 0; index < samples.size(); index++ )
+    {
+        covariance  += ( index - meanOperation ) * ( samples[index].largestFreeBlock - meanBlock );
+        variance    += ( index - meanOperation ) * ( index - meanOperation );
+    }
+
+    double trend = variance > 0.0 ? covariance / variance * 1e6 / options.sampleEvery : 0.0;
+
+    QuickHubServer::Statistics serverStatistics = server.getStatistics();
+    DeviceNode::EventLoopStatistics loopStatistics = node->getEventLoopStatistics();
+
+    printf("\nSoak: %llu operations in %.1f s, modelled heap %u bytes\n", static_cast<unsigned long long>(options.operations), elapsed, options.heapSize);
+    printf("  publishes            %llu, %llu rejected\n", static_cast<unsigned long long>(publishes), static_cast<unsigned long long>(rejectedPublishes) );
+    printf("  RPC calls            %llu sent, %u handled, %u settings stored\n", static_cast<unsigned long long>(rpcCalls), counters.rpcCallbacks.load(),
+           counters.storedSettings.load() );
+    printf("  property storage     %llu saves, %llu loads\n", static_cast<unsigned long long>(propertySaves), static_cast<unsigned long long>(propertyLoads) );
+    printf("  pings                %llu sent, %u pongs\n", static_cast<unsigned long long>(pings), serverStatistics.pongs);
+    printf("  reconnects           %u disconnects, %u connects\n", disconnects, counters.connects.load() );
+    printf("  server               %u messages, %u property updates\n", serverStatistics.messagesReceived, serverStatistics.propertyUpdates);
+    printf("  node events          %u processed, %u rejected\n", loopStatistics.processedEvents, loopStatistics.rejectedEvents);
+
+    printf("Heap\n");
+    printf("  largest free block   %zu first, %zu worst, %zu last, trend %+.0f bytes per million operations\n", first.largestFreeBlock,
+           worstLargestFreeBlock, last.largestFreeBlock, trend);
+    printf("  free                 %zu first, %zu last, %zu minimum\n", first.freeBytes, last.freeBytes, last.minimumFreeBytes);
+    printf("  live blocks          %zu first, %zu last, %zu free holes\n", first.liveBlocks, last.liveBlocks, last.freeBlocks);
+    printf("  allocations          %llu, %llu did not fit\n", static_cast<unsigned long long>(last.allocations),
+           static_cast<unsigned long long>(last.failedAllocations) );
+
+    printf("Allocation sizes (bytes)\n");
+    printf("  %-20s %9s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n", "", "<=16", "<=32", "<=64", "<=128", "<=256", "<=512", "<=1K", "<=2K", "<=4K", ">4K");
+    printHistogram("all allocations", last.sizeHistogram);
+    printHistogram("live at the end", last.liveSizeHistogram);
+
+    // the HeapMonitor of the component sees the same model
+    monitor.logReport();
+
+    unsigned fragmentation = last.freeBytes > 0 ? static_cast<unsigned>( 100 - last.largestFreeBlock * 100 / last.freeBytes ) : 0;
+
+    // one line for scripts that compare builds
+    printf("RESULT operations=%llu largest_free_first=%zu largest_free_last=%zu largest_free_worst=%zu trend_per_million=%.0f "
+           "fragmentation=%u min_free=%zu failed=%llu\n", static_cast<unsigned long long>(options.operations), first.largestFreeBlock,
+           last.largestFreeBlock, worstLargestFreeBlock, trend, fragmentation, last.minimumFreeBytes,
+           static_cast<unsigned long long>(last.failedAllocations) );
+
+    leaveModel();
+
+    return 0;
+}
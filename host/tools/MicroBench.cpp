@@ -0,0 +1,788 @@
+/*
+ * Hot path microbenchmarks
+ *
+ * Runs every hot path of the library many times and prints ns/op, allocations/op and allocated bytes/op:
+ *
+ *   quickhub_micro_bench --iterations 20000
+ *   quickhub_micro_bench --save host/tools/micro_bench_baseline.txt
+ *   quickhub_micro_bench --compare host/tools/micro_bench_baseline.txt --tolerance 10
+ *
+ * - connection_send_*      Connection::sendPayload() and sendPayloadAsync(), serialization, queueing and the
+ *                          write of the sender task, to a peer that only counts the frames
+ * - connection_receive     Connection::webSocketBinaryMessageReceived(), parsing and dispatch of a node message
+ * - node_set_property_*    the DeviceNode::setProperty() variants through the loop task and a Connection
+ * - node_register          DeviceNode::registerNode() of a node with 16 RPC functions
+ * - node_call_rpc          DeviceNode::jsonReceived() of a call, the copy, the loop task and the callRPC lookup
+ * - property_save/get      DeviceProperties::saveProperty() and getProperty() of 16 keys
+ * - settings_load          DeviceSettings::init() with loadDeviceSettings(), reading and decrypting the settings
+ *
+ * An operation that crosses tasks is timed until its result arrived, so ns/op is the throughput of the path
+ * and not only the cost for the caller. The time is the best of --repeat runs, the allocations are those of
+ * the last run, counted in the whole process.
+ *
+ * --compare reports every benchmark whose ns/op or bytes/op got more than --tolerance percent worse or that
+ * allocates more often than the baseline, and exits with 1 if there is one. ns/op is only comparable on the
+ * machine and build type the baseline was saved with; --no-time compares the allocations only.
+ *
+ * The files are created below HOST_VFS_ROOT (default ./host_vfs).
+ */
+
+#include "Connection.h"
+#include "DeviceNode.h"
+#include "DeviceNodeEventHandler.h"
+#include "DeviceProperties.h"
+#include "DeviceSettings.h"
+
+#include <cJSON.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+    #include "esp_log.h"
+}
+
+using namespace _2log;
+using IDFix::Protocols::WebSocket;
+
+/*
+ * Allocation counting: the heap functions of the C library are wrapped, which also covers operator new
+ * and cJSON. Only allocations while `countAllocations` is set are counted.
+ */
+
+extern "C"
+{
+    void*   __libc_malloc(size_t size);
+    void*   __libc_calloc(size_t count, size_t size);
+    void*   __libc_realloc(void *pointer, size_t size);
+    void    __libc_free(void *pointer);
+}
+
+namespace
+{
+    std::atomic<bool>       countAllocations    = { false };
+    std::atomic<uint64_t>   allocationCount     = { 0 };
+    std::atomic<uint64_t>   allocatedBytes      = { 0 };
+
+    inline void countAllocation(size_t size)
+    {
+        if ( countAllocations.load(std::memory_order_relaxed) )
+        {
+            allocationCount.fetch_add(1, std::memory_order_relaxed);
+            allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+        }
+    }
+}
+
+extern "C" void *malloc(size_t size)
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    countAllocation(size);
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void *pointer)
+{
+    __libc_free(pointer);
+}
+
+namespace
+{
+    const char*     LOG_TAG         = "MicroBench";
+    const char*     URL             = "ws://bench/micro";
+    const int       KEY_COUNT       = 16;
+    const int       RPC_COUNT       = 16;
+    const uint32_t  WAIT_TIMEOUT    = 10000;
+
+    struct Options
+    {
+        uint32_t        iterations  = { 20000 };
+        uint32_t        repeat      = { 3 };
+        uint32_t        tolerance   = { 10 };
+        bool            compareTime = { true };
+        const char*     saveFile    = { nullptr };
+        const char*     compareFile = { nullptr };
+        const char*     filter      = { nullptr };
+    };
+
+    struct Measurement
+    {
+        std::string     name;
+        double          nanosecondsPerOperation;
+        double          allocationsPerOperation;
+        double          bytesPerOperation;
+    };
+
+    struct Benchmark
+    {
+        const char*                     name;
+        std::function<void(uint32_t)>   run;
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @brief Spin until the condition is met, the benchmarks wait for results of other tasks this way
+     */
+    template<typename Condition>
+    void waitUntil(Condition condition)
+    {
+        Clock::time_point timeout = Clock::now() + std::chrono::milliseconds(WAIT_TIMEOUT);
+
+        while ( ! condition() )
+        {
+            if ( Clock::now() > timeout )
+            {
+                ESP_LOGE(LOG_TAG, "Timeout waiting for the benchmark operations");
+                exit(1);
+            }
+
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * @brief Answers the registration and counts the frames, without allocating
+     */
+    class Peer : public IDFix::Protocols::WebSocketPeer
+    {
+        public:
+
+            void peerConnected(WebSocket *) override
+            {
+
+            }
+
+            void peerDisconnected(WebSocket *) override
+            {
+
+            }
+
+            void peerMessageReceived(WebSocket *socket, const char *data, int length) override
+            {
+                const char  *command    = "connection:register";
+                size_t      size        = strlen(command);
+
+                if ( static_cast<size_t>(length) > size + 12 && memmem(data, static_cast<size_t>(length), command, size) != nullptr )
+                {
+                    const char *reply = "{\"command\":\"connection:registered\",\"uuid\":0}";
+                    socket->deliverBinaryMessage(reply, static_cast<int>( strlen(reply) ) );
+                }
+
+                frames++;
+            }
+
+        public:
+
+            std::atomic<uint32_t>   frames = { 0 };
+    };
+
+    class ConnectionEvents : public ConnectionEventHandler
+    {
+        public:
+
+            void connected() override
+            {
+                isConnected = true;
+            }
+
+            void disconnected() override
+            {
+                isConnected = false;
+            }
+
+            void jsonReceived(const cJSON *) override
+            {
+                messages++;
+            }
+
+        public:
+
+            std::atomic<bool>       isConnected = { false };
+            std::atomic<uint32_t>   messages = { 0 };
+    };
+
+    class NodeEvents : public DeviceNodeEventHandler
+    {
+        public:
+
+            void deviceNodeConnected() override
+            {
+                isConnected = true;
+            }
+
+            void deviceNodeDisconnected() override
+            {
+                isConnected = false;
+            }
+
+            void deviceNodeAuthKeyChanged(uint32_t) override
+            {
+
+            }
+
+        public:
+
+            std::atomic<bool>   isConnected = { false };
+    };
+
+    /**
+     * @brief Completes every payload right away and counts them, for the paths of the node alone
+     */
+    class CountingConnection : public IConnection
+    {
+        public:
+
+            bool connect(uint32_t) override
+            {
+                return true;
+            }
+
+            bool disconnect() override
+            {
+                return true;
+            }
+
+            bool sendPayload(const cJSON *) override
+            {
+                payloads++;
+                return true;
+            }
+
+            SendStatus sendPayloadAsync(const cJSON *, sendCompletionFunction completion, SendPriority) override
+            {
+                payloads++;
+
+                if ( completion )
+                {
+                    completion(SendStatus::Sent);
+                }
+
+                return SendStatus::Queued;
+            }
+
+            size_t getBacklogSize() const override
+            {
+                return 0;
+            }
+
+            bool setConnectionEventHandler(ConnectionEventHandler *) override
+            {
+                return true;
+            }
+
+        public:
+
+            std::atomic<uint32_t>   payloads = { 0 };
+    };
+
+    /**
+     * @brief Everything the benchmarks run on, set up once
+     */
+    struct Fixture
+    {
+        Peer                    peer;
+        ConnectionEvents        connectionEvents;
+        NodeEvents              nodeEvents;
+        Connection*             connection      = { nullptr };
+        DeviceNode*             node            = { nullptr };
+        CountingConnection*     nodeConnection  = { nullptr };
+        DeviceNode*             rpcNode         = { nullptr };
+        std::atomic<uint32_t>   rpcCalls        = { 0 };
+        std::atomic<uint32_t>   completions     = { 0 };
+        cJSON*                  payload         = { nullptr };
+        cJSON*                  rpcCall         = { nullptr };
+        std::string             message;
+        char                    keys[KEY_COUNT][16];
+        char                    functions[RPC_COUNT][16];      ///< the node keeps the pointers to the names
+    };
+
+    void setUp(Fixture &fixture)
+    {
+        WebSocket::registerPeer(URL, &fixture.peer);
+
+        // the Connection for the send and receive paths, the lanes never reject
+        fixture.connection = new Connection(URL);
+        fixture.connection->setConnectionEventHandler(&fixture.connectionEvents);
+
+        for ( size_t lane = 0; lane < Connection::LANE_COUNT; lane++ )
+        {
+            fixture.connection->setLaneLimit(static_cast<SendPriority>(lane), 1024 * 1024);
+        }
+
+        fixture.connection->connect();
+        waitUntil([&fixture]() { return fixture.connectionEvents.isConnected.load(); });
+
+        // the node for the property updates, on its own Connection
+        Connection *nodeConnection = new Connection(URL);
+
+        for ( size_t lane = 0; lane < Connection::LANE_COUNT; lane++ )
+        {
+            nodeConnection->setLaneLimit(static_cast<SendPriority>(lane), 1024 * 1024);
+        }
+
+        fixture.node = new DeviceNode(nodeConnection, &fixture.nodeEvents, "bench", "node", "node", 0);
+        fixture.node->declareScaledProperty("power", 2);
+        fixture.node->connect();
+        waitUntil([&fixture]() { return fixture.nodeEvents.isConnected.load(); });
+
+        // the node for registration and RPC calls, without a Connection behind it
+        fixture.nodeConnection  = new CountingConnection();
+        fixture.rpcNode         = new DeviceNode(fixture.nodeConnection, nullptr, "bench", "rpc", "rpc", 0);
+
+        for ( int function = 0; function < RPC_COUNT; function++ )
+        {
+            snprintf(fixture.functions[function], sizeof(fixture.functions[function]), "function_%d", function);
+
+            fixture.rpcNode->registerRPC(fixture.functions[function], [&fixture](const cJSON *) { fixture.rpcCalls++; });
+        }
+
+        fixture.payload = cJSON_CreateObject();
+        cJSON_AddStringToObject(fixture.payload, "command", "node:property");
+        cJSON_AddStringToObject(fixture.payload, "name", "temperature");
+        cJSON_AddNumberToObject(fixture.payload, "value", 21.5);
+
+        fixture.rpcCall = cJSON_Parse("{\"cmd\":\"call\",\"params\":{\"function_7\":{\"level\":42,\"ramp\":1.5,\"target\":\"lamp\"}}}");
+        fixture.message = "{\"command\":\"send\",\"payload\":{\"cmd\":\"call\",\"params\":{\"function_7\":{\"level\":42,\"ramp\":1.5,\"target\":\"lamp\"}}}}";
+
+        for ( int key = 0; key < KEY_COUNT; key++ )
+        {
+            snprintf(fixture.keys[key], sizeof(fixture.keys[key]), "bench_%d", key);
+            DeviceProperties::instance().saveProperty(fixture.keys[key], key);
+        }
+
+        DeviceSettings settings;
+        settings.init();
+        settings.setWiFiSSID("bench-network");
+        settings.setWiFiPassword("a-wifi-password");
+        settings.setServerURL("wss://quickhub.example.com/ws");
+        settings.saveConfiguration();
+        settings.writeAuthKey(1234);
+    }
+
+    void tearDown(Fixture &fixture)
+    {
+        // the disconnects are handled on the WebSocket tasks, they must be done before the destruction
+        fixture.connection->disconnect();
+        fixture.node->disconnect();
+        waitUntil([&fixture]() { return ! fixture.connectionEvents.isConnected && ! fixture.nodeEvents.isConnected; });
+
+        delete fixture.connection;
+        delete fixture.node;
+        delete fixture.rpcNode;
+
+        cJSON_Delete(fixture.payload);
+        cJSON_Delete(fixture.rpcCall);
+
+        WebSocket::registerPeer(URL, nullptr);
+    }
+
+    /**
+     * @brief Repeat a queueing operation until it was accepted, then wait for the peer to get all frames
+     */
+    template<typename Operation>
+    void sendAndWait(Fixture &fixture, uint32_t iterations, Operation operation)
+    {
+        uint32_t frames = fixture.peer.frames + iterations;
+
+        for ( uint32_t i = 0; i < iterations; i++ )
+        {
+            while ( operation(i) != SendStatus::Queued )
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        waitUntil([&fixture, frames]() { return fixture.peer.frames >= frames; });
+    }
+
+    std::vector<Benchmark> makeBenchmarks(Fixture &fixture)
+    {
+        std::vector<Benchmark> benchmarks;
+
+        benchmarks.push_back({ "connection_send_payload", [&fixture](uint32_t iterations)
+        {
+            sendAndWait(fixture, iterations, [&fixture](uint32_t)
+            {
+                return fixture.connection->sendPayload(fixture.payload) ? SendStatus::Queued : SendStatus::RejectedFull;
+            });
+        }});
+
+        benchmarks.push_back({ "connection_send_async", [&fixture](uint32_t iterations)
+        {
+            uint32_t completions = fixture.completions + iterations;
+
+            sendAndWait(fixture, iterations, [&fixture](uint32_t)
+            {
+                return fixture.connection->sendPayloadAsync(fixture.payload, [&fixture](SendStatus) { fixture.completions++; }, SendPriority::State);
+            });
+
+            waitUntil([&fixture, completions]() { return fixture.completions >= completions; });
+        }});
+
+        benchmarks.push_back({ "connection_receive", [&fixture](uint32_t iterations)
+        {
+            const char  *data   = fixture.message.c_str();
+            int         length  = static_cast<int>( fixture.message.size() );
+
+            // the WebSocket task of the connection is idle, the messages are dispatched on the caller
+            for ( uint32_t i = 0; i < iterations; i++ )
+            {
+                fixture.connection->webSocketBinaryMessageReceived(data, length);
+            }
+        }});
+
+        benchmarks.push_back({ "node_set_property_int", [&fixture](uint32_t iterations)
+        {
+            sendAndWait(fixture, iterations, [&fixture](uint32_t i) { return fixture.node->setProperty("count", static_cast<int>(i) ); });
+        }});
+
+        benchmarks.push_back({ "node_set_property_float", [&fixture](uint32_t iterations)
+        {
+            sendAndWait(fixture, iterations, [&fixture](uint32_t i) { return fixture.node->setProperty("temperature", i * 0.25F); });
+        }});
+
+        benchmarks.push_back({ "node_set_property_bool", [&fixture](uint32_t iterations)
+        {
+            sendAndWait(fixture, iterations, [&fixture](uint32_t i) { return fixture.node->setProperty("enabled", i % 2 == 0); });
+        }});
+
+        benchmarks.push_back({ "node_set_property_string", [&fixture](uint32_t iterations)
+        {
+            sendAndWait(fixture, iterations, [&fixture](uint32_t i) { return fixture.node->setProperty("mode", i % 2 == 0 ? "heating" : "cooling"); });
+        }});
+
+        benchmarks.push_back({ "node_set_property_scaled", [&fixture](uint32_t iterations)
+        {
+            sendAndWait(fixture, iterations, [&fixture](uint32_t i) { return fixture.node->setScaledProperty("power", static_cast<int32_t>(i) ); });
+        }});
+
+        benchmarks.push_back({ "node_set_property_completion", [&fixture](uint32_t iterations)
+        {
+            uint32_t completions = fixture.completions + iterations;
+
+            sendAndWait(fixture, iterations, [&fixture](uint32_t i)
+            {
+                return fixture.node->setProperty("count", static_cast<int>(i), [&fixture](SendStatus) { fixture.completions++; });
+            });
+
+            waitUntil([&fixture, completions]() { return fixture.completions >= completions; });
+        }});
+
+        benchmarks.push_back({ "node_register", [&fixture](uint32_t iterations)
+        {
+            for ( uint32_t i = 0; i < iterations; i++ )
+            {
+                uint32_t payloads = fixture.nodeConnection->payloads;
+
+                // every connected event registers the node once
+                fixture.rpcNode->connected();
+                waitUntil([&fixture, payloads]() { return fixture.nodeConnection->payloads > payloads; });
+            }
+        }});
+
+        benchmarks.push_back({ "node_call_rpc", [&fixture](uint32_t iterations)
+        {
+            uint32_t calls = fixture.rpcCalls + iterations;
+
+            for ( uint32_t i = 0; i < iterations; i++ )
+            {
+                fixture.rpcNode->jsonReceived(fixture.rpcCall);
+            }
+
+            waitUntil([&fixture, calls]() { return fixture.rpcCalls >= calls; });
+        }});
+
+        benchmarks.push_back({ "property_save", [&fixture](uint32_t iterations)
+        {
+            for ( uint32_t i = 0; i < iterations; i++ )
+            {
+                DeviceProperties::instance().saveProperty(fixture.keys[i % KEY_COUNT], static_cast<int>(i) );
+            }
+        }});
+
+        benchmarks.push_back({ "property_get", [&fixture](uint32_t iterations)
+        {
+            for ( uint32_t i = 0; i < iterations; i++ )
+            {
+                DeviceProperties::instance().getProperty(fixture.keys[i % KEY_COUNT]);
+            }
+        }});
+
+        benchmarks.push_back({ "settings_load", [](uint32_t iterations)
+        {
+            // a file read and the decryption per operation, far slower than the others
+            for ( uint32_t i = 0; i < iterations / 20 + 1; i++ )
+            {
+                DeviceSettings settings;
+                settings.init();
+            }
+        }});
+
+        return benchmarks;
+    }
+
+    uint32_t getOperations(const Benchmark &benchmark, uint32_t iterations)
+    {
+        return strcmp(benchmark.name, "settings_load") == 0 ? iterations / 20 + 1 : iterations;
+    }
+
+    Measurement measure(const Benchmark &benchmark, const Options &options)
+    {
+        Measurement measurement = { benchmark.name, 0.0, 0.0, 0.0 };
+        uint32_t    operations  = getOperations(benchmark, options.iterations);
+
+        // warm-up, e.g. the first operation creates what lives as long as the node
+        benchmark.run(options.iterations / 10 + 1);
+
+        for ( uint32_t run = 0; run < options.repeat; run++ )
+        {
+            allocationCount = 0;
+            allocatedBytes  = 0;
+            countAllocations = true;
+
+            Clock::time_point start = Clock::now();
+            benchmark.run(options.iterations);
+            double nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+            countAllocations = false;
+
+            if ( run == 0 || nanoseconds / operations < measurement.nanosecondsPerOperation )
+            {
+                measurement.nanosecondsPerOperation = nanoseconds / operations;
+            }
+
+            measurement.allocationsPerOperation = static_cast<double>(allocationCount) / operations;
+            measurement.bytesPerOperation       = static_cast<double>(allocatedBytes) / operations;
+        }
+
+        return measurement;
+    }
+
+    bool saveBaseline(const char *fileName, const std::vector<Measurement> &measurements)
+    {
+        FILE *file = fopen(fileName, "w");
+
+        if ( file == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to create %s", fileName);
+            return false;
+        }
+
+        fprintf(file, "# quickhub_micro_bench baseline: name ns/op allocations/op bytes/op\n");
+
+        for ( const Measurement &measurement : measurements )
+        {
+            fprintf(file, "%s %.1f %.3f %.1f\n", measurement.name.c_str(), measurement.nanosecondsPerOperation,
+                    measurement.allocationsPerOperation, measurement.bytesPerOperation);
+        }
+
+        return fclose(file) == 0;
+    }
+
+    bool loadBaseline(const char *fileName, std::vector<Measurement> &baseline)
+    {
+        FILE *file = fopen(fileName, "r");
+
+        if ( file == nullptr )
+        {
+            ESP_LOGE(LOG_TAG, "Failed to open %s", fileName);
+            return false;
+        }
+
+        char line[256];
+
+        while ( fgets(line, sizeof(line), file) != nullptr )
+        {
+            char        name[64];
+            Measurement measurement;
+
+            if ( line[0] == '#' || sscanf(line, "%63s %lf %lf %lf", name, &measurement.nanosecondsPerOperation,
+                                          &measurement.allocationsPerOperation, &measurement.bytesPerOperation) != 4 )
+            {
+                continue;
+            }
+
+            measurement.name = name;
+            baseline.push_back(measurement);
+        }
+
+        fclose(file);
+
+        return true;
+    }
+
+    /**
+     * @brief Print the measurements next to the baseline
+     * @return  the number of benchmarks that regressed
+     */
+    int compareWithBaseline(const std::vector<Measurement> &measurements, const std::vector<Measurement> &baseline, const Options &options)
+    {
+        const double    limit       = 1.0 + options.tolerance / 100.0;
+        int             regressions = 0;
+
+        printf("\n%-30s %10s %10s %8s %10s %10s %10s %10s\n", "compared with baseline", "ns/op", "base", "diff", "allocs/op", "base",
+               "bytes/op", "base");
+
+        for ( const Measurement &measurement : measurements )
+        {
+            const Measurement *base = nullptr;
+
+            for ( const Measurement &candidate : baseline )
+            {
+                if ( candidate.name == measurement.name )
+                {
+                    base = &candidate;
+                }
+            }
+
+            if ( base == nullptr )
+            {
+                printf("%-30s not in the baseline\n", measurement.name.c_str() );
+                continue;
+            }
+
+            bool slower     = options.compareTime && measurement.nanosecondsPerOperation > base->nanosecondsPerOperation * limit;
+            bool allocates  = measurement.allocationsPerOperation > base->allocationsPerOperation + 0.01;
+            bool larger     = measurement.bytesPerOperation > base->bytesPerOperation * limit + 1.0;
+
+            double difference = base->nanosecondsPerOperation > 0.0 ? ( measurement.nanosecondsPerOperation / base->nanosecondsPerOperation - 1.0 ) * 100.0 : 0.0;
+
+            printf("%-30s %10.1f %10.1f %+7.1f%% %10.3f %10.3f %10.1f %10.1f%s%s%s\n", measurement.name.c_str(),
+                   measurement.nanosecondsPerOperation, base->nanosecondsPerOperation, difference, measurement.allocationsPerOperation,
+                   base->allocationsPerOperation, measurement.bytesPerOperation, base->bytesPerOperation, slower ? " SLOWER" : "",
+                   allocates ? " MORE_ALLOCATIONS" : "", larger ? " MORE_BYTES" : "");
+
+            regressions += ( slower || allocates || larger ) ? 1 : 0;
+        }
+
+        return regressions;
+    }
+
+    void printUsage(const char *program)
+    {
+        printf("Usage: %s [options]\n"
+               "  --iterations N         operations per run (default 20000)\n"
+               "  --repeat N             runs per benchmark, the fastest counts (default 3)\n"
+               "  --filter TEXT          only the benchmarks whose name contains the text\n"
+               "  --save FILE            store the results as baseline\n"
+               "  --compare FILE         compare the results with a baseline, exit with 1 on a regression\n"
+               "  --tolerance PERCENT    allowed increase of ns/op and bytes/op (default 10)\n"
+               "  --no-time              only compare allocations/op and bytes/op\n", program);
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        for ( int i = 1; i < argc; i++ )
+        {
+            const char *name = argv[i];
+
+            if ( strcmp(name, "--no-time") == 0 )
+            {
+                options.compareTime = false;
+                continue;
+            }
+
+            if ( i + 1 >= argc )
+            {
+                return false;
+            }
+
+            const char *value = argv[++i];
+
+            if ( strcmp(name, "--iterations") == 0 )        options.iterations  = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--repeat") == 0 )       options.repeat      = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--tolerance") == 0 )    options.tolerance   = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--filter") == 0 )       options.filter      = value;
+            else if ( strcmp(name, "--save") == 0 )         options.saveFile    = value;
+            else if ( strcmp(name, "--compare") == 0 )      options.compareFile = value;
+            else
+            {
+                return false;
+            }
+        }
+
+        return options.iterations > 0 && options.repeat > 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    if ( ! parseOptions(argc, argv, options) )
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Measurement> baseline;
+
+    if ( options.compareFile != nullptr && ! loadBaseline(options.compareFile, baseline) )
+    {
+        return 1;
+    }
+
+    // the settings load logs the settings, which would be measured otherwise
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    Fixture fixture;
+    setUp(fixture);
+
+    std::vector<Benchmark>      benchmarks = makeBenchmarks(fixture);
+    std::vector<Measurement>    measurements;
+
+    printf("%-30s %10s %10s %10s\n", "benchmark", "ns/op", "allocs/op", "bytes/op");
+
+    for ( const Benchmark &benchmark : benchmarks )
+    {
+        if ( options.filter != nullptr && strstr(benchmark.name, options.filter) == nullptr )
+        {
+            continue;
+        }
+
+        Measurement measurement = measure(benchmark, options);
+
+        printf("%-30s %10.1f %10.3f %10.1f\n", measurement.name.c_str(), measurement.nanosecondsPerOperation,
+               measurement.allocationsPerOperation, measurement.bytesPerOperation);
+
+        measurements.push_back(measurement);
+    }
+
+    tearDown(fixture);
+
+    int result = 0;
+
+    if ( options.saveFile != nullptr && ! saveBaseline(options.saveFile, measurements) )
+    {
+        result = 1;
+    }
+    else if ( options.compareFile != nullptr )
+    {
+        int regressions = compareWithBaseline(measurements, baseline, options);
+
+        printf("RESULT benchmarks=%zu regressions=%d tolerance=%u\n", measurements.size(), regressions, options.tolerance);
+
+        result = regressions > 0 ? 1 : 0;
+    }
+
+    return result;
+}
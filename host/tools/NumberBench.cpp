@@ -0,0 +1,190 @@
+/*
+ * NumberFormatter benchmark
+ *
+ * Formats the same numbers with NumberFormatter and with the snprintf() formats cJSON and the former property
+ * code used, and prints the nanoseconds per number and the mean length of the output:
+ *
+ *   quickhub_number_bench --count 1000000
+ *
+ * - formatFloat() against "%1.15g" (cJSON) and "%.9g" (round-trips, but not the shortest)
+ * - formatFixed() against "%.*f"
+ * - formatDouble() against "%1.17g"
+ * - formatInteger() against "%lld"
+ *
+ * The floats are a mix of sensor like values with few digits and random bit patterns.
+ */
+
+#include "NumberFormatter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace _2log;
+
+namespace
+{
+    struct Options
+    {
+        uint32_t    count = { 1000000 };
+    };
+
+    struct Result
+    {
+        double      nanosecondsPerNumber;
+        double      meanLength;
+    };
+
+    // keeps the compiler from dropping the formatted output
+    volatile size_t sink = 0;
+
+    template<typename Number, typename Formatter>
+    Result measure(const std::vector<Number> &numbers, Formatter formatter)
+    {
+        char    buffer[64];
+        size_t  length  = 0;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for ( const Number &number : numbers )
+        {
+            length += formatter(number, buffer);
+        }
+
+        double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+        sink = sink + length;
+
+        return { seconds * 1e9 / numbers.size(), static_cast<double>(length) / numbers.size() };
+    }
+
+    void printResult(const char *name, const Result &result)
+    {
+        printf("%-24s %10.1f %10.1f\n", name, result.nanosecondsPerNumber, result.meanLength);
+    }
+
+    std::vector<float> makeFloats(uint32_t count, std::mt19937 &random)
+    {
+        std::vector<float>                      floats;
+        std::uniform_int_distribution<uint32_t> bits;
+        std::uniform_int_distribution<int>      reading(-4000, 12000);
+
+        floats.reserve(count);
+
+        for ( uint32_t i = 0; i < count; i++ )
+        {
+            if ( i % 2 == 0 )
+            {
+                // e.g. a temperature with one decimal
+                floats.push_back( reading(random) / 10.0F );
+            }
+            else
+            {
+                uint32_t    pattern = bits(random);
+                float       value;
+
+                memcpy(&value, &pattern, sizeof(value) );
+                floats.push_back( isfinite(value) ? value : 0.0F );
+            }
+        }
+
+        return floats;
+    }
+
+    void printUsage(const char *program)
+    {
+        printf("Usage: %s [options]\n"
+               "  --count N              numbers per format (default 1000000)\n", program);
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        for ( int i = 1; i < argc; i++ )
+        {
+            if ( i + 1 >= argc )
+            {
+                return false;
+            }
+
+            const char *name    = argv[i];
+            const char *value   = argv[++i];
+
+            if ( strcmp(name, "--count") == 0 )             options.count = strtoul(value, nullptr, 10);
+            else
+            {
+                return false;
+            }
+        }
+
+        return options.count > 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    if ( ! parseOptions(argc, argv, options) )
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::mt19937 random(42);
+
+    std::vector<float>      floats  = makeFloats(options.count, random);
+    std::vector<double>     doubles;
+    std::vector<int64_t>    integers;
+
+    std::uniform_real_distribution<double>  real(-1e6, 1e6);
+    std::uniform_int_distribution<int64_t>  integer(-1000000000LL, 1000000000LL);
+
+    doubles.reserve(options.count);
+    integers.reserve(options.count);
+
+    for ( uint32_t i = 0; i < options.count; i++ )
+    {
+        doubles.push_back( real(random) );
+        integers.push_back( integer(random) );
+    }
+
+    printf("%-24s %10s %10s\n", "format", "ns/number", "length");
+
+    Result shortest = measure(floats, [](float value, char *buffer) { return NumberFormatter::formatFloat(value, buffer); });
+    Result cjson    = measure(floats, [](float value, char *buffer) { return static_cast<size_t>( snprintf(buffer, 64, "%1.15g", static_cast<double>(value) ) ); });
+    Result exact    = measure(floats, [](float value, char *buffer) { return static_cast<size_t>( snprintf(buffer, 64, "%.9g", static_cast<double>(value) ) ); });
+
+    printResult("formatFloat", shortest);
+    printResult("snprintf %1.15g", cjson);
+    printResult("snprintf %.9g", exact);
+
+    Result fixed        = measure(floats, [](float value, char *buffer) { return NumberFormatter::formatFixed(value, 2, buffer); });
+    Result fixedPrintf  = measure(floats, [](float value, char *buffer) { return static_cast<size_t>( snprintf(buffer, 64, "%.*f", 2, static_cast<double>(value) ) ); });
+
+    printResult("formatFixed 2", fixed);
+    printResult("snprintf %.2f", fixedPrintf);
+
+    Result real64       = measure(doubles, [](double value, char *buffer) { return NumberFormatter::formatDouble(value, buffer); });
+    Result real64Printf = measure(doubles, [](double value, char *buffer) { return static_cast<size_t>( snprintf(buffer, 64, "%1.17g", value) ); });
+
+    printResult("formatDouble", real64);
+    printResult("snprintf %1.17g", real64Printf);
+
+    Result integer64        = measure(integers, [](int64_t value, char *buffer) { return NumberFormatter::formatInteger(value, buffer); });
+    Result integer64Printf  = measure(integers, [](int64_t value, char *buffer) { return static_cast<size_t>( snprintf(buffer, 64, "%lld", static_cast<long long>(value) ) ); });
+
+    printResult("formatInteger", integer64);
+    printResult("snprintf %lld", integer64Printf);
+
+    printf("RESULT count=%u float_ns=%.1f float_printf_ns=%.1f fixed_ns=%.1f fixed_printf_ns=%.1f double_ns=%.1f "
+           "double_printf_ns=%.1f integer_ns=%.1f integer_printf_ns=%.1f float_length=%.1f float_printf_length=%.1f\n",
+           options.count, shortest.nanosecondsPerNumber, cjson.nanosecondsPerNumber, fixed.nanosecondsPerNumber,
+           fixedPrintf.nanosecondsPerNumber, real64.nanosecondsPerNumber, real64Printf.nanosecondsPerNumber,
+           integer64.nanosecondsPerNumber, integer64Printf.nanosecondsPerNumber, shortest.meanLength, cjson.meanLength);
+
+    return 0;
+}
@@ -0,0 +1,441 @@
+/*
+ * Property storage benchmark
+ *
+ * Measures property updates and reads per second and the bytes written to the file system per update, for
+ * the former layout of one pretty printed JSON file per property and for DeviceProperties, i.e. its write-back
+ * cache in front of the LogStore:
+ *
+ *   quickhub_storage_bench --updates 20000 --keys 16
+ *
+ * It then writes files through DataStorage synchronously and with writeTextFileAsync() and prints the percentiles
+ * of the time the caller was blocked.
+ *
+ * Finally it measures the boot of a store with 10, 100 and 1000 properties, the open of the LogStore and the
+ * bulk load of all values as done by DeviceProperties at init, and the lookup latency of a value read from the
+ * store, of a preloaded value and of a missing key.
+ *
+ * The files are created below HOST_VFS_ROOT (default ./host_vfs), which should be empty. The written bytes are
+ * the bytes handed to the file system; SPIFFS additionally writes page headers and index pages, which is more
+ * per file operation than per byte, so the real difference on the flash is larger than the one shown here.
+ */
+
+#include "DeviceProperties.h"
+#include "DataStorage.h"
+
+#include <cJSON.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <map>
+#include <string>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_spiffs.h"
+}
+
+using namespace _2log;
+
+namespace
+{
+    const char*     LOG_TAG         = "host::StorageBench";
+    const char*     LEGACY_PREFIX   = "/2log/legacy/";
+
+    struct Options
+    {
+        uint32_t    updates = { 10000 };
+        uint32_t    reads   = { 10000 };
+        uint32_t    keys    = { 16 };
+    };
+
+    struct Result
+    {
+        double      updatesPerSecond;
+        double      readsPerSecond;
+        double      bytesPerUpdate;
+    };
+
+    double getSeconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    }
+
+    void makeKey(char *key, size_t size, uint32_t index)
+    {
+        snprintf(key, size, "bench_%u", index);
+    }
+
+    DeviceProperties::PropertyValue makeValue(uint32_t key, uint32_t update)
+    {
+        switch ( key % 3 )
+        {
+            case 0:     return DeviceProperties::PropertyValue( static_cast<int>(update) );
+            case 1:     return DeviceProperties::PropertyValue( update * 0.25F );
+            default:    return DeviceProperties::PropertyValue( static_cast<int32_t>(update), static_cast<uint8_t>(2) );
+        }
+    }
+
+    /**
+     * @brief The former DeviceProperties::saveProperty(), a file per key with the pretty printed value
+     */
+    int writeLegacyProperty(const char *key, const DeviceProperties::PropertyValue &value)
+    {
+        char filename[64];
+        snprintf(filename, sizeof(filename), "%s%s", LEGACY_PREFIX, key);
+
+        cJSON *object = cJSON_CreateObject();
+        cJSON_AddNumberToObject(object, "type", (int) value.getType() );
+
+        uint8_t decimals = 0;
+        cJSON_AddNumberToObject(object, "val", value.getType() == DeviceProperties::PropertyValue::SCALED ? value.asScaled(nullptr, &decimals) :
+                                                                                                           value.asNumber(nullptr) );
+
+        if ( value.getType() == DeviceProperties::PropertyValue::SCALED )
+        {
+            cJSON_AddNumberToObject(object, "dec", decimals);
+        }
+
+        char *jsonString = cJSON_Print(object);
+        int written = DataStorage::getInstance().writeTextFile(filename, jsonString);
+
+        cJSON_free(jsonString);
+        cJSON_Delete(object);
+
+        return written;
+    }
+
+    /**
+     * @brief The former DeviceProperties::getProperty(), stat, read and parse of the file of the key
+     */
+    bool readLegacyProperty(const char *key)
+    {
+        char filename[64];
+        snprintf(filename, sizeof(filename), "%s%s", LEGACY_PREFIX, key);
+
+        const char *propertyFile = DataStorage::getInstance().readTextFile(filename);
+        cJSON *propertyJson = cJSON_Parse(propertyFile);
+
+        bool found = cJSON_IsNumber(cJSON_GetObjectItem(propertyJson, "type") );
+
+        cJSON_Delete(propertyJson);
+        delete [] propertyFile;
+
+        return found;
+    }
+
+    Result runLegacy(const Options &options)
+    {
+        Result  result  = {};
+        char    key[32];
+        uint64_t written = 0;
+
+        mkdir("/2log/legacy", 0755);
+
+        auto start = std::chrono::steady_clock::now();
+
+        for ( uint32_t update = 0; update < options.updates; update++ )
+        {
+            uint32_t index = update % options.keys;
+            makeKey(key, sizeof(key), index);
+
+            int length = writeLegacyProperty(key, makeValue(index, update) );
+
+            if ( length > 0 )
+            {
+                written += static_cast<uint64_t>(length);
+            }
+        }
+
+        result.updatesPerSecond = options.updates / getSeconds(start);
+        result.bytesPerUpdate   = static_cast<double>(written) / options.updates;
+
+        start = std::chrono::steady_clock::now();
+
+        for ( uint32_t read = 0; read < options.reads; read++ )
+        {
+            makeKey(key, sizeof(key), read % options.keys);
+            readLegacyProperty(key);
+        }
+
+        result.readsPerSecond = options.reads / getSeconds(start);
+
+        return result;
+    }
+
+    Result runLogStore(const Options &options)
+    {
+        Result              result      = {};
+        char                key[32];
+        DeviceProperties&   properties  = DeviceProperties::instance();
+        uint64_t            written     = properties.getStorageStatistics().bytesWritten;
+
+        auto start = std::chrono::steady_clock::now();
+
+        for ( uint32_t update = 0; update < options.updates; update++ )
+        {
+            uint32_t index = update % options.keys;
+            makeKey(key, sizeof(key), index);
+            properties.saveProperty(key, makeValue(index, update) );
+        }
+
+        // the cache coalesces the updates, the flush is part of the measurement
+        properties.sync();
+
+        result.updatesPerSecond = options.updates / getSeconds(start);
+
+        start = std::chrono::steady_clock::now();
+
+        for ( uint32_t read = 0; read < options.reads; read++ )
+        {
+            makeKey(key, sizeof(key), read % options.keys);
+            properties.getProperty(key);
+        }
+
+        result.readsPerSecond = options.reads / getSeconds(start);
+
+        // includes the bytes of the background compactions that finished so far
+        LogStore::Statistics statistics = properties.getStorageStatistics();
+        result.bytesPerUpdate = static_cast<double>( statistics.bytesWritten - written ) / options.updates;
+
+        ESP_LOGI(LOG_TAG, "LogStore: %u keys, %u bytes, %u dead, %u compactions, %u batches", statistics.keys, static_cast<unsigned>(statistics.size),
+                 static_cast<unsigned>(statistics.deadBytes), statistics.compactions, statistics.batches);
+
+        DeviceProperties::CacheStatistics cache = properties.getCacheStatistics();
+
+        ESP_LOGI(LOG_TAG, "Cache: %u saves, %u unchanged, %u flushes writing %u records, %u hits, %u misses", cache.saves, cache.unchangedSaves,
+                 cache.flushes, cache.flushedProperties, cache.hits, cache.misses);
+
+        return result;
+    }
+
+    /**
+     * @brief Caller latency of file writes, synchronous or through the storage task
+     */
+    DataStorage::LatencyStatistics runFileWrites(const Options &options, bool async)
+    {
+        DataStorage&            storage     = DataStorage::getInstance();
+        std::atomic<uint32_t>   completed   = { 0 };
+        char                    fileName[48];
+        char                    content[48];
+
+        storage.resetLatencyStatistics();
+
+        for ( uint32_t update = 0; update < options.updates; update++ )
+        {
+            snprintf(fileName, sizeof(fileName), "%slatency_%u", LEGACY_PREFIX, update % options.keys);
+            snprintf(content, sizeof(content), "{\n\t\"value\":\t%u\n}", update);
+
+            if ( ! async )
+            {
+                storage.writeTextFile(fileName, content);
+                continue;
+            }
+
+            // keep the queue from overflowing, the wait is not part of the measured call
+            while ( update - completed.load() >= DATA_STORAGE_QUEUE_LENGTH / 2 )
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100) );
+            }
+
+            storage.writeTextFileAsync(fileName, content, [&completed](int) { completed++; });
+        }
+
+        DataStorage::LatencyStatistics latency = storage.getCallerLatency();
+
+        while ( async && completed.load() < options.updates )
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1) );
+        }
+
+        return latency;
+    }
+
+    struct BootResult
+    {
+        double      bootMicroseconds;       ///< LogStore::open() and forEach() into a map
+        double      readNanoseconds;        ///< LogStore::get() per lookup
+        double      cachedNanoseconds;      ///< lookup of a preloaded value
+        double      missingNanoseconds;     ///< lookup of a missing key in the preloaded map
+    };
+
+    BootResult runBoot(uint32_t count, uint32_t lookups)
+    {
+        BootResult  result = {};
+        char        fileName[48];
+        char        key[32];
+
+        snprintf(fileName, sizeof(fileName), "/2log/boot_%u.kv", count);
+
+        LogStore writer;
+
+        if ( ! writer.open(fileName) )
+        {
+            return result;
+        }
+
+        // every key twice, the scan also has to skip dead records
+        for ( uint32_t round = 0; round < 2; round++ )
+        {
+            for ( uint32_t index = 0; index < count; index++ )
+            {
+                std::string record;
+                makeKey(key, sizeof(key), index);
+                record.append(6, static_cast<char>(round + index) );
+                writer.put(key, record.data(), record.size() );
+            }
+        }
+
+        writer.close();
+
+        LogStore                                            store;
+        std::map<std::string, std::string, std::less<>>     cache;
+
+        auto start = std::chrono::steady_clock::now();
+
+        store.open(fileName);
+        store.forEach([&cache](const char *key, const std::string &value)
+        {
+            cache.emplace(key, value);
+            return true;
+        });
+
+        result.bootMicroseconds = getSeconds(start) * 1e6;
+
+        std::string value;
+        start = std::chrono::steady_clock::now();
+
+        for ( uint32_t lookup = 0; lookup < lookups; lookup++ )
+        {
+            makeKey(key, sizeof(key), lookup % count);
+            store.get(key, value);
+        }
+
+        result.readNanoseconds = getSeconds(start) * 1e9 / lookups;
+
+        size_t found = 0;
+        start = std::chrono::steady_clock::now();
+
+        for ( uint32_t lookup = 0; lookup < lookups; lookup++ )
+        {
+            makeKey(key, sizeof(key), lookup % count);
+            found += cache.count(key);
+        }
+
+        result.cachedNanoseconds = getSeconds(start) * 1e9 / lookups;
+        start = std::chrono::steady_clock::now();
+
+        for ( uint32_t lookup = 0; lookup < lookups; lookup++ )
+        {
+            makeKey(key, sizeof(key), count + lookup % count);
+            found += cache.count(key);
+        }
+
+        result.missingNanoseconds = getSeconds(start) * 1e9 / lookups;
+
+        if ( found != lookups )
+        {
+            ESP_LOGE(LOG_TAG, "Preloaded %u of %u properties", static_cast<unsigned>( cache.size() ), count);
+        }
+
+        store.close();
+
+        return result;
+    }
+
+    void printLatency(const char *mode, const DataStorage::LatencyStatistics &latency)
+    {
+        printf("%-10s %8u %8u %8u %8u %8u\n", mode, latency.count, latency.p50, latency.p90, latency.p99, latency.max);
+    }
+
+    void printUsage(const char *program)
+    {
+        printf("Usage: %s [options]\n"
+               "  --updates N            number of property updates (default 10000)\n"
+               "  --reads N              number of property reads (default 10000)\n"
+               "  --keys N               number of distinct properties (default 16)\n", program);
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        for ( int i = 1; i < argc; i++ )
+        {
+            if ( i + 1 >= argc )
+            {
+                return false;
+            }
+
+            const char *name    = argv[i];
+            const char *value   = argv[++i];
+
+            if ( strcmp(name, "--updates") == 0 )           options.updates = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--reads") == 0 )        options.reads   = strtoul(value, nullptr, 10);
+            else if ( strcmp(name, "--keys") == 0 )         options.keys    = strtoul(value, nullptr, 10);
+            else
+            {
+                return false;
+            }
+        }
+
+        return options.updates > 0 && options.reads > 0 && options.keys > 0;
+    }
+
+    void printResult(const char *layout, const Result &result)
+    {
+        printf("%-10s %12.0f %12.0f %14.1f\n", layout, result.updatesPerSecond, result.readsPerSecond, result.bytesPerUpdate);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    if ( ! parseOptions(argc, argv, options) )
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // DeviceProperties mounts the storage, the legacy files live next to its store
+    Result logStore = runLogStore(options);
+    Result legacy   = runLegacy(options);
+
+    printf("%-10s %12s %12s %14s\n", "layout", "updates/s", "reads/s", "bytes/update");
+    printResult("files", legacy);
+    printResult("logstore", logStore);
+
+    DataStorage::LatencyStatistics syncLatency  = runFileWrites(options, false);
+    DataStorage::LatencyStatistics asyncLatency = runFileWrites(options, true);
+
+    printf("\ncaller latency of file writes in us (upper bounds of power of two buckets)\n");
+    printf("%-10s %8s %8s %8s %8s %8s\n", "mode", "calls", "p50", "p90", "p99", "max");
+    printLatency("sync", syncLatency);
+    printLatency("async", asyncLatency);
+
+    printf("RESULT updates=%u keys=%u files_updates_per_s=%.0f files_bytes_per_update=%.1f logstore_updates_per_s=%.0f "
+           "logstore_bytes_per_update=%.1f sync_write_p99_us=%u async_write_p99_us=%u\n", options.updates, options.keys,
+           legacy.updatesPerSecond, legacy.bytesPerUpdate, logStore.updatesPerSecond, logStore.bytesPerUpdate, syncLatency.p99, asyncLatency.p99);
+
+    printf("\nboot with N properties: open and bulk load in us, lookups in ns\n");
+    printf("%-10s %12s %12s %12s %12s\n", "properties", "boot", "store get", "preloaded", "missing");
+
+    const uint32_t  bootCounts[]    = { 10, 100, 1000 };
+    BootResult      bootLarge       = {};
+
+    for ( uint32_t count : bootCounts )
+    {
+        BootResult boot = runBoot(count, options.reads);
+        printf("%-10u %12.0f %12.0f %12.0f %12.0f\n", count, boot.bootMicroseconds, boot.readNanoseconds, boot.cachedNanoseconds,
+               boot.missingNanoseconds);
+
+        bootLarge = boot;
+    }
+
+    printf("RESULT boot_1000_us=%.0f store_get_ns=%.0f preloaded_get_ns=%.0f missing_get_ns=%.0f\n", bootLarge.bootMicroseconds,
+           bootLarge.readNanoseconds, bootLarge.cachedNanoseconds, bootLarge.missingNanoseconds);
+
+    return 0;
+}
@@ -0,0 +1,517 @@
+/*
+ * Traffic replay
+ *
+ * Feeds the inbound frames of a traffic log (see Connection::startCapture) into a Connection + DeviceNode
+ * at the original or an accelerated speed and measures the CPU time, heap allocations and output bytes,
+ * so production traces become regression benchmarks for new builds:
+ *
+ *   quickhub_traffic_replay capture.bin --speed 10
+ *
+ * The node is registered with the ID, type and RPC functions found in the recorded node:register message.
+ * RPC callbacks only count the calls, the replay measures the library and not the application.
+ */
+
+#include "DeviceNode.h"
+#include "DeviceNodeEventHandler.h"
+#include "Connection.h"
+#include "TrafficRecorder.h"
+
+#include <cJSON.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <thread>
+#include <chrono>
+
+extern "C"
+{
+    #include "esp_log.h"
+    #include "esp_timer.h"
+}
+
+using namespace _2log;
+
+/*
+ * Allocation counting: the heap functions of the C library are wrapped, which also covers operator new
+ * and cJSON. Only allocations while `countAllocations` is set are counted.
+ */
+
+extern "C"
+{
+    void*   __libc_malloc(size_t size);
+    void*   __libc_calloc(size_t count, size_t size);
+    void*   __libc_realloc(void *pointer, size_t size);
+    void    __libc_free(void *pointer);
+}
+
+namespace
+{
+    std::atomic<bool>       countAllocations    = { false };
+    std::atomic<uint64_t>   allocationCount     = { 0 };
+    std::atomic<uint64_t>   allocatedBytes      = { 0 };
+
+    inline void countAllocation(size_t size)
+    {
+        if ( countAllocations.load(std::memory_order_relaxed) )
+        {
+            allocationCount.fetch_add(1, std::memory_order_relaxed);
+            allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+        }
+    }
+}
+
+extern "C" void *malloc(size_t size)
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    countAllocation(size);
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void *pointer)
+{
+    __libc_free(pointer);
+}
+
+namespace
+{
+    const char*     LOG_TAG         = "TrafficReplay";
+    const char*     REPLAY_URL      = "ws://traffic.replay/ws";
+    const uint32_t  WAIT_TIMEOUT    = 5000;
+    const uint32_t  QUIET_TIME      = 200;
+
+    struct Options
+    {
+        const char*     fileName    = nullptr;
+        double          speed       = 1.0;      // 0 replays without delays
+    };
+
+    /**
+     * @brief The NodeIdentity struct is taken from the recorded node:register message
+     */
+    struct NodeIdentity
+    {
+        std::string                 id          = "replay";
+        std::string                 shortID     = "replay";
+        std::string                 type        = "replay";
+        uint32_t                    authKey     = 0;
+        std::deque<std::string>     functions;  // the node keeps pointers to the names
+    };
+
+    /**
+     * @brief The ReplayPeer class stands in for the server and counts the frames the device writes
+     */
+    class ReplayPeer : public IDFix::Protocols::WebSocketPeer
+    {
+        public:
+
+            virtual void peerConnected(IDFix::Protocols::WebSocket *socket) override
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _socket = socket;
+                _condition.notify_all();
+            }
+
+            virtual void peerDisconnected(IDFix::Protocols::WebSocket *socket) override
+            {
+                (void) socket;
+
+                std::lock_guard<std::mutex> lock(_mutex);
+                _socket = nullptr;
+                _condition.notify_all();
+            }
+
+            virtual void peerMessageReceived(IDFix::Protocols::WebSocket *socket, const char *data, int length) override
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _frames++;
+                _bytes += static_cast<uint64_t>(length);
+                _lastFrameTime = esp_timer_get_time();
+
+                // the device sends "connection:register", the reply is not part of a log captured while connected
+                if ( _autoRegister && memmem(data, static_cast<size_t>(length), "connection:register", 19) != nullptr )
+                {
+                    const char *registered = "{\"command\":\"connection:registered\",\"uuid\":0}";
+                    socket->deliverBinaryMessage(registered, static_cast<int>(strlen(registered)) );
+                }
+            }
+
+            void setAutoRegister(bool autoRegister)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _autoRegister = autoRegister;
+            }
+
+            bool waitForConnection(bool connected, uint32_t timeout)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+
+                return _condition.wait_for(lock, std::chrono::milliseconds(timeout), [this, connected]()
+                {
+                    return ( _socket != nullptr ) == connected;
+                });
+            }
+
+            bool deliver(const std::string &frame)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                return _socket != nullptr && _socket->deliverBinaryMessage(frame.data(), static_cast<int>(frame.size()) );
+            }
+
+            void close()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                if ( _socket != nullptr )
+                {
+                    _socket->close();
+                }
+            }
+
+            void waitUntilQuiet(uint32_t quietTime)
+            {
+                while ( true )
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(quietTime / 4) );
+
+                    std::lock_guard<std::mutex> lock(_mutex);
+
+                    if ( esp_timer_get_time() - _lastFrameTime >= static_cast<int64_t>(quietTime) * 1000 )
+                    {
+                        return;
+                    }
+                }
+            }
+
+            uint64_t getFrames()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _frames;
+            }
+
+            uint64_t getBytes()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _bytes;
+            }
+
+        private:
+
+            std::mutex                      _mutex;
+            std::condition_variable         _condition;
+            IDFix::Protocols::WebSocket*    _socket = { nullptr };
+            uint64_t                        _frames = { 0 };
+            uint64_t                        _bytes = { 0 };
+            int64_t                         _lastFrameTime = { 0 };
+            bool                            _autoRegister = { false };
+    };
+
+    /**
+     * @brief The ReplayDevice class reconnects the node whenever the replay closes the connection
+     */
+    class ReplayDevice : public DeviceNodeEventHandler
+    {
+        public:
+
+            virtual void deviceNodeConnected() override
+            {
+
+            }
+
+            virtual void deviceNodeDisconnected() override
+            {
+                if ( _node )
+                {
+                    _node->connect(0);
+                }
+            }
+
+            virtual void deviceNodeAuthKeyChanged(uint32_t newAuthKey) override
+            {
+                (void) newAuthKey;
+            }
+
+            void setNode(DeviceNode *node)
+            {
+                _node = node;
+            }
+
+        private:
+
+            DeviceNode*     _node = { nullptr };
+    };
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        for ( int i = 1; i < argc; i++ )
+        {
+            if ( strcmp(argv[i], "--speed") == 0 && i + 1 < argc )
+            {
+                options.speed = strtod(argv[++i], nullptr);
+            }
+            else if ( argv[i][0] != '-' && options.fileName == nullptr )
+            {
+                options.fileName = argv[i];
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        return options.fileName != nullptr && options.speed >= 0.0;
+    }
+
+    void readIdentity(const std::string &frame, NodeIdentity &identity)
+    {
+        cJSON *envelope     = cJSON_ParseWithLength(frame.data(), frame.size() );
+        cJSON *payload      = cJSON_GetObjectItemCaseSensitive(envelope, "payload");
+        cJSON *command      = cJSON_GetObjectItemCaseSensitive(payload, "command");
+
+        if ( cJSON_IsString(command) && strcmp(command->valuestring, "node:register") == 0 )
+        {
+            cJSON *parameters   = cJSON_GetObjectItemCaseSensitive(payload, "parameters");
+            cJSON *id           = cJSON_GetObjectItemCaseSensitive(parameters, "id");
+            cJSON *shortID      = cJSON_GetObjectItemCaseSensitive(parameters, "sid");
+            cJSON *type         = cJSON_GetObjectItemCaseSensitive(parameters, "type");
+            cJSON *key          = cJSON_GetObjectItemCaseSensitive(parameters, "key");
+            cJSON *functions    = cJSON_GetObjectItemCaseSensitive(parameters, "functions");
+            cJSON *function;
+
+            if ( cJSON_IsString(id) )           identity.id         = id->valuestring;
+            if ( cJSON_IsString(shortID) )      identity.shortID    = shortID->valuestring;
+            if ( cJSON_IsString(type) )         identity.type       = type->valuestring;
+            if ( cJSON_IsNumber(key) )          identity.authKey    = static_cast<uint32_t>(key->valuedouble);
+
+            identity.functions.clear();
+
+            cJSON_ArrayForEach(function, functions)
+            {
+                cJSON *name = cJSON_GetObjectItemCaseSensitive(function, "name");
+
+                if ( cJSON_IsString(name) )
+                {
+                    identity.functions.push_back(name->valuestring);
+                }
+            }
+        }
+
+        cJSON_Delete(envelope);
+    }
+
+    double processTime()
+    {
+        timespec time;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+
+        return time.tv_sec + time.tv_nsec / 1e9;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    if ( ! parseOptions(argc, argv, options) )
+    {
+        printf("Usage: %s <traffic log> [--speed FACTOR]\n"
+               "  --speed FACTOR   1 replays in real time, 10 ten times faster, 0 without any delay (default 1)\n", argv[0]);
+        return 1;
+    }
+
+    TrafficLogReader reader;
+    TrafficLogReader::Record record;
+
+    if ( ! reader.open(options.fileName) )
+    {
+        return 1;
+    }
+
+    // a first pass for the node identity and the recorded totals
+    NodeIdentity identity;
+
+    uint64_t recordedInbound        = 0;
+    uint64_t recordedInboundBytes   = 0;
+    uint64_t recordedOutbound       = 0;
+    uint64_t recordedOutboundBytes  = 0;
+    uint64_t recordedDuration       = 0;
+    bool     capturedConnected      = false;
+    bool     firstRecord            = true;
+
+    while ( reader.next(record) )
+    {
+        if ( firstRecord )
+        {
+            capturedConnected   = record.type != TrafficRecordType::Connected;
+            firstRecord         = false;
+        }
+
+        if ( record.type == TrafficRecordType::Outbound )
+        {
+            if ( recordedOutbound == 0 || record.data.find("node:register") != std::string::npos )
+            {
+                readIdentity(record.data, identity);
+            }
+
+            recordedOutbound++;
+            recordedOutboundBytes += record.data.size();
+        }
+        else if ( record.type == TrafficRecordType::Inbound )
+        {
+            recordedInbound++;
+            recordedInboundBytes += record.data.size();
+        }
+
+        recordedDuration = record.timestamp;
+    }
+
+    ReplayPeer peer;
+    peer.setAutoRegister(capturedConnected);
+    IDFix::Protocols::WebSocket::registerPeer(REPLAY_URL, &peer);
+
+    std::atomic<uint32_t> rpcCalls = { 0 };
+
+    ReplayDevice device;
+    DeviceNode *node = new DeviceNode(new Connection(REPLAY_URL, nullptr), &device, identity.type, identity.id, identity.shortID, identity.authKey);
+    device.setNode(node);
+
+    for ( const std::string &function : identity.functions )
+    {
+        node->registerRPC(function.c_str(), [&rpcCalls](cJSON *arguments)
+        {
+            (void) arguments;
+            rpcCalls++;
+        });
+    }
+
+    node->connect(0);
+
+    if ( ! peer.waitForConnection(true, WAIT_TIMEOUT) )
+    {
+        ESP_LOGE(LOG_TAG, "Node did not connect");
+        delete node;
+        return 1;
+    }
+
+    // the replay starts with a fresh connection, like the recording did
+    peer.waitUntilQuiet(QUIET_TIME);
+
+    reader.open(options.fileName);
+
+    uint64_t baseOutboundFrames = peer.getFrames();
+    uint64_t baseOutboundBytes  = peer.getBytes();
+    uint64_t replayedFrames     = 0;
+    uint64_t droppedFrames      = 0;
+    uint32_t reconnects         = 0;
+    bool     connected          = true;
+    bool     firstConnect       = true;
+
+    allocationCount = 0;
+    allocatedBytes  = 0;
+
+    double  startCPU        = processTime();
+    auto    startTime       = std::chrono::steady_clock::now();
+
+    countAllocations = true;
+
+    while ( reader.next(record) )
+    {
+        if ( options.speed > 0.0 )
+        {
+            std::this_thread::sleep_until(startTime + std::chrono::microseconds( static_cast<int64_t>(record.timestamp / options.speed) ) );
+        }
+
+        switch ( record.type )
+        {
+            case TrafficRecordType::Connected:
+                if ( ! connected )
+                {
+                    connected = peer.waitForConnection(true, WAIT_TIMEOUT);
+                    reconnects++;
+                }
+                else if ( ! firstConnect )
+                {
+                    ESP_LOGW(LOG_TAG, "Connected record without a previous disconnect");
+                }
+
+                firstConnect = false;
+                break;
+
+            case TrafficRecordType::Disconnected:
+                // from now on the log contains the registration replies
+                peer.setAutoRegister(false);
+                peer.close();
+                peer.waitForConnection(false, WAIT_TIMEOUT);
+                connected = false;
+                break;
+
+            case TrafficRecordType::Inbound:
+                if ( peer.deliver(record.data) )
+                {
+                    replayedFrames++;
+                }
+                else
+                {
+                    droppedFrames++;
+                }
+                break;
+
+            case TrafficRecordType::Outbound:
+                break;
+        }
+    }
+
+    // let the node finish all frames of the replay
+    peer.waitUntilQuiet(QUIET_TIME);
+
+    countAllocations = false;
+
+    double cpuTime = processTime() - startCPU;
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() - QUIET_TIME / 1000.0;
+
+    uint64_t outboundFrames = peer.getFrames() - baseOutboundFrames;
+    uint64_t outboundBytes  = peer.getBytes() - baseOutboundBytes;
+
+    DeviceNode::EventLoopStatistics loopStatistics = node->getEventLoopStatistics();
+
+    printf("\nReplay of %s (%s, %.1f s recorded, speed %g)\n", options.fileName, identity.id.c_str(), recordedDuration / 1e6, options.speed);
+    printf("  inbound frames     %llu replayed, %llu dropped (%llu recorded, %llu bytes)\n", static_cast<unsigned long long>(replayedFrames),
+           static_cast<unsigned long long>(droppedFrames), static_cast<unsigned long long>(recordedInbound), static_cast<unsigned long long>(recordedInboundBytes) );
+    printf("  outbound frames    %llu, %llu bytes (recorded %llu, %llu bytes)\n", static_cast<unsigned long long>(outboundFrames),
+           static_cast<unsigned long long>(outboundBytes), static_cast<unsigned long long>(recordedOutbound), static_cast<unsigned long long>(recordedOutboundBytes) );
+    printf("  RPC calls          %u, reconnects %u\n", rpcCalls.load(), reconnects);
+    printf("  wall time          %.3f s\n", elapsed);
+    printf("  CPU time           %.3f s, %.1f us per inbound frame\n", cpuTime, replayedFrames ? cpuTime * 1e6 / replayedFrames : 0.0);
+    printf("  allocations        %llu, %llu bytes, %.1f per inbound frame\n", static_cast<unsigned long long>(allocationCount.load()),
+           static_cast<unsigned long long>(allocatedBytes.load()), replayedFrames ? static_cast<double>(allocationCount.load()) / replayedFrames : 0.0);
+    printf("  node events        %u processed, %u rejected, max latency %u us\n", loopStatistics.processedEvents, loopStatistics.rejectedEvents,
+           loopStatistics.maxLatency);
+
+    // one line for scripts that compare builds
+    printf("RESULT frames=%llu cpu_us=%.0f allocations=%llu allocated_bytes=%llu output_frames=%llu output_bytes=%llu rejected=%u\n",
+           static_cast<unsigned long long>(replayedFrames), cpuTime * 1e6, static_cast<unsigned long long>(allocationCount.load()),
+           static_cast<unsigned long long>(allocatedBytes.load()), static_cast<unsigned long long>(outboundFrames),
+           static_cast<unsigned long long>(outboundBytes), loopStatistics.rejectedEvents);
+
+    // the node uses the device and the peer
+    delete node;
+
+    return 0;
+}